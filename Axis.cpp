@@ -268,6 +268,36 @@ namespace StepDirController
         return nodeId;
     }
 
+    bool Axis::getIsAlive() const
+    {
+        return isAlive;
+    }
+
+    RobotConstants::InitStatus Axis::getInitStatus() const
+    {
+        return initStatus;
+    }
+
+    uint16_t Axis::getEmcyErrorCode() const
+    {
+        return emcyErrorCode;
+    }
+
+    uint8_t Axis::getNmtState() const
+    {
+        return nmtState;
+    }
+
+    uint16_t Axis::getStatusword() const
+    {
+        return statusword;
+    }
+
+    RobotConstants::DriveState Axis::getDriveState() const
+    {
+        return driveState;
+    }
+
     double Axis::getMovementUnits() const
     {
         if (!initialized)
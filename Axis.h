@@ -50,6 +50,13 @@ namespace StepDirController
 
         int32_t getCurrentPositionInSteps() const;
 
+        bool getIsAlive() const;                          // Heartbeat seen within HEARTBEAT_TIMEOUT_MS
+        RobotConstants::InitStatus getInitStatus() const; // Zero initialization (ZEI) state
+        uint16_t getEmcyErrorCode() const;                // Last EMCY error code, 0 if none or reset
+        uint8_t getNmtState() const;                      // Last reported NMT state, RobotConstants::CANOpen::NMT_STATE_*
+        uint16_t getStatusword() const;                   // Last statusword (TPDO1 or SDO read)
+        RobotConstants::DriveState getDriveState() const; // CiA 402 state decoded from it
+
     protected:
         bool initialized = false;
         uint8_t nodeId;
@@ -60,9 +67,7 @@ namespace StepDirController
 
         double movementUnits;            // относительное перемещение в единицах измерения; используется для расчета синхронизации осей
         volatile uint32_t movementSteps; // относительное перемещение в шагах;
-
-        double regularSpeed; // крейсерская скорость в шагах/сек
-        double acceleration; // ускорение в шагах/сек^2
+        // Скорость и ускорение движения — в плане движения (MoveControllerBase::MovePlan)
 
         friend class MoveControllerBase;
 
@@ -70,6 +75,29 @@ namespace StepDirController
         RobotConstants::InitStatus initStatus;
         uint32_t lastHeartbeatMs = 0;
         bool isAlive = true;
+
+        uint16_t emcyErrorCode = RobotConstants::Emcy::ERROR_RESET;
+
+        // NMT: state from heartbeats and boot-up messages; a rebooted drive is configured again
+        uint8_t nmtState = RobotConstants::CANOpen::NMT_STATE_UNKNOWN;
+        bool configurationPending = false;
+        uint32_t bootUpMs = 0;     // Boot-up message seen (0: not since the last recovery)
+        uint32_t configuredMs = 0; // Configuration last sent
+
+        // 0x6081/0x6083 last written: a feed-rate change during a move writes only what differs
+        uint32_t sentProfileVelocity = 0;
+        uint32_t sentProfileAcceleration = 0;
+
+        // CiA 402: state from the statusword; enable requests are driven from it (MoveControllerBase::enableDrive)
+        uint16_t statusword = 0;
+        uint32_t statuswordMs = 0; // Last statusword received
+        RobotConstants::DriveState driveState = RobotConstants::DriveState::DRIVE_UNKNOWN;
+        bool enableRequested = false;
+        bool enableResetsFault = false; // The request may acknowledge a fault
+        bool enableInFlight = false;    // Controlwords sent, waiting for the statusword to follow
+        uint8_t enableAttempts = 0;
+        uint32_t enableSentMs = 0;
+        uint32_t enableRequestedUs = 0;
     };
 }
 
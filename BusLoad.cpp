@@ -0,0 +1,299 @@
+#include "BusLoad.h"
+
+#include <string.h>
+#include "Arduino.h"
+#include "RobotConstants.h"
+
+namespace BusLoad
+{
+    namespace
+    {
+        constexpr uint16_t CRC15_POLYNOMIAL = 0x4599;
+        constexpr uint8_t FIXED_TAIL_BITS = 1 + 1 + 1 + 7 + 3; // CRC delimiter, ACK slot, ACK delimiter, EOF, intermission
+
+        // Feeds the stuffed part of a frame (SOF .. CRC) bit by bit, counting stuff bits
+        struct BitStream
+        {
+            uint16_t crc = 0;
+            uint16_t bits = 0;
+            uint8_t stuffBits = 0;
+            uint8_t run = 0;   // SOF is dominant (0) and starts the first run
+            bool last = false;
+
+            void push(bool bit)
+            {
+                run = (bit == last) ? run + 1 : 1;
+                last = bit;
+                bits++;
+                if (run == 5)
+                {
+                    stuffBits++; // Complement bit inserted by the transmitter; it starts the next run
+                    last = !bit;
+                    run = 1;
+                }
+            }
+
+            void pushCrc(bool bit)
+            {
+                const uint16_t crcNext = bit ^ ((crc >> 14) & 1);
+                crc = static_cast<uint16_t>(((crc << 1) ^ (-crcNext & CRC15_POLYNOMIAL)) & 0x7FFF);
+                push(bit);
+            }
+
+            void pushField(uint32_t value, uint8_t width)
+            {
+                for (int8_t i = width - 1; i >= 0; --i)
+                {
+                    pushCrc((value >> i) & 1);
+                }
+            }
+
+            void pushCrcField()
+            {
+                const uint16_t value = crc;
+                for (int8_t i = 14; i >= 0; --i)
+                {
+                    push((value >> i) & 1);
+                }
+            }
+        };
+    }
+
+    uint16_t frameBits(const CanFrame &frame)
+    {
+        const uint8_t len = frame.len > 8 ? 8 : frame.len;
+        BitStream stream;
+        stream.pushField(0, 1); // SOF
+        if (frame.extended)
+        {
+            stream.pushField(frame.id >> 18, 11);
+            stream.pushField(1, 1); // SRR
+            stream.pushField(1, 1); // IDE
+            stream.pushField(frame.id & 0x3FFFF, 18);
+            stream.pushField(frame.remote ? 1 : 0, 1);
+            stream.pushField(0, 2); // r1, r0
+        }
+        else
+        {
+            stream.pushField(frame.id & 0x7FF, 11);
+            stream.pushField(frame.remote ? 1 : 0, 1);
+            stream.pushField(0, 2); // IDE, r0
+        }
+        stream.pushField(frame.len, 4);
+        if (!frame.remote)
+        {
+            for (uint8_t i = 0; i < len; ++i)
+            {
+                stream.pushField(frame.buf[i], 8);
+            }
+        }
+        stream.pushCrcField();
+        return stream.bits + stream.stuffBits + FIXED_TAIL_BITS;
+    }
+
+    uint16_t worstCaseFrameBits(bool extended, uint8_t len)
+    {
+        const uint16_t stuffable = (extended ? 54 : 34) + 8 * (len > 8 ? 8 : len);
+        return stuffable + (stuffable - 1) / 4 + FIXED_TAIL_BITS;
+    }
+
+#if BUS_LOAD_ENABLED
+    namespace
+    {
+        uint32_t busBaudRate = RobotConstants::Robot::CAN_BAUD_RATE;
+        TrafficStats stats[BUS_TRAFFIC_COUNT];
+        BusTraffic currentCommand = BUS_TRAFFIC_OTHER;
+        bool cyclicActive = false;
+
+        uint32_t slotBits[WINDOW_SLOTS];
+        uint8_t slotIndex = 0;       // Next slot of the ring to be written
+        uint32_t currentSlot = 0;    // millis() / SLOT_MS of the slot being filled
+        uint32_t currentSlotBits = 0;
+        uint32_t completedSlots = 0;
+        uint32_t peakWindowBits = 0;
+        uint32_t resetMs = 0;
+
+        uint32_t windowBits()
+        {
+            uint32_t sum = 0;
+            for (uint8_t i = 0; i < WINDOW_SLOTS; ++i)
+            {
+                sum += slotBits[i];
+            }
+            return sum;
+        }
+
+        void closeSlot()
+        {
+            slotBits[slotIndex] = currentSlotBits;
+            slotIndex = (slotIndex + 1) % WINDOW_SLOTS;
+            currentSlotBits = 0;
+            completedSlots++;
+            if (completedSlots >= WINDOW_SLOTS)
+            {
+                const uint32_t bits = windowBits();
+                if (bits > peakWindowBits)
+                {
+                    peakWindowBits = bits;
+                }
+            }
+        }
+
+        void advance(uint32_t nowMs)
+        {
+            const uint32_t slot = nowMs / SLOT_MS;
+            if (slot - currentSlot > WINDOW_SLOTS)
+            {
+                // Idle for longer than the window: everything in it is zero now
+                closeSlot();
+                memset(slotBits, 0, sizeof(slotBits));
+                completedSlots += WINDOW_SLOTS;
+                currentSlot = slot;
+                return;
+            }
+            while (currentSlot != slot)
+            {
+                closeSlot();
+                currentSlot++;
+            }
+        }
+
+        uint16_t toPermille(uint64_t bits, uint32_t ms)
+        {
+            if (busBaudRate == 0 || ms == 0)
+            {
+                return 0;
+            }
+            return static_cast<uint16_t>(bits * 1000000ull / (static_cast<uint64_t>(busBaudRate) * ms));
+        }
+
+        BusTraffic classify(const CanFrame &frame)
+        {
+            const uint32_t functionCode = frame.id & 0x780;
+            if (functionCode == RobotConstants::CANOpen::COB_ID_HEARTBEAT_BASE)
+            {
+                return BUS_TRAFFIC_HEARTBEAT;
+            }
+            if ((functionCode == RobotConstants::CANOpen::COB_ID_SDO_SERVER_BASE ||
+                 functionCode == RobotConstants::CANOpen::COB_ID_SDO_CLIENT_BASE) &&
+                frame.len >= 3 &&
+                (frame.buf[1] | (frame.buf[2] << 8)) == RobotConstants::ODIndices::POSITION_ACTUAL_VALUE)
+            {
+                return BUS_TRAFFIC_POLL;
+            }
+            if (cyclicActive && (frame.id == RobotConstants::CANOpen::COB_ID_SYNC || functionCode == RobotConstants::CANOpen::COB_ID_RPDO4_BASE))
+            {
+                return BUS_TRAFFIC_CSP;
+            }
+            if (functionCode == RobotConstants::CANOpen::COB_ID_RPDO3_BASE)
+            {
+                return BUS_TRAFFIC_JOG;
+            }
+            return currentCommand;
+        }
+    }
+
+    void begin(uint32_t baudRate)
+    {
+        busBaudRate = baudRate;
+        reset();
+    }
+
+    void reset()
+    {
+        memset(stats, 0, sizeof(stats));
+        memset(slotBits, 0, sizeof(slotBits));
+        slotIndex = 0;
+        resetMs = millis();
+        currentSlot = resetMs / SLOT_MS;
+        currentSlotBits = 0;
+        completedSlots = 0;
+        peakWindowBits = 0;
+    }
+
+    void beginCommand(BusTraffic traffic)
+    {
+        currentCommand = traffic;
+        stats[traffic].commands++;
+    }
+
+    void setCyclic(bool active)
+    {
+        cyclicActive = active;
+    }
+
+    void recordFrame(const CanFrame &frame)
+    {
+        const uint16_t bits = frameBits(frame);
+        advance(millis());
+        currentSlotBits += bits;
+
+        TrafficStats &traffic = stats[classify(frame)];
+        traffic.frames++;
+        traffic.bits += bits;
+        traffic.worstBits += worstCaseFrameBits(frame.extended, frame.len);
+    }
+
+    uint32_t baudRate()
+    {
+        return busBaudRate;
+    }
+
+    uint64_t bitsToMicros(uint64_t bits)
+    {
+        return busBaudRate == 0 ? 0 : bits * 1000000ull / busBaudRate;
+    }
+
+    uint16_t utilizationPermille()
+    {
+        advance(millis());
+        return completedSlots == 0 ? 0 : toPermille(windowBits(), WINDOW_SLOTS * SLOT_MS);
+    }
+
+    uint16_t peakPermille()
+    {
+        advance(millis());
+        return toPermille(peakWindowBits, WINDOW_SLOTS * SLOT_MS);
+    }
+
+    uint16_t averagePermille()
+    {
+        uint64_t bits = 0;
+        for (uint8_t i = 0; i < BUS_TRAFFIC_COUNT; ++i)
+        {
+            bits += stats[i].bits;
+        }
+        return toPermille(bits, millis() - resetMs);
+    }
+
+    const TrafficStats &trafficStats(BusTraffic traffic)
+    {
+        return stats[traffic];
+    }
+
+    const char *trafficName(BusTraffic traffic)
+    {
+        switch (traffic)
+        {
+        case BUS_TRAFFIC_HEARTBEAT:
+            return "HB";
+        case BUS_TRAFFIC_POLL:
+            return "POLL";
+        case BUS_TRAFFIC_MAJ:
+            return "MAJ";
+        case BUS_TRAFFIC_MRJ:
+            return "MRJ";
+        case BUS_TRAFFIC_ZEI:
+            return "ZEI";
+        case BUS_TRAFFIC_CSP:
+            return "CSP";
+        case BUS_TRAFFIC_JOG:
+            return "JOG";
+        case BUS_TRAFFIC_OTHER:
+            return "OTHER";
+        default:
+            return "?";
+        }
+    }
+#endif
+}
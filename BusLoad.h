@@ -0,0 +1,79 @@
+#pragma once
+#ifndef BUS_LOAD_H
+#define BUS_LOAD_H
+
+#include <stdint.h>
+#include "CanDriver.h"
+#include "DebugConfig.h"
+
+#ifndef BUS_LOAD_ENABLED
+#define BUS_LOAD_ENABLED 0
+#endif
+
+// Who a frame on the bus belongs to. Heartbeats and 0x6064 position polls are background
+// traffic, SYNC and RPDO4 frames are the CSP cycle while it runs, RPDO3 frames are jog updates
+// (deadman stops included); everything else is charged to the command that is currently being executed.
+enum BusTraffic : uint8_t
+{
+    BUS_TRAFFIC_HEARTBEAT = 0,
+    BUS_TRAFFIC_POLL,
+    BUS_TRAFFIC_MAJ,
+    BUS_TRAFFIC_MRJ,
+    BUS_TRAFFIC_ZEI,
+    BUS_TRAFFIC_CSP, // Cyclic SYNC + setpoint RPDOs (CspStreamer)
+    BUS_TRAFFIC_JOG, // Target velocity RPDO3s and the mode switches of JOG
+    BUS_TRAFFIC_OTHER, // Setup and anything not started by a command
+    BUS_TRAFFIC_COUNT
+};
+
+// CAN bus accounting.
+//
+// CanOpen records every frame it sends or receives. The on-wire length is computed bit-exact
+// (CRC-15 and the actual stuff bits) and, for planning, as the worst case of stuffing for the
+// same DLC. Utilization is kept over a sliding window of WINDOW_SLOTS * SLOT_MS. Only frames
+// the master sees are counted: traffic between other nodes, error frames and retransmissions
+// are not.
+namespace BusLoad
+{
+    constexpr uint32_t SLOT_MS = 100;
+    constexpr uint8_t WINDOW_SLOTS = 10; // 1 s window
+
+    struct TrafficStats
+    {
+        uint32_t commands;  // Commands started (MAJ/MRJ/ZEI only)
+        uint32_t frames;
+        uint64_t bits;      // Exact on-wire bits, incl. stuffing and interframe space
+        uint64_t worstBits; // Same frames with worst-case stuffing
+    };
+
+    // On-wire length including stuff bits, CRC/ACK delimiters, EOF and the 3-bit intermission
+    uint16_t frameBits(const CanFrame &frame);
+    uint16_t worstCaseFrameBits(bool extended, uint8_t len);
+
+#if BUS_LOAD_ENABLED
+    void begin(uint32_t baudRate); // Called by CanOpen::startCan
+    void reset();
+
+    void beginCommand(BusTraffic traffic); // Frames from here on are charged to this command
+    void setCyclic(bool active);           // SYNC and RPDO4 frames are charged to BUS_TRAFFIC_CSP
+    void recordFrame(const CanFrame &frame);
+
+    uint32_t baudRate();
+    uint64_t bitsToMicros(uint64_t bits);
+
+    uint16_t utilizationPermille(); // Last full window
+    uint16_t peakPermille();        // Highest full window since reset
+    uint16_t averagePermille();     // Since reset
+
+    const TrafficStats &trafficStats(BusTraffic traffic);
+    const char *trafficName(BusTraffic traffic);
+#else
+    inline void begin(uint32_t) {}
+    inline void reset() {}
+    inline void beginCommand(BusTraffic) {}
+    inline void setCyclic(bool) {}
+    inline void recordFrame(const CanFrame &) {}
+#endif
+}
+
+#endif // BUS_LOAD_H
@@ -1,20 +1,43 @@
 #include <unordered_set>
 
 #include "STM32_CAN.h"
+#include "Stm32CanDriver.h"
 #include "CanOpenController.h"
 #include "CanOpen.h"
 #include "Params.h"
 #include "RobotConstants.h"
 #include "Debug.h"
+#include "Profiler.h"
+#include "HeapStats.h"
+#include "BusLoad.h"
+#include "CanTrace.h"
 
 HardwareSerial Serial2(PA3, PA2);
 
-CanOpen canOpen;
+// CAN transport. The Linux gateway build (host/gateway) compiles the sketch with
+// CAN_DRIVER_CLASS=SocketCanDriver; everything above the driver stays the same.
+#ifndef CAN_DRIVER_CLASS
+#define CAN_DRIVER_CLASS Stm32CanDriver
+#endif
+CAN_DRIVER_CLASS canDriver;
+
+// Abort input: a falling edge quick-stops every axis (MoveControllerBase::abort), as ABT does
+#ifndef ABORT_PIN
+#define ABORT_PIN PB0
+#endif
+CanOpen canOpen(canDriver);
 MoveController moveController;
+CspStreamer cspStreamer;
 
 String inData;
 uint8_t bufIndex = 0;        // хранилище данных с последовательного порта
 std::vector<String> outData; // очередь сообщений на отправку
+uint32_t commandReceivedUs = 0; // Line complete, for the ABT latency
+
+// Set by the abort pin interrupt; CanOpen is not interrupt-safe, serviceAbort() sends from the loop or yield()
+volatile bool abortRequested = false;
+volatile uint32_t abortRequestedUs = 0;
+bool abortInService = false;
 
 // Forward declarations
 MoveParams<RobotConstants::Robot::AXES_COUNT> stringToMoveParams(String command);
@@ -24,6 +47,27 @@ void handleMove(MoveParams<RobotConstants::Robot::AXES_COUNT> params, bool isAbs
 void handleZeroInitialize(MotorIndices motorIndices);
 void handleRequestPosition(MotorIndices motorIndices);
 void handleMotorStatus(String command);
+void handleProfile(String command);
+void handleDebugLog(String command);
+void handleDebugLevel(String command);
+void handleHeapStats(String command);
+void handleBusLoad(String command);
+void handleCanTrace(String command);
+void handleSyncStart(String command);
+void handleCspStream(String command);
+void handleTxQueues(String command);
+void handleEmergency(String command);
+void handleNmt(String command);
+void handleDriveState(String command);
+void handleFeedback(String command);
+void handleJog(String command);
+void handleFeedRate(String command);
+void handleAbort(String command);
+void handleMovePlan(String command);
+void handlePath(String command);
+void abortPinInterrupt();
+void serviceAbort();
+void streamCanTrace();
 
 bool receiveCommand();
 void handleCommand();
@@ -67,17 +111,29 @@ void setup()
     {
         Serial2.println("MoveController initialized successfully");
     }
+    pinMode(ABORT_PIN, INPUT_PULLUP);
+    attachInterrupt(digitalPinToInterrupt(ABORT_PIN), abortPinInterrupt, FALLING);
     inData.reserve(128);
     outData.reserve(128);
+    Profiler::begin();
+    HeapStats::markSetupComplete();
 }
 
 void loop()
 {
+    PROF_SCOPE(PROF_LOOP);
+    serviceAbort();
+    cspStreamer.service();
     if (receiveCommand())
+    {
+        commandReceivedUs = micros();
         handleCommand();
+    }
 
     sendData();
+    streamCanTrace();
     canOpen.read();
+    moveController.tick_fast();
     // if (millis() - lastTickTime_50 >= 50) {
     //     lastTickTime_50 = millis();
     // }
@@ -115,7 +171,11 @@ void handleCommand()
     }
 
     String function = inData.substring(0, 3);
-    if (function.equals(RobotConstants::Commands::MOVE_ABSOLUTE))
+    if (function.equals(RobotConstants::Commands::ABORT)) // First: no comparisons ahead of the stop
+    {
+        handleAbort(inData);
+    }
+    else if (function.equals(RobotConstants::Commands::MOVE_ABSOLUTE))
     {
         handleMove(stringToMoveParams(inData), true);
     }
@@ -140,6 +200,74 @@ void handleCommand()
     {
         handleRequestPosition(stringToMotorIndices(inData));
     }
+    else if (function.equals(RobotConstants::Commands::PROFILE))
+    {
+        handleProfile(inData);
+    }
+    else if (function.equals(RobotConstants::Commands::DEBUG_LOG))
+    {
+        handleDebugLog(inData);
+    }
+    else if (function.equals(RobotConstants::Commands::DEBUG_LEVEL))
+    {
+        handleDebugLevel(inData);
+    }
+    else if (function.equals(RobotConstants::Commands::HEAP_STATS))
+    {
+        handleHeapStats(inData);
+    }
+    else if (function.equals(RobotConstants::Commands::BUS_LOAD))
+    {
+        handleBusLoad(inData);
+    }
+    else if (function.equals(RobotConstants::Commands::CAN_TRACE))
+    {
+        handleCanTrace(inData);
+    }
+    else if (function.equals(RobotConstants::Commands::SYNC_START))
+    {
+        handleSyncStart(inData);
+    }
+    else if (function.equals(RobotConstants::Commands::CSP_STREAM))
+    {
+        handleCspStream(inData);
+    }
+    else if (function.equals(RobotConstants::Commands::TX_QUEUES))
+    {
+        handleTxQueues(inData);
+    }
+    else if (function.equals(RobotConstants::Commands::EMERGENCY))
+    {
+        handleEmergency(inData);
+    }
+    else if (function.equals(RobotConstants::Commands::NMT))
+    {
+        handleNmt(inData);
+    }
+    else if (function.equals(RobotConstants::Commands::DRIVE_STATE))
+    {
+        handleDriveState(inData);
+    }
+    else if (function.equals(RobotConstants::Commands::FEEDBACK))
+    {
+        handleFeedback(inData);
+    }
+    else if (function.equals(RobotConstants::Commands::JOG))
+    {
+        handleJog(inData);
+    }
+    else if (function.equals(RobotConstants::Commands::FEED_RATE))
+    {
+        handleFeedRate(inData);
+    }
+    else if (function.equals(RobotConstants::Commands::MOVE_PLAN))
+    {
+        handleMovePlan(inData);
+    }
+    else if (function.equals(RobotConstants::Commands::PATH))
+    {
+        handlePath(inData);
+    }
     else
     {
         addDataToOutQueue(function + " " + RobotConstants::Status::INCORRECT_COMMAND);
@@ -194,6 +322,7 @@ bool isFloat(String str)
 
 MoveParams<RobotConstants::Robot::AXES_COUNT> stringToMoveParams(String command)
 {
+    PROF_SCOPE(PROF_COMMAND_PARSE);
     MoveParams<RobotConstants::Robot::AXES_COUNT> params;
 
     String paramsStr = command.substring(RobotConstants::Commands::COMMAND_LEN); // Only parameters, without command and space
@@ -327,6 +456,7 @@ MoveParams<RobotConstants::Robot::AXES_COUNT> stringToMoveParams(String command)
 
 MotorIndices stringToMotorIndices(String command)
 {
+    PROF_SCOPE(PROF_COMMAND_PARSE);
     String params = command.substring(3); // Only parameters, without command and space
     MotorIndices motorIndices;
     motorIndices.status = ParamsStatus::OK;
@@ -399,15 +529,41 @@ void handleMove(MoveParams<RobotConstants::Robot::AXES_COUNT> params, bool isAbs
 
     for (uint8_t nodeId = 1; nodeId <= moveController.getAxesCount(); ++nodeId)
     {
+        Axis &axis = moveController.getAxis(nodeId);
         if (isAbsoluteMove)
-            moveController.getAxis(nodeId).setTargetPositionAbsoluteInUnits(params.movementUnits[nodeId - 1]);
+            axis.setTargetPositionAbsoluteInUnits(params.movementUnits[nodeId - 1]);
+        else if (cspStreamer.isActive())
+            axis.setTargetPositionAbsoluteInSteps(cspStreamer.pathEnd(nodeId) + axis.unitsToSteps(params.movementUnits[nodeId - 1])); // From the previous waypoint
         else
-            moveController.getAxis(nodeId).setTargetPositionRelativeInUnits(params.movementUnits[nodeId - 1]);
+            axis.setTargetPositionAbsoluteInSteps(moveController.moveStartPosition(nodeId) + axis.unitsToSteps(params.movementUnits[nodeId - 1])); // After a move under way: from its target
     }
 
     moveController.setRegularSpeedUnits(params.speed);
     moveController.setAccelerationUnits(params.acceleration);
 
+    if (moveController.isMotionPaused() || moveController.hasDriveFault())
+    {
+        DBG_WARN(DBG_GROUP_MOVE, "Move refused: motion paused by a drive fault, EMCR resumes");
+        addDataToOutQueue((isAbsoluteMove ? RobotConstants::Commands::MOVE_ABSOLUTE : RobotConstants::Commands::MOVE_RELATIVE) + " " + RobotConstants::Status::COMMAND_FULL_FAIL);
+        return;
+    }
+    if (moveController.isJogActive())
+    {
+        DBG_WARN(DBG_GROUP_MOVE, "Move refused: an axis is jogging, JOGS stops it");
+        addDataToOutQueue((isAbsoluteMove ? RobotConstants::Commands::MOVE_ABSOLUTE : RobotConstants::Commands::MOVE_RELATIVE) + " " + RobotConstants::Status::COMMAND_FULL_FAIL);
+        return;
+    }
+
+    BusLoad::beginCommand(isAbsoluteMove ? BUS_TRAFFIC_MAJ : BUS_TRAFFIC_MRJ);
+
+    if (cspStreamer.isActive())
+    {
+        if (!cspStreamer.move())
+        {
+            addDataToOutQueue((isAbsoluteMove ? RobotConstants::Commands::MOVE_ABSOLUTE : RobotConstants::Commands::MOVE_RELATIVE) + " " + RobotConstants::Status::COMMAND_FULL_FAIL);
+        }
+        return;
+    }
     moveController.move();
 }
 
@@ -429,6 +585,10 @@ void handleZeroInitialize(MotorIndices motorIndices)
         addDataToOutQueue(RobotConstants::Commands::ZERO_INITIALIZE + " " + RobotConstants::Status::INVALID_PARAMS);
         return;
     }
+    if (motorIndices.nodeIds.size() == RobotConstants::Robot::AXES_COUNT || motorIndices.nodeIds.size() == 1)
+    {
+        BusLoad::beginCommand(BUS_TRAFFIC_ZEI);
+    }
     if (motorIndices.nodeIds.size() == RobotConstants::Robot::AXES_COUNT)
     {
         DBG_VERBOSE(DBG_GROUP_ZEI, RobotConstants::Commands::ZERO_INITIALIZE + " Starting Zero Initialization for all nodes");
@@ -459,4 +619,899 @@ void handleRequestPosition(MotorIndices motorIndices)
         reply += String((char)RobotConstants::Robot::AXIS_IDENTIFIER_CHAR) + String((char)(RobotConstants::Robot::MIN_NODE_ID + nodeId - 1)) + String(moveController.axisPosition(nodeId)) + " ";
     }
     addDataToOutQueue(reply);
-}
\ No newline at end of file
+}
+
+void handleProfile(String command)
+{
+    String params = command.substring(RobotConstants::Commands::COMMAND_LEN);
+    if (params.length() > 0 && !params.equals("R"))
+    {
+        addDataToOutQueue(RobotConstants::Commands::PROFILE + " " + RobotConstants::Status::INVALID_PARAMS);
+        return;
+    }
+#if PROFILER_ENABLED
+    const uint32_t cyclesPerUs = Profiler::cyclesPerMicrosecond();
+    for (uint8_t probe = 0; probe < PROF_PROBE_COUNT; ++probe)
+    {
+        const Profiler::Histogram &histogram = Profiler::histogram(static_cast<ProfilerProbe>(probe));
+        String reply = RobotConstants::Commands::PROFILE + " " + RobotConstants::Status::OK + " " + Profiler::probeName(static_cast<ProfilerProbe>(probe)) + " n=" + String(histogram.count);
+        if (histogram.count > 0)
+        {
+            reply += " min=" + String(histogram.minCycles / cyclesPerUs) +
+                     " avg=" + String((uint32_t)(histogram.totalCycles / histogram.count / cyclesPerUs)) +
+                     " max=" + String(histogram.maxCycles / cyclesPerUs) + "us h=";
+            for (uint8_t bucket = 0; bucket < Profiler::BUCKET_COUNT; ++bucket)
+            {
+                reply += String(histogram.buckets[bucket]) + (bucket + 1 < Profiler::BUCKET_COUNT ? "," : "");
+            }
+        }
+        addDataToOutQueue(reply);
+    }
+    if (params.equals("R"))
+    {
+        Profiler::reset();
+    }
+#else
+    addDataToOutQueue(RobotConstants::Commands::PROFILE + " " + RobotConstants::Status::COMMAND_FULL_FAIL + " Profiler disabled (PROFILER_ENABLED 0)");
+#endif
+}
+
+void handleDebugLog(String command)
+{
+    if (command != RobotConstants::Commands::DEBUG_LOG)
+    {
+        addDataToOutQueue(RobotConstants::Commands::DEBUG_LOG + " " + RobotConstants::Status::INVALID_PARAMS);
+        return;
+    }
+#if DBG_DEFERRED
+    // One line per record, all fields in hex: DLG <timestampUs> <messageId> <level> <argCount> <arg0..arg3>
+    DbgRecord records[8];
+    uint32_t total = 0;
+    size_t count;
+    while ((count = dbgDrainRecords(records, 8)) > 0)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            const DbgRecord &record = records[i];
+            String line = RobotConstants::Commands::DEBUG_LOG + " " + String(record.timestampUs, HEX) + " " + String(record.messageId, HEX) + " " + String(record.level, HEX) + " " + String(record.argCount, HEX);
+            for (uint8_t arg = 0; arg < DBG_RECORD_MAX_ARGS; ++arg)
+            {
+                line += " " + String(record.args[arg], HEX);
+            }
+            addDataToOutQueue(line);
+        }
+        total += count;
+    }
+    addDataToOutQueue(RobotConstants::Commands::DEBUG_LOG + " " + RobotConstants::Status::OK + " " + String(total) + " dropped=" + String(dbgDroppedRecords()));
+#else
+    addDataToOutQueue(RobotConstants::Commands::DEBUG_LOG + " " + RobotConstants::Status::COMMAND_FULL_FAIL + " Deferred logging disabled (DBG_DEFERRED 0)");
+#endif
+}
+
+// DBL                 -- report the runtime filter and the compile-time ceiling
+// DBL<level>          -- set the level (0..4), keep the groups
+// DBL<level>G<groups> -- set the level and the group mask (hex, see DBG_GROUP_* in Debug.h)
+//                        Both are clamped to the ceiling (DEBUG_CONFIG; every level of the main groups
+//                        unless built with DEBUG_CONFIG_RELEASE_WARN): DBL can raise the level up to it
+void handleDebugLevel(String command)
+{
+    String params = command.substring(RobotConstants::Commands::COMMAND_LEN);
+    if (params.length() > 0)
+    {
+        char levelChar = params.charAt(0);
+        if (levelChar < '0' || levelChar > '4' || (params.length() > 1 && params.charAt(1) != 'G'))
+        {
+            addDataToOutQueue(RobotConstants::Commands::DEBUG_LEVEL + " " + RobotConstants::Status::INVALID_PARAMS);
+            return;
+        }
+
+        uint32_t groups = dbgConfigGroups(dbgRuntimeConfig);
+        if (params.length() > 1)
+        {
+            String groupsStr = params.substring(2);
+            char *end = nullptr;
+            groups = strtoul(groupsStr.c_str(), &end, 16);
+            if (groupsStr.length() == 0 || *end != '\0')
+            {
+                addDataToOutQueue(RobotConstants::Commands::DEBUG_LEVEL + " " + RobotConstants::Status::INVALID_PARAMS);
+                return;
+            }
+        }
+        dbgSetRuntimeConfig(DBG_CONFIG(levelChar - '0', groups));
+    }
+
+    addDataToOutQueue(RobotConstants::Commands::DEBUG_LEVEL + " " + RobotConstants::Status::OK +
+                      " L" + String(dbgConfigLevel(dbgRuntimeConfig)) + "G" + String(dbgConfigGroups(dbgRuntimeConfig), HEX) +
+                      " max L" + String(dbgConfigLevel(DEBUG_CONFIG)) + "G" + String(dbgConfigGroups(DEBUG_CONFIG), HEX));
+}
+
+void handleHeapStats(String command)
+{
+    if (command != RobotConstants::Commands::HEAP_STATS)
+    {
+        addDataToOutQueue(RobotConstants::Commands::HEAP_STATS + " " + RobotConstants::Status::INVALID_PARAMS);
+        return;
+    }
+#if HEAP_STATS_ENABLED
+    // Take the snapshot before building the reply, so the reply's own Strings are not counted
+    HeapStats::Snapshot stats = HeapStats::snapshot();
+    addDataToOutQueue(RobotConstants::Commands::HEAP_STATS + " " + RobotConstants::Status::OK +
+                      " ops=" + String(stats.operations) +
+                      " afterSetup=" + String(stats.operationsAfterSetup) +
+                      " used=" + String(stats.currentBytes) +
+                      " peak=" + String(stats.peakBytes) +
+                      " largestFree=" + String(stats.largestFreeBlock) +
+                      " headroom=" + String(stats.headroomBytes));
+#else
+    addDataToOutQueue(RobotConstants::Commands::HEAP_STATS + " " + RobotConstants::Status::COMMAND_FULL_FAIL + " Heap statistics disabled (HEAP_STATS_ENABLED 0)");
+#endif
+}
+
+// BUS  -- bus load over the last window, the peak and the average since reset, then one line per
+//         traffic class: frames and bus time in total and per command (MAJ/MRJ/ZEI)
+// BUSR -- the same, then reset the counters
+void handleBusLoad(String command)
+{
+    String params = command.substring(RobotConstants::Commands::COMMAND_LEN);
+    if (params.length() > 0 && !params.equals("R"))
+    {
+        addDataToOutQueue(RobotConstants::Commands::BUS_LOAD + " " + RobotConstants::Status::INVALID_PARAMS);
+        return;
+    }
+#if BUS_LOAD_ENABLED
+    const uint16_t load = BusLoad::utilizationPermille();
+    const uint16_t peak = BusLoad::peakPermille();
+    const uint16_t average = BusLoad::averagePermille();
+    addDataToOutQueue(RobotConstants::Commands::BUS_LOAD + " " + RobotConstants::Status::OK +
+                      " load=" + String(load / 10) + "." + String(load % 10) + "%" +
+                      " peak=" + String(peak / 10) + "." + String(peak % 10) + "%" +
+                      " avg=" + String(average / 10) + "." + String(average % 10) + "%" +
+                      " window=" + String(BusLoad::WINDOW_SLOTS * BusLoad::SLOT_MS) + "ms" +
+                      " baud=" + String(BusLoad::baudRate()));
+    for (uint8_t traffic = 0; traffic < BUS_TRAFFIC_COUNT; ++traffic)
+    {
+        const BusLoad::TrafficStats &stats = BusLoad::trafficStats(static_cast<BusTraffic>(traffic));
+        String reply = RobotConstants::Commands::BUS_LOAD + " " + RobotConstants::Status::OK + " " + BusLoad::trafficName(static_cast<BusTraffic>(traffic)) +
+                       " frames=" + String(stats.frames) +
+                       " us=" + String((uint32_t)BusLoad::bitsToMicros(stats.bits)) +
+                       " worstUs=" + String((uint32_t)BusLoad::bitsToMicros(stats.worstBits));
+        if (stats.commands > 0)
+        {
+            reply += " n=" + String(stats.commands) +
+                     " perCmd frames=" + String(stats.frames / stats.commands) +
+                     " us=" + String((uint32_t)BusLoad::bitsToMicros(stats.bits / stats.commands)) +
+                     " worstUs=" + String((uint32_t)BusLoad::bitsToMicros(stats.worstBits / stats.commands));
+        }
+        addDataToOutQueue(reply);
+    }
+    if (params.equals("R"))
+    {
+        BusLoad::reset();
+    }
+#else
+    addDataToOutQueue(RobotConstants::Commands::BUS_LOAD + " " + RobotConstants::Status::COMMAND_FULL_FAIL + " Bus accounting disabled (BUS_LOAD_ENABLED 0)");
+#endif
+}
+
+// SYN  -- start mode and the inter-axis start skew of the last move, measured from timestamped 0x6064 answers:
+//         SYN OK mode=<0|1> skew=<us> res=<us> axes=<started>/<moving>
+// SYN0 -- immediate start: every drive starts when its own RPDO arrives (default)
+// SYN1 -- synchronous start: RPDO4 of every drive is remapped to 0x607A + 0x6040 with transmission
+//         type 0x01, MAJ/MRJ preload all drives and release them with one SYNC.
+//         The mapping lives in the drive's RAM: send SYN1 again after a drive power cycle
+void handleSyncStart(String command)
+{
+    String params = command.substring(RobotConstants::Commands::COMMAND_LEN);
+    if (params.length() > 1 || (params.length() == 1 && params.charAt(0) != '0' && params.charAt(0) != '1'))
+    {
+        addDataToOutQueue(RobotConstants::Commands::SYNC_START + " " + RobotConstants::Status::INVALID_PARAMS);
+        return;
+    }
+    if (params.length() == 1)
+    {
+        const MoveController::StartMode mode = params.charAt(0) == '1' ? MoveController::StartMode::SYNC : MoveController::StartMode::IMMEDIATE;
+        if (!moveController.setStartMode(mode))
+        {
+            addDataToOutQueue(RobotConstants::Commands::SYNC_START + " " + RobotConstants::Status::COMMAND_FULL_FAIL);
+            return;
+        }
+    }
+
+    const MoveController::StartSkew &skew = moveController.getLastStartSkew();
+    addDataToOutQueue(RobotConstants::Commands::SYNC_START + " " + RobotConstants::Status::OK +
+                      " mode=" + String(static_cast<uint8_t>(moveController.getStartMode())) +
+                      " skew=" + String(skew.skewUs) +
+                      " res=" + String(skew.resolutionUs) +
+                      " axes=" + String(skew.axesStarted) + "/" + String(skew.axesProbed));
+}
+
+// CSP          -- state and cycle statistics:
+//                 CSP OK active=<0|1> period=<us> cycles=.. missed=.. overruns=.. underruns=..
+//                 latency=<min>/<avg>/<max>us interval=+-<us> service=<max>us buffer=<n> load=<bus %>
+// CSP<period>  -- cyclic synchronous position with a SYNC every <period> us (500..10000), e.g. CSP1000;
+//                 MAJ/MRJ then stream interpolated setpoints (one RPDO per axis and cycle). MAJ/MRJ
+//                 while a move is still streaming are queued as waypoints (PTH), FF once the queue is full
+// CSP0         -- back to profile position
+// CSPR         -- reset the statistics
+void handleCspStream(String command)
+{
+    String params = command.substring(RobotConstants::Commands::COMMAND_LEN);
+    if (params.equals("0"))
+    {
+        cspStreamer.end();
+    }
+    else if (params.equals("R"))
+    {
+        cspStreamer.resetStats();
+    }
+    else if (params.length() > 0)
+    {
+        for (uint8_t i = 0; i < params.length(); ++i)
+        {
+            if (!isDigit(params.charAt(i)))
+            {
+                addDataToOutQueue(RobotConstants::Commands::CSP_STREAM + " " + RobotConstants::Status::INVALID_PARAMS);
+                return;
+            }
+        }
+        const uint32_t periodUs = params.toInt();
+        if (periodUs < RobotConstants::Csp::MIN_PERIOD_US || RobotConstants::Csp::MAX_PERIOD_US < periodUs)
+        {
+            addDataToOutQueue(RobotConstants::Commands::CSP_STREAM + " " + RobotConstants::Status::INVALID_PARAMS);
+            return;
+        }
+        if (!cspStreamer.begin(&canOpen, &moveController, periodUs))
+        {
+            addDataToOutQueue(RobotConstants::Commands::CSP_STREAM + " " + RobotConstants::Status::COMMAND_FULL_FAIL);
+            return;
+        }
+    }
+
+    const CspStreamer::Stats &stats = cspStreamer.getStats();
+    String reply = RobotConstants::Commands::CSP_STREAM + " " + RobotConstants::Status::OK +
+                   " active=" + String(cspStreamer.isActive() ? 1 : 0) +
+                   " period=" + String(cspStreamer.getPeriodUs()) +
+                   " cycles=" + String(stats.cycles) +
+                   " missed=" + String(stats.missedCycles) +
+                   " overruns=" + String(stats.overruns) +
+                   " underruns=" + String(stats.underruns) +
+                   " latency=" + String(stats.latencyMinUs) + "/" + String(stats.cycles > 0 ? (uint32_t)(stats.latencyTotalUs / stats.cycles) : 0) + "/" + String(stats.latencyMaxUs) + "us" +
+                   " interval=+-" + String(stats.intervalMaxDeviationUs) + "us" +
+                   " service=" + String(stats.serviceMaxUs) + "us" +
+                   " buffer=" + String(cspStreamer.bufferedCycles());
+#if BUS_LOAD_ENABLED
+    const uint16_t load = BusLoad::utilizationPermille();
+    reply += " load=" + String(load / 10) + "." + String(load % 10) + "%";
+#endif
+    addDataToOutQueue(reply);
+}
+
+// TXQ  -- transmit scheduling: TXQ OK mode=<prio|fifo> preemptions=<n>, then per class
+//         TXQ OK <class> frames=.. dropped=.. preempted=.. depth=<now>/<max> latency=<avg>/<max>us
+//         (latency: queued -> loaded into a TX mailbox)
+// TXQ1 -- classes by priority, urgent frames preempt SDO/diagnostic mailboxes (default)
+// TXQ0 -- one FIFO in queue order, for comparison
+// TXQR -- print and reset the statistics
+void handleTxQueues(String command)
+{
+    String params = command.substring(RobotConstants::Commands::COMMAND_LEN);
+    if (params.length() > 1 || (params.length() == 1 && params.charAt(0) != '0' && params.charAt(0) != '1' && params.charAt(0) != 'R'))
+    {
+        addDataToOutQueue(RobotConstants::Commands::TX_QUEUES + " " + RobotConstants::Status::INVALID_PARAMS);
+        return;
+    }
+    CanTxScheduler &scheduler = canOpen.getTxScheduler();
+    if (params.length() == 1 && params.charAt(0) != 'R')
+    {
+        scheduler.setPrioritized(params.charAt(0) == '1');
+    }
+
+    addDataToOutQueue(RobotConstants::Commands::TX_QUEUES + " " + RobotConstants::Status::OK +
+                      " mode=" + String(scheduler.isPrioritized() ? "prio" : "fifo") +
+                      " preemptions=" + String(scheduler.preemptions()));
+    for (uint8_t txClass = 0; txClass < CAN_TX_CLASS_COUNT; ++txClass)
+    {
+        const CanTxScheduler::ClassStats &stats = scheduler.classStats(static_cast<CanTxClass>(txClass));
+        addDataToOutQueue(RobotConstants::Commands::TX_QUEUES + " " + RobotConstants::Status::OK + " " + CanTxScheduler::className(static_cast<CanTxClass>(txClass)) +
+                          " frames=" + String(stats.frames) +
+                          " dropped=" + String(stats.dropped) +
+                          " preempted=" + String(stats.preempted) +
+                          " depth=" + String(scheduler.depth(static_cast<CanTxClass>(txClass))) + "/" + String(stats.maxDepth) +
+                          " latency=" + String(stats.frames > 0 ? (uint32_t)(stats.totalLatencyUs / stats.frames) : 0) + "/" + String(stats.maxLatencyUs) + "us");
+    }
+    if (params.equals("R"))
+    {
+        scheduler.resetStats();
+    }
+}
+
+// EMC          -- fault state: EMC OK paused=<0|1> reaction=<bits> emergencies=<n> last=<node>:<code>/<register>
+//                 time=<last>/<max>us codes=<error code per axis>  (codes in hex; time: EMCY received -> quick stops queued)
+// EMC<bits>    -- fault reaction, RobotConstants::Emcy::REACTION_*: 1 report, 2 pause moves, 4 quick stop
+//                 (default 7); EMC0 only records drive faults
+// EMCR         -- fault reset to the faulted drives, re-enable all, resume motion
+// A fault is reported as it arrives: EMC <node> <error code> <error register> <vendor bytes> (hex);
+// error code 0 is the drive's error reset
+void handleEmergency(String command)
+{
+    String params = command.substring(RobotConstants::Commands::COMMAND_LEN);
+    if (params.length() > 1 || (params.length() == 1 && params.charAt(0) != 'R' && (params.charAt(0) < '0' || '7' < params.charAt(0))))
+    {
+        addDataToOutQueue(RobotConstants::Commands::EMERGENCY + " " + RobotConstants::Status::INVALID_PARAMS);
+        return;
+    }
+    if (params.equals("R"))
+    {
+        if (!moveController.clearFault())
+        {
+            addDataToOutQueue(RobotConstants::Commands::EMERGENCY + " " + RobotConstants::Status::COMMAND_FULL_FAIL);
+            return;
+        }
+    }
+    else if (params.length() == 1)
+    {
+        moveController.setFaultReaction(static_cast<uint8_t>(params.charAt(0) - '0'));
+    }
+
+    const MoveController::FaultStats &stats = moveController.getFaultStats();
+    String reply = RobotConstants::Commands::EMERGENCY + " " + RobotConstants::Status::OK +
+                   " paused=" + String(moveController.isMotionPaused() ? 1 : 0) +
+                   " reaction=" + String(moveController.getFaultReaction()) +
+                   " emergencies=" + String(stats.emergencies) +
+                   " last=" + String(stats.lastNodeId) + ":" + String(stats.lastErrorCode, HEX) + "/" + String(stats.lastErrorRegister, HEX) +
+                   " time=" + String(stats.reactionUs) + "/" + String(stats.reactionMaxUs) + "us" +
+                   " codes=";
+    for (uint8_t nodeId = 1; nodeId <= moveController.getAxesCount(); ++nodeId)
+    {
+        if (nodeId > 1)
+        {
+            reply += ",";
+        }
+        reply += String(moveController.getAxis(nodeId).getEmcyErrorCode(), HEX);
+    }
+    addDataToOutQueue(reply);
+}
+
+// NMT          -- NMT master state: NMT OK target=<state> bootups=<n> configured=<n> last=<node>
+//                 recovery=<last>/<max>ms states=<NMT state per axis>  (states in hex: 0 boot-up, 4 stopped,
+//                 5 operational, 7F pre-operational, FF nothing heard; recovery: boot-up -> configured and started)
+// NMTS / NMTP / NMTT -- broadcast start / enter pre-operational / stop (one frame to all nodes);
+//                 also the state a rebooted drive is brought back to
+// NMTR / NMTC  -- broadcast reset node / reset communication; the drives boot and are configured again
+void handleNmt(String command)
+{
+    String params = command.substring(RobotConstants::Commands::COMMAND_LEN);
+    uint8_t nmtCommand = 0;
+    if (params.length() == 1)
+    {
+        switch (params.charAt(0))
+        {
+        case 'S':
+            nmtCommand = RobotConstants::CANOpen::NMT_START;
+            break;
+        case 'P':
+            nmtCommand = RobotConstants::CANOpen::NMT_PRE_OPERATIONAL;
+            break;
+        case 'T':
+            nmtCommand = RobotConstants::CANOpen::NMT_STOP;
+            break;
+        case 'R':
+            nmtCommand = RobotConstants::CANOpen::NMT_RESET_NODE;
+            break;
+        case 'C':
+            nmtCommand = RobotConstants::CANOpen::NMT_RESET_COMMUNICATION;
+            break;
+        }
+    }
+    if (params.length() > 0 && nmtCommand == 0)
+    {
+        addDataToOutQueue(RobotConstants::Commands::NMT + " " + RobotConstants::Status::INVALID_PARAMS);
+        return;
+    }
+    if (nmtCommand != 0 && !moveController.broadcastNmt(nmtCommand))
+    {
+        addDataToOutQueue(RobotConstants::Commands::NMT + " " + RobotConstants::Status::COMMAND_FULL_FAIL);
+        return;
+    }
+
+    const MoveController::NmtStats &stats = moveController.getNmtStats();
+    String reply = RobotConstants::Commands::NMT + " " + RobotConstants::Status::OK +
+                   " target=" + String(moveController.getNmtTarget(), HEX) +
+                   " bootups=" + String(stats.bootUps) +
+                   " configured=" + String(stats.configurations) +
+                   " last=" + String(stats.lastNodeId) +
+                   " recovery=" + String(stats.recoveryMs) + "/" + String(stats.recoveryMaxMs) + "ms" +
+                   " states=";
+    for (uint8_t nodeId = 1; nodeId <= moveController.getAxesCount(); ++nodeId)
+    {
+        if (nodeId > 1)
+        {
+            reply += ",";
+        }
+        reply += String(moveController.getAxis(nodeId).getNmtState(), HEX);
+    }
+    addDataToOutQueue(reply);
+}
+
+// DRV          -- CiA 402 drive states: DRV OK states=<state per axis> sw=<statusword per axis>
+//                 enables=<requests> frames=<controlwords> failed=<n> held=<moves> dropped=<moves>
+//                 enable=<last>/<max>us  (states: RobotConstants::DriveState, 5 operation enabled, 8 fault;
+//                 statuswords in hex; enable: request -> operation enabled reported)
+// DRVE         -- enable every drive from the state it reports (no fault reset, that is EMCR)
+// DRVZ         -- reset the counters
+void handleDriveState(String command)
+{
+    String params = command.substring(RobotConstants::Commands::COMMAND_LEN);
+    if (params.equals("E"))
+    {
+        for (uint8_t nodeId = 1; nodeId <= moveController.getAxesCount(); ++nodeId)
+        {
+            moveController.enableDrive(nodeId);
+        }
+    }
+    else if (params.equals("Z"))
+    {
+        moveController.resetDriveStats();
+    }
+    else if (params.length() > 0)
+    {
+        addDataToOutQueue(RobotConstants::Commands::DRIVE_STATE + " " + RobotConstants::Status::INVALID_PARAMS);
+        return;
+    }
+
+    String states = "";
+    String statuswords = "";
+    for (uint8_t nodeId = 1; nodeId <= moveController.getAxesCount(); ++nodeId)
+    {
+        if (nodeId > 1)
+        {
+            states += ",";
+            statuswords += ",";
+        }
+        states += String(moveController.getAxis(nodeId).getDriveState());
+        statuswords += String(moveController.getAxis(nodeId).getStatusword(), HEX);
+    }
+    const MoveController::DriveStats &stats = moveController.getDriveStats();
+    addDataToOutQueue(RobotConstants::Commands::DRIVE_STATE + " " + RobotConstants::Status::OK +
+                      " states=" + states +
+                      " sw=" + statuswords +
+                      " enables=" + String(stats.enableRequests) +
+                      " frames=" + String(stats.controlwords) +
+                      " failed=" + String(stats.failures) +
+                      " held=" + String(stats.movesHeld) +
+                      " dropped=" + String(stats.movesDropped) +
+                      " enable=" + String(stats.lastEnableUs) + "/" + String(stats.enableMaxUs) + "us");
+}
+
+// FBK         -- position feedback: FBK OK ceiling=<%> budget=<polls/s> throttled=<n> rate=<Hz per axis> interval=<ms per axis>
+// FBK<1-1000> -- bus share the polls may take, in permille, then the same report
+void handleFeedback(String command)
+{
+    String params = command.substring(RobotConstants::Commands::COMMAND_LEN);
+    if (params.length() > 0)
+    {
+        for (uint8_t i = 0; i < params.length(); ++i)
+        {
+            if (!isDigit(params.charAt(i)))
+            {
+                addDataToOutQueue(RobotConstants::Commands::FEEDBACK + " " + RobotConstants::Status::INVALID_PARAMS);
+                return;
+            }
+        }
+        const uint32_t permille = params.toInt();
+        if (permille == 0 || RobotConstants::Feedback::MAX_CEILING_PERMILLE < permille)
+        {
+            addDataToOutQueue(RobotConstants::Commands::FEEDBACK + " " + RobotConstants::Status::INVALID_PARAMS);
+            return;
+        }
+        moveController.setFeedbackCeiling(permille);
+    }
+
+    String rates = "";
+    String intervals = "";
+    for (uint8_t nodeId = 1; nodeId <= moveController.getAxesCount(); ++nodeId)
+    {
+        if (nodeId > 1)
+        {
+            rates += ",";
+            intervals += ",";
+        }
+        rates += String(moveController.getFeedbackRate(nodeId), 1);
+        intervals += String(moveController.getFeedbackInterval(nodeId));
+    }
+    const uint16_t ceiling = moveController.getFeedbackCeiling();
+    addDataToOutQueue(RobotConstants::Commands::FEEDBACK + " " + RobotConstants::Status::OK +
+                      " ceiling=" + String(ceiling / 10) + "." + String(ceiling % 10) + "%" +
+                      " budget=" + String(moveController.getFeedbackBudget()) + "/s" +
+                      " throttled=" + String(moveController.getFeedbackThrottled()) +
+                      " rate=" + rates + "Hz" +
+                      " interval=" + intervals + "ms");
+}
+
+// JOG          -- jog state: JOG OK states=<per axis: 0 idle, 1 jogging, 2 stopping> velocity=<0x60FF per axis>rpm
+//                 acc=<units/s^2> updates=<n> frames=<RPDO3s> switches=<0x6060 writes> deadman=<stops> stop=<last>/<max>ms
+//                 (stop: zero velocity sent -> standing, back in profile position)
+// JOGJA<v>[JB<v>...][AC<a>] -- jog the listed axes at <v> units/s (signed, 0 stops), other axes untouched;
+//                 AC sets the jog acceleration for the axes that start now. Repeat within Jog::DEADMAN_MS
+//                 to keep going: each repeat is one frame. Replies JOG OK, or JOG FF if an axis cannot jog
+//                 (fault pause, a move or CSP under way, drive missing)
+// JOGS         -- stop every jogging axis, then the state
+void handleJog(String command)
+{
+    String params = command.substring(RobotConstants::Commands::COMMAND_LEN);
+    if (params.equals("S"))
+    {
+        moveController.stopJog();
+        params = "";
+    }
+    if (params.length() == 0)
+    {
+        String states = "";
+        String velocities = "";
+        for (uint8_t nodeId = 1; nodeId <= moveController.getAxesCount(); ++nodeId)
+        {
+            if (nodeId > 1)
+            {
+                states += ",";
+                velocities += ",";
+            }
+            states += String(static_cast<uint8_t>(moveController.getJogState(nodeId)));
+            velocities += String(moveController.getJogVelocity(nodeId));
+        }
+        const MoveController::JogStats &stats = moveController.getJogStats();
+        addDataToOutQueue(RobotConstants::Commands::JOG + " " + RobotConstants::Status::OK +
+                          " states=" + states +
+                          " velocity=" + velocities + "rpm" +
+                          " acc=" + String(moveController.getJogAccelerationUnits()) +
+                          " updates=" + String(stats.updates) +
+                          " frames=" + String(stats.frames) +
+                          " switches=" + String(stats.modeSwitches) +
+                          " deadman=" + String(stats.deadmanStops) +
+                          " stop=" + String(stats.lastStopMs) + "/" + String(stats.stopMaxMs) + "ms");
+        return;
+    }
+
+    // Parsed in full before anything is sent: a malformed line moves nothing
+    float speeds[RobotConstants::Robot::AXES_COUNT];
+    bool listed[RobotConstants::Robot::AXES_COUNT] = {false};
+    float acceleration = 0;
+    int i = 0;
+    while (i < params.length())
+    {
+        const bool isAcceleration = params.substring(i, i + 2).equals("AC");
+        uint8_t nodeId = 0;
+        if (!isAcceleration)
+        {
+            const char motorChar = params.charAt(i + 1);
+            if (params.charAt(i) != RobotConstants::Robot::AXIS_IDENTIFIER_CHAR ||
+                motorChar < RobotConstants::Robot::MIN_NODE_ID || RobotConstants::Robot::MAX_NODE_ID < motorChar)
+            {
+                addDataToOutQueue(RobotConstants::Commands::JOG + " " + RobotConstants::Status::INVALID_PARAMS);
+                return;
+            }
+            nodeId = (motorChar - RobotConstants::Robot::MIN_NODE_ID) + 1;
+        }
+        int j = i + 2;
+        while (j < params.length() && params.charAt(j) != RobotConstants::Robot::AXIS_IDENTIFIER_CHAR && params.charAt(j) != 'A')
+        {
+            j++;
+        }
+        const String value = params.substring(i + 2, j);
+        if (value.length() == 0 || !isFloat(value))
+        {
+            addDataToOutQueue(RobotConstants::Commands::JOG + " " + RobotConstants::Status::INVALID_PARAMS);
+            return;
+        }
+        const float number = value.toFloat();
+        if (isAcceleration)
+        {
+            if (number <= RobotConstants::Commands::MIN_ACCELERATION_UNITS || RobotConstants::Commands::MAX_ACCELERATION_UNITS < number || j != params.length())
+            {
+                addDataToOutQueue(RobotConstants::Commands::JOG + " " + RobotConstants::Status::INVALID_PARAMS);
+                return;
+            }
+            acceleration = number;
+        }
+        else
+        {
+            if (RobotConstants::Commands::MAX_SPEED_UNITS < fabs(number))
+            {
+                addDataToOutQueue(RobotConstants::Commands::JOG + " " + RobotConstants::Status::INVALID_PARAMS);
+                return;
+            }
+            speeds[nodeId - 1] = number;
+            listed[nodeId - 1] = true;
+        }
+        i = j;
+    }
+
+    if (acceleration > 0)
+    {
+        moveController.setJogAccelerationUnits(acceleration);
+    }
+    BusLoad::beginCommand(BUS_TRAFFIC_JOG);
+    bool ok = true;
+    for (uint8_t nodeId = 1; nodeId <= moveController.getAxesCount(); ++nodeId)
+    {
+        if (listed[nodeId - 1])
+        {
+            ok = moveController.jog(nodeId, speeds[nodeId - 1]) && ok;
+        }
+    }
+    addDataToOutQueue(RobotConstants::Commands::JOG + " " + (ok ? RobotConstants::Status::OK : RobotConstants::Status::COMMAND_FULL_FAIL));
+}
+
+// OVR          -- feed-rate override: OVR OK rate=<%> changes=<n> frames=<profile and halt writes during moves>
+//                 unchanged=<profile objects not written> holds=<n>
+// OVR<0-100>   -- scale 0x6081/0x6083 of the move under way and of the moves that follow; only the objects
+//                 that change are written, 0 holds the move (halt bit) until another rate releases it.
+//                 Replies OVR OK, OVR FF if a frame could not be sent, OVR IP out of range
+void handleFeedRate(String command)
+{
+    String params = command.substring(RobotConstants::Commands::COMMAND_LEN);
+    if (params.length() > 0)
+    {
+        for (uint8_t i = 0; i < params.length(); ++i)
+        {
+            if (!isDigit(params.charAt(i)))
+            {
+                addDataToOutQueue(RobotConstants::Commands::FEED_RATE + " " + RobotConstants::Status::INVALID_PARAMS);
+                return;
+            }
+        }
+        const uint32_t percent = params.toInt();
+        if (params.length() > 3 || RobotConstants::FeedRate::MAX_PERCENT < percent)
+        {
+            addDataToOutQueue(RobotConstants::Commands::FEED_RATE + " " + RobotConstants::Status::INVALID_PARAMS);
+            return;
+        }
+        const bool ok = moveController.setFeedRate(static_cast<uint8_t>(percent));
+        addDataToOutQueue(RobotConstants::Commands::FEED_RATE + " " + (ok ? RobotConstants::Status::OK : RobotConstants::Status::COMMAND_FULL_FAIL));
+        return;
+    }
+
+    const MoveController::FeedRateStats &stats = moveController.getFeedRateStats();
+    addDataToOutQueue(RobotConstants::Commands::FEED_RATE + " " + RobotConstants::Status::OK +
+                      " rate=" + String(moveController.getFeedRate()) + "%" +
+                      " changes=" + String(stats.changes) +
+                      " frames=" + String(stats.frames) +
+                      " unchanged=" + String(stats.unchanged) +
+                      " holds=" + String(stats.holds));
+}
+
+// ABT          -- abort: queued motion frames dropped, quick stop controlword to every axis in the urgent
+//                 class, motion paused until EMCR. Replies ABT OK latency=<line complete -> quick stops queued>us
+//                 flushed=<frames dropped>. A falling edge on ABORT_PIN does the same and queues ABT PIN ...
+// ABTS         -- ABT OK aborts=<n> source=<last: 0 command, 1 pin> latency=<last>/<max>us flushed=<all aborts>
+//                 resends=<quick stops sent again to axes still reporting operation enabled>
+void handleAbort(String command)
+{
+    String params = command.substring(RobotConstants::Commands::COMMAND_LEN);
+    if (params.length() == 0)
+    {
+        if (!moveController.abort(RobotConstants::Abort::SOURCE_COMMAND, commandReceivedUs))
+        {
+            addDataToOutQueue(RobotConstants::Commands::ABORT + " " + RobotConstants::Status::COMMAND_FULL_FAIL);
+            return;
+        }
+        const MoveController::AbortStats &stats = moveController.getAbortStats();
+        addDataToOutQueue(RobotConstants::Commands::ABORT + " " + RobotConstants::Status::OK +
+                          " latency=" + String(stats.latencyUs) + "us" +
+                          " flushed=" + String(stats.lastFlushed));
+        return;
+    }
+    if (!params.equals("S"))
+    {
+        addDataToOutQueue(RobotConstants::Commands::ABORT + " " + RobotConstants::Status::INVALID_PARAMS);
+        return;
+    }
+    const MoveController::AbortStats &stats = moveController.getAbortStats();
+    addDataToOutQueue(RobotConstants::Commands::ABORT + " " + RobotConstants::Status::OK +
+                      " aborts=" + String(stats.aborts) +
+                      " source=" + String(stats.lastSource) +
+                      " latency=" + String(stats.latencyUs) + "/" + String(stats.latencyMaxUs) + "us" +
+                      " flushed=" + String(stats.flushed) +
+                      " resends=" + String(stats.resends));
+}
+
+// PLN          -- move plans (double buffer): PLN OK plan=<active buffer> seq=<active plan> prepared=<n>
+//                 dispatched=<n> replaced=<staged plans overwritten before dispatch> queued=<plans that
+//                 waited for the move under way> rejected=<n> prepare=<last>/<max>us planned=<active plan duration>ms
+void handleMovePlan(String command)
+{
+    if (command != RobotConstants::Commands::MOVE_PLAN)
+    {
+        addDataToOutQueue(RobotConstants::Commands::MOVE_PLAN + " " + RobotConstants::Status::INVALID_PARAMS);
+        return;
+    }
+    const MoveController::PlanStats &stats = moveController.getPlanStats();
+    const MoveController::MovePlan &plan = moveController.getActivePlan();
+    addDataToOutQueue(RobotConstants::Commands::MOVE_PLAN + " " + RobotConstants::Status::OK +
+                      " plan=" + String(moveController.getActivePlanIndex()) +
+                      " seq=" + String(plan.sequence) +
+                      " prepared=" + String(stats.prepared) +
+                      " dispatched=" + String(stats.dispatched) +
+                      " replaced=" + String(stats.replaced) +
+                      " queued=" + String(stats.queued) +
+                      " rejected=" + String(stats.rejected) +
+                      " prepare=" + String(stats.prepareUs) + "/" + String(stats.prepareMaxUs) + "us" +
+                      " planned=" + String(plan.plannedMs) + "ms");
+}
+
+// PTH          -- CSP waypoint path: PTH OK blend=<0|1> queued=<n>/<queue> waypoints=<n> blended=<junctions
+//                 passed without stopping> stopped=<n> late=<queued after the blend had to start> saved=<overlap>ms
+//                 junction=<fastest axis in the middle of the last blend, units/s> acc=<largest axis acceleration
+//                 between planned cycles, units/s^2>
+// PTH1 / PTH0  -- blend consecutive waypoints / stop at every waypoint
+// PTHR         -- reset the statistics
+void handlePath(String command)
+{
+    String params = command.substring(RobotConstants::Commands::COMMAND_LEN);
+    if (params.equals("1") || params.equals("0"))
+    {
+        cspStreamer.setBlending(params.equals("1"));
+    }
+    else if (params.equals("R"))
+    {
+        cspStreamer.resetPathStats();
+    }
+    else if (params.length() > 0)
+    {
+        addDataToOutQueue(RobotConstants::Commands::PATH + " " + RobotConstants::Status::INVALID_PARAMS);
+        return;
+    }
+    const CspStreamer::PathStats &stats = cspStreamer.getPathStats();
+    addDataToOutQueue(RobotConstants::Commands::PATH + " " + RobotConstants::Status::OK +
+                      " blend=" + String(cspStreamer.isBlending() ? 1 : 0) +
+                      " queued=" + String(cspStreamer.queuedWaypoints()) + "/" + String(RobotConstants::Csp::PATH_QUEUE) +
+                      " waypoints=" + String(stats.waypoints) +
+                      " blended=" + String(stats.blended) +
+                      " stopped=" + String(stats.stopped) +
+                      " late=" + String(stats.late) +
+                      " saved=" + String((uint32_t)(stats.savedUs / 1000)) + "ms" +
+                      " junction=" + String(stats.junctionSpeed) +
+                      " acc=" + String(stats.peakAcceleration));
+}
+
+void abortPinInterrupt()
+{
+    if (!abortRequested)
+    {
+        abortRequestedUs = micros();
+        abortRequested = true;
+    }
+}
+
+// Sends the quick stops for a pin edge: at the top of loop() and from yield(), which delay() calls while
+// a command handler waits between frames
+void serviceAbort()
+{
+    if (!abortRequested || abortInService)
+    {
+        return;
+    }
+    abortInService = true;
+    noInterrupts();
+    const uint32_t requestedUs = abortRequestedUs;
+    abortRequested = false;
+    interrupts();
+    if (moveController.abort(RobotConstants::Abort::SOURCE_PIN, requestedUs))
+    {
+        const MoveController::AbortStats &stats = moveController.getAbortStats();
+        addDataToOutQueue(RobotConstants::Commands::ABORT + " PIN latency=" + String(stats.latencyUs) + "us" +
+                          " flushed=" + String(stats.lastFlushed));
+    }
+    abortInService = false;
+}
+
+void yield()
+{
+    serviceAbort();
+}
+
+#if CAN_TRACE_ENABLED
+uint32_t canTraceStreamLeft = 0; // Records still to send for the running CTR dump
+uint32_t canTraceStreamSent = 0;
+#endif
+
+// CTR          -- stream the trace out (oldest first) and drain it; one line per record, all in hex:
+//                 CTR <timestampUs> <flags> <id> <len> <data>, then CTR OK <count> dropped=.. trigger=..
+// CTRS         -- status only
+// CTRT<mask>   -- arm the trigger (hex, CAN_TRACE_TRIGGER_* in CanTrace.h) and unfreeze; CTRT0 = free running
+// CTRF         -- freeze now (manual trigger, has to be armed)
+// CTRC         -- clear the ring and re-arm
+// Decode the capture with host/tools/cantrace_convert
+void handleCanTrace(String command)
+{
+#if CAN_TRACE_ENABLED
+    String params = command.substring(RobotConstants::Commands::COMMAND_LEN);
+    if (params.length() == 0)
+    {
+        // Records captured while the dump runs are left for the next one
+        canTraceStreamLeft = CanTrace::count();
+        canTraceStreamSent = 0;
+        if (canTraceStreamLeft == 0)
+        {
+            addDataToOutQueue(RobotConstants::Commands::CAN_TRACE + " " + RobotConstants::Status::OK + " 0 dropped=" + String(CanTrace::droppedRecords()) +
+                              " trigger=" + String(CanTrace::triggerSource(), HEX) + " frozen=" + String(CanTrace::frozen() ? 1 : 0));
+        }
+        return;
+    }
+
+    const char sub = params.charAt(0);
+    if (sub == 'T' && params.length() > 1)
+    {
+        String maskStr = params.substring(1);
+        char *end = nullptr;
+        uint32_t mask = strtoul(maskStr.c_str(), &end, 16);
+        if (*end != '\0')
+        {
+            addDataToOutQueue(RobotConstants::Commands::CAN_TRACE + " " + RobotConstants::Status::INVALID_PARAMS);
+            return;
+        }
+        CanTrace::arm(mask);
+    }
+    else if (sub == 'F' && params.length() == 1)
+    {
+        CanTrace::trigger(CAN_TRACE_TRIGGER_MANUAL);
+    }
+    else if (sub == 'C' && params.length() == 1)
+    {
+        CanTrace::clear();
+    }
+    else if (!(sub == 'S' && params.length() == 1))
+    {
+        addDataToOutQueue(RobotConstants::Commands::CAN_TRACE + " " + RobotConstants::Status::INVALID_PARAMS);
+        return;
+    }
+    addDataToOutQueue(RobotConstants::Commands::CAN_TRACE + " " + RobotConstants::Status::OK +
+                      " count=" + String((uint32_t)CanTrace::count()) +
+                      " dropped=" + String(CanTrace::droppedRecords()) +
+                      " mask=" + String(CanTrace::triggerMask(), HEX) +
+                      " trigger=" + String(CanTrace::triggerSource(), HEX) +
+                      " frozen=" + String(CanTrace::frozen() ? 1 : 0));
+#else
+    addDataToOutQueue(RobotConstants::Commands::CAN_TRACE + " " + RobotConstants::Status::COMMAND_FULL_FAIL + " CAN trace disabled (CAN_TRACE_ENABLED 0)");
+#endif
+}
+
+// Sends the CTR dump one record per loop pass, only when the output queue is empty,
+// so a dump never holds up the loop or fills the heap with queued lines.
+void streamCanTrace()
+{
+#if CAN_TRACE_ENABLED
+    if (canTraceStreamLeft == 0 || !outData.empty())
+    {
+        return;
+    }
+
+    CanTraceRecord record;
+    if (CanTrace::drain(record))
+    {
+        static const char hexDigits[] = "0123456789ABCDEF";
+        char data[17];
+        for (uint8_t i = 0; i < record.len; ++i)
+        {
+            data[2 * i] = hexDigits[record.data[i] >> 4];
+            data[2 * i + 1] = hexDigits[record.data[i] & 0x0F];
+        }
+        data[2 * record.len] = '\0';
+        addDataToOutQueue(RobotConstants::Commands::CAN_TRACE + " " + String(record.timestampUs, HEX) + " " + String(record.flags, HEX) + " " +
+                          String(record.id, HEX) + " " + String(record.len) + " " + data);
+        canTraceStreamSent++;
+        canTraceStreamLeft--;
+    }
+    else
+    {
+        canTraceStreamLeft = 0; // Drained by a CTRC in the meantime
+    }
+
+    if (canTraceStreamLeft == 0)
+    {
+        addDataToOutQueue(RobotConstants::Commands::CAN_TRACE + " " + RobotConstants::Status::OK + " " + String(canTraceStreamSent) +
+                          " dropped=" + String(CanTrace::droppedRecords()) +
+                          " trigger=" + String(CanTrace::triggerSource(), HEX) +
+                          " frozen=" + String(CanTrace::frozen() ? 1 : 0));
+    }
+#endif
+}
@@ -0,0 +1,60 @@
+#pragma once
+#ifndef CAN_DRIVER_H
+#define CAN_DRIVER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Classic CAN frame as seen by CanOpen, independent of the controller library
+struct CanFrame
+{
+    uint32_t id = 0;
+    bool extended = false;
+    bool remote = false;
+    uint8_t len = 0;
+    uint8_t buf[8] = {0};
+    uint32_t timestampUs = 0; // Reception time; source depends on the driver (micros(), kernel timestamp)
+};
+
+// Acceptance filter for standard (11-bit) data frames: a frame passes if (id & mask) == (filter.id & mask)
+struct CanRxFilter
+{
+    uint32_t id = 0;
+    uint32_t mask = 0;
+};
+
+// CAN transport used by CanOpen.
+// Stm32CanDriver (bxCAN on the Blue Pill) is the firmware's implementation; host builds add
+// SocketCAN and in-process transports (host/drivers), so the same CANopen master and
+// motion controller run on a Linux gateway.
+class CanDriver
+{
+public:
+    virtual ~CanDriver() = default;
+
+    // loopback = silent self-test mode: written frames are received back and do not reach the bus
+    virtual bool begin(uint32_t baudRate, bool loopback) = 0;
+    virtual void end() = 0;
+
+    virtual bool write(const CanFrame &frame) = 0; // false if the frame could not be queued
+    virtual bool read(CanFrame &frame) = 0;        // false if nothing was received
+
+    // Drivers that batch transmissions push them out here; CanOpen calls it once per read()
+    virtual void flush() {}
+
+    // Receive only frames matching one of the filters (count 0: everything). Kept over end()/begin().
+    // False if the driver cannot filter or the set does not fit; everything then still arrives
+    virtual bool setRxFilters(const CanRxFilter * /*filters*/, uint8_t /*count*/) { return false; }
+
+    // Hardware TX mailboxes, for CanTxScheduler. Drivers without them (0) take frames through
+    // write() for as long as their own queue accepts them.
+    virtual uint8_t txMailboxCount() const { return 0; }
+    virtual int8_t freeTxMailbox() { return -1; } // Mailbox the next write() loads, -1 if all are busy
+    virtual bool txMailboxBusy(uint8_t /*mailbox*/) { return false; }
+    // Asks for the frame to be taken back and returns at once (false: the mailbox is empty already).
+    // A frame on the wire still goes out; once the mailbox is no longer busy, txMailboxAborted() tells which
+    virtual bool abortTxMailbox(uint8_t /*mailbox*/) { return false; }
+    virtual bool txMailboxAborted(uint8_t /*mailbox*/) { return false; } // Its last frame was taken back, not sent
+};
+
+#endif // CAN_DRIVER_H
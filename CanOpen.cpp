@@ -2,6 +2,9 @@
 #include "CanOpen.h"
 #include "RobotConstants.h"
 #include "Debug.h"
+#include "Profiler.h"
+#include "BusLoad.h"
+#include "CanTrace.h"
 
 bool CanOpen::send_x260A_electronicGearMolecules(uint8_t nodeId, uint16_t value)
 {
@@ -43,14 +46,15 @@ bool CanOpen::send_x6081_profileVelocity(uint8_t nodeId, uint32_t value)
         &value);
 }
 
-bool CanOpen::send_x6040_controlword(uint8_t nodeId, uint16_t value)
+bool CanOpen::send_x6040_controlword(uint8_t nodeId, uint16_t value, CanTxClass txClass)
 {
     return sendSDOWrite(
         nodeId,
         2,
         RobotConstants::ODIndices::CONTROLWORD,
         _Controlword_Controlword_sIdx,
-        &value);
+        &value,
+        txClass);
 }
 
 bool CanOpen::send_x6060_modesOfOperation(uint8_t nodeId, uint8_t value)
@@ -73,7 +77,7 @@ bool CanOpen::send_x607A_targetPosition(uint8_t nodeId, int32_t value)
         &value);
 }
 
-bool CanOpen::sendSDOWrite(uint8_t nodeId, uint8_t dataLenBytes, uint16_t index, uint8_t subindex, const void *data)
+bool CanOpen::sendSDOWrite(uint8_t nodeId, uint8_t dataLenBytes, uint16_t index, uint8_t subindex, const void *data, CanTxClass txClass)
 {
     uint8_t msgBuf[RobotConstants::Buffers::MAX_CAN_MESSAGE_LEN] = {0}; // 8 bytes of CAN message data
 
@@ -110,11 +114,12 @@ bool CanOpen::sendSDOWrite(uint8_t nodeId, uint8_t dataLenBytes, uint16_t index,
 
     return send(0x600 + nodeId, 
                 msgBuf, 
-                RobotConstants::Buffers::MAX_CAN_MESSAGE_LEN);
+                RobotConstants::Buffers::MAX_CAN_MESSAGE_LEN,
+                txClass);
 
             }
 // Example: Sending SDO request to read position: "40 64 60 00"
-bool CanOpen::sendSDORead(uint8_t nodeId, uint16_t index, uint8_t subindex)
+bool CanOpen::sendSDORead(uint8_t nodeId, uint16_t index, uint8_t subindex, CanTxClass txClass)
 {
     uint8_t msgBuf[RobotConstants::Buffers::MAX_CAN_MESSAGE_LEN] = {0};
     msgBuf[0] = 0x40; // SDO read command specifier
@@ -132,7 +137,8 @@ bool CanOpen::sendSDORead(uint8_t nodeId, uint16_t index, uint8_t subindex)
     return send(
         0x600 + nodeId,
         msgBuf,
-        RobotConstants::Buffers::MAX_CAN_MESSAGE_LEN);
+        RobotConstants::Buffers::MAX_CAN_MESSAGE_LEN,
+        txClass);
 }
 
 bool CanOpen::sendPDO4_x607A_SyncMovement(uint8_t nodeId, int32_t targetPositionAbsolute)
@@ -142,18 +148,106 @@ bool CanOpen::sendPDO4_x607A_SyncMovement(uint8_t nodeId, int32_t targetPosition
     return send(0x500 + nodeId, msgBuf, 4);
 }
 
+bool CanOpen::sendPDO4_x607A_x6040_SyncMovement(uint8_t nodeId, int32_t targetPositionAbsolute, uint16_t controlword)
+{
+    uint8_t msgBuf[6] = {0};
+    memcpy(msgBuf, &targetPositionAbsolute, 4);
+    memcpy(&msgBuf[4], &controlword, 2);
+    return send(RobotConstants::CANOpen::COB_ID_RPDO4_BASE + nodeId, msgBuf, 6);
+}
+
+bool CanOpen::sendPDO3_x60FF_TargetVelocity(uint8_t nodeId, int32_t targetVelocity)
+{
+    uint8_t msgBuf[4] = {0};
+    memcpy(msgBuf, &targetVelocity, 4);
+    return send(RobotConstants::CANOpen::COB_ID_RPDO3_BASE + nodeId, msgBuf, 4);
+}
+
+bool CanOpen::configureRPDO3(uint8_t nodeId)
+{
+    const uint16_t communication = RobotConstants::ODIndices::RPDO_PARAM_BASE + 2;
+    const uint16_t mapping = RobotConstants::ODIndices::RPDO_MAPPING_BASE + 2;
+    const uint32_t cobId = RobotConstants::CANOpen::COB_ID_RPDO3_BASE + nodeId;
+    const uint32_t cobIdInvalid = cobId | RobotConstants::CANOpen::COB_ID_PDO_INVALID;
+    const uint32_t mapVelocityEntry = (static_cast<uint32_t>(RobotConstants::ODIndices::TARGET_VELOCITY) << 16) | 32;
+    const uint8_t noEntries = 0;
+    const uint8_t entries = 1;
+    const uint8_t transmissionType = RobotConstants::CANOpen::PDO_TRANSMISSION_EVENT;
+
+    // Same order as configureRPDO4
+    bool ok = sendSDOWrite(nodeId, 4, communication, 0x01, &cobIdInvalid);
+    ok = sendSDOWrite(nodeId, 1, mapping, 0x00, &noEntries) && ok;
+    ok = sendSDOWrite(nodeId, 4, mapping, 0x01, &mapVelocityEntry) && ok;
+    ok = sendSDOWrite(nodeId, 1, mapping, 0x00, &entries) && ok;
+    ok = sendSDOWrite(nodeId, 1, communication, 0x02, &transmissionType) && ok;
+    ok = sendSDOWrite(nodeId, 4, communication, 0x01, &cobId) && ok;
+    return ok;
+}
+
+bool CanOpen::configureRPDO4(uint8_t nodeId, bool mapControlword, uint8_t transmissionType)
+{
+    const uint16_t communication = RobotConstants::ODIndices::RPDO_PARAM_BASE + 3;
+    const uint16_t mapping = RobotConstants::ODIndices::RPDO_MAPPING_BASE + 3;
+    const uint32_t cobId = RobotConstants::CANOpen::COB_ID_RPDO4_BASE + nodeId;
+    const uint32_t cobIdInvalid = cobId | RobotConstants::CANOpen::COB_ID_PDO_INVALID;
+    const uint32_t mapTargetEntry = (static_cast<uint32_t>(RobotConstants::ODIndices::TARGET_POSITION) << 16) | 32;
+    const uint32_t mapControlwordEntry = (static_cast<uint32_t>(RobotConstants::ODIndices::CONTROLWORD) << 16) | 16;
+    const uint8_t noEntries = 0;
+    const uint8_t entries = mapControlword ? 2 : 1;
+
+    // CiA 301 order: disable the PDO, clear the mapping, write the entries, set the count, enable
+    bool ok = sendSDOWrite(nodeId, 4, communication, 0x01, &cobIdInvalid);
+    ok = sendSDOWrite(nodeId, 1, mapping, 0x00, &noEntries) && ok;
+    ok = sendSDOWrite(nodeId, 4, mapping, 0x01, &mapTargetEntry) && ok;
+    if (mapControlword)
+    {
+        ok = sendSDOWrite(nodeId, 4, mapping, 0x02, &mapControlwordEntry) && ok;
+    }
+    ok = sendSDOWrite(nodeId, 1, mapping, 0x00, &entries) && ok;
+    ok = sendSDOWrite(nodeId, 1, communication, 0x02, &transmissionType) && ok;
+    ok = sendSDOWrite(nodeId, 4, communication, 0x01, &cobId) && ok;
+    return ok;
+}
+
+bool CanOpen::configureTPDO1(uint8_t nodeId, uint16_t eventTimerMs)
+{
+    const uint16_t communication = RobotConstants::ODIndices::TPDO_PARAM_BASE;
+    const uint16_t mapping = RobotConstants::ODIndices::TPDO_MAPPING_BASE;
+    const uint32_t cobId = RobotConstants::CANOpen::COB_ID_TPDO1_BASE + nodeId;
+    const uint32_t cobIdInvalid = cobId | RobotConstants::CANOpen::COB_ID_PDO_INVALID;
+    const uint32_t mapStatuswordEntry = (static_cast<uint32_t>(RobotConstants::ODIndices::STATUSWORD) << 16) | 16;
+    const uint8_t noEntries = 0;
+    const uint8_t entries = 1;
+    const uint8_t transmissionType = RobotConstants::CANOpen::PDO_TRANSMISSION_EVENT;
+
+    // Same order as configureRPDO4; the event timer is sub 5 of the communication parameter
+    bool ok = sendSDOWrite(nodeId, 4, communication, 0x01, &cobIdInvalid);
+    ok = sendSDOWrite(nodeId, 1, mapping, 0x00, &noEntries) && ok;
+    ok = sendSDOWrite(nodeId, 4, mapping, 0x01, &mapStatuswordEntry) && ok;
+    ok = sendSDOWrite(nodeId, 1, mapping, 0x00, &entries) && ok;
+    ok = sendSDOWrite(nodeId, 1, communication, 0x02, &transmissionType) && ok;
+    ok = sendSDOWrite(nodeId, 2, communication, 0x05, &eventTimerMs) && ok;
+    ok = sendSDOWrite(nodeId, 4, communication, 0x01, &cobId) && ok;
+    return ok;
+}
+
 bool CanOpen::sendSYNC()
 {
-    DBG_VERBOSE(DBG_GROUP_CANOPEN, "Sending SYNC");
+    DBG_VERBOSE_MSG(DBG_GROUP_CANOPEN, CAN_SENDING_SYNC);
     return send(0x80, nullptr, 0);
 }
 
+bool CanOpen::sendNMT(uint8_t command, uint8_t nodeId)
+{
+    uint8_t msgBuf[2] = {command, nodeId};
+    return send(RobotConstants::CANOpen::COB_ID_NMT, msgBuf, 2);
+}
+
 bool CanOpen::startCan(uint32_t baudRate)
 {
     if (!can_initialized)
     {
         this->canBaudRate = baudRate;
-        Can.setAutoRetransmission(true);
 
         // Loopback test
         if (!loopbackTest())
@@ -161,28 +255,93 @@ bool CanOpen::startCan(uint32_t baudRate)
             addDataToOutQueue("CAN loopback test failed during start");
             return false;
         }
-        Can.end();
+        driver.end();
 
         // Start CAN in normal mode
-        Can.enableLoopBack(false);
-        Can.begin();
-        Can.setBaudRate(canBaudRate);
+        if (!driver.begin(canBaudRate, false))
+        {
+            addDataToOutQueue("CAN driver failed to start");
+            return false;
+        }
         can_initialized = true;
+        BusLoad::begin(canBaudRate);
+        applyRxFilters();
         DBG_INFO(DBG_GROUP_CANOPEN, "CAN initialized with baud rate: " + String(canBaudRate));
         return true;
     }
     return false; // already initialized
 }
 
+void CanOpen::consumeFunction(uint32_t functionCode)
+{
+    const uint16_t bit = static_cast<uint16_t>(1u << (functionCode >> 7));
+    if (functionCode == 0 || (rxFunctions & bit) != 0)
+    {
+        return; // Handler removed, or the function code is already let through
+    }
+    rxFunctions |= bit;
+    if (can_initialized)
+    {
+        applyRxFilters();
+    }
+}
+
+uint8_t CanOpen::rxFilters(CanRxFilter *filters, uint8_t maxCount) const
+{
+    uint8_t count = 0;
+    for (uint8_t function = 0; function < 16; ++function)
+    {
+        if ((rxFunctions & (1u << function)) == 0)
+        {
+            continue;
+        }
+        // Node IDs 1..AXES_COUNT as power-of-two blocks aligned to their size: each one is an id/mask pair
+        const uint32_t functionCode = static_cast<uint32_t>(function) << 7;
+        uint32_t low = 1;
+        const uint32_t high = RobotConstants::Robot::AXES_COUNT;
+        while (low <= high)
+        {
+            uint32_t size = low & (~low + 1); // Largest block aligned at `low`
+            while (low + size - 1 > high)
+            {
+                size >>= 1;
+            }
+            if (count == maxCount)
+            {
+                return 0; // Does not fit: no filtering rather than losing frames
+            }
+            filters[count].id = functionCode + low;
+            filters[count].mask = 0x7FF & ~(size - 1);
+            count++;
+            low += size;
+        }
+    }
+    return count;
+}
+
+bool CanOpen::applyRxFilters()
+{
+    CanRxFilter filters[RobotConstants::CANOpen::MAX_RX_FILTERS];
+    const uint8_t count = rxFilters(filters, RobotConstants::CANOpen::MAX_RX_FILTERS);
+    rxFiltersActive = count > 0 && driver.setRxFilters(filters, count);
+    if (count > 0)
+    {
+        DBG_INFO(DBG_GROUP_CANOPEN, "RX filters: " + String(count) + (rxFiltersActive ? " programmed" : " not supported by the driver"));
+    }
+    return rxFiltersActive;
+}
+
 bool CanOpen::loopbackTest()
 {
-    Can.enableLoopBack(true);
-    Can.begin();
-    Can.setBaudRate(canBaudRate);
+    if (!driver.begin(canBaudRate, true))
+    {
+        addDataToOutQueue("CAN driver failed to start in loopback mode");
+        return false;
+    }
 
-    CAN_message_t testMsg;
+    CanFrame testMsg;
     testMsg.id = 0x123;
-    testMsg.flags.extended = 0;
+    testMsg.extended = false;
     testMsg.len = 8;
     testMsg.buf[0] = 0xAA;
     testMsg.buf[1] = 0xBB;
@@ -193,7 +352,7 @@ bool CanOpen::loopbackTest()
     testMsg.buf[6] = 0x11;
     testMsg.buf[7] = 0x22;
 
-    bool queued = Can.write(testMsg);
+    bool queued = driver.write(testMsg);
     if (!queued)
     {
         addDataToOutQueue("Failed to queue test message for transmission");
@@ -203,12 +362,13 @@ bool CanOpen::loopbackTest()
     {
         DBG_INFO(DBG_GROUP_CANOPEN, "Test message queued for loopback transmission");
     }
+    driver.flush();
 
     delay(100); // Wait for message to loop back
 
-    CAN_message_t receivedMsg;
+    CanFrame receivedMsg;
     bool got = false;
-    if (Can.read(receivedMsg))
+    if (driver.read(receivedMsg))
     {
         got = true;
     }
@@ -249,24 +409,24 @@ bool CanOpen::loopbackTest()
     }
 }
 
-bool CanOpen::send(uint32_t id, const uint8_t *msgData, uint8_t msgDataLen) // data contains not only data but also SDO command specifier, index, subindex etc.
+bool CanOpen::send(uint32_t id, const uint8_t *msgData, uint8_t msgDataLen, CanTxClass txClass) // data contains not only data but also SDO command specifier, index, subindex etc.
 {
     // Check for null data pointer
     if (msgData == nullptr && msgDataLen > 0)
     {
-        DBG_ERROR(DBG_GROUP_CANOPEN, "Null data pointer in CAN send with non-zero length");
+        DBG_ERROR_MSG(DBG_GROUP_CANOPEN, CAN_SEND_NULL_DATA);
         return false;
     }
 
     // Check for invalid length (CAN frame can have max 8 bytes of data)
     if (msgDataLen > 8)
     {
-        DBG_ERROR(DBG_GROUP_CANOPEN, "Invalid data length in CAN send: " + String(msgDataLen));
+        DBG_ERROR_MSG(DBG_GROUP_CANOPEN, CAN_SEND_INVALID_LENGTH, msgDataLen);
         return false;
     }
 
     CAN_TX_msg.id = id;
-    CAN_TX_msg.flags.extended = 0;
+    CAN_TX_msg.extended = false;
     CAN_TX_msg.len = msgDataLen;
 
     // Copy data to CAN message buffer
@@ -275,19 +435,26 @@ bool CanOpen::send(uint32_t id, const uint8_t *msgData, uint8_t msgDataLen) // d
         CAN_TX_msg.buf[i] = msgData[i];
     }
 
-    bool ok = Can.write(CAN_TX_msg);
+    // Queued by class; BusLoad and CanTrace see the frame when it is loaded into a mailbox
+    bool ok = txScheduler.enqueue(CAN_TX_msg, txClass);
     if (!ok)
     {
-        DBG_ERROR(DBG_GROUP_CANOPEN, "CAN send failed for ID: " + String(id, HEX));
+        DBG_ERROR_MSG(DBG_GROUP_CANOPEN, CAN_SEND_FAILED, id);
+    }
+    txScheduler.pump();
+    if (txPacing && txClass != CAN_TX_CLASS_URGENT) // Urgent frames (stop commands) are not held back
+    {
+        delay(1);
     }
-    delay(1);
     return ok;
 }
 
 bool CanOpen::receive(uint16_t &cob_id, uint8_t *data, uint8_t &len)
 {
-    if (Can.read(CAN_RX_msg))
+    if (driver.read(CAN_RX_msg))
     {
+        BusLoad::recordFrame(CAN_RX_msg);
+        CanTrace::record(CAN_RX_msg.timestampUs, CAN_RX_msg.id, CAN_RX_msg.extended, CAN_RX_msg.remote, CAN_RX_msg.len, CAN_RX_msg.buf, false);
         cob_id = CAN_RX_msg.id;
         len = CAN_RX_msg.len;
         for (int i = 0; i < CAN_RX_msg.len; ++i)
@@ -305,32 +472,71 @@ bool CanOpen::read()
     uint8_t data[8];
     uint8_t len;
 
+    txScheduler.pump(); // Frames that waited for a free mailbox
+    driver.flush();     // Frames batched by the driver since the last pass
+
     if (receive(id, data, len))
     {
+        PROF_SCOPE(PROF_RX_DISPATCH);
+        dispatchStats.framesDecoded++;
         uint16_t nodeId = id & 0x7F; // Extract node ID from COB-ID
         if (nodeId <= 0 || RobotConstants::Robot::AXES_COUNT < nodeId)
         {
-            DBG_ERROR(DBG_GROUP_CANOPEN, "Received message from invalid node ID: " + String(nodeId));
+            dispatchStats.rejected++;
+            DBG_ERROR_MSG(DBG_GROUP_CANOPEN, CAN_INVALID_NODE, nodeId);
             return false;
         }
 
         uint16_t function_code = id & 0x780; // Extract base COB-ID
 
-        if (function_code == RobotConstants::CANOpen::COB_ID_HEARTBEAT_BASE)
+        if (function_code == RobotConstants::CANOpen::COB_ID_EMCY_BASE)
+        { // EMCY: error code (LE), error register, vendor-specific bytes
+            if (len < RobotConstants::Emcy::FRAME_MIN_LEN)
+            {
+                dispatchStats.rejected++;
+                DBG_ERROR_MSG(DBG_GROUP_CANOPEN, CAN_EMCY_LENGTH, nodeId, len);
+                return false;
+            }
+            for (uint8_t i = len; i < 8; ++i)
+            {
+                data[i] = 0;
+            }
+            if (callbacks_emcy != nullptr)
+            {
+                dispatchStats.emcy++;
+                callbacks_emcy(nodeId, static_cast<uint16_t>(data[0] | (data[1] << 8)), data[2], &data[3]);
+            }
+        }
+        else if (function_code == RobotConstants::CANOpen::COB_ID_HEARTBEAT_BASE)
         {
             if (callbacks_heartbeat != nullptr)
             {
+                dispatchStats.heartbeat++;
                 callbacks_heartbeat(nodeId, data[0]);
             }
         }
+        else if (function_code == RobotConstants::CANOpen::COB_ID_TPDO1_BASE)
+        { // TPDO1: statusword (configureTPDO1)
+            if (len < 2)
+            {
+                dispatchStats.rejected++;
+                return false;
+            }
+            if (callbacks_x6041_statusword[nodeId] != nullptr)
+            {
+                dispatchStats.x6041_statusword++;
+                callbacks_x6041_statusword[nodeId](nodeId, true, static_cast<uint16_t>(data[0] | (data[1] << 8)));
+            }
+        }
         else if (function_code == RobotConstants::CANOpen::COB_ID_SDO_CLIENT_BASE)
         { // SDO READ/WRITE RESPONSE
-            DBG_VERBOSE(DBG_GROUP_CANOPEN, "SDO Response from node " + String(nodeId));
+            DBG_VERBOSE_MSG(DBG_GROUP_CANOPEN, CAN_SDO_RESPONSE, nodeId);
 
             // Accept 4-byte write acks and 8-byte read responses
             if (len < 4)
             {
-                DBG_ERROR(DBG_GROUP_CANOPEN, "Invalid SDO response length from node " + String(nodeId) + ": " + String(len));
+                dispatchStats.rejected++;
+                DBG_ERROR_MSG(DBG_GROUP_CANOPEN, CAN_SDO_RESPONSE_LENGTH, nodeId, len);
                 return false;
             }
 
@@ -340,6 +546,7 @@ bool CanOpen::read()
             { // 0x260A
                 if (callbacks_x260A_electronicGearMolecules[nodeId] != nullptr)
                 {
+                    dispatchStats.x260A_electronicGearMolecules++;
                     callbacks_x260A_electronicGearMolecules[nodeId](nodeId, (data[0] == 0x60));
                 }
             }
@@ -347,6 +554,7 @@ bool CanOpen::read()
             { // 0x6040
                 if (callbacks_x6040_controlword[nodeId] != nullptr)
                 {
+                    dispatchStats.x6040_controlword++;
                     callbacks_x6040_controlword[nodeId](nodeId, (data[0] == 0x60));
                 }
             }
@@ -354,6 +562,7 @@ bool CanOpen::read()
             { // 0x6060
                 if (callbacks_x6060_modesOfOperation[nodeId] != nullptr)
                 {
+                    dispatchStats.x6060_modesOfOperation++;
                     callbacks_x6060_modesOfOperation[nodeId](nodeId, (data[0] == 0x60));
                 }
             }
@@ -361,6 +570,7 @@ bool CanOpen::read()
             { // 0x607A
                 if (callbacks_x607A_targetPosition[nodeId] != nullptr)
                 {
+                    dispatchStats.x607A_targetPosition++;
                     callbacks_x607A_targetPosition[nodeId](nodeId, (data[0] == 0x60));
                 }
             }
@@ -372,7 +582,8 @@ bool CanOpen::read()
                 {
                     if (len < 8)
                     {
-                        DBG_ERROR(DBG_GROUP_CANOPEN, "Invalid SDO read response length for position value from node " + String(nodeId) + ": " + String(len));
+                        dispatchStats.rejected++;
+                        DBG_ERROR_MSG(DBG_GROUP_CANOPEN, CAN_POSITION_RESPONSE_LENGTH, nodeId, len);
                         return false;
                     }
                     positionValue = (static_cast<int32_t>(data[7]) << 24) |
@@ -382,6 +593,7 @@ bool CanOpen::read()
                 }
                 if (callbacks_x6064_positionActualValue[nodeId] != nullptr)
                 {
+                    dispatchStats.x6064_positionActualValue++;
                     callbacks_x6064_positionActualValue[nodeId](nodeId, success, positionValue);
                 }
             }
@@ -395,6 +607,7 @@ bool CanOpen::read()
                     {
                         statusWordValue = static_cast<uint16_t>(data[4]) | (static_cast<uint16_t>(data[5]) << 8);
                     }
+                    dispatchStats.x6041_statusword++;
                     callbacks_x6041_statusword[nodeId](nodeId, success, statusWordValue);
                 }
             }
@@ -7,7 +7,8 @@
 #include <functional>
 #include "OD.h"
 #include "objdict_objectdefines.h"
-#include "STM32_CAN.h"
+#include "CanDriver.h"
+#include "CanTxScheduler.h"
 #include "RobotConstants.h"
 
 // Make SDOReceiveCallback type
@@ -16,15 +17,35 @@ extern void addDataToOutQueue(String data);
 
 class CanOpen
 {
+public:
+    // What read() did with the received frames (callbacks actually invoked, per object)
+    struct DispatchStats
+    {
+        uint32_t framesDecoded; // Frames taken from the driver
+        uint32_t rejected;      // Invalid node ID or malformed SDO response
+        uint32_t heartbeat;
+        uint32_t emcy;
+        uint32_t x260A_electronicGearMolecules;
+        uint32_t x6040_controlword;
+        uint32_t x6060_modesOfOperation;
+        uint32_t x607A_targetPosition;
+        uint32_t x6064_positionActualValue;
+        uint32_t x6041_statusword;
+    };
+
 private:
-    STM32_CAN Can;
-    CAN_message_t CAN_TX_msg;
-    CAN_message_t CAN_RX_msg;
+    CanDriver &driver;
+    CanFrame CAN_TX_msg;
+    CanFrame CAN_RX_msg;
     bool can_initialized = false;
     bool loopbackTest();
     uint32_t canBaudRate;
+    bool txPacing = true;
+
+    CanTxScheduler txScheduler;
 
-    bool send(uint32_t id, const uint8_t *data, uint8_t len);
+    bool send(uint32_t id, const uint8_t *data, uint8_t len, CanTxClass txClass);
+    bool send(uint32_t id, const uint8_t *data, uint8_t len) { return send(id, data, len, CanTxScheduler::classify(id)); }
     bool receive(uint16_t &cob_id, uint8_t *data, uint8_t &len);
 
     callback_x6064_positionActualValue callbacks_x6064_positionActualValue[RobotConstants::Robot::AXES_COUNT + 1] = {nullptr};                // index 0 is unused
@@ -34,60 +55,119 @@ private:
     callback_x607A_targetPosition callbacks_x607A_targetPosition[RobotConstants::Robot::AXES_COUNT + 1] = {nullptr};                   // index 0 is unused
     callback_x6041_statusword callbacks_x6041_statusword[RobotConstants::Robot::AXES_COUNT + 1] = {nullptr};                           // index 0 is unused
     callback_heartbeat callbacks_heartbeat = nullptr;
+    callback_emcy callbacks_emcy = nullptr;
+
+    DispatchStats dispatchStats = {};
+
+    // Function codes read() has handlers for, bit (COB-ID >> 7); drives the RX acceptance filters
+    uint16_t rxFunctions = 0;
+    bool rxFiltersActive = false;
+    void consumeFunction(uint32_t functionCode);
 
 public:
-    CanOpen() : Can(PA11, PA12, RX_SIZE_128, TX_SIZE_128) {};
+    explicit CanOpen(CanDriver &driver) : driver(driver), txScheduler(driver) {};
     bool startCan(uint32_t baudRate);
 
     bool send_x260A_electronicGearMolecules(uint8_t nodeId, uint16_t value);
     bool send_x60FF_targetVelocity(uint8_t nodeId, int32_t value);
     bool send_x6083_profileAcceleration(uint8_t nodeId, uint32_t value);
     bool send_x6081_profileVelocity(uint8_t nodeId, uint32_t value);
-    bool send_x6040_controlword(uint8_t nodeId, uint16_t value);
+    bool send_x6040_controlword(uint8_t nodeId, uint16_t value, CanTxClass txClass = CAN_TX_CLASS_SDO);
     bool send_x6060_modesOfOperation(uint8_t nodeId, uint8_t value);
     bool send_x607A_targetPosition(uint8_t nodeId, int32_t value);
 
-    bool sendSDOWrite(uint8_t nodeId, uint8_t dataLen, uint16_t index, uint8_t subindex, const void *data);
-    bool sendSDORead(uint8_t nodeId, uint16_t index, uint8_t subindex);
+    bool sendSDOWrite(uint8_t nodeId, uint8_t dataLen, uint16_t index, uint8_t subindex, const void *data, CanTxClass txClass = CAN_TX_CLASS_SDO);
+    bool sendSDORead(uint8_t nodeId, uint16_t index, uint8_t subindex, CanTxClass txClass = CAN_TX_CLASS_SDO);
     bool sendPDO4_x607A_SyncMovement(uint8_t nodeId, int32_t targetPositionAbsolute);
+    // RPDO4 mapped to 0x607A + 0x6040 (see configureRPDO4): target and new-set-point edge in one frame
+    bool sendPDO4_x607A_x6040_SyncMovement(uint8_t nodeId, int32_t targetPositionAbsolute, uint16_t controlword);
+    // Remaps RPDO4 of the drive to 0x607A (+ 0x6040 with mapControlword) and sets its transmission
+    // type (PDO_TRANSMISSION_SYNC: applied on the next SYNC). SDO writes, not confirmed
+    bool configureRPDO4(uint8_t nodeId, bool mapControlword, uint8_t transmissionType);
+    // RPDO3 mapped to 0x60FF alone, applied on reception (see configureRPDO3): one frame per jog update
+    bool sendPDO3_x60FF_TargetVelocity(uint8_t nodeId, int32_t targetVelocity);
+    // Remaps RPDO3 of the drive to 0x60FF (the default mapping also carries 0x6040 and 0x6060).
+    // SDO writes, not confirmed
+    bool configureRPDO3(uint8_t nodeId);
+    // Maps TPDO1 of the drive to 0x6041, sent on every change and every eventTimerMs (0: on change only).
+    // Received statuswords go to the 0x6041 callback, like SDO reads of it. SDO writes, not confirmed
+    bool configureTPDO1(uint8_t nodeId, uint16_t eventTimerMs);
     bool sendSYNC();
+    // NMT command to one node, or to all with RobotConstants::CANOpen::NMT_ALL_NODES (one frame, urgent class)
+    bool sendNMT(uint8_t command, uint8_t nodeId);
+
+    // Off: send() returns as soon as the frame is queued, without the 1 ms pause after each frame
+    // (cyclic streaming, where a whole cycle has to go out within the period)
+    void setTxPacing(bool enabled) { txPacing = enabled; }
 
     void set_callback_x260A_electronicGearMolecules(callback_x260A_electronicGearMolecules callback, uint8_t nodeId)
     {
         callbacks_x260A_electronicGearMolecules[nodeId] = callback;
+        consumeFunction(callback ? RobotConstants::CANOpen::COB_ID_SDO_CLIENT_BASE : 0);
     }
 
     void set_callback_x6040_controlword(callback_x6040_controlword callback, uint8_t nodeId)
     {
         callbacks_x6040_controlword[nodeId] = callback;
+        consumeFunction(callback ? RobotConstants::CANOpen::COB_ID_SDO_CLIENT_BASE : 0);
     }
 
     void set_callback_x6060_modesOfOperation(callback_x6060_modesOfOperation callback, uint8_t nodeId)
     {
         callbacks_x6060_modesOfOperation[nodeId] = callback;
+        consumeFunction(callback ? RobotConstants::CANOpen::COB_ID_SDO_CLIENT_BASE : 0);
     }
 
     void set_callback_x6064_positionActualValue(callback_x6064_positionActualValue callback, uint8_t nodeId)
     {
         callbacks_x6064_positionActualValue[nodeId] = callback;
+        consumeFunction(callback ? RobotConstants::CANOpen::COB_ID_SDO_CLIENT_BASE : 0);
     }
 
     void set_callback_x607A_targetPosition(callback_x607A_targetPosition callback, uint8_t nodeId)
     {
         callbacks_x607A_targetPosition[nodeId] = callback;
+        consumeFunction(callback ? RobotConstants::CANOpen::COB_ID_SDO_CLIENT_BASE : 0);
     }
 
+    // SDO reads of 0x6041 and TPDO1 (configureTPDO1)
     void set_callback_x6041_statusword(callback_x6041_statusword callback, uint8_t nodeId)
     {
         callbacks_x6041_statusword[nodeId] = callback;
+        consumeFunction(callback ? RobotConstants::CANOpen::COB_ID_SDO_CLIENT_BASE : 0);
+        consumeFunction(callback ? RobotConstants::CANOpen::COB_ID_TPDO1_BASE : 0);
     }
 
     void set_callback_heartbeat(callback_heartbeat callback)
     {
         callbacks_heartbeat = callback;
+        consumeFunction(callback ? RobotConstants::CANOpen::COB_ID_HEARTBEAT_BASE : 0);
+    }
+
+    // Dispatched before anything else in read(), from the frame's own pass
+    void set_callback_emcy(callback_emcy callback)
+    {
+        callbacks_emcy = callback;
+        consumeFunction(callback ? RobotConstants::CANOpen::COB_ID_EMCY_BASE : 0);
     }
 
     bool read();
+
+    // Reception time of the frame read() is dispatching (valid inside the callbacks)
+    uint32_t lastRxTimestampUs() const { return CAN_RX_msg.timestampUs; }
+
+    // Programs the driver's acceptance filters with the COB-IDs read() consumes: the function codes
+    // that have handlers, for nodes 1..AXES_COUNT. Called by startCan and whenever a handler for a
+    // new function code is registered. False if the driver cannot filter (everything arrives)
+    bool applyRxFilters();
+    // Filters for the consumed COB-IDs as aligned id/mask blocks; returns the count
+    uint8_t rxFilters(CanRxFilter *filters, uint8_t maxCount) const;
+    bool rxFiltering() const { return rxFiltersActive; }
+
+    CanTxScheduler &getTxScheduler() { return txScheduler; }
+
+    const DispatchStats &getDispatchStats() const { return dispatchStats; }
+    void resetDispatchStats() { dispatchStats = DispatchStats(); }
 };
 
 #endif
\ No newline at end of file
@@ -2,6 +2,8 @@
 
 #include "MoveControllerBase.h"
 #include "Axis.h"
+#include "CspStreamer.h"
 
 using Axis = StepDirController::Axis;
-using MoveController = StepDirController::MoveControllerBase;
\ No newline at end of file
+using MoveController = StepDirController::MoveControllerBase;
+using CspStreamer = StepDirController::CspStreamer;
\ No newline at end of file
@@ -0,0 +1,164 @@
+#include "CanTrace.h"
+
+#if CAN_TRACE_ENABLED
+
+#include <string.h>
+#include "RobotConstants.h"
+
+namespace CanTrace
+{
+    namespace
+    {
+        CanTraceRecord ring[CAN_TRACE_RING_SIZE];
+        size_t ringHead = 0;  // Next slot to write
+        size_t ringCount = 0; // Records waiting to be drained
+        uint32_t dropped = 0;
+
+        uint32_t armedMask = 0;
+        uint32_t firedSource = 0;
+        bool pendingTriggerFlag = false; // Mark the next stored record (trigger fired between frames)
+        uint32_t postTriggerLeft = 0;
+        bool isFrozen = false;
+
+        uint32_t frameTriggerSource(uint32_t id, uint8_t len, const uint8_t *data, bool tx)
+        {
+            if (tx)
+            {
+                return 0;
+            }
+            const uint32_t functionCode = id & 0x780;
+            const uint32_t nodeId = id & 0x7F;
+            if (functionCode == RobotConstants::CANOpen::COB_ID_SDO_CLIENT_BASE && len > 0 && data[0] == 0x80)
+            {
+                return CAN_TRACE_TRIGGER_SDO_ABORT;
+            }
+            if (functionCode == RobotConstants::CANOpen::COB_ID_SYNC && nodeId != 0) // 0x081..0x0FF
+            {
+                return CAN_TRACE_TRIGGER_EMCY;
+            }
+            return 0;
+        }
+
+        void fire(uint32_t source)
+        {
+            firedSource = source;
+            pendingTriggerFlag = true;
+            postTriggerLeft = (source == CAN_TRACE_TRIGGER_MANUAL) ? 0 : CAN_TRACE_POST_TRIGGER;
+            isFrozen = postTriggerLeft == 0;
+        }
+    }
+
+    void record(uint32_t timestampUs, uint32_t id, bool extended, bool remote, uint8_t len, const uint8_t *data, bool tx)
+    {
+        if (isFrozen)
+        {
+            dropped++;
+            return;
+        }
+
+        const uint32_t source = frameTriggerSource(id, len, data, tx);
+        if ((source & armedMask) != 0 && firedSource == 0)
+        {
+            fire(source);
+            isFrozen = false; // This frame is stored even if nothing follows it
+        }
+
+        CanTraceRecord &slot = ring[ringHead];
+        slot.timestampUs = timestampUs;
+        slot.id = id;
+        slot.flags = (tx ? CAN_TRACE_FLAG_TX : 0) | (extended ? CAN_TRACE_FLAG_EXTENDED : 0) | (remote ? CAN_TRACE_FLAG_REMOTE : 0);
+        if (pendingTriggerFlag)
+        {
+            slot.flags |= CAN_TRACE_FLAG_TRIGGER;
+            pendingTriggerFlag = false;
+        }
+        slot.len = len > 8 ? 8 : len;
+        memcpy(slot.data, data, slot.len);
+
+        ringHead = (ringHead + 1) % CAN_TRACE_RING_SIZE;
+        if (ringCount < CAN_TRACE_RING_SIZE)
+        {
+            ringCount++;
+        }
+        else
+        {
+            dropped++; // Oldest record was overwritten
+        }
+
+        if (firedSource != 0 && !isFrozen)
+        {
+            if (postTriggerLeft == 0)
+            {
+                isFrozen = true;
+            }
+            else
+            {
+                postTriggerLeft--;
+            }
+        }
+    }
+
+    void trigger(uint32_t source)
+    {
+        if ((source & armedMask) != 0 && firedSource == 0)
+        {
+            fire(source);
+        }
+    }
+
+    void arm(uint32_t triggerMask)
+    {
+        armedMask = triggerMask;
+        firedSource = 0;
+        pendingTriggerFlag = false;
+        postTriggerLeft = 0;
+        isFrozen = false;
+    }
+
+    void clear()
+    {
+        ringHead = 0;
+        ringCount = 0;
+        dropped = 0;
+        arm(armedMask);
+    }
+
+    bool drain(CanTraceRecord &out)
+    {
+        if (ringCount == 0)
+        {
+            return false;
+        }
+        const size_t tail = (ringHead + CAN_TRACE_RING_SIZE - ringCount) % CAN_TRACE_RING_SIZE;
+        out = ring[tail];
+        ringCount--;
+        return true;
+    }
+
+    size_t count()
+    {
+        return ringCount;
+    }
+
+    uint32_t droppedRecords()
+    {
+        return dropped;
+    }
+
+    uint32_t triggerMask()
+    {
+        return armedMask;
+    }
+
+    uint32_t triggerSource()
+    {
+        return firedSource;
+    }
+
+    bool frozen()
+    {
+        return isFrozen;
+    }
+}
+
+#endif // CAN_TRACE_ENABLED
@@ -0,0 +1,76 @@
+#pragma once
+#ifndef CAN_TRACE_H
+#define CAN_TRACE_H
+
+// CAN frame trace ring shared by the firmware and the host converter.
+// Must not depend on Arduino.h: host/tools/cantrace_convert compiles it as plain C++.
+
+#include <stddef.h>
+#include <stdint.h>
+#include "DebugConfig.h"
+
+#ifndef CAN_TRACE_ENABLED
+#define CAN_TRACE_ENABLED 0
+#endif
+
+#ifndef CAN_TRACE_RING_SIZE
+#define CAN_TRACE_RING_SIZE 128u // 20 bytes per frame
+#endif
+
+#ifndef CAN_TRACE_POST_TRIGGER
+#define CAN_TRACE_POST_TRIGGER (CAN_TRACE_RING_SIZE / 4) // Frames kept after the trigger before the ring freezes
+#endif
+
+// CanTraceRecord::flags
+#define CAN_TRACE_FLAG_TX (1u << 0)
+#define CAN_TRACE_FLAG_EXTENDED (1u << 1)
+#define CAN_TRACE_FLAG_REMOTE (1u << 2)
+#define CAN_TRACE_FLAG_TRIGGER (1u << 3) // The frame (or the error right before it) that fired the trigger
+
+// Trigger sources, combined into the mask set with the CTRT command
+#define CAN_TRACE_TRIGGER_SDO_ABORT (1u << 0) // SDO abort received from a drive
+#define CAN_TRACE_TRIGGER_EMCY (1u << 1)      // EMCY frame received
+#define CAN_TRACE_TRIGGER_ERROR (1u << 2)     // Any DBG_ERROR / DBG_ERROR_MSG in the firmware
+#define CAN_TRACE_TRIGGER_MANUAL (1u << 3)    // CTRF
+
+struct CanTraceRecord
+{
+    uint32_t timestampUs;
+    uint32_t id;
+    uint8_t flags;
+    uint8_t len;
+    uint8_t data[8];
+    uint16_t reserved;
+};
+
+// Flight recorder for the bus.
+//
+// CanOpen records every frame it sends and receives; with no trigger armed the ring keeps the
+// last CAN_TRACE_RING_SIZE frames. When an armed trigger fires, CAN_TRACE_POST_TRIGGER more
+// frames are kept and the ring freezes, so it holds what led up to the fault and what followed.
+// Recording is a copy into the ring, nothing is formatted on the MCU until the CTR command
+// streams the ring out. Called from loop() only.
+namespace CanTrace
+{
+#if CAN_TRACE_ENABLED
+    void record(uint32_t timestampUs, uint32_t id, bool extended, bool remote, uint8_t len, const uint8_t *data, bool tx);
+    void trigger(uint32_t source); // Ignored unless the source is in the armed mask
+
+    void arm(uint32_t triggerMask); // Unfreezes; 0 = free running
+    void clear();                   // Drops all records and re-arms with the current mask
+
+    // Removes the oldest record. Returns false when the ring is empty
+    bool drain(CanTraceRecord &out);
+
+    size_t count();
+    uint32_t droppedRecords(); // Overwritten before being drained, or not stored while frozen
+    uint32_t triggerMask();
+    uint32_t triggerSource(); // Source that fired, 0 if none yet
+    bool frozen();
+#else
+    inline void record(uint32_t, uint32_t, bool, bool, uint8_t, const uint8_t *, bool) {}
+    inline void trigger(uint32_t) {}
+#endif
+}
+
+#endif // CAN_TRACE_H
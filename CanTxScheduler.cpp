@@ -0,0 +1,311 @@
+#include "CanTxScheduler.h"
+#include "Arduino.h"
+#include "BusLoad.h"
+#include "CanTrace.h"
+
+CanTxClass CanTxScheduler::classify(uint32_t id)
+{
+    const uint32_t functionCode = id & 0x780;
+    if (id == RobotConstants::CANOpen::COB_ID_NMT || (functionCode == RobotConstants::CANOpen::COB_ID_EMCY_BASE && id != RobotConstants::CANOpen::COB_ID_SYNC))
+    {
+        return CAN_TX_CLASS_URGENT;
+    }
+    if (id == RobotConstants::CANOpen::COB_ID_SYNC)
+    {
+        return CAN_TX_CLASS_SYNC;
+    }
+    if (functionCode >= 0x200 && functionCode <= RobotConstants::CANOpen::COB_ID_RPDO4_BASE)
+    {
+        return CAN_TX_CLASS_PDO; // RPDO 1..4
+    }
+    if (functionCode == RobotConstants::CANOpen::COB_ID_SDO_SERVER_BASE)
+    {
+        return CAN_TX_CLASS_SDO;
+    }
+    return CAN_TX_CLASS_DIAG;
+}
+
+bool CanTxScheduler::enqueue(const CanFrame &frame, CanTxClass txClass)
+{
+    Queue &queue = queues[txClass];
+    if (queue.count + queue.reserved == queue.size)
+    {
+        statistics[txClass].dropped++;
+        return false;
+    }
+    Entry &entry = queue.entries[(queue.head + queue.count) % queue.size];
+    entry.frame = frame;
+    entry.queuedUs = micros();
+    entry.sequence = nextSequence++;
+    entry.recorded = false;
+    queue.count++;
+    if (queue.count > statistics[txClass].maxDepth)
+    {
+        statistics[txClass].maxDepth = queue.count;
+    }
+    return true;
+}
+
+void CanTxScheduler::pump()
+{
+    CanTxClass txClass;
+    const uint8_t mailboxes = driver.txMailboxCount();
+    if (mailboxes == 0)
+    {
+        while (nextClass(txClass))
+        {
+            Queue &queue = queues[txClass];
+            Entry &entry = queue.entries[queue.head];
+            if (!driver.write(entry.frame))
+            {
+                return; // Driver queue full, retried on the next pump
+            }
+            loaded(entry, txClass);
+            queue.head = (queue.head + 1) % queue.size;
+            queue.count--;
+        }
+        return;
+    }
+
+    for (uint8_t i = 0; i < mailboxes && i < RobotConstants::CanTx::MAX_MAILBOXES; ++i)
+    {
+        settle(i);
+    }
+
+    while (nextClass(txClass))
+    {
+        int8_t mailbox = driver.freeTxMailbox();
+        if (mailbox < 0)
+        {
+            if (!prioritized || !preempt(txClass))
+            {
+                return;
+            }
+            mailbox = driver.freeTxMailbox();
+            if (mailbox < 0)
+            {
+                return; // Taken back on a later pass, or it goes out first
+            }
+        }
+        if (mailbox < RobotConstants::CanTx::MAX_MAILBOXES)
+        {
+            settle(mailbox); // Emptied since the pass above: read its outcome before the write clears it
+        }
+
+        Queue &queue = queues[txClass];
+        Entry &entry = queue.entries[queue.head];
+        if (!driver.write(entry.frame))
+        {
+            return;
+        }
+        const uint32_t latencyUs = loaded(entry, txClass);
+        if (mailbox < RobotConstants::CanTx::MAX_MAILBOXES)
+        {
+            inFlight[mailbox].valid = true;
+            inFlight[mailbox].txClass = txClass;
+            inFlight[mailbox].latencyUs = latencyUs;
+            inFlight[mailbox].abortRequested = false;
+            inFlight[mailbox].entry = entry;
+        }
+        queue.head = (queue.head + 1) % queue.size;
+        queue.count--;
+    }
+}
+
+bool CanTxScheduler::idle() const
+{
+    for (uint8_t i = 0; i < CAN_TX_CLASS_COUNT; ++i)
+    {
+        if (queues[i].count > 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint8_t CanTxScheduler::flush(CanTxClass txClass)
+{
+    Queue &queue = queues[txClass];
+    uint8_t dropped = queue.count;
+    queue.head = 0;
+    queue.count = 0;
+    for (uint8_t i = 0; i < driver.txMailboxCount() && i < RobotConstants::CanTx::MAX_MAILBOXES; ++i)
+    {
+        InFlight &slot = inFlight[i];
+        if (!slot.valid || slot.txClass != txClass)
+        {
+            continue;
+        }
+        if (slot.abortRequested)
+        {
+            if (slot.requeue)
+            {
+                slot.requeue = false; // Preempted already: dropped instead of going back to the queue
+                queue.reserved--;
+                dropped++;
+            }
+        }
+        else if (driver.abortTxMailbox(i))
+        {
+            slot.abortRequested = true;
+            slot.requeue = false;
+            dropped++;
+        }
+    }
+    return dropped;
+}
+
+void CanTxScheduler::resetStats()
+{
+    for (uint8_t i = 0; i < CAN_TX_CLASS_COUNT; ++i)
+    {
+        statistics[i] = ClassStats();
+    }
+    preemptionCount = 0;
+}
+
+const char *CanTxScheduler::className(CanTxClass txClass)
+{
+    switch (txClass)
+    {
+    case CAN_TX_CLASS_URGENT:
+        return "URGENT";
+    case CAN_TX_CLASS_SYNC:
+        return "SYNC";
+    case CAN_TX_CLASS_PDO:
+        return "PDO";
+    case CAN_TX_CLASS_SDO:
+        return "SDO";
+    case CAN_TX_CLASS_DIAG:
+        return "DIAG";
+    default:
+        return "?";
+    }
+}
+
+bool CanTxScheduler::nextClass(CanTxClass &txClass) const
+{
+    bool found = false;
+    for (uint8_t i = 0; i < CAN_TX_CLASS_COUNT; ++i)
+    {
+        const Queue &queue = queues[i];
+        if (queue.count == 0 || idInFlight(queue.entries[queue.head].frame))
+        {
+            continue; // Empty, or its head has to wait for the frame with its COB-ID to go out
+        }
+        if (prioritized)
+        {
+            txClass = static_cast<CanTxClass>(i);
+            return true;
+        }
+        // FIFO: the oldest head over all classes (sequence numbers wrap)
+        const uint16_t sequence = queue.entries[queue.head].sequence;
+        if (!found || static_cast<int16_t>(sequence - queues[txClass].entries[queues[txClass].head].sequence) < 0)
+        {
+            txClass = static_cast<CanTxClass>(i);
+            found = true;
+        }
+    }
+    return found;
+}
+
+bool CanTxScheduler::idInFlight(const CanFrame &frame) const
+{
+    for (uint8_t i = 0; i < RobotConstants::CanTx::MAX_MAILBOXES; ++i)
+    {
+        if (inFlight[i].valid && inFlight[i].entry.frame.id == frame.id && inFlight[i].entry.frame.extended == frame.extended)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CanTxScheduler::preempt(CanTxClass waiting)
+{
+    if (waiting > CAN_TX_CLASS_PDO)
+    {
+        return false; // SDOs and diagnostics wait their turn
+    }
+
+    // Victim: an SDO or diagnostic frame, lowest class first, whose queue can take it back.
+    // One abort at a time: a mailbox that is still being taken back frees one soon
+    int8_t victim = -1;
+    for (uint8_t i = 0; i < driver.txMailboxCount() && i < RobotConstants::CanTx::MAX_MAILBOXES; ++i)
+    {
+        const InFlight &slot = inFlight[i];
+        if (slot.valid && slot.abortRequested)
+        {
+            return false;
+        }
+        const Queue &queue = queues[slot.txClass];
+        if (!slot.valid || slot.txClass < CAN_TX_CLASS_SDO || queue.count + queue.reserved == queue.size)
+        {
+            continue;
+        }
+        if (victim < 0 || slot.txClass > inFlight[victim].txClass ||
+            (slot.txClass == inFlight[victim].txClass && static_cast<int16_t>(slot.entry.sequence - inFlight[victim].entry.sequence) > 0))
+        {
+            victim = static_cast<int8_t>(i); // Of equal classes the newer one goes back, so the queue order holds
+        }
+    }
+    if (victim < 0 || !driver.abortTxMailbox(victim))
+    {
+        return false; // Nothing to take back, or it went out meanwhile
+    }
+    InFlight &slot = inFlight[victim];
+    slot.abortRequested = true;
+    slot.requeue = true;
+    queues[slot.txClass].reserved++; // Its place at the head of the queue
+    return true;
+}
+
+void CanTxScheduler::settle(uint8_t mailbox)
+{
+    InFlight &slot = inFlight[mailbox];
+    if (!slot.valid || driver.txMailboxBusy(mailbox))
+    {
+        return;
+    }
+    slot.valid = false;
+    if (!slot.abortRequested)
+    {
+        return; // Sent
+    }
+    Queue &queue = queues[slot.txClass];
+    if (slot.requeue)
+    {
+        queue.reserved--;
+    }
+    if (!slot.requeue || !driver.txMailboxAborted(mailbox))
+    {
+        return; // Flushed, or it went out before the abort took effect
+    }
+
+    queue.head = (queue.head + queue.size - 1) % queue.size;
+    queue.entries[queue.head] = slot.entry;
+    queue.count++;
+    ClassStats &stats = statistics[slot.txClass];
+    stats.preempted++;
+    stats.frames--; // Counted again, with its full latency, when it is loaded for good
+    stats.totalLatencyUs -= slot.latencyUs;
+    preemptionCount++;
+}
+
+uint32_t CanTxScheduler::loaded(Entry &entry, CanTxClass txClass)
+{
+    ClassStats &stats = statistics[txClass];
+    const uint32_t nowUs = micros();
+    const uint32_t latencyUs = nowUs - entry.queuedUs;
+    stats.frames++;
+    stats.totalLatencyUs += latencyUs;
+    stats.maxLatencyUs = latencyUs > stats.maxLatencyUs ? latencyUs : stats.maxLatencyUs;
+    if (!entry.recorded)
+    {
+        BusLoad::recordFrame(entry.frame);
+        CanTrace::record(nowUs, entry.frame.id, entry.frame.extended, entry.frame.remote, entry.frame.len, entry.frame.buf, true);
+        entry.recorded = true;
+    }
+    return latencyUs;
+}
@@ -0,0 +1,124 @@
+#pragma once
+#ifndef CAN_TX_SCHEDULER_H
+#define CAN_TX_SCHEDULER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "CanDriver.h"
+#include "RobotConstants.h"
+
+// Transmit class of a frame, highest priority first
+enum CanTxClass : uint8_t
+{
+    CAN_TX_CLASS_URGENT = 0, // NMT, EMCY, stop commands
+    CAN_TX_CLASS_SYNC,
+    CAN_TX_CLASS_PDO,  // Real-time RPDO setpoints
+    CAN_TX_CLASS_SDO,  // Configuration and motion SDOs
+    CAN_TX_CLASS_DIAG, // Position polls and other background reads
+    CAN_TX_CLASS_COUNT
+};
+
+// Priority-aware transmit path between CanOpen and the CAN driver.
+//
+// Every class has its own FIFO. pump() loads free hardware mailboxes from the highest class
+// that has a frame waiting; if an urgent, SYNC or PDO frame waits while all mailboxes are busy,
+// an abort is requested for the mailbox holding the lowest SDO/diagnostic frame. The abort is not
+// waited for: once the mailbox is empty, pump() puts the frame back at the head of its queue if it
+// was taken back, and leaves it counted as sent if it went out first. On the bus, bxCAN (TXFP = 0) and arbitration already favour the lower
+// COB-ID among loaded mailboxes, so what matters is which frames get into the mailboxes. Of equal
+// COB-IDs the lower mailbox number goes first, whatever was loaded first: a frame waits at the head
+// of its queue while a mailbox still holds one with its COB-ID, so frames to one object keep their order.
+// Drivers without mailboxes take the frames in class order for as long as they accept them.
+//
+// With prioritization off, frames go out in the order they were queued (one FIFO, as the
+// library's TX buffer used to), which is what the latency numbers compare against.
+class CanTxScheduler
+{
+public:
+    struct ClassStats
+    {
+        uint32_t frames;         // Handed to the driver
+        uint32_t dropped;        // Queue full
+        uint32_t preempted;      // Taken back out of a mailbox for a more urgent frame
+        uint8_t maxDepth;        // Queue high-water mark
+        uint32_t maxLatencyUs;   // Queued -> loaded into a mailbox (for the last time, if preempted)
+        uint64_t totalLatencyUs;
+    };
+
+    explicit CanTxScheduler(CanDriver &driver) : driver(driver) {}
+
+    static CanTxClass classify(uint32_t id); // By COB-ID, for frames sent without an explicit class
+
+    bool enqueue(const CanFrame &frame, CanTxClass txClass); // False if the class queue is full
+    void pump();                                             // Call after queueing and on every loop() pass
+    bool idle() const;                                       // Nothing queued
+    // Drops what the class has queued and requests aborts for the mailboxes holding its frames, so
+    // the ones not on the wire yet never go out (abort: no set point may follow the stop). Returns
+    // the frames dropped and the aborts requested
+    uint8_t flush(CanTxClass txClass);
+
+    void setPrioritized(bool enabled) { prioritized = enabled; }
+    bool isPrioritized() const { return prioritized; }
+    uint32_t preemptions() const { return preemptionCount; }
+
+    const ClassStats &classStats(CanTxClass txClass) const { return statistics[txClass]; }
+    uint8_t depth(CanTxClass txClass) const { return queues[txClass].count; }
+    void resetStats();
+    static const char *className(CanTxClass txClass);
+
+private:
+    struct Entry
+    {
+        CanFrame frame;
+        uint32_t queuedUs;
+        uint16_t sequence; // Queue order across classes (FIFO mode)
+        bool recorded;     // Already counted in BusLoad/CanTrace (preempted frames are not counted twice)
+    };
+
+    struct Queue
+    {
+        Entry *entries;
+        uint8_t size;
+        uint8_t head;
+        uint8_t count;
+        uint8_t reserved; // Room kept for frames whose preemption is not settled yet
+    };
+
+    struct InFlight
+    {
+        bool valid;
+        CanTxClass txClass;
+        uint32_t latencyUs; // Taken back out of the statistics if the frame is preempted
+        bool abortRequested;
+        bool requeue;       // Aborted for a more urgent frame (not flushed): back to its queue once taken back
+        Entry entry;
+    };
+
+    CanDriver &driver;
+    bool prioritized = true;
+    uint16_t nextSequence = 0;
+    uint32_t preemptionCount = 0;
+
+    Entry urgentEntries[RobotConstants::CanTx::QUEUE_URGENT];
+    Entry syncEntries[RobotConstants::CanTx::QUEUE_SYNC];
+    Entry pdoEntries[RobotConstants::CanTx::QUEUE_PDO];
+    Entry sdoEntries[RobotConstants::CanTx::QUEUE_SDO];
+    Entry diagEntries[RobotConstants::CanTx::QUEUE_DIAG];
+    Queue queues[CAN_TX_CLASS_COUNT] = {
+        {urgentEntries, RobotConstants::CanTx::QUEUE_URGENT, 0, 0, 0},
+        {syncEntries, RobotConstants::CanTx::QUEUE_SYNC, 0, 0, 0},
+        {pdoEntries, RobotConstants::CanTx::QUEUE_PDO, 0, 0, 0},
+        {sdoEntries, RobotConstants::CanTx::QUEUE_SDO, 0, 0, 0},
+        {diagEntries, RobotConstants::CanTx::QUEUE_DIAG, 0, 0, 0},
+    };
+    InFlight inFlight[RobotConstants::CanTx::MAX_MAILBOXES] = {};
+    ClassStats statistics[CAN_TX_CLASS_COUNT] = {};
+
+    bool nextClass(CanTxClass &txClass) const; // Class whose head goes out next
+    bool idInFlight(const CanFrame &frame) const; // A mailbox still holds a frame with its COB-ID
+    bool preempt(CanTxClass waiting);          // True if an abort was requested
+    void settle(uint8_t mailbox);              // Mailbox no longer busy: its frame sent, or taken back
+    uint32_t loaded(Entry &entry, CanTxClass txClass); // Returns the frame's queue latency
+};
+
+#endif // CAN_TX_SCHEDULER_H
@@ -0,0 +1,554 @@
+#include <cmath>
+#include "CspStreamer.h"
+#include "BusLoad.h"
+#include "Debug.h"
+
+namespace StepDirController
+{
+    bool CspStreamer::begin(CanOpen *canOpen, MoveControllerBase *controller, uint32_t periodUs)
+    {
+        if (canOpen == nullptr || controller == nullptr || controller->getAxesCount() == 0 || isMoving() || controller->isJogActive())
+        {
+            return false;
+        }
+        if (periodUs < RobotConstants::Csp::MIN_PERIOD_US || RobotConstants::Csp::MAX_PERIOD_US < periodUs)
+        {
+            return false;
+        }
+        if (timer != nullptr)
+        {
+            timer->pause();
+        }
+        this->canOpen = canOpen;
+        this->controller = controller;
+        this->periodUs = periodUs;
+
+        bool ok = true;
+        if (!active)
+        {
+            for (uint8_t nodeId = 1; nodeId <= controller->getAxesCount(); ++nodeId)
+            {
+                ok = canOpen->configureRPDO4(nodeId, false, RobotConstants::CANOpen::PDO_TRANSMISSION_SYNC) && ok;
+                ok = canOpen->send_x6060_modesOfOperation(nodeId, RobotConstants::Control::MODE_CYCLIC_SYNC_POSITION) && ok;
+                controller->enableDrive(nodeId);
+                lastSetpoint[nodeId - 1] = controller->axisPosition(nodeId);
+            }
+            if (!ok)
+            {
+                DBG_ERROR(DBG_GROUP_MOVE, "CSP: failed to switch the drives to cyclic synchronous position");
+                return false;
+            }
+        }
+
+        head = 0;
+        count = 0;
+        holdCycles = 0;
+        dropPath();
+        pushRow(lastSetpoint); // The drives' 0x607A has to match where they stand before the first SYNC
+        statistics = Stats();
+        syncSent = false;
+        noInterrupts();
+        pendingTicks = 0;
+        interrupts();
+
+        // A drive that reboots while streaming comes back in CSP, holding the last setpoint sent
+        controller->setNodeConfigurator([this](uint8_t nodeId)
+                                        { return this->configureNode(nodeId); });
+        canOpen->setTxPacing(false);
+        BusLoad::setCyclic(true);
+        if (timer == nullptr)
+        {
+            timer = new HardwareTimer(TIM2);
+        }
+        timer->setOverflow(periodUs, MICROSEC_FORMAT);
+        timer->attachInterrupt([this]()
+                               { this->onTimer(); });
+        timer->resume();
+        active = true;
+        DBG_INFO(DBG_GROUP_MOVE, "CSP started, period " + String(periodUs) + " us");
+        return true;
+    }
+
+    void CspStreamer::end()
+    {
+        if (!active)
+        {
+            return;
+        }
+        timer->pause();
+        active = false;
+        dropPath();
+        count = 0;
+        canOpen->setTxPacing(true);
+        BusLoad::setCyclic(false);
+        controller->setNodeConfigurator(nullptr);
+
+        for (uint8_t nodeId = 1; nodeId <= controller->getAxesCount(); ++nodeId)
+        {
+            controller->getAxis(nodeId).setCurrentPositionInSteps(lastSetpoint[nodeId - 1]);
+            canOpen->send_x6060_modesOfOperation(nodeId, RobotConstants::Control::DEFAULT_MODE_POSITION);
+        }
+        controller->setStartMode(controller->getStartMode()); // RPDO4 mapping for profile position moves
+        DBG_INFO(DBG_GROUP_MOVE, "CSP stopped");
+    }
+
+    bool CspStreamer::configureNode(uint8_t nodeId)
+    {
+        bool ok = canOpen->configureRPDO4(nodeId, false, RobotConstants::CANOpen::PDO_TRANSMISSION_SYNC);
+        ok = canOpen->send_x6060_modesOfOperation(nodeId, RobotConstants::Control::MODE_CYCLIC_SYNC_POSITION) && ok;
+        if (!controller->isMotionPaused())
+        {
+            controller->enableDrive(nodeId); // From the state its statusword reports once it is operational
+        }
+        return ok;
+    }
+
+    bool CspStreamer::move()
+    {
+        if (!active || controller->isMotionPaused() || waypointCount == RobotConstants::Csp::PATH_QUEUE)
+        {
+            return false;
+        }
+
+        // Queued behind the path: setpoints already in the ring and segments under way go first
+        Waypoint &waypoint = waypoints[(waypointHead + waypointCount) % RobotConstants::Csp::PATH_QUEUE];
+        bool moves = false;
+        for (uint8_t nodeId = 1; nodeId <= controller->getAxesCount(); ++nodeId)
+        {
+            waypoint.target[nodeId - 1] = controller->getAxis(nodeId).getTargetPositionAbsolute();
+            moves = moves || waypoint.target[nodeId - 1] != pathEnd(nodeId);
+        }
+        if (!moves)
+        {
+            return true; // Already there
+        }
+
+        waypoint.speedUnits = controller->getRegularSpeedUnits();
+        waypoint.accelerationUnits = controller->getAccelerationUnits();
+        if (waypoint.speedUnits <= 0 || waypoint.accelerationUnits <= 0)
+        {
+            return false;
+        }
+        if (!planning)
+        {
+            // The mode is re-sent with every path, as profile position moves do, and a drive that is not
+            // enabled is enabled: one that missed them at begin() joins in again
+            for (uint8_t nodeId = 1; nodeId <= controller->getAxesCount(); ++nodeId)
+            {
+                canOpen->send_x6060_modesOfOperation(nodeId, RobotConstants::Control::MODE_CYCLIC_SYNC_POSITION);
+                controller->enableDrive(nodeId);
+            }
+            plannedCycles = 0;
+            for (uint8_t i = 0; i < controller->getAxesCount(); ++i)
+            {
+                plannedHistory[0][i] = lastQueued[i]; // At rest there
+                plannedHistory[1][i] = lastQueued[i];
+            }
+            planning = true;
+        }
+        waypointCount++;
+        pathStatistics.waypoints++;
+        fillBuffer();
+        return true;
+    }
+
+    int32_t CspStreamer::pathEnd(uint8_t nodeId) const
+    {
+        const uint8_t i = nodeId - 1;
+        if (waypointCount > 0)
+        {
+            return waypoints[(waypointHead + waypointCount - 1) % RobotConstants::Csp::PATH_QUEUE].target[i];
+        }
+        if (segmentCount > 0)
+        {
+            const Segment &last = segments[segmentCount - 1];
+            return last.start[i] + last.delta[i];
+        }
+        return lastQueued[i];
+    }
+
+    void CspStreamer::planSegment(const Waypoint &waypoint, const int32_t *from, Segment &segment) const
+    {
+        double maxMovementUnits = 0;
+        for (uint8_t nodeId = 1; nodeId <= controller->getAxesCount(); ++nodeId)
+        {
+            const uint8_t i = nodeId - 1;
+            segment.start[i] = from[i];
+            segment.delta[i] = waypoint.target[i] - from[i];
+            const double movementUnits = std::fabs(controller->getAxis(nodeId).stepsToUnits(segment.delta[i]));
+            maxMovementUnits = movementUnits > maxMovementUnits ? movementUnits : maxMovementUnits;
+        }
+
+        // Normalized to the longest axis (distance 1); without room for cruising the profile is a triangle
+        double speed = waypoint.speedUnits / maxMovementUnits;
+        const double acceleration = waypoint.accelerationUnits / maxMovementUnits;
+        if (speed * speed / acceleration > 1.0)
+        {
+            segment.accelerationS = std::sqrt(1.0 / acceleration);
+            speed = acceleration * segment.accelerationS;
+            segment.cruiseS = 0;
+        }
+        else
+        {
+            segment.accelerationS = speed / acceleration;
+            segment.cruiseS = (1.0 - speed * segment.accelerationS) / speed;
+        }
+        segment.speed = speed;
+        segment.accelerationUnits = waypoint.accelerationUnits;
+    }
+
+    double CspStreamer::blendOverlapS(const Segment &current, Segment &next, const Waypoint &waypoint) const
+    {
+        // While both ramp, an axis accelerates by the sum of the current deceleration and the next
+        // acceleration: fine when it keeps its direction, up to twice the limit when it reverses. The
+        // sum has to stay within the limit of every segment the axis moves in. A shorter overlap does
+        // not lower it (both still ramp), a gentler next ramp does: each axis bounds the share of the
+        // next acceleration, |share * next - current| <= limit, and the largest share all allow is taken
+        const double currentAcceleration = current.speed / current.accelerationS;
+        const double nextAcceleration = next.speed / next.accelerationS;
+        double lowestShare = 0;
+        double share = 1;
+        for (uint8_t nodeId = 1; nodeId <= controller->getAxesCount(); ++nodeId)
+        {
+            const uint8_t i = nodeId - 1;
+            if (current.delta[i] == 0 && next.delta[i] == 0)
+            {
+                continue;
+            }
+            double limitUnits = current.delta[i] != 0 ? current.accelerationUnits : next.accelerationUnits;
+            if (next.delta[i] != 0 && next.accelerationUnits < limitUnits)
+            {
+                limitUnits = next.accelerationUnits;
+            }
+            limitUnits *= 1.0 + 1e-9;
+            const Axis &axis = controller->getAxis(nodeId);
+            const double currentUnits = currentAcceleration * axis.stepsToUnits(current.delta[i]);
+            const double nextUnits = nextAcceleration * axis.stepsToUnits(next.delta[i]);
+            if (nextUnits == 0)
+            {
+                if (std::fabs(currentUnits) > limitUnits)
+                {
+                    return 0;
+                }
+                continue;
+            }
+            double low = (currentUnits - limitUnits) / nextUnits;
+            double high = (currentUnits + limitUnits) / nextUnits;
+            if (nextUnits < 0)
+            {
+                const double swapped = low;
+                low = high;
+                high = swapped;
+            }
+            lowestShare = low > lowestShare ? low : lowestShare;
+            share = high < share ? high : share;
+        }
+        if (share <= 0 || share < lowestShare)
+        {
+            return 0; // An axis reverses at its full deceleration: no ramp fits
+        }
+
+        if (share < 1)
+        {
+            // Blend only if the slower segment still ends sooner than stopping at the waypoint would
+            Waypoint gentler = waypoint;
+            gentler.accelerationUnits *= share;
+            Segment softened;
+            planSegment(gentler, next.start, softened);
+            softened.accelerationUnits = waypoint.accelerationUnits; // Still the move's limit at the next junction
+            const double overlapS = current.accelerationS < softened.accelerationS ? current.accelerationS : softened.accelerationS;
+            if (overlapS <= segmentTotalS(softened) - segmentTotalS(next))
+            {
+                return 0;
+            }
+            next = softened;
+        }
+        // Overlapping by the shorter ramp keeps every axis within the faster move's speed as well
+        return current.accelerationS < next.accelerationS ? current.accelerationS : next.accelerationS;
+    }
+
+    void CspStreamer::admitSegment(double plannedS)
+    {
+        Segment &segment = segments[segmentCount];
+        const Waypoint &waypoint = waypoints[waypointHead];
+        if (segmentCount == 0)
+        {
+            planSegment(waypoint, lastQueued, segment); // From rest, where the last row left the axes
+            segment.startS = plannedS;
+        }
+        else
+        {
+            const Segment &current = segments[0];
+            int32_t from[RobotConstants::Robot::AXES_COUNT];
+            for (uint8_t i = 0; i < controller->getAxesCount(); ++i)
+            {
+                from[i] = current.start[i] + current.delta[i];
+            }
+            planSegment(waypoint, from, segment);
+
+            const double endS = current.startS + segmentTotalS(current);
+            const double stoppingS = segmentTotalS(segment);
+            const double overlapS = blending ? blendOverlapS(current, segment, waypoint) : 0;
+            segment.startS = endS - overlapS;
+            if (segment.startS < plannedS)
+            {
+                // Rows past the blend start are in the ring already: blend what is left (less than a
+                // cycle is only the rows' sampling)
+                if (segment.startS + periodUs / 1e6 <= plannedS)
+                {
+                    pathStatistics.late++;
+                }
+                segment.startS = plannedS;
+            }
+            if (segment.startS < endS)
+            {
+                pathStatistics.blended++;
+                const double savedS = (endS - segment.startS) - (segmentTotalS(segment) - stoppingS); // Less a gentler ramp's cost
+                pathStatistics.savedUs += savedS > 0 ? static_cast<uint64_t>(savedS * 1e6) : 0;
+                const double middleS = 0.5 * (segment.startS + endS);
+                double fastest = 0;
+                for (uint8_t nodeId = 1; nodeId <= controller->getAxesCount(); ++nodeId)
+                {
+                    const uint8_t i = nodeId - 1;
+                    const double stepsPerS = current.delta[i] * segmentRate(current, middleS - current.startS) +
+                                             segment.delta[i] * segmentRate(segment, middleS - segment.startS);
+                    const double unitsPerS = std::fabs(stepsPerS * controller->getAxis(nodeId).stepsToUnits(1));
+                    fastest = unitsPerS > fastest ? unitsPerS : fastest;
+                }
+                pathStatistics.junctionSpeed = fastest;
+            }
+            else
+            {
+                pathStatistics.stopped++;
+                pathStatistics.junctionSpeed = 0;
+            }
+        }
+        waypointHead = (waypointHead + 1) % RobotConstants::Csp::PATH_QUEUE;
+        waypointCount--;
+        segmentCount++;
+    }
+
+    void CspStreamer::dropPath()
+    {
+        planning = false;
+        segmentCount = 0;
+        waypointHead = 0;
+        waypointCount = 0;
+    }
+
+    void CspStreamer::onTimer()
+    {
+        pendingTicks = pendingTicks + 1;
+        lastTickUs = micros();
+    }
+
+    void CspStreamer::service()
+    {
+        if (!active)
+        {
+            return;
+        }
+
+        noInterrupts();
+        const uint32_t ticks = pendingTicks;
+        const uint32_t tickUs = lastTickUs;
+        pendingTicks = 0;
+        interrupts();
+        if (ticks == 0)
+        {
+            fillBuffer(); // Idle pass: compute ahead
+            return;
+        }
+
+        const uint32_t startUs = micros();
+        statistics.cycles++;
+        if (ticks > 1)
+        {
+            statistics.missedCycles += ticks - 1;
+        }
+        const uint32_t latencyUs = startUs - tickUs;
+        statistics.latencyMinUs = (statistics.cycles == 1 || latencyUs < statistics.latencyMinUs) ? latencyUs : statistics.latencyMinUs;
+        statistics.latencyMaxUs = latencyUs > statistics.latencyMaxUs ? latencyUs : statistics.latencyMaxUs;
+        statistics.latencyTotalUs += latencyUs;
+        if (syncSent && ticks == 1)
+        {
+            const uint32_t intervalUs = startUs - lastSyncUs;
+            const uint32_t deviationUs = intervalUs > periodUs ? intervalUs - periodUs : periodUs - intervalUs;
+            statistics.intervalMaxDeviationUs = deviationUs > statistics.intervalMaxDeviationUs ? deviationUs : statistics.intervalMaxDeviationUs;
+        }
+        lastSyncUs = startUs;
+        syncSent = true;
+
+        // SYNC first: the drives take over the setpoints sent during the previous cycle
+        canOpen->sendSYNC();
+
+        const uint8_t axesCnt = controller->getAxesCount();
+        if (controller->isMotionPaused() && (isMoving() || holdCycles > 0))
+        {
+            // A drive fault quick-stopped the axes: the rest of the path is dropped, the next move
+            // plans from the last setpoint sent
+            dropPath();
+            count = 0;
+            holdCycles = 0;
+            for (uint8_t i = 0; i < axesCnt; ++i)
+            {
+                lastQueued[i] = lastSetpoint[i];
+                controller->getAxis(i + 1).setCurrentPositionInSteps(lastSetpoint[i]);
+            }
+        }
+        if (count > 0)
+        {
+            const int32_t *row = buffer[head];
+            for (uint8_t i = 0; i < axesCnt; ++i)
+            {
+                if (row[i] != lastSetpoint[i])
+                {
+                    controller->keepFeedbackActive(i + 1); // Polled fast while its setpoints change
+                }
+                lastSetpoint[i] = row[i];
+                canOpen->sendPDO4_x607A_SyncMovement(i + 1, row[i]);
+            }
+            head = (head + 1) % RobotConstants::Csp::BUFFER_CYCLES;
+            count--;
+            holdCycles = RobotConstants::Csp::HOLD_CYCLES;
+            if (!isMoving())
+            {
+                for (uint8_t i = 0; i < axesCnt; ++i)
+                {
+                    controller->getAxis(i + 1).setCurrentPositionInSteps(lastSetpoint[i]);
+                }
+            }
+        }
+        else if (planning)
+        {
+            statistics.underruns++;
+            for (uint8_t i = 0; i < axesCnt; ++i)
+            {
+                canOpen->sendPDO4_x607A_SyncMovement(i + 1, lastSetpoint[i]);
+            }
+        }
+        else if (holdCycles > 0)
+        {
+            // Repeat the final setpoints for a while: a drive that missed the last RPDO still gets there
+            holdCycles--;
+            for (uint8_t i = 0; i < axesCnt; ++i)
+            {
+                canOpen->sendPDO4_x607A_SyncMovement(i + 1, lastSetpoint[i]);
+            }
+        }
+        // Standing still: SYNC only, the drives hold the last setpoint
+
+        const uint32_t serviceUs = micros() - startUs;
+        statistics.serviceMaxUs = serviceUs > statistics.serviceMaxUs ? serviceUs : statistics.serviceMaxUs;
+        if (serviceUs > periodUs)
+        {
+            statistics.overruns++;
+        }
+        fillBuffer();
+    }
+
+    double CspStreamer::segmentFraction(const Segment &segment, double t)
+    {
+        const double totalS = segmentTotalS(segment);
+        if (t <= 0)
+        {
+            return 0;
+        }
+        if (t >= totalS)
+        {
+            return 1;
+        }
+        const double acceleration = segment.speed / segment.accelerationS;
+        if (t < segment.accelerationS)
+        {
+            return 0.5 * acceleration * t * t;
+        }
+        if (t < segment.accelerationS + segment.cruiseS)
+        {
+            return 0.5 * segment.speed * segment.accelerationS + segment.speed * (t - segment.accelerationS);
+        }
+        const double remainingS = totalS - t;
+        return 1.0 - 0.5 * acceleration * remainingS * remainingS;
+    }
+
+    double CspStreamer::segmentRate(const Segment &segment, double t)
+    {
+        const double totalS = segmentTotalS(segment);
+        if (t <= 0 || t >= totalS)
+        {
+            return 0;
+        }
+        const double acceleration = segment.speed / segment.accelerationS;
+        if (t < segment.accelerationS)
+        {
+            return acceleration * t;
+        }
+        if (t < segment.accelerationS + segment.cruiseS)
+        {
+            return segment.speed;
+        }
+        return acceleration * (totalS - t);
+    }
+
+    void CspStreamer::fillBuffer()
+    {
+        const uint8_t axesCnt = controller->getAxesCount();
+        const double periodS = periodUs / 1e6;
+        while (planning && count < RobotConstants::Csp::BUFFER_CYCLES)
+        {
+            // Look-ahead: a queued waypoint joins as soon as there is room, so its blend is planned
+            // before the rows of the current segment's deceleration are computed
+            while (segmentCount < 2 && waypointCount > 0)
+            {
+                admitSegment(plannedCycles * periodS);
+            }
+            if (segmentCount == 0)
+            {
+                planning = false;
+                break;
+            }
+
+            plannedCycles++;
+            const double t = plannedCycles * periodS;
+            const Segment &current = segments[0];
+            const double currentFraction = segmentFraction(current, t - current.startS);
+            const double nextFraction = segmentCount > 1 ? segmentFraction(segments[1], t - segments[1].startS) : 0;
+            int32_t row[RobotConstants::Robot::AXES_COUNT];
+            for (uint8_t i = 0; i < axesCnt; ++i)
+            {
+                const double offset = current.delta[i] * currentFraction + (segmentCount > 1 ? segments[1].delta[i] * nextFraction : 0);
+                row[i] = current.start[i] + static_cast<int32_t>(std::lround(offset));
+
+                // Second difference of the planned positions: what a drive following every row goes through
+                const double position = current.start[i] + offset;
+                const double accelerationUnits = std::fabs(controller->getAxis(i + 1).stepsToUnits(1) *
+                                                           (position - 2 * plannedHistory[1][i] + plannedHistory[0][i]) / (periodS * periodS));
+                pathStatistics.peakAcceleration = accelerationUnits > pathStatistics.peakAcceleration ? accelerationUnits : pathStatistics.peakAcceleration;
+                plannedHistory[0][i] = plannedHistory[1][i];
+                plannedHistory[1][i] = position;
+            }
+            pushRow(row);
+            if (t >= current.startS + segmentTotalS(current))
+            {
+                // The next segment, if any, carries on from the waypoint
+                if (segmentCount > 1)
+                {
+                    segments[0] = segments[1];
+                }
+                segmentCount--;
+                planning = segmentCount > 0 || waypointCount > 0;
+            }
+        }
+    }
+
+    void CspStreamer::pushRow(const int32_t *row)
+    {
+        int32_t *slot = buffer[(head + count) % RobotConstants::Csp::BUFFER_CYCLES];
+        for (uint8_t i = 0; i < controller->getAxesCount(); ++i)
+        {
+            slot[i] = row[i];
+            lastQueued[i] = row[i];
+        }
+        count++;
+    }
+}
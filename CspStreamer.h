@@ -0,0 +1,158 @@
+#pragma once
+#ifndef CSP_STREAMER_H
+#define CSP_STREAMER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <Arduino.h>
+#include "CanOpen.h"
+#include "MoveControllerBase.h"
+#include "RobotConstants.h"
+
+namespace StepDirController
+{
+    // Cyclic synchronous position (CSP, mode 8) streaming.
+    //
+    // A hardware timer ticks at the cycle period. Each cycle, service() sends SYNC (the drives
+    // apply the setpoints of the previous cycle) and then one RPDO4 per axis with the next
+    // setpoint from the buffer. move() plans a trapezoid over all axes (same speed/acceleration
+    // rules as profile position: the longest axis sets the time, the others scale), and service()
+    // keeps up to Csp::BUFFER_CYCLES setpoints computed ahead between cycles.
+    //
+    // Moves commanded while one is streaming are queued as waypoints (Csp::PATH_QUEUE). With blending
+    // on, the next segment starts ramping up while the current one ramps down (overlap up to the
+    // shorter of the two ramps), so the arm passes the waypoint without stopping and cuts the corner
+    // by at most the ramp distances. Each segment alone keeps its speed and acceleration, so the sum
+    // stays within the larger of the two moves' speeds. An axis may accelerate by no more than the
+    // smallest limit of the segments it moves in: over it, the next segment ramps up more gently, as
+    // far as that still gains time; a junction where no gentler ramp fits (an axis reversing at its
+    // full deceleration) stops at the waypoint instead.
+    //
+    // The timer interrupt only counts the tick and takes its timestamp: CanOpen, BusLoad and
+    // CanTrace are not interrupt safe, so the frames go out from loop(). Latency is the time
+    // from the tick to the SYNC; a tick that finds the previous one not yet served is a missed
+    // cycle; a cycle whose frames take longer than the period is an overrun.
+    class CspStreamer
+    {
+    public:
+        struct Stats
+        {
+            uint32_t cycles = 0;
+            uint32_t missedCycles = 0; // Ticks not served before the next one
+            uint32_t overruns = 0;     // Serving a cycle took longer than the period
+            uint32_t underruns = 0;    // Moving, but no setpoint computed for the cycle (previous one repeated)
+            uint32_t latencyMinUs = 0; // Timer tick to SYNC queued
+            uint32_t latencyMaxUs = 0;
+            uint64_t latencyTotalUs = 0;
+            uint32_t intervalMaxDeviationUs = 0; // |SYNC to SYNC - period|
+            uint32_t serviceMaxUs = 0;           // SYNC + setpoint frames of one cycle
+        };
+
+        struct PathStats
+        {
+            uint32_t waypoints = 0;    // Moves queued (the first one of a path included)
+            uint32_t blended = 0;      // Junctions passed without stopping
+            uint32_t stopped = 0;      // Junctions stopped at: blending off or over the acceleration limit
+            uint32_t late = 0;         // Waypoint queued after the blend should have started (partial or no blend)
+            uint64_t savedUs = 0;      // Segment overlap: time gained against stopping at every waypoint
+            double junctionSpeed = 0;  // Fastest axis at the middle of the last blend [units/s]
+            double peakAcceleration = 0; // Largest speed change of an axis between planned cycles, before rounding [units/s^2]
+        };
+
+        // Switches every axis to CSP: RPDO4 = 0x607A on SYNC, 0x6060 = 8, drive enabled (MoveControllerBase::enableDrive),
+        // then starts the timer. The first cycle sends the current positions as setpoints.
+        // A drive that reboots meanwhile is configured the same way (MoveControllerBase NMT master)
+        bool begin(CanOpen *canOpen, MoveControllerBase *controller, uint32_t periodUs);
+        // Stops the timer and returns the axes to profile position (RPDO4 as the start mode needs)
+        void end();
+        bool isActive() const { return active; }
+
+        // Streams a move to the axes' targets at the controller's speed/acceleration, from the end of
+        // the path already queued. False when the waypoint queue is full or a drive fault paused
+        // motion (MoveControllerBase::isMotionPaused; the rest of a streaming path is dropped)
+        bool move();
+        bool isMoving() const { return planning || count > 0; }
+        // Where the path queued so far ends [steps]: relative moves queued while streaming start there
+        int32_t pathEnd(uint8_t nodeId) const;
+
+        void setBlending(bool enabled) { blending = enabled; }
+        bool isBlending() const { return blending; }
+        uint8_t queuedWaypoints() const { return waypointCount; }
+        const PathStats &getPathStats() const { return pathStatistics; }
+        void resetPathStats() { pathStatistics = PathStats(); }
+
+        void service(); // Call this on every loop() pass
+        void onTimer(); // Timer update interrupt
+
+        uint32_t getPeriodUs() const { return periodUs; }
+        uint8_t bufferedCycles() const { return count; }
+        const Stats &getStats() const { return statistics; }
+        void resetStats() { statistics = Stats(); }
+
+    private:
+        CanOpen *canOpen = nullptr;
+        MoveControllerBase *controller = nullptr;
+        HardwareTimer *timer = nullptr;
+        bool active = false;
+        uint32_t periodUs = RobotConstants::Csp::DEFAULT_PERIOD_US;
+        Stats statistics;
+
+        volatile uint32_t pendingTicks = 0;
+        volatile uint32_t lastTickUs = 0;
+        uint32_t lastSyncUs = 0;
+        bool syncSent = false;
+
+        // Setpoint ring, one row of axis positions [steps] per cycle
+        int32_t buffer[RobotConstants::Csp::BUFFER_CYCLES][RobotConstants::Robot::AXES_COUNT];
+        uint8_t head = 0; // Next row to send
+        uint8_t count = 0;
+        uint8_t holdCycles = 0; // Cycles left repeating the final row
+        int32_t lastSetpoint[RobotConstants::Robot::AXES_COUNT] = {0}; // Last row sent
+        int32_t lastQueued[RobotConstants::Robot::AXES_COUNT] = {0};   // Last row put into the ring
+
+        // Straight segment between two waypoints: position = start + delta * s(t - startS), s from 0 to 1
+        struct Segment
+        {
+            int32_t start[RobotConstants::Robot::AXES_COUNT];
+            int32_t delta[RobotConstants::Robot::AXES_COUNT];
+            double accelerationS;     // Time to reach cruise speed [s]
+            double cruiseS;           // Time at cruise speed [s]
+            double speed;             // Normalized cruise speed [1/s]
+            double accelerationUnits; // Limit of the move [units/s^2]
+            double startS;            // On the path clock (plannedCycles * period)
+        };
+        struct Waypoint
+        {
+            int32_t target[RobotConstants::Robot::AXES_COUNT];
+            double speedUnits;
+            double accelerationUnits;
+        };
+
+        // Segments being planned: the current one and the next one blending in
+        bool planning = false;
+        Segment segments[2];
+        uint8_t segmentCount = 0;
+        uint32_t plannedCycles = 0; // Rows computed since the path started from rest
+        double plannedHistory[2][RobotConstants::Robot::AXES_COUNT]; // The last two rows before rounding [steps]
+
+        // Waypoints queued behind the segments
+        Waypoint waypoints[RobotConstants::Csp::PATH_QUEUE];
+        uint8_t waypointHead = 0;
+        uint8_t waypointCount = 0;
+        bool blending = true;
+        PathStats pathStatistics;
+
+        static double segmentFraction(const Segment &segment, double t);
+        static double segmentRate(const Segment &segment, double t); // ds/dt [1/s]
+        static double segmentTotalS(const Segment &segment) { return 2 * segment.accelerationS + segment.cruiseS; }
+        void planSegment(const Waypoint &waypoint, const int32_t *from, Segment &segment) const;
+        double blendOverlapS(const Segment &current, Segment &next, const Waypoint &waypoint) const; // May soften next's ramp
+        void admitSegment(double plannedS);
+        void dropPath();
+        void fillBuffer();
+        void pushRow(const int32_t *row);
+        bool configureNode(uint8_t nodeId); // MoveControllerBase node configurator while streaming
+    };
+}
+
+#endif
@@ -1,11 +1,8 @@
 #pragma once
 
 #include "Arduino.h"
-
-#define DBG_LEVEL_ERROR 1u
-#define DBG_LEVEL_WARN 2u
-#define DBG_LEVEL_INFO 3u
-#define DBG_LEVEL_VERBOSE 4u
+#include "DebugRecord.h"
+#include "CanTrace.h"
 
 #define DBG_GROUP_AXIS (1u << 0)
 #define DBG_GROUP_MOVE (1u << 1)
@@ -27,40 +24,65 @@
 #define DEBUG_CONFIG 0u
 #endif
 
-inline uint32_t dbgConfigLevel(uint32_t config)
+#ifndef DBG_DEFERRED
+#define DBG_DEFERRED 0
+#endif
+
+#ifndef DBG_DEFERRED_RING_SIZE
+#define DBG_DEFERRED_RING_SIZE 64u
+#endif
+
+constexpr uint32_t dbgConfigLevel(uint32_t config)
 {
     return (config >> DBG_LEVEL_SHIFT);
 }
 
-inline uint32_t dbgConfigGroups(uint32_t config)
+constexpr uint32_t dbgConfigGroups(uint32_t config)
 {
     return (config & DBG_GROUP_MASK);
 }
 
-inline const char *dbgLevelTag(uint32_t level)
+#ifndef DEBUG_RUNTIME_CONFIG
+#define DEBUG_RUNTIME_CONFIG DEBUG_CONFIG
+#endif
+
+// A filter narrowed to the DEBUG_CONFIG ceiling: nothing above it is compiled in
+constexpr uint32_t dbgClampToCeiling(uint32_t config)
 {
-    switch (level)
-    {
-    case DBG_LEVEL_ERROR:
-        return "ERROR";
-    case DBG_LEVEL_WARN:
-        return "WARN";
-    case DBG_LEVEL_INFO:
-        return "INFO";
-    case DBG_LEVEL_VERBOSE:
-        return "VERBOSE";
-    default:
-        return "DBG";
-    }
+    return DBG_CONFIG(dbgConfigLevel(config) < dbgConfigLevel(DEBUG_CONFIG) ? dbgConfigLevel(config) : dbgConfigLevel(DEBUG_CONFIG),
+                      dbgConfigGroups(config) & dbgConfigGroups(DEBUG_CONFIG));
 }
 
 extern void addDataToOutQueue(String data);
 
-#define DBG_ENABLED(level, group) ((dbgConfigLevel(DEBUG_CONFIG) >= (level)) && ((dbgConfigGroups(DEBUG_CONFIG) & (group)) != 0u))
+// Runtime filter, changed with the DBL command. Starts as DEBUG_RUNTIME_CONFIG (within the ceiling)
+extern uint32_t dbgRuntimeConfig;
+
+// Sets the runtime filter. Levels and groups above the DEBUG_CONFIG ceiling are dropped
+// because their call sites are not compiled in. Returns the effective configuration
+uint32_t dbgSetRuntimeConfig(uint32_t config);
+
+// DEBUG_CONFIG is the compile-time ceiling: call sites outside it fold to nothing.
+// Call sites inside it test the runtime filter first, so the message arguments
+// (String building included) are only evaluated when the message is actually wanted.
+#define DBG_COMPILED(level, group) ((dbgConfigLevel(DEBUG_CONFIG) >= (level)) && ((dbgConfigGroups(DEBUG_CONFIG) & (group)) != 0u))
+#define DBG_RUNTIME_ENABLED(level, group) __builtin_expect((dbgConfigLevel(dbgRuntimeConfig) >= (level)) && ((dbgConfigGroups(dbgRuntimeConfig) & (group)) != 0u), 0)
+#define DBG_ENABLED(level, group) (DBG_COMPILED(level, group) && DBG_RUNTIME_ENABLED(level, group))
+
+// Errors fire the CAN trace trigger (CAN_TRACE_TRIGGER_ERROR) whether or not they are printed
+#define DBG_TRACE_TRIGGER(level)                        \
+    do                                                  \
+    {                                                   \
+        if ((level) == DBG_LEVEL_ERROR)                 \
+        {                                               \
+            CanTrace::trigger(CAN_TRACE_TRIGGER_ERROR); \
+        }                                               \
+    } while (0)
 
 #define DBG_LOG(level, group, msg)     \
     do                                 \
     {                                  \
+        DBG_TRACE_TRIGGER(level);      \
         if (DBG_ENABLED(level, group)) \
         {                              \
             addDataToOutQueue(String("[") + dbgLevelTag(level) + "] " + String(msg)); \
@@ -71,3 +93,44 @@ extern void addDataToOutQueue(String data);
 #define DBG_WARN(group, msg) DBG_LOG(DBG_LEVEL_WARN, group, msg)
 #define DBG_INFO(group, msg) DBG_LOG(DBG_LEVEL_INFO, group, msg)
 #define DBG_VERBOSE(group, msg) DBG_LOG(DBG_LEVEL_VERBOSE, group, msg)
+
+// ======== Catalog messages (DebugMessages.h) ========
+// Call sites pass a message ID and raw arguments instead of building a String.
+// With DBG_DEFERRED 0 the record is formatted right away and queued like DBG_LOG output.
+// With DBG_DEFERRED 1 it is stored in a binary ring, drained by the DLG command and
+// formatted on the host by host/tools/dbglog_decode.
+
+void dbgCommitRecord(const DbgRecord &record);
+
+// Drains up to `maxRecords` records from the deferred ring into `out`. Returns the number copied
+size_t dbgDrainRecords(DbgRecord *out, size_t maxRecords);
+uint32_t dbgDroppedRecords(); // Records overwritten before they were drained
+
+template <typename... Args>
+inline void dbgEmit(uint32_t level, DbgMessageId id, Args... args)
+{
+    static_assert(sizeof...(Args) <= DBG_RECORD_MAX_ARGS, "Too many arguments for a debug record");
+    DbgRecord record;
+    record.timestampUs = micros();
+    record.messageId = static_cast<uint16_t>(id);
+    record.level = static_cast<uint8_t>(level);
+    record.argCount = static_cast<uint8_t>(sizeof...(Args));
+    const uint32_t values[DBG_RECORD_MAX_ARGS + 1] = {dbgArg(args)...};
+    memcpy(record.args, values, sizeof(record.args));
+    dbgCommitRecord(record);
+}
+
+#define DBG_LOG_MSG(level, group, id, ...)                         \
+    do                                                              \
+    {                                                               \
+        DBG_TRACE_TRIGGER(level);                                   \
+        if (DBG_ENABLED(level, group))                              \
+        {                                                           \
+            dbgEmit(level, DbgMessageId::id, ##__VA_ARGS__);        \
+        }                                                           \
+    } while (0)
+
+#define DBG_ERROR_MSG(group, id, ...) DBG_LOG_MSG(DBG_LEVEL_ERROR, group, id, ##__VA_ARGS__)
+#define DBG_WARN_MSG(group, id, ...) DBG_LOG_MSG(DBG_LEVEL_WARN, group, id, ##__VA_ARGS__)
+#define DBG_INFO_MSG(group, id, ...) DBG_LOG_MSG(DBG_LEVEL_INFO, group, id, ##__VA_ARGS__)
+#define DBG_VERBOSE_MSG(group, id, ...) DBG_LOG_MSG(DBG_LEVEL_VERBOSE, group, id, ##__VA_ARGS__)
@@ -1,5 +1,39 @@
 #pragma once
 
-// Uncomment one line to enable debug output and select groups/level.
+// DEBUG_CONFIG is the compile-time ceiling: levels/groups outside it are stripped from the build.
+// Release builds keep every level of the main groups, so a field unit can be traced without a
+// reflash (the Arduino IDE passes no -D flags); a message the runtime filter turns off costs one
+// predicted branch. -DDEBUG_CONFIG_RELEASE_WARN=1 strips it down to warnings and errors when flash
+// is short, -DDEBUG_CONFIG_DEVELOPMENT=1 opens every group, -D'DEBUG_CONFIG=DBG_CONFIG(...)' sets any.
+// DEBUG_RUNTIME_CONFIG is what is printed after reset; the DBL command changes it on the fly, within
+// the ceiling (e.g. "DBL1" = errors only, "DBL4G4" = verbose CANopen tracing).
 
-#define DEBUG_CONFIG DBG_CONFIG(DBG_LEVEL_WARN, DBG_GROUP_AXIS | DBG_GROUP_MOVE | DBG_GROUP_CANOPEN | DBG_GROUP_SERIAL | DBG_GROUP_HEARTBEAT | DBG_GROUP_COMMAND)
\ No newline at end of file
+#ifndef DEBUG_CONFIG
+#if defined(DEBUG_CONFIG_DEVELOPMENT) && DEBUG_CONFIG_DEVELOPMENT
+#define DEBUG_CONFIG DBG_CONFIG(DBG_LEVEL_VERBOSE, DBG_GROUP_ALL)
+#elif defined(DEBUG_CONFIG_RELEASE_WARN) && DEBUG_CONFIG_RELEASE_WARN
+#define DEBUG_CONFIG DBG_CONFIG(DBG_LEVEL_WARN, DBG_GROUP_AXIS | DBG_GROUP_MOVE | DBG_GROUP_CANOPEN | DBG_GROUP_SERIAL | DBG_GROUP_HEARTBEAT | DBG_GROUP_COMMAND)
+#else
+#define DEBUG_CONFIG DBG_CONFIG(DBG_LEVEL_VERBOSE, DBG_GROUP_AXIS | DBG_GROUP_MOVE | DBG_GROUP_CANOPEN | DBG_GROUP_SERIAL | DBG_GROUP_HEARTBEAT | DBG_GROUP_COMMAND)
+#endif
+#endif
+
+#ifndef DEBUG_RUNTIME_CONFIG
+#define DEBUG_RUNTIME_CONFIG DBG_CONFIG(DBG_LEVEL_WARN, DBG_GROUP_AXIS | DBG_GROUP_MOVE | DBG_GROUP_CANOPEN | DBG_GROUP_SERIAL | DBG_GROUP_HEARTBEAT | DBG_GROUP_COMMAND)
+#endif
+
+// Set to 1 to store catalog messages (DBG_*_MSG) in a binary ring instead of formatting them on the MCU.
+// Drain the ring with the DLG command and decode it with host/tools/dbglog_decode.
+#define DBG_DEFERRED 0
+
+// Set to 1 to compile in the DWT cycle counter profiler (PRF command). With 0 all probes compile out.
+#define PROFILER_ENABLED 0
+
+// Set to 1 to count heap operations and report them with the HPS command.
+#define HEAP_STATS_ENABLED 1
+
+// Set to 1 to account CAN bus time per frame and per command (BUS command).
+#define BUS_LOAD_ENABLED 1
+
+// Set to 1 to record every CAN frame in a binary ring (CTR command, host/tools/cantrace_convert).
+#define CAN_TRACE_ENABLED 1
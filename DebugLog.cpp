@@ -0,0 +1,78 @@
+#include "Debug.h"
+
+uint32_t dbgRuntimeConfig = dbgClampToCeiling(DEBUG_RUNTIME_CONFIG);
+
+uint32_t dbgSetRuntimeConfig(uint32_t config)
+{
+    dbgRuntimeConfig = dbgClampToCeiling(config);
+    return dbgRuntimeConfig;
+}
+
+#if DBG_DEFERRED
+
+namespace
+{
+    DbgRecord ring[DBG_DEFERRED_RING_SIZE];
+    volatile size_t ringHead = 0;  // Next slot to write
+    volatile size_t ringCount = 0; // Records waiting to be drained
+    volatile uint32_t droppedRecords = 0;
+}
+
+void dbgCommitRecord(const DbgRecord &record)
+{
+    noInterrupts();
+    ring[ringHead] = record;
+    ringHead = (ringHead + 1) % DBG_DEFERRED_RING_SIZE;
+    if (ringCount < DBG_DEFERRED_RING_SIZE)
+    {
+        ringCount++;
+    }
+    else
+    {
+        droppedRecords++; // Oldest record was overwritten
+    }
+    interrupts();
+}
+
+size_t dbgDrainRecords(DbgRecord *out, size_t maxRecords)
+{
+    size_t copied = 0;
+    noInterrupts();
+    size_t tail = (ringHead + DBG_DEFERRED_RING_SIZE - ringCount) % DBG_DEFERRED_RING_SIZE;
+    while (copied < maxRecords && ringCount > 0)
+    {
+        out[copied++] = ring[tail];
+        tail = (tail + 1) % DBG_DEFERRED_RING_SIZE;
+        ringCount--;
+    }
+    interrupts();
+    return copied;
+}
+
+uint32_t dbgDroppedRecords()
+{
+    return droppedRecords;
+}
+
+#else
+
+void dbgCommitRecord(const DbgRecord &record)
+{
+    char text[96];
+    dbgFormatRecord(record, text, sizeof(text));
+    addDataToOutQueue(String("[") + dbgLevelTag(record.level) + "] " + text);
+}
+
+size_t dbgDrainRecords(DbgRecord *out, size_t maxRecords)
+{
+    (void)out;
+    (void)maxRecords;
+    return 0;
+}
+
+uint32_t dbgDroppedRecords()
+{
+    return 0;
+}
+
+#endif // DBG_DEFERRED
@@ -0,0 +1,40 @@
+#pragma once
+#ifndef DEBUG_MESSAGES_H
+#define DEBUG_MESSAGES_H
+
+// Catalog of messages that can be logged as compact binary records (DBG_*_MSG macros).
+// The firmware stores only the message ID and raw arguments; the format string is applied
+// either on the spot (text mode) or by host/tools/dbglog_decode (deferred mode).
+//
+// IDs are positional: append new entries at the end, never reorder or delete,
+// otherwise dumps taken with an older firmware are decoded with the wrong text.
+//
+// Supported conversions: %d %i %u %x %X %c %f %%  (at most DBG_RECORD_MAX_ARGS per message)
+#define DBG_MESSAGE_LIST(X)                                                                      \
+    X(CAN_INVALID_NODE, "Received message from invalid node ID: %u")                             \
+    X(CAN_SDO_RESPONSE, "SDO Response from node %u")                                             \
+    X(CAN_SDO_RESPONSE_LENGTH, "Invalid SDO response length from node %u: %u")                   \
+    X(CAN_POSITION_RESPONSE_LENGTH, "Invalid SDO read response length for position value from node %u: %u") \
+    X(CAN_SEND_NULL_DATA, "Null data pointer in CAN send with non-zero length")                  \
+    X(CAN_SEND_INVALID_LENGTH, "Invalid data length in CAN send: %u")                            \
+    X(CAN_SEND_FAILED, "CAN send failed for ID: %x")                                             \
+    X(CAN_SENDING_SYNC, "Sending SYNC")                                                          \
+    X(POSITION_UPDATE, "Position update from node %u: %d")                                       \
+    X(POSITION_READ_FAILED, "Failed to read Position Actual Value for node %u")                  \
+    X(HEARTBEAT_TIMEOUT, "==== Heartbeat timeout for Axis %u ====")                              \
+    X(HEARTBEAT_RESTORED, "==== Heartbeat restored for Axis %u ====")                            \
+    X(ZEI_HEARTBEAT_TIMEOUT, "Zero Initialization failed for Axis %u: Heartbeat timeout")        \
+    X(CAN_EMCY_LENGTH, "Invalid EMCY length from node %u: %u")                                   \
+    X(EMCY_FAULT, "==== EMCY from Axis %u: error code %X, error register %X ====")               \
+    X(EMCY_ERROR_RESET, "EMCY error reset from Axis %u")                                         \
+    X(NMT_BOOT_UP, "==== NMT boot-up from Axis %u ====")                                         \
+    X(NMT_NODE_CONFIGURED, "NMT: Axis %u configured and started %u ms after its boot-up")        \
+    X(NMT_NODE_RECONFIGURED, "NMT: Axis %u reported pre-operational, configured again")          \
+    X(DRIVE_STATE_CHANGED, "Axis %u drive state %u -> %u, statusword %X")                        \
+    X(DRIVE_ENABLE_FAILED, "==== Axis %u not enabled after %u attempts, drive state %u ====")    \
+    X(DRIVE_MOVE_DROPPED, "Move dropped: drives not enabled within %u ms")                       \
+    X(JOG_DEADMAN_STOP, "==== Axis %u jog stopped: no update for %u ms ====")                    \
+    X(JOG_STOP_TIMEOUT, "Axis %u jog: still moving %u ms after the stop, position mode anyway")  \
+    X(MOTION_ABORTED, "==== Motion aborted (source %u): stops in %u us, %u frames dropped ====")
+
+#endif // DEBUG_MESSAGES_H
@@ -0,0 +1,166 @@
+#include "DebugRecord.h"
+
+namespace
+{
+    const char *const messageFormats[] = {
+#define DBG_MESSAGE_FORMAT(name, format) format,
+        DBG_MESSAGE_LIST(DBG_MESSAGE_FORMAT)
+#undef DBG_MESSAGE_FORMAT
+    };
+
+    // Appends characters while keeping room for the terminating NUL
+    struct Writer
+    {
+        char *out;
+        size_t size;
+        size_t pos;
+
+        void put(char c)
+        {
+            if (pos + 1 < size)
+            {
+                out[pos++] = c;
+            }
+        }
+
+        void putUnsigned(uint32_t value, uint8_t base, bool upper)
+        {
+            char digits[10];
+            uint8_t count = 0;
+            do
+            {
+                uint8_t digit = value % base;
+                digits[count++] = digit < 10 ? static_cast<char>('0' + digit) : static_cast<char>((upper ? 'A' : 'a') + digit - 10);
+                value /= base;
+            } while (value != 0);
+            while (count > 0)
+            {
+                put(digits[--count]);
+            }
+        }
+
+        void putSigned(int32_t value)
+        {
+            if (value < 0)
+            {
+                put('-');
+                putUnsigned(static_cast<uint32_t>(-(static_cast<int64_t>(value))), 10, false);
+                return;
+            }
+            putUnsigned(static_cast<uint32_t>(value), 10, false);
+        }
+
+        // Two decimal places, the same as Arduino's String(float)
+        void putFloat(float value)
+        {
+            if (value != value)
+            {
+                put('n');
+                put('a');
+                put('n');
+                return;
+            }
+            if (value < 0)
+            {
+                put('-');
+                value = -value;
+            }
+            if (value > 4294967040.0f)
+            {
+                put('o');
+                put('v');
+                put('f');
+                return;
+            }
+            uint32_t scaled = static_cast<uint32_t>(static_cast<double>(value) * 100.0 + 0.5);
+            putUnsigned(scaled / 100, 10, false);
+            put('.');
+            put(static_cast<char>('0' + (scaled / 10) % 10));
+            put(static_cast<char>('0' + scaled % 10));
+        }
+    };
+}
+
+const char *dbgMessageFormat(uint16_t messageId)
+{
+    if (messageId >= static_cast<uint16_t>(DbgMessageId::COUNT))
+    {
+        return nullptr;
+    }
+    return messageFormats[messageId];
+}
+
+size_t dbgFormatRecord(const DbgRecord &record, char *out, size_t outSize)
+{
+    if (out == nullptr || outSize == 0)
+    {
+        return 0;
+    }
+
+    Writer writer{out, outSize, 0};
+    const char *format = dbgMessageFormat(record.messageId);
+    if (format == nullptr)
+    {
+        const char unknown[] = "Unknown message ";
+        for (const char *c = unknown; *c != '\0'; ++c)
+        {
+            writer.put(*c);
+        }
+        writer.putUnsigned(record.messageId, 10, false);
+        out[writer.pos] = '\0';
+        return writer.pos;
+    }
+
+    uint8_t argIndex = 0;
+    for (const char *c = format; *c != '\0'; ++c)
+    {
+        if (*c != '%' || c[1] == '\0')
+        {
+            writer.put(*c);
+            continue;
+        }
+
+        char conversion = *++c;
+        if (conversion == '%')
+        {
+            writer.put('%');
+            continue;
+        }
+
+        uint32_t arg = (argIndex < record.argCount && argIndex < DBG_RECORD_MAX_ARGS) ? record.args[argIndex] : 0;
+        argIndex++;
+        switch (conversion)
+        {
+        case 'd':
+        case 'i':
+            writer.putSigned(static_cast<int32_t>(arg));
+            break;
+        case 'u':
+            writer.putUnsigned(arg, 10, false);
+            break;
+        case 'x':
+            writer.putUnsigned(arg, 16, false);
+            break;
+        case 'X':
+            writer.putUnsigned(arg, 16, true);
+            break;
+        case 'c':
+            writer.put(static_cast<char>(arg));
+            break;
+        case 'f':
+        {
+            float value;
+            memcpy(&value, &arg, sizeof(value));
+            writer.putFloat(value);
+            break;
+        }
+        default: // Unsupported conversion: print it verbatim
+            writer.put('%');
+            writer.put(conversion);
+            break;
+        }
+    }
+
+    out[writer.pos] = '\0';
+    return writer.pos;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#ifndef DEBUG_RECORD_H
+#define DEBUG_RECORD_H
+
+// Binary debug records shared by the firmware and the host decoder.
+// Must not depend on Arduino.h: host/tools/dbglog_decode compiles it as plain C++.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "DebugMessages.h"
+
+#define DBG_LEVEL_ERROR 1u
+#define DBG_LEVEL_WARN 2u
+#define DBG_LEVEL_INFO 3u
+#define DBG_LEVEL_VERBOSE 4u
+
+inline const char *dbgLevelTag(uint32_t level)
+{
+    switch (level)
+    {
+    case DBG_LEVEL_ERROR:
+        return "ERROR";
+    case DBG_LEVEL_WARN:
+        return "WARN";
+    case DBG_LEVEL_INFO:
+        return "INFO";
+    case DBG_LEVEL_VERBOSE:
+        return "VERBOSE";
+    default:
+        return "DBG";
+    }
+}
+
+enum class DbgMessageId : uint16_t
+{
+#define DBG_MESSAGE_ENUM(name, format) name,
+    DBG_MESSAGE_LIST(DBG_MESSAGE_ENUM)
+#undef DBG_MESSAGE_ENUM
+        COUNT
+};
+
+constexpr uint8_t DBG_RECORD_MAX_ARGS = 4;
+
+struct DbgRecord
+{
+    uint32_t timestampUs;
+    uint16_t messageId;
+    uint8_t level;
+    uint8_t argCount;
+    uint32_t args[DBG_RECORD_MAX_ARGS]; // Raw argument bits: integers as 32-bit values, floats as IEEE-754 single
+};
+
+// Converts a call site argument to its raw 32-bit representation
+inline uint32_t dbgArg(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+inline uint32_t dbgArg(double value) { return dbgArg(static_cast<float>(value)); }
+
+template <typename T>
+inline uint32_t dbgArg(T value)
+{
+    return static_cast<uint32_t>(value);
+}
+
+// Returns the catalog format string for a message ID, or nullptr for an unknown ID
+const char *dbgMessageFormat(uint16_t messageId);
+
+// Formats a record into `out` (always NUL-terminated). Returns the number of characters written
+size_t dbgFormatRecord(const DbgRecord &record, char *out, size_t outSize);
+
+#endif // DEBUG_RECORD_H
@@ -0,0 +1,189 @@
+#include "HeapStats.h"
+
+#if HEAP_STATS_ENABLED
+
+#include <stdlib.h>
+#include <malloc.h>
+
+#if defined(ARDUINO_ARCH_STM32)
+#include <reent.h>
+#include <unistd.h>
+#include "Arduino.h"
+#else
+#include <new>
+#endif
+
+namespace
+{
+    volatile uint32_t heapOperations = 0;
+    uint32_t setupCompleteOperations = 0;
+    bool setupComplete = false;
+
+#if defined(ARDUINO_ARCH_STM32)
+    volatile bool queryingStats = false; // mallinfo() takes the malloc lock too; do not count our own queries
+
+    uint32_t bytesInUse()
+    {
+        queryingStats = true;
+        struct mallinfo info = mallinfo();
+        queryingStats = false;
+        return info.uordblks;
+    }
+#else
+    size_t currentBytes = 0;
+    size_t peakBytes = 0;
+
+    void countAllocation(void *ptr)
+    {
+        heapOperations++;
+        currentBytes += malloc_usable_size(ptr);
+        if (currentBytes > peakBytes)
+        {
+            peakBytes = currentBytes;
+        }
+    }
+
+    void countFree(void *ptr)
+    {
+        heapOperations++;
+        currentBytes -= malloc_usable_size(ptr);
+    }
+#endif
+}
+
+#if defined(ARDUINO_ARCH_STM32)
+// newlib-nano's free list (nano-mallocr.c): freed chunks in address order, size with the header
+struct MallocFreeChunk
+{
+    long size;
+    MallocFreeChunk *next;
+};
+extern "C" MallocFreeChunk *__malloc_free_list;
+extern "C" char _end; // Heap start (linker script); _sbrk() grows the heap from here
+
+// newlib calls this before every malloc/free/realloc. The firmware is single threaded,
+// so no actual locking is needed (the default newlib implementation is empty as well).
+// Only a counter: every String and std::function copy passes through here.
+extern "C" void __malloc_lock(struct _reent *)
+{
+    if (!queryingStats)
+    {
+        heapOperations++;
+    }
+}
+#else
+void *operator new(std::size_t size)
+{
+    void *ptr = malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    countAllocation(ptr);
+    return ptr;
+}
+
+void *operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    if (ptr == nullptr)
+    {
+        return;
+    }
+    countFree(ptr);
+    free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    operator delete(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+    operator delete(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) noexcept
+{
+    operator delete(ptr);
+}
+#endif
+
+namespace HeapStats
+{
+    Snapshot snapshot()
+    {
+        Snapshot result;
+        result.operations = heapOperations;
+        result.operationsAfterSetup = setupComplete ? heapOperations - setupCompleteOperations : 0;
+#if defined(ARDUINO_ARCH_STM32)
+        // newlib-nano serves a request from its free list first and never gives memory back to
+        // _sbrk(), so the size the heap grew to is its high-water mark, fragmentation included
+        char *heapEnd = static_cast<char *>(sbrk(0));
+        result.currentBytes = bytesInUse();
+        result.peakBytes = static_cast<uint32_t>(heapEnd - &_end);
+
+        // Holes left by freed blocks: what fragmentation leaves to a request that does not fit them
+        uint32_t largest = 0;
+        for (const MallocFreeChunk *chunk = __malloc_free_list; chunk != nullptr; chunk = chunk->next)
+        {
+            largest = static_cast<uint32_t>(chunk->size) > largest ? static_cast<uint32_t>(chunk->size) : largest;
+        }
+        result.largestFreeBlock = largest;
+
+        char *stackPointer = reinterpret_cast<char *>(__get_MSP());
+        result.headroomBytes = stackPointer > heapEnd ? static_cast<uint32_t>(stackPointer - heapEnd) : 0;
+#else
+        result.currentBytes = static_cast<uint32_t>(currentBytes);
+        result.peakBytes = static_cast<uint32_t>(peakBytes);
+        result.largestFreeBlock = 0; // Not meaningful on a host
+        result.headroomBytes = 0;
+#endif
+        return result;
+    }
+
+    void markSetupComplete()
+    {
+        setupCompleteOperations = heapOperations;
+        setupComplete = true;
+    }
+
+    NoAllocGuard::NoAllocGuard() : startOperations(heapOperations)
+    {
+    }
+
+    uint32_t NoAllocGuard::operations() const
+    {
+        return heapOperations - startOperations;
+    }
+}
+
+#else
+
+namespace HeapStats
+{
+    Snapshot snapshot()
+    {
+        return Snapshot{0, 0, 0, 0, 0, 0};
+    }
+
+    void markSetupComplete()
+    {
+    }
+
+    NoAllocGuard::NoAllocGuard() : startOperations(0)
+    {
+    }
+
+    uint32_t NoAllocGuard::operations() const
+    {
+        return 0;
+    }
+}
+
+#endif // HEAP_STATS_ENABLED
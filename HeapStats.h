@@ -0,0 +1,46 @@
+#pragma once
+#ifndef HEAP_STATS_H
+#define HEAP_STATS_H
+
+#include <stdint.h>
+#include "DebugConfig.h"
+
+#ifndef HEAP_STATS_ENABLED
+#define HEAP_STATS_ENABLED 0
+#endif
+
+// Heap allocation accounting.
+//
+// On target (newlib) every malloc/free/realloc takes the malloc lock, so the hook in HeapStats.cpp
+// counts all heap operations (String, std::vector, std::function, new) without linker flags.
+// Byte figures are read when a snapshot is taken: bytes in use from mallinfo(), the peak from how far
+// the heap grew, the largest free block from newlib-nano's free list. On host builds the global
+// operator new/delete are replaced instead, which covers the String shim and the standard containers.
+namespace HeapStats
+{
+    struct Snapshot
+    {
+        uint32_t operations;          // malloc/free/realloc calls since reset
+        uint32_t operationsAfterSetup; // heap operations after markSetupComplete()
+        uint32_t currentBytes;        // bytes currently allocated
+        uint32_t peakBytes;           // high-water mark of the heap (target: its size, allocations and holes)
+        uint32_t largestFreeBlock;    // largest chunk freed inside the heap (target; 0 on a host)
+        uint32_t headroomBytes;       // untouched memory between the heap end and the stack (target; 0 on a host)
+    };
+
+    Snapshot snapshot();
+    void markSetupComplete(); // Call at the end of setup(): from here on the firmware should not touch the heap
+
+    // Counts heap operations in a region that must not allocate (steady-state move/feedback loop).
+    class NoAllocGuard
+    {
+    public:
+        NoAllocGuard();
+        uint32_t operations() const; // Heap operations since construction
+
+    private:
+        uint32_t startOperations;
+    };
+}
+
+#endif // HEAP_STATS_H
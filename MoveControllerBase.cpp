@@ -1,7 +1,10 @@
 #include <cmath>
+#include <cstdlib>
 #include "MoveControllerBase.h"
 #include "Arduino.h"
+#include "BusLoad.h"
 #include "Debug.h"
+#include "Profiler.h"
 
 namespace StepDirController
 {
@@ -39,14 +42,28 @@ namespace StepDirController
             axes[nodeId] = Axis(nodeId);
             axes[nodeId].lastHeartbeatMs = 0;
             axes[nodeId].isAlive = false;
+            axes[nodeId].configuredMs = millis();
 
             setRegularPositionActualValueCallback(nodeId);
+            canOpen->set_callback_x6041_statusword([this](uint8_t callbackNodeId, bool success, uint16_t statusword)
+                                                   { this->regularStatuswordCallback(callbackNodeId, success, statusword); }, nodeId);
+            // Drives powered already report their state from now on; the ones that boot later get it with their configuration
+            canOpen->configureTPDO1(nodeId, RobotConstants::Cia402::STATUSWORD_EVENT_TIMER_MS);
+            canOpen->configureRPDO3(nodeId); // Jog updates: 0x60FF alone
         }
 
         canOpen->set_callback_heartbeat([this](uint8_t nodeId, uint8_t status)
                                         { this->regularHeartbeatCallback(nodeId, status); });
+        canOpen->set_callback_emcy([this](uint8_t nodeId, uint16_t errorCode, uint8_t errorRegister, const uint8_t *vendor)
+                                   { this->regularEmcyCallback(nodeId, errorCode, errorRegister, vendor); });
+
+        setFeedbackCeiling(feedbackCeilingPermille);
+        feedbackTokensMs = millis();
+        feedbackWindowMs = feedbackTokensMs;
 
         initialized = true;
+        // Drives already up go operational; the ones that boot later announce themselves and are configured then
+        broadcastNmt(RobotConstants::CANOpen::NMT_START);
         Serial2.println("MoveControllerBase initialized with " + String(axesCnt) + " axes");
         return true;
     }
@@ -85,126 +102,1059 @@ namespace StepDirController
             DBG_VERBOSE(DBG_GROUP_MOVE, "MoveControllerBase::move failed. Not initialized");
             return;
         }
-        prepareMove();
-        sendMove();
+        if (motionPaused || hasDriveFault())
+        {
+            DBG_WARN(DBG_GROUP_MOVE, "MoveControllerBase::move refused. Motion paused by a drive fault (EMCR resumes)");
+            return;
+        }
+        if (isJogActive())
+        {
+            DBG_WARN(DBG_GROUP_MOVE, "MoveControllerBase::move refused. An axis is jogging (JOGS stops it)");
+            return;
+        }
+        const bool waiting = planQueued || movePending; // A staged move not sent yet
+        if (!prepareMove())
+        {
+            // Planning failed: the staging buffer is untouched, a move staged earlier still goes out
+            addDataToOutQueue(RobotConstants::Commands::MOVE_DONE + " " + RobotConstants::Status::COMMAND_FULL_FAIL + " time=0us"); // Nothing was sent
+            return;
+        }
+        if (waiting)
+        {
+            addDataToOutQueue(RobotConstants::Commands::MOVE_DONE + " " + RobotConstants::Status::COMMAND_FULL_FAIL + " time=0us"); // The staged move it replaced, never sent
+        }
+        if (moveTrackActive)
+        {
+            // Planned now, while the move under way runs: tick_fast() sends it once that one is done (MDN)
+            planQueued = true;
+            movePending = false;
+            planStats.queued++;
+            return;
+        }
+        dispatchMove();
+    }
+
+    int32_t MoveControllerBase::moveStartPosition(uint8_t nodeId)
+    {
+        // A move commanded now is queued behind the tracked one and starts at its target
+        return moveTrackActive ? plans[activePlan].axes[nodeId].target : axes.at(nodeId).getCurrentPositionInSteps();
+    }
+
+    void MoveControllerBase::dispatchMove()
+    {
+        if (drivesReadyToMove())
+        {
+            movePending = false;
+            sendMove();
+            return;
+        }
+
+        // A drive that is not enabled would ignore the set point: enable it and send the move from tick_fast()
+        for (uint8_t nodeId = 1; nodeId <= axesCnt; ++nodeId)
+        {
+            if (isDrivePresent(axes[nodeId]))
+            {
+                enableDrive(nodeId);
+            }
+        }
+        if (!movePending)
+        {
+            driveStats.movesHeld++;
+        }
+        movePending = true; // A newer move replaces a held one: its plan took over the staging buffer
+        movePendingSinceMs = millis();
     }
 
     void MoveControllerBase::tick_50()
     {
         if (!initialized)
         {
-            return;
+            return;
+        }
+        tick_checkTimeouts();
+        tick_checkZEITimeouts();
+    }
+
+    void MoveControllerBase::tick_500()
+    {
+        if (!initialized)
+        {
+            addDataToOutQueue("JJ");
+        }
+    }
+
+    bool MoveControllerBase::setStartMode(StartMode mode)
+    {
+        if (!initialized)
+        {
+            return false;
+        }
+        bool ok = true;
+        for (uint8_t nodeId = 1; nodeId <= axesCnt; ++nodeId)
+        {
+            ok = configureStartMode(nodeId, mode) && ok;
+        }
+        startMode = mode;
+        return ok;
+    }
+
+    bool MoveControllerBase::broadcastNmt(uint8_t command)
+    {
+        if (!initialized)
+        {
+            return false;
+        }
+        switch (command)
+        {
+        case RobotConstants::CANOpen::NMT_START:
+            nmtTarget = RobotConstants::CANOpen::NMT_STATE_OPERATIONAL;
+            break;
+        case RobotConstants::CANOpen::NMT_STOP:
+            nmtTarget = RobotConstants::CANOpen::NMT_STATE_STOPPED;
+            break;
+        case RobotConstants::CANOpen::NMT_PRE_OPERATIONAL:
+            nmtTarget = RobotConstants::CANOpen::NMT_STATE_PRE_OPERATIONAL;
+            break;
+        case RobotConstants::CANOpen::NMT_RESET_NODE:
+        case RobotConstants::CANOpen::NMT_RESET_COMMUNICATION:
+            break;
+        default:
+            return false;
+        }
+        return canOpen->sendNMT(command, RobotConstants::CANOpen::NMT_ALL_NODES);
+    }
+
+    bool MoveControllerBase::clearFault()
+    {
+        if (!initialized)
+        {
+            return false;
+        }
+        // Each drive goes the shortest way from the state it reports: a faulted one resets and
+        // enables in three controlwords, a quick-stopped one in one, an enabled one needs none
+        motionPaused = false; // First: enableDrive() refuses while motion is paused
+        for (uint8_t nodeId = 1; nodeId <= axesCnt; ++nodeId)
+        {
+            axes[nodeId].emcyErrorCode = RobotConstants::Emcy::ERROR_RESET; // Set again if the drive reports the fault anew
+            enableDrive(nodeId, true);
+        }
+        DBG_INFO(DBG_GROUP_AXIS, "Drive faults cleared, motion resumed");
+        return true;
+    }
+
+    void MoveControllerBase::enableDrive(uint8_t nodeId, bool resetFault)
+    {
+        auto it = axes.find(nodeId);
+        if (!initialized || it == axes.end())
+        {
+            return;
+        }
+        if (motionPaused)
+        {
+            // An abort or fault stopped the drives: only clearFault() (EMCR) enables them again
+            DBG_WARN(DBG_GROUP_AXIS, "MoveControllerBase::enableDrive refused. Motion paused (EMCR resumes)");
+            return;
+        }
+        Axis &axis = it->second;
+        if (axis.driveState == RobotConstants::DriveState::DRIVE_OPERATION_ENABLED)
+        {
+            return;
+        }
+        if (axis.enableRequested)
+        {
+            if (resetFault && !axis.enableResetsFault)
+            {
+                axis.enableResetsFault = true; // The request under way may acknowledge the fault now
+                axis.enableAttempts = 0;
+                sendEnableSequence(nodeId);
+            }
+            return;
+        }
+        axis.enableRequested = true;
+        axis.enableResetsFault = resetFault;
+        axis.enableAttempts = 0;
+        axis.enableRequestedUs = micros();
+        driveStats.enableRequests++;
+        sendEnableSequence(nodeId);
+    }
+
+    bool MoveControllerBase::hasDriveFault() const
+    {
+        for (auto it = axes.begin(); it != axes.end(); ++it)
+        {
+            const RobotConstants::DriveState state = it->second.driveState;
+            if (state == RobotConstants::DriveState::DRIVE_FAULT || state == RobotConstants::DriveState::DRIVE_FAULT_REACTION_ACTIVE)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void MoveControllerBase::tick_fast()
+    {
+        tick_abort();
+        tick_configureNode();
+        tick_driveStates();
+        tick_moveTrack();
+        if (planQueued && !moveTrackActive)
+        {
+            planQueued = false;
+            dispatchMove(); // The move under way is done: the staged plan goes out as it was prepared
+        }
+        tick_jog();
+        tick_requestPosition();
+        if (!startProbeActive)
+        {
+            return;
+        }
+        if (micros() - startProbeReleaseUs > RobotConstants::Control::START_SKEW_WINDOW_MS * 1000u)
+        {
+            startProbeFinish();
+            return;
+        }
+
+        // At most one position read per pass, round-robin over the axes that have not moved yet
+        const uint32_t nowUs = micros();
+        for (uint8_t i = 0; i < axesCnt; ++i)
+        {
+            const uint8_t nodeId = startProbeNextNodeId;
+            startProbeNextNodeId = (nodeId % axesCnt) + 1;
+            StartProbe &probe = startProbes[nodeId];
+            if (!probe.probing || probe.started ||
+                (probe.awaiting && nowUs - probe.requestedUs < RobotConstants::Control::START_SKEW_READ_TIMEOUT_US))
+            {
+                continue;
+            }
+            probe.awaiting = true;
+            probe.requestedUs = nowUs;
+            canOpen->sendSDORead(nodeId,
+                                 RobotConstants::ODIndices::POSITION_ACTUAL_VALUE,
+                                 RobotConstants::ODIndices::DEFAULT_SUBINDEX,
+                                 CAN_TX_CLASS_DIAG);
+            return;
+        }
+    }
+
+    void MoveControllerBase::keepFeedbackActive(uint8_t nodeId)
+    {
+        if (nodeId == 0 || nodeId > axesCnt)
+        {
+            return;
+        }
+        const uint32_t now = millis();
+        feedback[nodeId].lastActiveMs = now != 0 ? now : 1;
+    }
+
+    void MoveControllerBase::setFeedbackCeiling(uint16_t permille)
+    {
+        feedbackCeilingPermille = permille < RobotConstants::Feedback::MAX_CEILING_PERMILLE ? permille : RobotConstants::Feedback::MAX_CEILING_PERMILLE;
+        // A poll is an SDO request and its answer, 8 bytes each, counted with worst-case stuffing
+        const uint32_t pollBits = 2u * BusLoad::worstCaseFrameBits(false, 8);
+        feedbackBudgetPerSecond = static_cast<uint32_t>(static_cast<uint64_t>(RobotConstants::Robot::CAN_BAUD_RATE) * feedbackCeilingPermille / 1000u / pollBits);
+    }
+
+    uint32_t MoveControllerBase::getFeedbackInterval(uint8_t nodeId) const
+    {
+        return (nodeId == 0 || nodeId > axesCnt) ? 0 : feedback[nodeId].intervalMs;
+    }
+
+    float MoveControllerBase::getFeedbackRate(uint8_t nodeId) const
+    {
+        return (nodeId == 0 || nodeId > axesCnt) ? 0 : feedback[nodeId].rateHz;
+    }
+
+    bool MoveControllerBase::jog(uint8_t nodeId, double speedUnits)
+    {
+        if (!initialized || nodeId == 0 || nodeId > axesCnt)
+        {
+            return false;
+        }
+        JogAxis &jogAxis = jogs[nodeId];
+        if (speedUnits == 0)
+        {
+            if (jogAxis.state == JogState::RUNNING)
+            {
+                jogStop(nodeId);
+            }
+            return true;
+        }
+        Axis &axis = axes[nodeId];
+        if (motionPaused || movePending || moveTrackActive || nodeConfigurator != nullptr || !isDrivePresent(axis))
+        {
+            return false;
+        }
+
+        // 0x60FF is signed, the conversion is not; a speed below 1 rpm still moves the axis
+        int32_t velocity = static_cast<int32_t>(axis.speedUnitsToRevolutionsPerMinute(std::fabs(speedUnits)));
+        velocity = velocity > 0 ? velocity : 1;
+        velocity = speedUnits < 0 ? -velocity : velocity;
+
+        if (jogAxis.state == JogState::IDLE)
+        {
+            axis.sentProfileAcceleration = axis.accelerationUnitsTorpmPerSecond(jogAccelerationUnits);
+            bool ok = canOpen->send_x6083_profileAcceleration(nodeId, axis.sentProfileAcceleration);
+            ok = canOpen->send_x6060_modesOfOperation(nodeId, RobotConstants::Control::DEFAULT_MODE_VELOCITY) && ok;
+            if (!ok)
+            {
+                return false;
+            }
+            jogStats.modeSwitches++;
+            enableDrive(nodeId); // From profile position the drive is normally enabled already
+        }
+        // Sent on every update, a repeated speed included: RPDOs are not confirmed, the next one makes up for a lost one
+        jogAxis.state = JogState::RUNNING;
+        jogAxis.velocity = velocity;
+        jogAxis.updateMs = millis();
+        jogStats.updates++;
+        if (!canOpen->sendPDO3_x60FF_TargetVelocity(nodeId, velocity))
+        {
+            return false; // Running on the previous update until the next one or the deadman
+        }
+        jogStats.frames++;
+        keepFeedbackActive(nodeId);
+        return true;
+    }
+
+    void MoveControllerBase::stopJog()
+    {
+        for (uint8_t nodeId = 1; nodeId <= axesCnt; ++nodeId)
+        {
+            if (jogs[nodeId].state == JogState::RUNNING)
+            {
+                jogStop(nodeId);
+            }
+        }
+    }
+
+    bool MoveControllerBase::isJogActive() const
+    {
+        for (uint8_t nodeId = 1; nodeId <= axesCnt; ++nodeId)
+        {
+            if (jogs[nodeId].state != JogState::IDLE)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    MoveControllerBase::JogState MoveControllerBase::getJogState(uint8_t nodeId) const
+    {
+        return (nodeId == 0 || nodeId > axesCnt) ? JogState::IDLE : jogs[nodeId].state;
+    }
+
+    int32_t MoveControllerBase::getJogVelocity(uint8_t nodeId) const
+    {
+        return (nodeId == 0 || nodeId > axesCnt) ? 0 : jogs[nodeId].velocity;
+    }
+
+    bool MoveControllerBase::abort(uint8_t source, uint32_t requestedUs)
+    {
+        if (!initialized)
+        {
+            return false;
+        }
+        // Set points, controlwords and profile writes still waiting would follow the stop: dropped first
+        CanTxScheduler &txScheduler = canOpen->getTxScheduler();
+        const uint8_t flushed = txScheduler.flush(CAN_TX_CLASS_PDO) + txScheduler.flush(CAN_TX_CLASS_SDO);
+        sendQuickStops();
+        const uint32_t latencyUs = micros() - requestedUs;
+        motionPaused = true; // Checked by sendMove() too, in case this runs from one of its delays
+        abortCleanupPending = true;
+        abortConfirmPending = true;
+        abortStopSentMs = millis();
+        abortStopAttempts = 1;
+
+        abortStats.aborts++;
+        abortStats.lastSource = source;
+        abortStats.latencyUs = latencyUs;
+        abortStats.latencyMaxUs = latencyUs > abortStats.latencyMaxUs ? latencyUs : abortStats.latencyMaxUs;
+        abortStats.lastFlushed = flushed;
+        abortStats.flushed += flushed;
+        DBG_WARN_MSG(DBG_GROUP_MOVE, MOTION_ABORTED, source, latencyUs, flushed);
+        return true;
+    }
+
+    bool MoveControllerBase::setFeedRate(uint8_t percent)
+    {
+        if (percent > RobotConstants::FeedRate::MAX_PERCENT)
+        {
+            return false;
+        }
+        const bool wasHeld = feedRatePercent == 0;
+        if (percent == feedRatePercent)
+        {
+            return true;
+        }
+        feedRatePercent = percent;
+        feedRateStats.changes++;
+        if (!moveTrackActive)
+        {
+            return true; // The next move is sent with it
+        }
+
+        // Axes already at their targets keep what they have; the others get the new profile first,
+        // then the hold or release, so a released axis starts on the new ramp
+        bool ok = true;
+        for (uint8_t nodeId = 1; nodeId <= axesCnt; ++nodeId)
+        {
+            const MoveTrack &track = moveTracks[nodeId];
+            if (!track.tracked || track.reached)
+            {
+                continue;
+            }
+            if (percent != 0)
+            {
+                ok = sendProfile(axes[nodeId], true) && ok;
+            }
+            if (wasHeld != (percent == 0))
+            {
+                ok = canOpen->send_x6040_controlword(nodeId, 0x005F | feedHoldBit()) && ok;
+                feedRateStats.frames++;
+            }
+        }
+        if (percent == 0)
+        {
+            feedRateStats.holds++;
+        }
+        else if (wasHeld)
+        {
+            moveTrackReleasedMs = millis();
+        }
+        moveTrackRestartTimeout();
+        return ok;
+    }
+
+    // ============================= Public methods end =============================
+
+    // ============================ Protected methods =============================
+bool MoveControllerBase::prepareMove() // TODO: Does not work for a = 0, maybe other corner cases
+    {
+        if (axesCnt == 0 || axes.empty())
+        {
+            addDataToOutQueue("No axes configured");
+            return false;
+        }
+        PROF_SCOPE(PROF_PREPARE_MOVE);
+        DBG_VERBOSE(DBG_GROUP_MOVE, "MoveControllerBase.cpp prepareMove called");
+        const uint32_t prepareStartUs = micros();
+        // The move under way keeps its own plan (the active buffer), and the staging buffer is only
+        // written once planning succeeded: a move staged earlier survives a command that cannot be planned
+        MovePlan plan;
+        bool firstAxis = true;
+        double maxMovement = 0;
+
+        for (auto it = axes.begin(); it != axes.end(); ++it)
+        {
+            Axis &axis = it->second;
+            plan.axes[axis.nodeId].target = axis.getTargetPositionAbsolute();
+            double axisMovement = std::fabs(axis.stepsToUnits(axis.getTargetPositionAbsolute() - moveStartPosition(axis.nodeId)));
+            if (firstAxis || axisMovement > maxMovement)
+            {
+                maxMovement = axisMovement;
+                firstAxis = false;
+            }
+        }
+
+        if (accelerationUnits == 0)
+        { // Right now we do not support zero acceleration. But in the future we can add special handling for this case.
+            addDataToOutQueue("MoveControllerBase.cpp zero acceleration is not supported");
+            planStats.rejected++;
+            return false;
+        }
+        double tAcceleration = regularSpeedUnits / accelerationUnits; // в секундах
+        if (regularSpeedUnits == 0)
+        { // Zero speed means no movement at all. It is strange to call move with zero speed
+            addDataToOutQueue("MoveControllerBase.cpp zero regularSpeedUnits is not supported (zero speed)");
+            planStats.rejected++;
+            return false;
+        }
+        double tCruising = (maxMovement - regularSpeedUnits * regularSpeedUnits / accelerationUnits) / regularSpeedUnits;
+
+        if (maxMovement == 0)
+        {
+            // Sent all the same, with zero profiles: every drive reports the target it stands on (MDN OK)
+            addDataToOutQueue("MoveControllerBase.cpp maxMovement division by zero. Motors do not need to move.");
+        }
+        else if (tAcceleration == 0 || (tAcceleration + tCruising == 0))
+        {
+            addDataToOutQueue("MoveControllerBase.cpp tAcceleration or tAcceleration + tCruising division by zero");
+            planStats.rejected++;
+            return false;
+        }
+        else
+        {
+            plan.plannedMs = static_cast<uint32_t>((tAcceleration + maxMovement / regularSpeedUnits) * 1000.0);
+
+            for (auto it = axes.begin(); it != axes.end(); ++it)
+            {
+                Axis &axis = it->second;
+                MovePlan::AxisPlan &axisPlan = plan.axes[axis.nodeId];
+
+                double axisMovementUnits = std::fabs(axis.stepsToUnits(axis.getTargetPositionAbsolute() - moveStartPosition(axis.nodeId)));
+
+                axisPlan.acceleration = (axisMovementUnits) / (tAcceleration * (tAcceleration + tCruising));
+                axisPlan.regularSpeed = axisPlan.acceleration * tAcceleration;
+                axisPlan.profileAccelerationRpmPerS = axis.accelerationUnitsTorpmPerSecond(axisPlan.acceleration);
+                axisPlan.profileVelocityRpm = axis.speedUnitsToRevolutionsPerMinute(axisPlan.regularSpeed);
+            }
+        }
+
+        if (planStaged)
+        {
+            planStats.replaced++;
+        }
+        planStats.prepared++;
+        plan.sequence = planStats.prepared;
+        stagingPlan() = plan;
+        planStaged = true;
+        planStats.prepareUs = micros() - prepareStartUs;
+        planStats.prepareMaxUs = planStats.prepareUs > planStats.prepareMaxUs ? planStats.prepareUs : planStats.prepareMaxUs;
+        return true;
+    }
+    // ============================ Protected methods end ===========================
+
+    // ============================= Private methods =============================
+    bool MoveControllerBase::configureStartMode(uint8_t nodeId, StartMode mode)
+    {
+        return mode == StartMode::SYNC ? canOpen->configureRPDO4(nodeId, true, RobotConstants::CANOpen::PDO_TRANSMISSION_SYNC)
+                                       : canOpen->configureRPDO4(nodeId, false, RobotConstants::CANOpen::PDO_TRANSMISSION_EVENT);
+    }
+
+    // A booted drive is back at its power-on defaults: statusword TPDO, RPDO4 mapping, mode and profile
+    // parameters are sent again (SDOs work in pre-operational), then the node is put into the requested NMT state
+    bool MoveControllerBase::configureNode(uint8_t nodeId)
+    {
+        Axis &axis = axes[nodeId];
+        bool ok = canOpen->configureTPDO1(nodeId, RobotConstants::Cia402::STATUSWORD_EVENT_TIMER_MS);
+        ok = canOpen->configureRPDO3(nodeId) && ok;
+        if (nodeConfigurator != nullptr)
+        {
+            ok = nodeConfigurator(nodeId) && ok;
+        }
+        else
+        {
+            ok = configureStartMode(nodeId, startMode) && ok;
+            ok = canOpen->send_x6060_modesOfOperation(nodeId, RobotConstants::Control::DEFAULT_MODE_POSITION) && ok;
+            const MovePlan::AxisPlan &axisPlan = plans[activePlan].axes[nodeId];
+            if (axisPlan.profileVelocityRpm != 0 && axisPlan.profileAccelerationRpmPerS != 0)
+            {
+                ok = sendProfile(axis, false) && ok; // The last move's profile at the current feed rate
+            }
+        }
+
+        if (nmtTarget == RobotConstants::CANOpen::NMT_STATE_OPERATIONAL)
+        {
+            ok = canOpen->sendNMT(RobotConstants::CANOpen::NMT_START, nodeId) && ok;
+        }
+        else if (nmtTarget == RobotConstants::CANOpen::NMT_STATE_STOPPED)
+        {
+            ok = canOpen->sendNMT(RobotConstants::CANOpen::NMT_STOP, nodeId) && ok;
+        }
+        return ok; // Pre-operational: a booted node is there already
+    }
+
+    void MoveControllerBase::sendEnableSequence(uint8_t nodeId)
+    {
+        Axis &axis = axes[nodeId];
+        uint16_t controlwords[4];
+        uint8_t count = 0;
+        axis.enableAttempts++;
+        axis.enableSentMs = millis();
+        axis.enableInFlight = false;
+
+        switch (axis.driveState)
+        {
+        case RobotConstants::DriveState::DRIVE_OPERATION_ENABLED:
+            axis.enableRequested = false;
+            return;
+        case RobotConstants::DriveState::DRIVE_UNKNOWN:
+            // State first: a controlword that does not fit the state is ignored by the drive
+            canOpen->sendSDORead(nodeId, RobotConstants::ODIndices::STATUSWORD, RobotConstants::ODIndices::DEFAULT_SUBINDEX);
+            return;
+        case RobotConstants::DriveState::DRIVE_NOT_READY_TO_SWITCH_ON:
+        case RobotConstants::DriveState::DRIVE_FAULT_REACTION_ACTIVE:
+            return; // The drive leaves these by itself; the statusword callback continues from there
+        case RobotConstants::DriveState::DRIVE_FAULT:
+            if (!axis.enableResetsFault)
+            {
+                axis.enableRequested = false;
+                driveStats.failures++;
+                DBG_ERROR_MSG(DBG_GROUP_AXIS, DRIVE_ENABLE_FAILED, nodeId, axis.enableAttempts, axis.driveState);
+                return;
+            }
+            if (axis.enableAttempts > 1)
+            {
+                controlwords[count++] = RobotConstants::Control::CONTROLWORD_DISABLE_VOLTAGE; // Bit 7 low again: the reset is an edge
+            }
+            controlwords[count++] = RobotConstants::Control::CONTROLWORD_FAULT_RESET; // Transition 15
+            controlwords[count++] = RobotConstants::Control::CONTROLWORD_SHUTDOWN;    // 2
+            controlwords[count++] = RobotConstants::Control::CONTROLWORD_ENABLE_OPERATION; // 3 and 4
+            break;
+        case RobotConstants::DriveState::DRIVE_SWITCH_ON_DISABLED:
+            controlwords[count++] = RobotConstants::Control::CONTROLWORD_SHUTDOWN;
+            controlwords[count++] = RobotConstants::Control::CONTROLWORD_ENABLE_OPERATION;
+            break;
+        default: // Ready to switch on, switched on, quick stop active (transition 16)
+            controlwords[count++] = RobotConstants::Control::CONTROLWORD_ENABLE_OPERATION;
+            break;
+        }
+
+        for (uint8_t i = 0; i < count; ++i)
+        {
+            canOpen->send_x6040_controlword(nodeId, controlwords[i]);
+        }
+        driveStats.controlwords += count;
+        axis.enableInFlight = true;
+    }
+
+    bool MoveControllerBase::sendProfile(Axis &axis, bool changedOnly)
+    {
+        // Held: the planned profile, which the release rescales if it needs to
+        const uint8_t percent = feedRatePercent == 0 ? RobotConstants::FeedRate::MAX_PERCENT : feedRatePercent;
+        const MovePlan::AxisPlan &axisPlan = plans[activePlan].axes[axis.nodeId];
+        uint32_t velocity = axisPlan.profileVelocityRpm;
+        uint32_t acceleration = axisPlan.profileAccelerationRpmPerS;
+        if (percent != RobotConstants::FeedRate::MAX_PERCENT)
+        {
+            // From the planned speed rather than the rounded rpm; an axis that moves never gets 0
+            const double factor = percent / static_cast<double>(RobotConstants::FeedRate::MAX_PERCENT);
+            const uint32_t scaledVelocity = axis.speedUnitsToRevolutionsPerMinute(axisPlan.regularSpeed * factor);
+            const uint32_t scaledAcceleration = axis.accelerationUnitsTorpmPerSecond(axisPlan.acceleration * factor);
+            velocity = velocity == 0 ? 0 : (scaledVelocity > 0 ? scaledVelocity : 1);
+            acceleration = acceleration == 0 ? 0 : (scaledAcceleration > 0 ? scaledAcceleration : 1);
+        }
+
+        bool ok = true;
+        if (!changedOnly || velocity != axis.sentProfileVelocity)
+        {
+            ok = canOpen->send_x6081_profileVelocity(axis.nodeId, velocity) && ok;
+            axis.sentProfileVelocity = velocity;
+            feedRateStats.frames += changedOnly ? 1 : 0;
+        }
+        else
+        {
+            feedRateStats.unchanged++;
+        }
+        if (!changedOnly || acceleration != axis.sentProfileAcceleration)
+        {
+            ok = canOpen->send_x6083_profileAcceleration(axis.nodeId, acceleration) && ok;
+            axis.sentProfileAcceleration = acceleration;
+            feedRateStats.frames += changedOnly ? 1 : 0;
+        }
+        else
+        {
+            feedRateStats.unchanged++;
+        }
+        return ok;
+    }
+
+    void MoveControllerBase::commitPlan()
+    {
+        activePlan ^= 1; // One write: whatever reads the active plan sees the previous move or this one, never a mix
+        planStaged = false;
+        planStats.dispatched++;
+    }
+
+    void MoveControllerBase::sendQuickStops()
+    {
+        startProbeActive = false;
+        for (uint8_t nodeId = 1; nodeId <= axesCnt; ++nodeId)
+        {
+            canOpen->send_x6040_controlword(nodeId, RobotConstants::Control::CONTROLWORD_QUICK_STOP, CAN_TX_CLASS_URGENT);
+        }
+    }
+
+    void MoveControllerBase::cancelMotion()
+    {
+        // Enabling stops here and a held or queued move is not sent
+        if (movePending || planQueued)
+        {
+            movePending = false;
+            planQueued = false;
+            driveStats.movesDropped++;
+            addDataToOutQueue(RobotConstants::Commands::MOVE_DONE + " " + RobotConstants::Status::COMMAND_FULL_FAIL + " time=0us"); // Nothing was sent
+        }
+        if (moveTrackActive)
+        {
+            moveTrackFinish(); // With the axes that got there before the stop
+        }
+        for (uint8_t nodeId = 1; nodeId <= axesCnt; ++nodeId)
+        {
+            axes[nodeId].enableRequested = false;
+            axes[nodeId].enableInFlight = false;
+        }
+    }
+
+    bool MoveControllerBase::isDrivePresent(const Axis &axis) const
+    {
+        return axis.lastHeartbeatMs != 0 && millis() - axis.lastHeartbeatMs <= RobotConstants::Robot::HEARTBEAT_TIMEOUT_MS;
+    }
+
+    // Every drive that answers heartbeats is enabled; a silent one cannot be enabled, its moves are lost as before
+    bool MoveControllerBase::drivesReadyToMove() const
+    {
+        for (auto it = axes.begin(); it != axes.end(); ++it)
+        {
+            const Axis &axis = it->second;
+            if (isDrivePresent(axis) && axis.driveState != RobotConstants::DriveState::DRIVE_OPERATION_ENABLED)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void MoveControllerBase::sendMove()
+    {
+        PROF_SCOPE(PROF_SEND_MOVE);
+        if (moveTrackActive)
+        {
+            moveTrackFinish(); // Not expected: move() queues behind a tracked move (reported against its own plan)
+        }
+        commitPlan();
+        const MovePlan &plan = plans[activePlan];
+        startProbeActive = false;
+        lastStartSkew = StartSkew();
+        lastStartSkew.mode = startMode;
+        bool released = false;
+
+        for (auto it = axes.begin(); it != axes.end(); ++it)
+        {
+            Axis &axis = it->second;
+
+            StartProbe &probe = startProbes[axis.nodeId];
+            probe = StartProbe();
+            probe.startPosition = axis.getCurrentPositionInSteps();
+            const int32_t target = plan.axes[axis.nodeId].target;
+            probe.probing = axis.isAlive && std::abs(target - probe.startPosition) >= RobotConstants::Control::START_SKEW_THRESHOLD_STEPS;
+            if (probe.probing)
+            {
+                lastStartSkew.axesProbed++;
+            }
+
+            // An abort runs from yield() in these sends: nothing may follow its quick stops, the next
+            // controlword would enable the drive again
+            sendProfile(axis, false);
+            if (motionPaused)
+            {
+                break;
+            }
+
+            canOpen->send_x6040_controlword(axis.nodeId,
+                                            0x004F | feedHoldBit());
+            if (motionPaused)
+            {
+                break;
+            }
+
+            if (startMode == StartMode::SYNC)
+            {
+                // Held by the drive until the SYNC below; the 0x5F is the new-set-point edge
+                canOpen->sendPDO4_x607A_x6040_SyncMovement(axis.nodeId, target, 0x005F | feedHoldBit());
+            }
+            else
+            {
+                canOpen->send_x6040_controlword(axis.nodeId,
+                                                0x005F | feedHoldBit());
+                if (motionPaused)
+                {
+                    break;
+                }
+
+                canOpen->sendPDO4_x607A_SyncMovement(axis.nodeId, target);
+                probe.commandedUs = micros();
+                if (!released)
+                {
+                    startProbeReleaseUs = probe.commandedUs;
+                    released = true;
+                }
+            }
+        }
+
+        if (startMode == StartMode::SYNC && !motionPaused) // No release after an abort
+        {
+            canOpen->sendSYNC();
+            startProbeReleaseUs = micros();
+            for (uint8_t nodeId = 1; nodeId <= axesCnt; ++nodeId)
+            {
+                startProbes[nodeId].commandedUs = startProbeReleaseUs;
+            }
+        }
+        else
+        {
+            delay(5);
+        }
+        if (motionPaused)
+        {
+            moveTrackBegin(); // Tracked all the same: tick_abort() reports it (MDN FF) as a move stopped under way
+            return;
+        }
+
+        startProbeNextNodeId = 1;
+        startProbeActive = lastStartSkew.axesProbed > 0;
+        moveTrackBegin();
+    }
+
+    // ======== Start skew probe ========
+    void MoveControllerBase::startProbeSample(uint8_t nodeId, int32_t position)
+    {
+        if (!startProbeActive || nodeId > RobotConstants::Robot::AXES_COUNT)
+        {
+            return;
+        }
+        StartProbe &probe = startProbes[nodeId];
+        if (!probe.probing || probe.started)
+        {
+            return;
+        }
+
+        probe.awaiting = false;
+        const uint32_t receivedUs = canOpen->lastRxTimestampUs();
+        if (std::abs(position - probe.startPosition) < RobotConstants::Control::START_SKEW_THRESHOLD_STEPS)
+        {
+            probe.lastStillUs = receivedUs;
+            return;
+        }
+        probe.started = true;
+        probe.startedUs = receivedUs;
+        lastStartSkew.axesStarted++;
+        if (lastStartSkew.axesStarted == lastStartSkew.axesProbed)
+        {
+            startProbeFinish();
+        }
+    }
+
+    void MoveControllerBase::startProbeFinish()
+    {
+        startProbeActive = false;
+
+        // Offsets from the release, so micros() wrapping between samples does not matter.
+        // An axis started after its command and its last still sample, and before its first moving one
+        bool first = true;
+        uint32_t earliestUs = 0;
+        uint32_t latestUs = 0;
+        for (uint8_t nodeId = 1; nodeId <= axesCnt; ++nodeId)
+        {
+            const StartProbe &probe = startProbes[nodeId];
+            if (!probe.started)
+            {
+                continue;
+            }
+            const uint32_t commandedUs = probe.commandedUs - startProbeReleaseUs;
+            const int32_t stillUs = static_cast<int32_t>(probe.lastStillUs - startProbeReleaseUs);
+            const uint32_t fromUs = (stillUs > static_cast<int32_t>(commandedUs)) ? static_cast<uint32_t>(stillUs) : commandedUs;
+            const uint32_t toUs = probe.startedUs - startProbeReleaseUs;
+            const uint32_t widthUs = toUs > fromUs ? toUs - fromUs : 0;
+            const uint32_t startUs = fromUs + widthUs / 2;
+            earliestUs = (first || startUs < earliestUs) ? startUs : earliestUs;
+            latestUs = (first || startUs > latestUs) ? startUs : latestUs;
+            lastStartSkew.resolutionUs = widthUs > lastStartSkew.resolutionUs ? widthUs : lastStartSkew.resolutionUs;
+            first = false;
+        }
+        lastStartSkew.skewUs = latestUs - earliestUs;
+        DBG_INFO(DBG_GROUP_MOVE, "Start skew " + String(lastStartSkew.skewUs) + " us (+-" + String(lastStartSkew.resolutionUs) + " us), " +
+                                     String(lastStartSkew.axesStarted) + "/" + String(lastStartSkew.axesProbed) + " axes started");
+    }
+    // ======== Start skew probe end ========
+
+    // ======== Move tracking ========
+    // Every drive that answers heartbeats got the set point, including the ones whose target is
+    // where they stand: the stored position may be an old poll, the drive's own bits are not
+    void MoveControllerBase::moveTrackBegin()
+    {
+        for (uint8_t nodeId = 1; nodeId <= axesCnt; ++nodeId)
+        {
+            MoveTrack &track = moveTracks[nodeId];
+            track = MoveTrack();
+            track.tracked = isDrivePresent(axes[nodeId]);
+            track.moving = startProbes[nodeId].probing;
+        }
+        moveTrackActive = true;
+        moveTrackStartMs = millis();
+        moveTrackReleaseUs = startProbeReleaseUs;
+        moveTrackReleasedMs = 0;
+        moveTrackRestartTimeout();
+    }
+
+    void MoveControllerBase::moveTrackRestartTimeout()
+    {
+        // The whole planned duration again from now: an upper bound however far the axes got
+        moveTrackTimeoutFromMs = millis();
+        moveTrackTimeoutMs = feedRatePercent == 0 ? 0 : plans[activePlan].plannedMs * RobotConstants::FeedRate::MAX_PERCENT / feedRatePercent + RobotConstants::Cia402::MOVE_DONE_MARGIN_MS;
+    }
+
+    void MoveControllerBase::moveTrackStatusword(uint8_t nodeId, uint16_t statusword)
+    {
+        if (!moveTrackActive || nodeId > RobotConstants::Robot::AXES_COUNT)
+        {
+            return;
+        }
+        MoveTrack &track = moveTracks[nodeId];
+        if (!track.tracked || track.reached)
+        {
+            return;
+        }
+        if (axes[nodeId].driveState == RobotConstants::DriveState::DRIVE_OPERATION_ENABLED &&
+            (feedRatePercent == 0 || ((statusword & RobotConstants::Cia402::STATUSWORD_TARGET_REACHED) && moveTrackReleasedMs != 0 &&
+                                      millis() - moveTrackReleasedMs <= RobotConstants::Cia402::TRANSITION_TIMEOUT_MS)))
+        {
+            // Held, target reached only says the axis stands; just after the release it may still be the
+            // halted one. A drive that stays at target repeats it with the event timer
+            return;
+        }
+        if (axes[nodeId].driveState != RobotConstants::DriveState::DRIVE_OPERATION_ENABLED)
+        {
+            // Quick stop, fault or power loss: the drive stopped somewhere on the way
+            moveTrackFinish();
+            return;
+        }
+
+        const bool acknowledged = statusword & RobotConstants::Cia402::STATUSWORD_SET_POINT_ACK;
+        const bool reached = statusword & RobotConstants::Cia402::STATUSWORD_TARGET_REACHED;
+        if (!track.started)
+        {
+            track.ackCleared = track.ackCleared || !acknowledged;
+            if (track.moving)
+            {
+                // In immediate start mode the 0x5F edge reaches the drive before the new target,
+                // and the drive may report the old one reached in between
+                track.started = !reached || startProbes[nodeId].started;
+            }
+            else
+            {
+                // If the statusword with the bit low was lost, a high one well after the release
+                // can only be for the new set point
+                track.started = acknowledged && (track.ackCleared || !reached ||
+                                                 millis() - moveTrackStartMs > RobotConstants::Cia402::TRANSITION_TIMEOUT_MS);
+            }
+        }
+        if (track.started && reached)
+        {
+            track.reached = true;
+            track.reachedUs = canOpen->lastRxTimestampUs();
+            track.readSentMs = millis();
+            canOpen->sendSDORead(nodeId, RobotConstants::ODIndices::POSITION_ACTUAL_VALUE, RobotConstants::ODIndices::DEFAULT_SUBINDEX);
         }
-        tick_checkTimeouts();
-        tick_checkZEITimeouts();
     }
 
-    void MoveControllerBase::tick_500()
+    void MoveControllerBase::moveTrackPosition(uint8_t nodeId)
     {
-        if (!initialized)
+        if (!moveTrackActive || nodeId > RobotConstants::Robot::AXES_COUNT)
         {
-            addDataToOutQueue("JJ");
             return;
         }
-        tick_requestPosition();
-    }
-
-    // ============================= Public methods end =============================
-
-    // ============================ Protected methods =============================
-void MoveControllerBase::prepareMove() // TODO: Does not work for a = 0, maybe other corner cases
-    {
-        if (axesCnt == 0 || axes.empty())
+        MoveTrack &track = moveTracks[nodeId];
+        if (track.tracked && track.reached)
         {
-            addDataToOutQueue("No axes configured");
-            return;
+            track.positionRead = true; // Any answer after target reached: the drive stands there
         }
-        DBG_VERBOSE(DBG_GROUP_MOVE, "MoveControllerBase.cpp prepareMove called");
-        uint8_t maxMovementAxisId = 0;
-        bool firstAxis = true;
-        double maxMovement = 0;
+    }
 
-        for (auto it = axes.begin(); it != axes.end(); ++it)
+    void MoveControllerBase::moveTrackFinish()
+    {
+        moveTrackActive = false;
+        uint8_t tracked = 0;
+        uint8_t reached = 0;
+        uint32_t durationUs = 0;
+        String positions = "";
+        for (uint8_t nodeId = 1; nodeId <= axesCnt; ++nodeId)
         {
-            Axis &axis = it->second;
-            double axisMovement = std::fabs(axis.getMovementUnits());
-            if (firstAxis || axisMovement > maxMovement)
+            const MoveTrack &track = moveTracks[nodeId];
+            if (track.tracked)
             {
-                maxMovement = axisMovement;
-                maxMovementAxisId = axis.nodeId;
-                firstAxis = false;
+                tracked++;
+            }
+            if (track.reached)
+            {
+                reached++;
+                const uint32_t reachedUs = track.reachedUs - moveTrackReleaseUs;
+                durationUs = reachedUs > durationUs ? reachedUs : durationUs;
             }
+            positions += " " + String((char)RobotConstants::Robot::AXIS_IDENTIFIER_CHAR) + String((char)(RobotConstants::Robot::MIN_NODE_ID + nodeId - 1)) +
+                         String(axes[nodeId].getCurrentPositionInSteps());
         }
 
-        if (accelerationUnits == 0)
-        { // Right now we do not support zero acceleration. But in the future we can add special handling for this case.
-            addDataToOutQueue("MoveControllerBase.cpp zero acceleration is not supported");
-            return;
+        String status = RobotConstants::Status::COMMAND_FULL_FAIL;
+        if (tracked > 0 && reached == tracked)
+        {
+            status = RobotConstants::Status::OK;
         }
-        double tAcceleration = regularSpeedUnits / accelerationUnits; // в секундах
-        if (regularSpeedUnits == 0)
-        { // Zero speed means no movement at all. It is strange to call move with zero speed
-            addDataToOutQueue("MoveControllerBase.cpp zero regularSpeedUnits is not supported (zero speed)");
-            return;
+        else if (reached > 0)
+        {
+            status = RobotConstants::Status::COMMAND_PARTIAL_FAIL;
         }
-        double tCruising = (maxMovement - regularSpeedUnits * regularSpeedUnits / accelerationUnits) / regularSpeedUnits;
-        double res = 0;
+        if (reached < tracked)
+        {
+            durationUs = micros() - moveTrackReleaseUs; // Until it was given up on
+            DBG_WARN(DBG_GROUP_MOVE, "Move ended with " + String(reached) + "/" + String(tracked) + " axes at their targets");
+        }
+        addDataToOutQueue(RobotConstants::Commands::MOVE_DONE + " " + status + " time=" + String(durationUs) + "us" + positions);
+    }
+    // ======== Move tracking end ========
 
-        if (maxMovement == 0)
+    // ======== Velocity jog ========
+    void MoveControllerBase::jogStop(uint8_t nodeId)
+    {
+        JogAxis &jogAxis = jogs[nodeId];
+        jogAxis.state = JogState::STOPPING;
+        jogAxis.velocity = 0;
+        jogAxis.stopMs = millis();
+        jogAxis.positionSeen = false;
+        if (canOpen->sendPDO3_x60FF_TargetVelocity(nodeId, 0))
         {
-            addDataToOutQueue("MoveControllerBase.cpp maxMovement division by zero. Motors do not need to move.");
-            return;
+            jogStats.frames++;
         }
+    }
 
-        if (tAcceleration == 0 || (tAcceleration + tCruising == 0))
+    void MoveControllerBase::jogPosition(uint8_t nodeId, int32_t position)
+    {
+        if (nodeId > RobotConstants::Robot::AXES_COUNT || jogs[nodeId].state != JogState::STOPPING)
         {
-            addDataToOutQueue("MoveControllerBase.cpp tAcceleration or tAcceleration + tCruising division by zero");
             return;
         }
-
-        for (auto it = axes.begin(); it != axes.end(); ++it)
+        JogAxis &jogAxis = jogs[nodeId];
+        if (jogAxis.positionSeen && position == jogAxis.lastPosition)
         {
-            Axis &axis = it->second;
-
-            double axisMovementUnits = std::fabs(axis.getMovementUnits());
-
-            axis.acceleration = (axisMovementUnits) / (tAcceleration * (tAcceleration + tCruising));
-            axis.regularSpeed = axis.acceleration * tAcceleration;
-            axis.params.x6083_profileAcceleration = axis.accelerationUnitsTorpmPerSecond(axis.acceleration);
-            axis.params.x6081_profileVelocity = axis.speedUnitsToRevolutionsPerMinute(axis.regularSpeed);
+            jogFinish(nodeId);
+            return;
+        }
+        jogAxis.positionSeen = true;
+        jogAxis.lastPosition = position;
+        if (canOpen->sendPDO3_x60FF_TargetVelocity(nodeId, 0))
+        {
+            jogStats.frames++;
         }
     }
-    // ============================ Protected methods end ===========================
 
-    // ============================= Private methods =============================
-    void MoveControllerBase::sendMove()
+    void MoveControllerBase::jogFinish(uint8_t nodeId)
     {
-        for (auto it = axes.begin(); it != axes.end(); ++it)
-        {
-            Axis &axis = it->second;
-            canOpen->send_x6081_profileVelocity(axis.nodeId, axis.params.x6081_profileVelocity);
-            canOpen->send_x6083_profileAcceleration(axis.nodeId, axis.params.x6083_profileAcceleration);
-
-            canOpen->send_x6040_controlword(axis.nodeId,
-                                            0x004F);
-
-            canOpen->send_x6040_controlword(axis.nodeId,
-                                            0x005F);
-
-            canOpen->sendPDO4_x607A_SyncMovement(axis.nodeId, axis.getTargetPositionAbsolute());
+        JogAxis &jogAxis = jogs[nodeId];
+        // The drive holds where it stands: profile position without a new set point does not move
+        canOpen->send_x6060_modesOfOperation(nodeId, RobotConstants::Control::DEFAULT_MODE_POSITION);
+        jogStats.modeSwitches++;
+        jogStats.lastStopMs = millis() - jogAxis.stopMs;
+        jogStats.stopMaxMs = jogStats.lastStopMs > jogStats.stopMaxMs ? jogStats.lastStopMs : jogStats.stopMaxMs;
+        jogAxis.state = JogState::IDLE;
+        jogAxis.positionSeen = false;
+    }
+    // ======== Velocity jog end ========
 
-            // Imitation, that the motor reached the target position
-            axis.setCurrentPositionInSteps(axis.params.x607A_targetPosition);
-            // axis.params.x6064_positionActualValue = axis.params.x607A_targetPosition;
+    bool MoveControllerBase::isFeedbackActive(uint8_t nodeId, uint32_t now) const
+    {
+        const MoveTrack &track = moveTracks[nodeId];
+        if (moveTrackActive && track.tracked && !track.reached)
+        {
+            return true;
         }
-
-        delay(5);
-        // canOpen->sendSYNC();
+        const uint32_t lastActiveMs = feedback[nodeId].lastActiveMs;
+        return lastActiveMs != 0 && now - lastActiveMs <= RobotConstants::Feedback::ACTIVE_HOLD_MS;
     }
 
     void MoveControllerBase::positionUpdate(uint8_t nodeId, int32_t position)
     {
-        DBG_INFO(DBG_GROUP_CANOPEN, "Position update from node " + String(nodeId) + ": " + String(position));
+        DBG_INFO_MSG(DBG_GROUP_CANOPEN, POSITION_UPDATE, nodeId, position);
         auto it = axes.find(nodeId);
         if (it != axes.end())
         {
@@ -234,12 +1184,12 @@ void MoveControllerBase::prepareMove() // TODO: Does not work for a = 0, maybe o
 
             if ((now - lastHb) > RobotConstants::Robot::HEARTBEAT_TIMEOUT_MS && axis.isAlive)
             {
-                DBG_ERROR(DBG_GROUP_HEARTBEAT, "==== Heartbeat timeout for Axis " + String(nodeId) + " ====");
+                DBG_ERROR_MSG(DBG_GROUP_HEARTBEAT, HEARTBEAT_TIMEOUT, nodeId);
                 axis.isAlive = false;
             }
             else if ((now - lastHb) <= RobotConstants::Robot::HEARTBEAT_TIMEOUT_MS && !axis.isAlive)
             {
-                DBG_ERROR(DBG_GROUP_HEARTBEAT, "==== Heartbeat restored for Axis " + String(nodeId) + " ====");
+                DBG_ERROR_MSG(DBG_GROUP_HEARTBEAT, HEARTBEAT_RESTORED, nodeId);
                 axis.isAlive = true;
             }
         }
@@ -252,22 +1202,267 @@ void MoveControllerBase::prepareMove() // TODO: Does not work for a = 0, maybe o
             Axis &axis = axes[nodeId];
             if (axis.initStatus == RobotConstants::InitStatus::ZEI_ONGOING && !axis.isAlive)
             {
-                DBG_WARN(DBG_GROUP_ZEI, "Zero Initialization failed for Axis " + String(nodeId) + ": Heartbeat timeout");
+                DBG_WARN_MSG(DBG_GROUP_ZEI, ZEI_HEARTBEAT_TIMEOUT, nodeId);
                 axis.initStatus = RobotConstants::InitStatus::ZEI_FAILED;
                 ZEI_finalResult();
             }
         }
     }
 
+    void MoveControllerBase::tick_configureNode()
+    {
+        for (uint8_t nodeId = 1; nodeId <= axesCnt; ++nodeId)
+        {
+            Axis &axis = axes[nodeId];
+            if (!axis.configurationPending)
+            {
+                continue;
+            }
+            axis.configurationPending = false;
+            if (!configureNode(nodeId))
+            {
+                DBG_ERROR(DBG_GROUP_HEARTBEAT, "NMT: failed to queue the configuration of Axis " + String(nodeId));
+            }
+            axis.configuredMs = millis();
+            nmtStats.configurations++;
+            nmtStats.lastNodeId = nodeId;
+            if (axis.bootUpMs != 0)
+            {
+                nmtStats.recoveryMs = axis.configuredMs - axis.bootUpMs;
+                nmtStats.recoveryMaxMs = nmtStats.recoveryMs > nmtStats.recoveryMaxMs ? nmtStats.recoveryMs : nmtStats.recoveryMaxMs;
+                axis.bootUpMs = 0;
+                DBG_INFO_MSG(DBG_GROUP_HEARTBEAT, NMT_NODE_CONFIGURED, nodeId, nmtStats.recoveryMs);
+            }
+            else
+            {
+                DBG_INFO_MSG(DBG_GROUP_HEARTBEAT, NMT_NODE_RECONFIGURED, nodeId);
+            }
+            return;
+        }
+    }
+
+    void MoveControllerBase::tick_driveStates()
+    {
+        const uint32_t now = millis();
+        bool enabling = false;
+        for (uint8_t nodeId = 1; nodeId <= axesCnt; ++nodeId)
+        {
+            Axis &axis = axes[nodeId];
+            if (!axis.enableRequested)
+            {
+                continue;
+            }
+            enabling = true;
+            if (now - axis.enableSentMs <= RobotConstants::Cia402::TRANSITION_TIMEOUT_MS)
+            {
+                continue;
+            }
+            if (axis.enableAttempts >= RobotConstants::Cia402::MAX_ENABLE_ATTEMPTS)
+            {
+                axis.enableRequested = false;
+                axis.enableInFlight = false;
+                driveStats.failures++;
+                DBG_ERROR_MSG(DBG_GROUP_AXIS, DRIVE_ENABLE_FAILED, nodeId, axis.enableAttempts, axis.driveState);
+                continue;
+            }
+            sendEnableSequence(nodeId); // Frames lost or the drive slower than expected: again, from the state it reports now
+        }
+
+        if (!movePending)
+        {
+            return;
+        }
+        if (drivesReadyToMove())
+        {
+            movePending = false;
+            sendMove();
+        }
+        else if (!enabling || now - movePendingSinceMs > RobotConstants::Cia402::MOVE_HOLD_TIMEOUT_MS)
+        {
+            movePending = false;
+            driveStats.movesDropped++;
+            DBG_WARN_MSG(DBG_GROUP_MOVE, DRIVE_MOVE_DROPPED, now - movePendingSinceMs);
+            addDataToOutQueue(RobotConstants::Commands::MOVE_DONE + " " + RobotConstants::Status::COMMAND_FULL_FAIL + " time=0us"); // Nothing was sent
+        }
+    }
+
+    void MoveControllerBase::tick_moveTrack()
+    {
+        if (!moveTrackActive)
+        {
+            return;
+        }
+        const uint32_t now = millis();
+        bool done = true;
+        for (uint8_t nodeId = 1; nodeId <= axesCnt; ++nodeId)
+        {
+            MoveTrack &track = moveTracks[nodeId];
+            if (!track.tracked)
+            {
+                continue;
+            }
+            if (track.reached && !track.positionRead && now - track.readSentMs > RobotConstants::Cia402::FINAL_POSITION_TIMEOUT_MS)
+            {
+                // Target reached means within the drive's position window: the target stands in for the lost answer
+                axes[nodeId].setCurrentPositionInSteps(plans[activePlan].axes[nodeId].target);
+                track.positionRead = true;
+            }
+            done = done && track.positionRead;
+        }
+
+        if (done || (feedRatePercent != 0 && now - moveTrackTimeoutFromMs > moveTrackTimeoutMs))
+        {
+            moveTrackFinish();
+        }
+    }
+
+    void MoveControllerBase::tick_abort()
+    {
+        if (abortCleanupPending)
+        {
+            abortCleanupPending = false;
+            cancelMotion(); // Running jogs are stopped by tick_jog() while motion is paused
+        }
+        const uint32_t now = millis();
+        if (!abortConfirmPending || now - abortStopSentMs <= RobotConstants::Abort::STOP_CONFIRM_MS)
+        {
+            return;
+        }
+        if (!motionPaused)
+        {
+            abortConfirmPending = false; // EMCR: the axes are enabled on purpose
+            return;
+        }
+        // A lost quick stop leaves the axis running: the statusword tells, send it again
+        bool running = false;
+        for (uint8_t nodeId = 1; nodeId <= axesCnt; ++nodeId)
+        {
+            if (axes[nodeId].driveState == RobotConstants::DriveState::DRIVE_OPERATION_ENABLED && isDrivePresent(axes[nodeId]))
+            {
+                running = true;
+                canOpen->send_x6040_controlword(nodeId, RobotConstants::Control::CONTROLWORD_QUICK_STOP, CAN_TX_CLASS_URGENT);
+                abortStats.resends++;
+            }
+        }
+        abortStopSentMs = now;
+        abortStopAttempts++;
+        abortConfirmPending = running && abortStopAttempts < RobotConstants::Abort::MAX_STOP_ATTEMPTS;
+    }
+
+    void MoveControllerBase::tick_jog()
+    {
+        const uint32_t now = millis();
+        for (uint8_t nodeId = 1; nodeId <= axesCnt; ++nodeId)
+        {
+            JogAxis &jogAxis = jogs[nodeId];
+            if (jogAxis.state == JogState::IDLE)
+            {
+                continue;
+            }
+            keepFeedbackActive(nodeId); // The standstill check runs on the position answers
+            if (jogAxis.state == JogState::RUNNING)
+            {
+                if (motionPaused)
+                {
+                    jogStop(nodeId); // Quick-stopped already; the velocity must not come back with EMCR
+                }
+                else if (now - jogAxis.updateMs > RobotConstants::Jog::DEADMAN_MS)
+                {
+                    jogStats.deadmanStops++;
+                    DBG_WARN_MSG(DBG_GROUP_MOVE, JOG_DEADMAN_STOP, nodeId, now - jogAxis.updateMs);
+                    jogStop(nodeId);
+                }
+            }
+            else if (now - jogAxis.stopMs > RobotConstants::Jog::STOP_TIMEOUT_MS)
+            {
+                DBG_WARN_MSG(DBG_GROUP_MOVE, JOG_STOP_TIMEOUT, nodeId, now - jogAxis.stopMs);
+                jogFinish(nodeId);
+            }
+        }
+    }
+
     void MoveControllerBase::tick_requestPosition()
     {
-        for(uint8_t nodeId = 1; nodeId <= axesCnt; ++nodeId) { 
-            if(axes[nodeId].isAlive) {
-                canOpen->sendSDORead(nodeId, 
-                                     RobotConstants::ODIndices::POSITION_ACTUAL_VALUE,
-                                     RobotConstants::ODIndices::DEFAULT_SUBINDEX);
+        const uint32_t now = millis();
+        if (now - feedbackWindowMs >= RobotConstants::Feedback::RATE_WINDOW_MS)
+        {
+            const uint32_t windowMs = now - feedbackWindowMs;
+            for (uint8_t nodeId = 1; nodeId <= axesCnt; ++nodeId)
+            {
+                feedback[nodeId].rateHz = feedback[nodeId].answers * 1000.0f / windowMs;
+                feedback[nodeId].answers = 0;
+            }
+            feedbackWindowMs = now;
+        }
+
+        // Token bucket in thousandths of a poll, refilled at the ceiling's rate; a burst of one poll per axis at most
+        uint32_t elapsedMs = now - feedbackTokensMs;
+        feedbackTokensMs = now;
+        elapsedMs = elapsedMs < 1000u ? elapsedMs : 1000u;
+        const uint32_t capacity = axesCnt * 1000u;
+        feedbackTokens += elapsedMs * feedbackBudgetPerSecond;
+        feedbackTokens = feedbackTokens < capacity ? feedbackTokens : capacity;
+
+        uint8_t dueNodeId = 0;
+        uint32_t mostOverdueMs = 0;
+        for (uint8_t nodeId = 1; nodeId <= axesCnt; ++nodeId)
+        {
+            FeedbackPoll &poll = feedback[nodeId];
+            if (isFeedbackActive(nodeId, now))
+            {
+                if (moveTrackActive && moveTracks[nodeId].tracked && !moveTracks[nodeId].reached)
+                {
+                    poll.lastActiveMs = now != 0 ? now : 1; // The hold runs from the end of the move
+                }
+                poll.intervalMs = RobotConstants::Feedback::ACTIVE_INTERVAL_MS;
+            }
+            if (!axes[nodeId].isAlive)
+            {
+                continue;
+            }
+            const StartProbe &probe = startProbes[nodeId];
+            if (startProbeActive && probe.probing && !probe.started)
+            {
+                continue; // Read back to back by the start skew probe already
             }
+            const uint32_t sinceMs = now - poll.lastPollMs;
+            if (sinceMs < poll.intervalMs)
+            {
+                continue;
+            }
+            if (dueNodeId == 0 || sinceMs - poll.intervalMs > mostOverdueMs)
+            {
+                dueNodeId = nodeId;
+                mostOverdueMs = sinceMs - poll.intervalMs;
+            }
+        }
+        if (dueNodeId == 0)
+        {
+            return;
+        }
+
+        FeedbackPoll &poll = feedback[dueNodeId];
+        if (feedbackTokens < 1000u)
+        {
+            poll.waited = true;
+            return;
+        }
+        feedbackTokens -= 1000u;
+        if (poll.waited)
+        {
+            feedbackThrottled++;
+            poll.waited = false;
+        }
+        poll.lastPollMs = now;
+        if (!isFeedbackActive(dueNodeId, now))
+        {
+            const uint32_t intervalMs = poll.intervalMs * 2;
+            poll.intervalMs = intervalMs < RobotConstants::Feedback::IDLE_INTERVAL_MS ? intervalMs : RobotConstants::Feedback::IDLE_INTERVAL_MS;
         }
+        canOpen->sendSDORead(dueNodeId,
+                             RobotConstants::ODIndices::POSITION_ACTUAL_VALUE,
+                             RobotConstants::ODIndices::DEFAULT_SUBINDEX,
+                             CAN_TX_CLASS_DIAG);
     }
     // ======== Timer functions end ========
 
@@ -286,7 +1481,7 @@ void MoveControllerBase::prepareMove() // TODO: Does not work for a = 0, maybe o
 
         // Step 4
         bool successSend = canOpen->send_x6040_controlword(nodeId,
-                                                           0x0000);
+                                                           RobotConstants::Control::CONTROLWORD_DISABLE_VOLTAGE);
 
         // Step 5
         if (!ZEI_checkResponseStatus(nodeId, successSend,
@@ -363,8 +1558,16 @@ void MoveControllerBase::prepareMove() // TODO: Does not work for a = 0, maybe o
                                                 { this->ZEI_AfterSecondWriteTo_0x6040(cbNodeId, cbSuccess); }, nodeId);
         // Step 4
         delay(200);
+        if (motionPaused)
+        {
+            // Aborted from the delay: the zero is set, 0x000F would enable the quick-stopped drive again
+            canOpen->set_callback_x6040_controlword(nullptr, nodeId);
+            axes[nodeId].initStatus = RobotConstants::InitStatus::ZEI_FINISHED;
+            ZEI_finalResult();
+            return;
+        }
         bool successSend = canOpen->send_x6040_controlword(nodeId,
-                                                           0x000F);
+                                                           RobotConstants::Control::CONTROLWORD_ENABLE_OPERATION);
         // Step 5
         if (!ZEI_checkResponseStatus(nodeId, successSend,
                                      "ZEI: Failed to send control word <- 0x000F"))
@@ -385,6 +1588,12 @@ void MoveControllerBase::prepareMove() // TODO: Does not work for a = 0, maybe o
             return;
         }
         axes[nodeId].initStatus = RobotConstants::InitStatus::ZEI_FINISHED;
+        // 0x000F after disable voltage is no CiA 402 transition: the drive is enabled from the state it reports,
+        // unless motion was aborted meanwhile (the drive stays quick-stopped until EMCR)
+        if (!motionPaused)
+        {
+            enableDrive(nodeId);
+        }
         ZEI_finalResult();
     }
 
@@ -490,19 +1699,155 @@ void MoveControllerBase::prepareMove() // TODO: Does not work for a = 0, maybe o
         }
         DBG_INFO(DBG_GROUP_HEARTBEAT, "HB from " + String(nodeId) + ": " + statusStr);
         */
-        axes[nodeId].lastHeartbeatMs = millis();
+        auto it = axes.find(nodeId);
+        if (it == axes.end())
+        {
+            return;
+        }
+        Axis &axis = it->second;
+        const uint32_t now = millis();
+        axis.lastHeartbeatMs = now;
+
+        const uint8_t state = status & 0x7F; // Bit 7 is the node guarding toggle bit
+        if (state == RobotConstants::CANOpen::NMT_STATE_BOOT_UP)
+        {
+            // Power-up or reset: the drive lost its configuration
+            nmtStats.bootUps++;
+            axis.bootUpMs = now != 0 ? now : 1;
+            axis.configurationPending = true;
+            axis.driveState = RobotConstants::DriveState::DRIVE_UNKNOWN; // Until its first TPDO1
+            axis.statusword = 0;
+            axis.enableInFlight = false;
+            if (nodeId <= RobotConstants::Robot::AXES_COUNT)
+            {
+                jogs[nodeId] = JogAxis(); // Back in profile position with its configuration; a jog has to start over
+            }
+            DBG_WARN_MSG(DBG_GROUP_HEARTBEAT, NMT_BOOT_UP, nodeId);
+        }
+        else if (state == RobotConstants::CANOpen::NMT_STATE_PRE_OPERATIONAL &&
+                 nmtTarget == RobotConstants::CANOpen::NMT_STATE_OPERATIONAL && !axis.configurationPending &&
+                 now - axis.configuredMs > RobotConstants::CANOpen::NMT_RECONFIGURE_HOLDOFF_MS)
+        {
+            axis.configurationPending = true; // Boot-up message missed, or the NMT start was lost
+        }
+        else if (state == RobotConstants::CANOpen::NMT_STATE_OPERATIONAL && !axis.configurationPending &&
+                 now - axis.statuswordMs > RobotConstants::Cia402::STATUSWORD_SILENT_MS &&
+                 now - axis.configuredMs > RobotConstants::Cia402::STATUSWORD_SILENT_MS)
+        {
+            // SDO writes are not retried: a lost one leaves TPDO1 invalid and the drive state stale
+            axis.configurationPending = true;
+        }
+        axis.nmtState = state;
+    }
+
+    void MoveControllerBase::regularEmcyCallback(uint8_t nodeId, uint16_t errorCode, uint8_t errorRegister, const uint8_t *vendor)
+    {
+        auto it = axes.find(nodeId);
+        if (it == axes.end())
+        {
+            return;
+        }
+        Axis &axis = it->second;
+        const bool fault = errorCode != RobotConstants::Emcy::ERROR_RESET;
+        axis.emcyErrorCode = errorCode;
+
+        // Stop first, report after: the quick stops go out before the serial line is even built
+        if (fault)
+        {
+            if (faultReaction & RobotConstants::Emcy::REACTION_QUICK_STOP)
+            {
+                sendQuickStops();
+            }
+            if (faultReaction & RobotConstants::Emcy::REACTION_PAUSE)
+            {
+                motionPaused = true;
+            }
+            if (faultReaction & (RobotConstants::Emcy::REACTION_QUICK_STOP | RobotConstants::Emcy::REACTION_PAUSE))
+            {
+                cancelMotion(); // EMCR resets and enables again; a report alone leaves motion as it is
+            }
+            faultStats.emergencies++;
+            faultStats.lastNodeId = nodeId;
+            faultStats.lastErrorCode = errorCode;
+            faultStats.lastErrorRegister = errorRegister;
+            faultStats.reactionUs = micros() - canOpen->lastRxTimestampUs();
+            faultStats.reactionMaxUs = faultStats.reactionUs > faultStats.reactionMaxUs ? faultStats.reactionUs : faultStats.reactionMaxUs;
+            DBG_ERROR_MSG(DBG_GROUP_AXIS, EMCY_FAULT, nodeId, errorCode, errorRegister);
+        }
+        else
+        {
+            DBG_INFO_MSG(DBG_GROUP_AXIS, EMCY_ERROR_RESET, nodeId);
+        }
+
+        if (faultReaction & RobotConstants::Emcy::REACTION_REPORT)
+        {
+            // EMC <node> <error code> <error register> <vendor bytes>, hex
+            String report = RobotConstants::Commands::EMERGENCY + " " + String(nodeId) + " " + String(errorCode, HEX) + " " + String(errorRegister, HEX) + " ";
+            for (uint8_t i = 0; i < RobotConstants::Emcy::VENDOR_BYTES; ++i)
+            {
+                if (vendor[i] < 0x10)
+                {
+                    report += "0";
+                }
+                report += String(vendor[i], HEX);
+            }
+            addDataToOutQueue(report);
+        }
     }
 
     void MoveControllerBase::regularPositionActualValueCallback(uint8_t nodeId, bool success, int32_t position)
     {
         if (!success)
         {
-            DBG_ERROR(DBG_GROUP_CANOPEN, "Failed to read Position Actual Value for node " + String(nodeId));
+            DBG_ERROR_MSG(DBG_GROUP_CANOPEN, POSITION_READ_FAILED, nodeId);
             return;
         }
+        startProbeSample(nodeId, position);
         positionUpdate(nodeId, position);
+        moveTrackPosition(nodeId);
+        jogPosition(nodeId, position);
+        if (nodeId <= RobotConstants::Robot::AXES_COUNT)
+        {
+            feedback[nodeId].answers++;
+        }
         axes[nodeId].lastHeartbeatMs = millis();
     }
+
+    void MoveControllerBase::regularStatuswordCallback(uint8_t nodeId, bool success, uint16_t statusword)
+    {
+        auto it = axes.find(nodeId);
+        if (!success || it == axes.end())
+        {
+            return;
+        }
+        Axis &axis = it->second;
+        const RobotConstants::DriveState previous = axis.driveState;
+        const RobotConstants::DriveState state = RobotConstants::driveStateFromStatusword(statusword);
+        axis.statusword = statusword;
+        axis.statuswordMs = millis();
+        axis.driveState = state;
+        if (state != previous)
+        {
+            DBG_INFO_MSG(DBG_GROUP_AXIS, DRIVE_STATE_CHANGED, nodeId, previous, state, statusword);
+        }
+        moveTrackStatusword(nodeId, statusword);
+        if (!axis.enableRequested)
+        {
+            return;
+        }
+
+        if (state == RobotConstants::DriveState::DRIVE_OPERATION_ENABLED)
+        {
+            axis.enableRequested = false;
+            axis.enableInFlight = false;
+            driveStats.lastEnableUs = micros() - axis.enableRequestedUs;
+            driveStats.enableMaxUs = driveStats.lastEnableUs > driveStats.enableMaxUs ? driveStats.lastEnableUs : driveStats.enableMaxUs;
+        }
+        else if (!axis.enableInFlight && state != previous)
+        {
+            sendEnableSequence(nodeId); // State read back, or the drive left a state it had to leave by itself
+        }
+    }
     // ======== Regular callbacks end ========
     // ============================= Private methods end =============================
     
@@ -3,6 +3,7 @@
 #define MOVECONTROLLERBASE_H
 
 #include <string>
+#include <functional>
 #include <unordered_map>
 #include "CanOpen.h"
 #include "Params.h"
@@ -14,8 +15,131 @@ namespace StepDirController
     class MoveControllerBase
     {
     public:
+        // How sendMove() releases the motion
+        enum class StartMode : uint8_t
+        {
+            IMMEDIATE = 0, // Each drive starts when its own RPDO arrives (axes start one after another)
+            SYNC = 1,      // All drives are preloaded on synchronous RPDOs and released by one SYNC frame
+        };
+
+        // Velocity jog of one axis
+        enum class JogState : uint8_t
+        {
+            IDLE = 0,     // Profile position, as every other command expects
+            RUNNING = 1,  // Profile velocity, following the jog updates
+            STOPPING = 2, // Target velocity 0 sent, waiting for the axis to stand before position mode
+        };
+
+        // Inter-axis start skew of the last move, from timestamped 0x6064 feedback
+        struct StartSkew
+        {
+            uint32_t skewUs = 0;       // Latest minus earliest start (middle of each axis' start interval)
+            uint32_t resolutionUs = 0; // Widest start interval: last still sample (or the command) to first moving sample
+            uint8_t axesProbed = 0;    // Axes that had to move
+            uint8_t axesStarted = 0;   // Axes seen moving within START_SKEW_WINDOW_MS
+            StartMode mode = StartMode::IMMEDIATE;
+        };
+
+        // Drive faults reported over EMCY, and how long the reaction took
+        struct FaultStats
+        {
+            uint32_t emergencies = 0; // EMCY frames with an error code (error resets not counted)
+            uint8_t lastNodeId = 0;
+            uint16_t lastErrorCode = 0;
+            uint8_t lastErrorRegister = 0;
+            uint32_t reactionUs = 0; // EMCY reception to the quick stops queued, last fault
+            uint32_t reactionMaxUs = 0;
+        };
+
+        // NMT master: drive (re)boots seen and the configurations they triggered
+        struct NmtStats
+        {
+            uint32_t bootUps = 0;        // Boot-up messages
+            uint32_t configurations = 0; // Nodes configured and put back into the requested state
+            uint8_t lastNodeId = 0;
+            uint32_t recoveryMs = 0; // Boot-up message to configuration and NMT start sent, last reboot
+            uint32_t recoveryMaxMs = 0;
+        };
+
+        // CiA 402 enabling: requests, controlwords they took, and moves waiting for it
+        struct DriveStats
+        {
+            uint32_t enableRequests = 0;
+            uint32_t controlwords = 0; // 0x6040 writes sent by the state machine
+            uint32_t failures = 0;     // Not enabled after MAX_ENABLE_ATTEMPTS
+            uint32_t movesHeld = 0;    // Moves that waited for their drives to be enabled
+            uint32_t movesDropped = 0;
+            uint32_t lastEnableUs = 0; // Request to operation enabled reported, last drive
+            uint32_t enableMaxUs = 0;
+        };
+
+        // Velocity jog: updates taken, the frames they took, and how jogs ended
+        struct JogStats
+        {
+            uint32_t updates = 0;       // jog() calls that sent a target velocity
+            uint32_t frames = 0;        // RPDO3 target velocity frames (updates and stops)
+            uint32_t modeSwitches = 0;  // 0x6060 writes: into profile velocity and back
+            uint32_t deadmanStops = 0;  // Axes stopped for want of an update
+            uint32_t lastStopMs = 0;    // Stop sent to position mode again, last axis
+            uint32_t stopMaxMs = 0;
+        };
+
+        // Feed-rate override: changes, and the profile writes they took
+        struct FeedRateStats
+        {
+            uint32_t changes = 0;   // setFeedRate() calls that changed the rate
+            uint32_t frames = 0;    // 0x6081/0x6083/0x6040 writes sent for them during moves
+            uint32_t unchanged = 0; // Profile objects not written, the drive has the value already
+            uint32_t holds = 0;     // Moves held at 0%
+        };
+
+        // One planned move, every axis: filled by prepareMove() into the staging buffer and not changed after.
+        // A move commanded while another one runs is planned at once and waits there until the one under
+        // way is done (MDN); sendMove() then makes it the active plan. Feed-rate changes, move tracking and
+        // the configuration of a rebooted drive read the active plan only, so a new command cannot touch
+        // the move under way
+        struct MovePlan
+        {
+            struct AxisPlan
+            {
+                int32_t target = 0;                      // Absolute [steps]
+                double regularSpeed = 0;                 // Cruise speed at 100 % feed rate [units/s]
+                double acceleration = 0;                 // [units/s^2]
+                uint32_t profileVelocityRpm = 0;         // 0x6081
+                uint32_t profileAccelerationRpmPerS = 0; // 0x6083
+            };
+            AxisPlan axes[RobotConstants::Robot::AXES_COUNT + 1]; // index 0 is unused
+            uint32_t plannedMs = 0; // Duration of the trapezoid (an upper bound for a triangle)
+            uint32_t sequence = 0;  // Plans prepared before and including this one; 0 = none yet
+        };
+
+        // Move plans: prepared, dispatched, and what became of the staged ones
+        struct PlanStats
+        {
+            uint32_t prepared = 0;
+            uint32_t dispatched = 0;
+            uint32_t replaced = 0;     // A staged plan overwritten by a newer one before it was dispatched (MDN FF for it)
+            uint32_t queued = 0;       // Plans that waited for the move under way to finish
+            uint32_t rejected = 0;     // prepareMove() could not plan: nothing sent
+            uint32_t prepareUs = 0;    // Last prepareMove()
+            uint32_t prepareMaxUs = 0;
+        };
+
+        // Aborts: how fast the quick stops were queued and what they dropped
+        struct AbortStats
+        {
+            uint32_t aborts = 0;
+            uint8_t lastSource = RobotConstants::Abort::SOURCE_COMMAND;
+            uint32_t latencyUs = 0; // Request (line complete or pin edge) to the last quick stop queued, last abort
+            uint32_t latencyMaxUs = 0;
+            uint8_t lastFlushed = 0; // Queued motion frames (PDO, SDO) dropped, last abort
+            uint32_t flushed = 0;    // The same, all aborts
+            uint32_t resends = 0;    // Quick stops sent again to axes still reporting operation enabled
+        };
+
         void requestStatus();
         int32_t axisPosition(uint8_t nodeId) { return axes.at(nodeId).getCurrentPositionInSteps(); }
+        int32_t moveStartPosition(uint8_t nodeId); // Where a move commanded now starts [steps]: MRJ is relative to it
 
         bool start(CanOpen *canOpen, uint8_t axesCnt);
 
@@ -25,21 +149,109 @@ namespace StepDirController
         void setRegularSpeedUnits(double speed);        // настройка крейсерской скорости в единицах измерения в секунду (градусы в секунду)
         void setAccelerationUnits(double acceleration); // настройка ускорения в единицах измерения в секунду^2 (градусы в секунду^2)
 
-        // double getRegularSpeedUnits() const;
-        // double getAccelerationUnits() const;
+        double getRegularSpeedUnits() const { return regularSpeedUnits; }
+        double getAccelerationUnits() const { return accelerationUnits; }
 
         void startZeroInitializationAllAxes();
         void startZeroInitializationSingleAxis(uint8_t nodeId);
 
         void move();
 
+        // Remaps RPDO4 of every axis for the mode; false if a frame could not be sent
+        bool setStartMode(StartMode mode);
+        StartMode getStartMode() const { return startMode; }
+        const StartSkew &getLastStartSkew() const { return lastStartSkew; }
+
+        // Reaction to an EMCY fault, RobotConstants::Emcy::REACTION_* bits
+        void setFaultReaction(uint8_t reaction) { faultReaction = reaction; }
+        uint8_t getFaultReaction() const { return faultReaction; }
+        bool isMotionPaused() const { return motionPaused; } // A fault paused motion, moves are refused
+        // Fault reset to the faulted drives, quick-stopped drives enabled again, motion resumed
+        bool clearFault();
+        const FaultStats &getFaultStats() const { return faultStats; }
+
+        // NMT command to all nodes in one frame. Start, stop and pre-operational also set the state
+        // rebooted nodes are brought back to; after a reset the nodes boot and are configured again
+        bool broadcastNmt(uint8_t command);
+        uint8_t getNmtTarget() const { return nmtTarget; } // RobotConstants::CANOpen::NMT_STATE_*
+        // Mode-specific part of the configuration a booted node gets (RPDO mapping, 0x6060, ...),
+        // instead of the profile position default. nullptr restores the default
+        void setNodeConfigurator(std::function<bool(uint8_t)> configurator) { nodeConfigurator = configurator; }
+        const NmtStats &getNmtStats() const { return nmtStats; }
+
+        // Brings the drive to operation enabled from the state its statusword reports, in as few
+        // controlwords as that state allows; resetFault also acknowledges a fault. Retried from the
+        // reported state until it gets there or runs out of attempts. Refused while motion is paused
+        // (abort, fault): clearFault() lifts the pause first
+        void enableDrive(uint8_t nodeId, bool resetFault = false);
+        bool hasDriveFault() const;                      // A drive reports fault or fault reaction active
+        bool isMovePending() const { return movePending; } // A move waits for its drives to be enabled
+        const DriveStats &getDriveStats() const { return driveStats; }
+        void resetDriveStats() { driveStats = DriveStats(); }
+
+        // A profile position move was sent and not every moving axis reported target reached yet.
+        // Its end is reported once, asynchronously: MDN <status> time=<us>us JA<steps> JB<steps> ...
+        bool isMoveInProgress() const { return moveTrackActive; }
+
+        // Position feedback: each live axis is polled at Feedback::ACTIVE_INTERVAL_MS while it is in a
+        // tracked move or marked active, and back down to IDLE_INTERVAL_MS after, halving the rate
+        // poll by poll. All polls together stay within the ceiling, a share of the bus in permille
+        void keepFeedbackActive(uint8_t nodeId); // Moving outside a tracked move (CSP, jog): fast for ACTIVE_HOLD_MS
+        void setFeedbackCeiling(uint16_t permille);
+        uint16_t getFeedbackCeiling() const { return feedbackCeilingPermille; }
+        uint32_t getFeedbackBudget() const { return feedbackBudgetPerSecond; } // Polls per second the ceiling allows
+        uint32_t getFeedbackInterval(uint8_t nodeId) const;
+        float getFeedbackRate(uint8_t nodeId) const; // Answered 0x6064 reads per second, last RATE_WINDOW_MS
+        uint32_t getFeedbackThrottled() const { return feedbackThrottled; } // Polls held back by the ceiling
+
+        // Velocity jog, signed speed in units/s: the first update of an axis writes 0x6083 from the jog
+        // acceleration, switches the drive to profile velocity (0x6060 = 3) and enables it; every update
+        // is then one RPDO3 frame with 0x60FF. An axis without an update for Jog::DEADMAN_MS is stopped.
+        // Speed 0 stops it; once it stands it goes back to profile position. False if the axis cannot
+        // jog now: drive not present, motion paused, a move held or under way, a node configurator (CSP) set
+        bool jog(uint8_t nodeId, double speedUnits);
+        void stopJog(); // Every jogging axis
+        bool isJogActive() const; // An axis jogs or is still stopping: moves are refused
+        void setJogAccelerationUnits(double acceleration) { jogAccelerationUnits = acceleration; } // Taken by the next jog start
+        double getJogAccelerationUnits() const { return jogAccelerationUnits; }
+        JogState getJogState(uint8_t nodeId) const;
+        int32_t getJogVelocity(uint8_t nodeId) const; // Last 0x60FF sent [rpm]
+        const JogStats &getJogStats() const { return jogStats; }
+        void resetJogStats() { jogStats = JogStats(); }
+
+        // Feed-rate override in percent of the planned profile: every axis gets 0x6081 and 0x6083
+        // scaled by the same factor, so the axes stay synchronized. During a move the axes still on
+        // their way get the objects whose value changes, nothing else; 0 holds them with the halt
+        // bit (0x6040 bit 8) and any other rate releases it. Moves sent later use the rate as well.
+        // False if the percent is out of range or a frame could not be sent
+        bool setFeedRate(uint8_t percent);
+        uint8_t getFeedRate() const { return feedRatePercent; }
+        const FeedRateStats &getFeedRateStats() const { return feedRateStats; }
+        void resetFeedRateStats() { feedRateStats = FeedRateStats(); }
+
+        // Abort: queued PDO and SDO frames are dropped, every axis gets the quick stop controlword in the
+        // urgent class and motion is paused, as after a drive fault (clearFault() resumes). Only that
+        // happens here, so it may be called from yield() in the middle of another send; the held move,
+        // the move under way (MDN FF) and jogs are cancelled by the next tick_fast().
+        // requestedUs: when the request came in, for the latency
+        bool abort(uint8_t source, uint32_t requestedUs);
+        const AbortStats &getAbortStats() const { return abortStats; }
+
+        const MovePlan &getActivePlan() const { return plans[activePlan]; }
+        uint8_t getActivePlanIndex() const { return activePlan; }
+        const PlanStats &getPlanStats() const { return planStats; }
+
         // Call this regularly from the main loop to check timeouts.
         void tick_50();
         void tick_500();
+        // Call this on every loop() pass: abort cleanup, configuration of booted nodes, drive enabling, held move,
+        // move tracking, jog deadman, position feedback, start skew probe
+        void tick_fast();
 
 
     protected:
-        void prepareMove();
+        // Plans the axes' targets into the staging buffer; false if it cannot (the staged plan is then empty)
+        bool prepareMove();
 
     private:
         CanOpen *canOpen;
@@ -50,7 +262,155 @@ namespace StepDirController
         double regularSpeedUnits = 1.0f; // The speed of the maximum moving axis in percent of full speed (1.0 = 100%)
         double accelerationUnits = 1.0f; // The acceleration of the maximum moving axis in percent of full acceleration (1.0 = 100%)
 
-        void sendMove();
+        MovePlan plans[2];        // Double buffer: plans[activePlan] is the move dispatched last, the other one is staged
+        uint8_t activePlan = 0;
+        bool planStaged = false;  // The staging buffer holds a plan not dispatched yet
+        PlanStats planStats;
+
+        MovePlan &stagingPlan() { return plans[activePlan ^ 1]; }
+        void commitPlan(); // The staged plan becomes the active one
+
+        bool planQueued = false; // Staged plan waits for the tracked move to finish, then dispatchMove()
+        void dispatchMove();     // sendMove() now, or hold the staged plan until every drive is enabled
+        void sendMove();         // Dispatches the staged plan
+
+        uint8_t feedRatePercent = RobotConstants::FeedRate::DEFAULT_PERCENT;
+        FeedRateStats feedRateStats;
+
+        // 0x6081/0x6083 of the planned move at the feed rate; changedOnly skips values the drive has
+        bool sendProfile(Axis &axis, bool changedOnly);
+        uint16_t feedHoldBit() const { return feedRatePercent == 0 ? RobotConstants::Control::CONTROLWORD_HALT : 0; }
+
+        uint8_t faultReaction = RobotConstants::Emcy::DEFAULT_REACTION;
+        bool motionPaused = false;
+        FaultStats faultStats;
+        AbortStats abortStats;
+        bool abortCleanupPending = false;
+        bool abortConfirmPending = false; // Until every axis has left operation enabled
+        uint32_t abortStopSentMs = 0;
+        uint8_t abortStopAttempts = 0;
+
+        void sendQuickStops(); // Controlword quick stop to every axis, urgent class
+        void cancelMotion();   // Held or queued move dropped and the move under way ended (both MDN FF), enabling stopped
+        void tick_abort();     // cancelMotion() after an abort, outside the yield() it may have run from; quick stop resends
+
+        uint8_t nmtTarget = RobotConstants::CANOpen::NMT_STATE_OPERATIONAL;
+        std::function<bool(uint8_t)> nodeConfigurator = nullptr;
+        NmtStats nmtStats;
+
+        bool configureStartMode(uint8_t nodeId, StartMode mode); // RPDO4 mapping for sendMove()
+        bool configureNode(uint8_t nodeId);
+
+        DriveStats driveStats;
+        bool movePending = false; // Plan staged, sendMove() once every drive is enabled
+        uint32_t movePendingSinceMs = 0;
+
+        void sendEnableSequence(uint8_t nodeId);
+        bool isDrivePresent(const Axis &axis) const; // Heartbeat within HEARTBEAT_TIMEOUT_MS
+        bool drivesReadyToMove() const;
+
+        // ======== Start skew probe ========
+        struct StartProbe
+        {
+            bool probing = false;
+            bool started = false;
+            bool awaiting = false;    // A 0x6064 read is outstanding (one SDO request per drive at a time)
+            uint32_t requestedUs = 0;
+            int32_t startPosition = 0;
+            uint32_t commandedUs = 0; // The frame that starts this axis went out (its RPDO or the SYNC)
+            uint32_t lastStillUs = 0;
+            uint32_t startedUs = 0;
+        };
+
+        StartMode startMode = StartMode::IMMEDIATE;
+        StartSkew lastStartSkew;
+        StartProbe startProbes[RobotConstants::Robot::AXES_COUNT + 1]; // index 0 is unused
+        bool startProbeActive = false;
+        uint32_t startProbeReleaseUs = 0;
+        uint8_t startProbeNextNodeId = 1;
+
+        void startProbeSample(uint8_t nodeId, int32_t position);
+        void startProbeFinish();
+        // ======== Start skew probe end ========
+
+        // ======== Move tracking ========
+        // An axis is done once its statusword reports target reached for the new set point, so one
+        // still describing the previous set point must not count: an axis that has to move is
+        // started when it is seen under way (target reached low, or the start probe saw it move),
+        // one that stays is started by the set-point acknowledge rising after the 0x4F cleared it.
+        // Its final position is then read back over SDO
+        struct MoveTrack
+        {
+            bool tracked = false;      // Present: got the set point
+            bool moving = false;       // Target START_SKEW_THRESHOLD_STEPS or more away (probed)
+            bool ackCleared = false;   // Set-point acknowledge seen low since the release
+            bool started = false;      // The drive took the set point
+            bool reached = false;
+            bool positionRead = false; // 0x6064 answered after target reached (or given up on)
+            uint32_t reachedUs = 0;    // Reception of the statusword that reported it
+            uint32_t readSentMs = 0;
+        };
+
+        MoveTrack moveTracks[RobotConstants::Robot::AXES_COUNT + 1]; // index 0 is unused
+        bool moveTrackActive = false;
+        uint32_t moveTrackStartMs = 0;
+        uint32_t moveTrackReleaseUs = 0;
+        uint32_t moveTrackTimeoutMs = 0;  // From moveTrackTimeoutFromMs; none while the feed is held
+        uint32_t moveTrackTimeoutFromMs = 0;
+        uint32_t moveTrackReleasedMs = 0; // Feed hold released (0: not during this move)
+
+        void moveTrackBegin();
+        void moveTrackStatusword(uint8_t nodeId, uint16_t statusword);
+        void moveTrackPosition(uint8_t nodeId); // A 0x6064 answer arrived
+        void moveTrackFinish(); // MDN reply; OK only if every tracked axis reached its target
+        void moveTrackRestartTimeout(); // The rest of the move at the current feed rate
+        void tick_moveTrack();
+        // ======== Move tracking end ========
+
+        // ======== Feedback polling ========
+        struct FeedbackPoll
+        {
+            uint32_t intervalMs = RobotConstants::Feedback::IDLE_INTERVAL_MS;
+            uint32_t lastPollMs = 0;
+            uint32_t lastActiveMs = 0;  // Moving or marked active; 0 if never
+            bool waited = false;        // Due, but held back by the ceiling
+            uint16_t answers = 0;       // In the current rate window
+            float rateHz = 0;           // Last full window
+        };
+
+        FeedbackPoll feedback[RobotConstants::Robot::AXES_COUNT + 1]; // index 0 is unused
+        uint16_t feedbackCeilingPermille = RobotConstants::Feedback::DEFAULT_CEILING_PERMILLE;
+        uint32_t feedbackBudgetPerSecond = 0;
+        uint32_t feedbackTokens = 0; // Thousandths of a poll
+        uint32_t feedbackTokensMs = 0;
+        uint32_t feedbackWindowMs = 0;
+        uint32_t feedbackThrottled = 0;
+
+        bool isFeedbackActive(uint8_t nodeId, uint32_t now) const;
+        // ======== Feedback polling end ========
+
+        // ======== Velocity jog ========
+        // A stopping axis stands once two 0x6064 answers in a row agree; until then every answer
+        // repeats the zero velocity, so a lost stop frame does not keep it running
+        struct JogAxis
+        {
+            JogState state = JogState::IDLE;
+            int32_t velocity = 0;      // 0x60FF [rpm]
+            uint32_t updateMs = 0;     // Last update (deadman)
+            uint32_t stopMs = 0;       // Zero velocity first sent
+            bool positionSeen = false; // A 0x6064 answer since the stop
+            int32_t lastPosition = 0;
+        };
+
+        JogAxis jogs[RobotConstants::Robot::AXES_COUNT + 1]; // index 0 is unused
+        double jogAccelerationUnits = RobotConstants::Jog::DEFAULT_ACCELERATION_UNITS;
+        JogStats jogStats;
+
+        void jogStop(uint8_t nodeId);
+        void jogPosition(uint8_t nodeId, int32_t position); // A 0x6064 answer arrived
+        void jogFinish(uint8_t nodeId);                     // Back to profile position
+        void tick_jog();                                    // Deadman, pause and stop timeouts
+        // ======== Velocity jog end ========
 
         void positionUpdate(uint8_t nodeId, int32_t position);
 
@@ -60,7 +420,9 @@ namespace StepDirController
         // ======== Timer functions ========
         void tick_checkTimeouts();
         void tick_checkZEITimeouts();
-        void tick_requestPosition();
+        void tick_requestPosition(); // One due axis per pass, most overdue first
+        void tick_configureNode(); // One pending node per pass
+        void tick_driveStates();   // Enable retries and the held move
         // ======== Timer functions end ========
 
         // ======== ZEI Sequence ======== 
@@ -79,7 +441,9 @@ namespace StepDirController
 
         // ======== Regular callbacks ========
         void regularHeartbeatCallback(uint8_t nodeId, uint8_t status);
+        void regularEmcyCallback(uint8_t nodeId, uint16_t errorCode, uint8_t errorRegister, const uint8_t *vendor);
         void regularPositionActualValueCallback(uint8_t nodeId, bool success, int32_t position);
+        void regularStatuswordCallback(uint8_t nodeId, bool success, uint16_t statusword);
         // ======== Regular callbacks end ========
     };
 
@@ -0,0 +1,109 @@
+#include "Profiler.h"
+
+#if PROFILER_ENABLED
+
+#include <string.h>
+#include "Arduino.h"
+
+#if !defined(ARDUINO_ARCH_STM32)
+#include <chrono>
+#endif
+
+namespace Profiler
+{
+    namespace
+    {
+        Histogram histograms[PROF_PROBE_COUNT];
+
+        uint8_t bucketIndex(uint32_t micros)
+        {
+            if (micros == 0)
+            {
+                return 0;
+            }
+            uint8_t index = static_cast<uint8_t>(32 - __builtin_clz(micros)); // 1 us -> 1, 2..3 us -> 2, ...
+            return index < BUCKET_COUNT ? index : BUCKET_COUNT - 1;
+        }
+    }
+
+    void begin()
+    {
+#if defined(ARDUINO_ARCH_STM32)
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CYCCNT = 0;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+        reset();
+    }
+
+    void reset()
+    {
+        memset(histograms, 0, sizeof(histograms));
+        for (uint8_t i = 0; i < PROF_PROBE_COUNT; ++i)
+        {
+            histograms[i].minCycles = UINT32_MAX;
+        }
+    }
+
+    uint32_t now()
+    {
+#if defined(ARDUINO_ARCH_STM32)
+        return DWT->CYCCNT;
+#else
+        return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                         std::chrono::steady_clock::now().time_since_epoch())
+                                         .count());
+#endif
+    }
+
+    uint32_t cyclesPerMicrosecond()
+    {
+#if defined(ARDUINO_ARCH_STM32)
+        return SystemCoreClock / 1000000u;
+#else
+        return 1000u; // Host ticks are nanoseconds
+#endif
+    }
+
+    void record(ProfilerProbe probe, uint32_t cycles)
+    {
+        Histogram &histogram = histograms[probe];
+        histogram.count++;
+        histogram.totalCycles += cycles;
+        if (cycles < histogram.minCycles)
+        {
+            histogram.minCycles = cycles;
+        }
+        if (cycles > histogram.maxCycles)
+        {
+            histogram.maxCycles = cycles;
+        }
+        histogram.buckets[bucketIndex(cycles / cyclesPerMicrosecond())]++;
+    }
+
+    const Histogram &histogram(ProfilerProbe probe)
+    {
+        return histograms[probe];
+    }
+
+    const char *probeName(ProfilerProbe probe)
+    {
+        switch (probe)
+        {
+        case PROF_LOOP:
+            return "LOOP";
+        case PROF_RX_DISPATCH:
+            return "RX_DISPATCH";
+        case PROF_PREPARE_MOVE:
+            return "PREPARE_MOVE";
+        case PROF_SEND_MOVE:
+            return "SEND_MOVE";
+        case PROF_COMMAND_PARSE:
+            return "COMMAND_PARSE";
+        default:
+            return "UNKNOWN";
+        }
+    }
+}
+
+#endif // PROFILER_ENABLED
@@ -0,0 +1,78 @@
+#pragma once
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+#include "DebugConfig.h"
+
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED 0
+#endif
+
+// Hot paths that carry a profiling probe
+enum ProfilerProbe : uint8_t
+{
+    PROF_LOOP = 0,
+    PROF_RX_DISPATCH,
+    PROF_PREPARE_MOVE,
+    PROF_SEND_MOVE,
+    PROF_COMMAND_PARSE,
+    PROF_PROBE_COUNT
+};
+
+namespace Profiler
+{
+    // Bucket 0 counts samples below 1 us, bucket i counts samples in [2^(i-1), 2^i) us.
+    // The last bucket also collects everything above its lower bound.
+    constexpr uint8_t BUCKET_COUNT = 16;
+
+    struct Histogram
+    {
+        uint32_t count;
+        uint32_t minCycles;
+        uint32_t maxCycles;
+        uint64_t totalCycles;
+        uint32_t buckets[BUCKET_COUNT];
+    };
+
+#if PROFILER_ENABLED
+    void begin(); // Enables the DWT cycle counter on target. Call once from setup()
+    void reset();
+
+    // Cycle counter: DWT->CYCCNT on Cortex-M3, nanoseconds of std::chrono::steady_clock on host builds
+    uint32_t now();
+    uint32_t cyclesPerMicrosecond();
+
+    void record(ProfilerProbe probe, uint32_t cycles);
+    const Histogram &histogram(ProfilerProbe probe);
+    const char *probeName(ProfilerProbe probe);
+
+    class Scope
+    {
+    public:
+        explicit Scope(ProfilerProbe probe) : probe(probe), start(now()) {}
+        ~Scope() { record(probe, now() - start); }
+
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+    private:
+        ProfilerProbe probe;
+        uint32_t start;
+    };
+#else
+    inline void begin() {}
+    inline void reset() {}
+#endif
+}
+
+#if PROFILER_ENABLED
+#define PROF_SCOPE(probe) Profiler::Scope profilerScope_(probe)
+#else
+#define PROF_SCOPE(probe) \
+    do                    \
+    {                     \
+    } while (0)
+#endif
+
+#endif // PROFILER_H
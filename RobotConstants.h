@@ -15,6 +15,7 @@ using callback_x607A_targetPosition = std::function<void(uint8_t, bool)>;
 using callback_x6041_statusword = std::function<void(uint8_t, bool, uint16_t)>;
 
 using callback_heartbeat = std::function<void(uint8_t, uint8_t)>;
+using callback_emcy = std::function<void(uint8_t, uint16_t, uint8_t, const uint8_t *)>; // Node, error code, error register, 5 vendor bytes
 
 namespace RobotConstants
 {
@@ -43,6 +44,67 @@ namespace RobotConstants
         }
     }
 
+    // CiA 402 drive state, decoded from the statusword (0x6041)
+    enum DriveState : uint8_t
+    {
+        DRIVE_UNKNOWN = 0, // No statusword received yet (or the drive rebooted since)
+        DRIVE_NOT_READY_TO_SWITCH_ON = 1,
+        DRIVE_SWITCH_ON_DISABLED = 2,
+        DRIVE_READY_TO_SWITCH_ON = 3,
+        DRIVE_SWITCHED_ON = 4,
+        DRIVE_OPERATION_ENABLED = 5,
+        DRIVE_QUICK_STOP_ACTIVE = 6,
+        DRIVE_FAULT_REACTION_ACTIVE = 7,
+        DRIVE_FAULT = 8
+    };
+
+    inline DriveState driveStateFromStatusword(uint16_t statusword)
+    {
+        // Bits 0-3, 5 and 6 (CiA 402 table of the statusword states)
+        if ((statusword & 0x004F) == 0x0000)
+            return DriveState::DRIVE_NOT_READY_TO_SWITCH_ON;
+        if ((statusword & 0x004F) == 0x0040)
+            return DriveState::DRIVE_SWITCH_ON_DISABLED;
+        if ((statusword & 0x006F) == 0x0021)
+            return DriveState::DRIVE_READY_TO_SWITCH_ON;
+        if ((statusword & 0x006F) == 0x0023)
+            return DriveState::DRIVE_SWITCHED_ON;
+        if ((statusword & 0x006F) == 0x0027)
+            return DriveState::DRIVE_OPERATION_ENABLED;
+        if ((statusword & 0x006F) == 0x0007)
+            return DriveState::DRIVE_QUICK_STOP_ACTIVE;
+        if ((statusword & 0x004F) == 0x000F)
+            return DriveState::DRIVE_FAULT_REACTION_ACTIVE;
+        if ((statusword & 0x004F) == 0x0008)
+            return DriveState::DRIVE_FAULT;
+        return DriveState::DRIVE_UNKNOWN;
+    }
+
+    inline const char *driveStateToString(DriveState state)
+    {
+        switch (state)
+        {
+        case DriveState::DRIVE_NOT_READY_TO_SWITCH_ON:
+            return "NOT_READY";
+        case DriveState::DRIVE_SWITCH_ON_DISABLED:
+            return "SWITCH_ON_DISABLED";
+        case DriveState::DRIVE_READY_TO_SWITCH_ON:
+            return "READY";
+        case DriveState::DRIVE_SWITCHED_ON:
+            return "SWITCHED_ON";
+        case DriveState::DRIVE_OPERATION_ENABLED:
+            return "ENABLED";
+        case DriveState::DRIVE_QUICK_STOP_ACTIVE:
+            return "QUICK_STOP";
+        case DriveState::DRIVE_FAULT_REACTION_ACTIVE:
+            return "FAULT_REACTION";
+        case DriveState::DRIVE_FAULT:
+            return "FAULT";
+        default:
+            return "UNKNOWN";
+        }
+    }
+
     // Physical and mathematical constants
     namespace Math
     {
@@ -58,6 +120,25 @@ namespace RobotConstants
         const String MOTOR_STATUS = "RMS";
         const String ZERO_INITIALIZE = "ZEI";
         const String REQUEST_POSITION = "RPP";
+        const String PROFILE = "PRF";
+        const String DEBUG_LOG = "DLG";
+        const String DEBUG_LEVEL = "DBL";
+        const String HEAP_STATS = "HPS";
+        const String BUS_LOAD = "BUS";
+        const String CAN_TRACE = "CTR";
+        const String SYNC_START = "SYN";
+        const String CSP_STREAM = "CSP";
+        const String TX_QUEUES = "TXQ";
+        const String EMERGENCY = "EMC";
+        const String NMT = "NMT";
+        const String DRIVE_STATE = "DRV";
+        const String MOVE_DONE = "MDN"; // Asynchronous: a profile position move finished (MoveControllerBase move tracking)
+        const String FEEDBACK = "FBK";
+        const String JOG = "JOG";
+        const String FEED_RATE = "OVR";
+        const String ABORT = "ABT";
+        const String MOVE_PLAN = "PLN";
+        const String PATH = "PTH";
         constexpr int COMMAND_LEN = 3;
         const float MIN_SPEED_UNITS = 0.0f;
         const float MAX_SPEED_UNITS = 100.0f;
@@ -84,10 +165,41 @@ namespace RobotConstants
     {
         constexpr uint32_t COB_ID_SYNC = 0x080;
         constexpr uint32_t COB_ID_NMT = 0x000;
+        constexpr uint32_t COB_ID_EMCY_BASE = 0x080; // + node ID (0x080 itself is SYNC)
         constexpr uint32_t COB_ID_HEARTBEAT_BASE = 0x700;
         constexpr uint32_t COB_ID_SDO_SERVER_BASE = 0x600;
         constexpr uint32_t COB_ID_SDO_CLIENT_BASE = 0x580;
         constexpr uint32_t COB_ID_PDO_BASE = 0x180;
+        constexpr uint32_t COB_ID_RPDO3_BASE = 0x400; // Jog target velocity (CanOpen::configureRPDO3)
+        constexpr uint32_t COB_ID_RPDO4_BASE = 0x500;
+        constexpr uint32_t COB_ID_TPDO1_BASE = COB_ID_PDO_BASE; // Statusword feedback (CanOpen::configureTPDO1)
+        constexpr uint32_t COB_ID_PDO_INVALID = 0x80000000; // Bit 31 of the PDO COB-ID: PDO disabled
+
+        // NMT commands (byte 0 of the 0x000 frame; byte 1 is the node ID, NMT_ALL_NODES for all)
+        constexpr uint8_t NMT_START = 0x01;
+        constexpr uint8_t NMT_STOP = 0x02;
+        constexpr uint8_t NMT_PRE_OPERATIONAL = 0x80;
+        constexpr uint8_t NMT_RESET_NODE = 0x81;
+        constexpr uint8_t NMT_RESET_COMMUNICATION = 0x82;
+        constexpr uint8_t NMT_ALL_NODES = 0x00;
+
+        // NMT states as reported in the heartbeat (the boot-up message is a heartbeat with 0x00)
+        constexpr uint8_t NMT_STATE_BOOT_UP = 0x00;
+        constexpr uint8_t NMT_STATE_STOPPED = 0x04;
+        constexpr uint8_t NMT_STATE_OPERATIONAL = 0x05;
+        constexpr uint8_t NMT_STATE_PRE_OPERATIONAL = 0x7F;
+        constexpr uint8_t NMT_STATE_UNKNOWN = 0xFF; // Nothing heard from the node yet
+        // A node reporting pre-operational although it should be operational is reconfigured again
+        // at most this often (a boot-up message always triggers it)
+        constexpr uint32_t NMT_RECONFIGURE_HOLDOFF_MS = Robot::HEARTBEAT_TIMEOUT_MS;
+
+        // PDO transmission types (sub 2 of the communication parameter)
+        constexpr uint8_t PDO_TRANSMISSION_SYNC = 0x01;  // Applied on the next SYNC
+        constexpr uint8_t PDO_TRANSMISSION_EVENT = 0xFF; // Applied on reception
+
+        // RX acceptance filters (CanOpen::applyRxFilters): nodes 1..N take up to log2(N) + 1 id/mask
+        // pairs per function code (3 for 5 axes)
+        constexpr uint8_t MAX_RX_FILTERS = 16;
 
         // PDO mapping
         constexpr uint8_t PDO_COUNT = 4;
@@ -156,8 +268,106 @@ namespace RobotConstants
         constexpr uint32_t DEFAULT_PROFILE_VELOCITY = 1000;
         constexpr uint32_t DEFAULT_PROFILE_ACCELERATION = 500;
         constexpr uint16_t DEFAULT_CONTROLWORD = 0x000F;
+        constexpr uint16_t CONTROLWORD_DISABLE_VOLTAGE = 0x0000;
+        constexpr uint16_t CONTROLWORD_QUICK_STOP = 0x0002;
+        constexpr uint16_t CONTROLWORD_SHUTDOWN = 0x0006;
+        constexpr uint16_t CONTROLWORD_SWITCH_ON = 0x0007;
+        constexpr uint16_t CONTROLWORD_FAULT_RESET = 0x0080;
+        constexpr uint16_t CONTROLWORD_ENABLE_OPERATION = 0x000F; // From ready to switch on: transitions 3 and 4 in one frame
+        constexpr uint16_t CONTROLWORD_HALT = 0x0100;             // Bit 8: the drive stops on its ramp and keeps the set point
         constexpr uint8_t DEFAULT_MODE_POSITION = 1;
         constexpr uint8_t DEFAULT_MODE_VELOCITY = 3;
+        constexpr uint8_t MODE_CYCLIC_SYNC_POSITION = 8;
+
+        // Start skew probe: after a move is released, 0x6064 is polled round-robin until every
+        // moving axis has left its start position or the window closes
+        constexpr uint32_t START_SKEW_WINDOW_MS = 200;
+        constexpr int32_t START_SKEW_THRESHOLD_STEPS = 2;
+        constexpr uint32_t START_SKEW_READ_TIMEOUT_US = 10000; // Unanswered read: ask again
+    }
+
+    // Position feedback polling (MoveControllerBase::tick_requestPosition): 0x6064 per axis, fast
+    // while the axis moves, the interval doubling back to the keep-alive once it stands
+    namespace Feedback
+    {
+        constexpr uint32_t ACTIVE_INTERVAL_MS = 20;  // 50 Hz while moving or jogging
+        constexpr uint32_t IDLE_INTERVAL_MS = 500;   // 2 Hz keep-alive, the old fixed poll rate
+        constexpr uint32_t ACTIVE_HOLD_MS = 100;     // Still fast this long after the axis was last active
+        constexpr uint16_t DEFAULT_CEILING_PERMILLE = 100; // Polls (request + answer) take at most 10% of the bus
+        constexpr uint16_t MAX_CEILING_PERMILLE = 1000;
+        constexpr uint32_t RATE_WINDOW_MS = 1000;    // Effective rate: answered reads over this window
+    }
+
+    // Feed-rate override (MoveControllerBase::setFeedRate): 0x6081 and 0x6083 of every axis scaled alike
+    namespace FeedRate
+    {
+        constexpr uint8_t DEFAULT_PERCENT = 100;
+        constexpr uint8_t MAX_PERCENT = 100; // 0 holds the move (halt bit), there is no overspeed
+    }
+
+    // Velocity jog (MoveControllerBase::jog): profile velocity mode, one RPDO3 frame per update
+    namespace Jog
+    {
+        constexpr uint32_t DEADMAN_MS = 300;      // No update for this long: the axis is stopped
+        constexpr uint32_t STOP_TIMEOUT_MS = 2000; // Stopped axis not seen standing by then: back to position mode anyway
+        constexpr float DEFAULT_ACCELERATION_UNITS = 50.0f; // 0x6083 for the jog ramp until JOG ...AC<a> sets another
+    }
+
+    // Cyclic synchronous position streaming (CspStreamer)
+    namespace Csp
+    {
+        constexpr uint32_t DEFAULT_PERIOD_US = 1000000 / Robot::CONTROL_LOOP_HZ;
+        constexpr uint32_t MIN_PERIOD_US = 500;
+        constexpr uint32_t MAX_PERIOD_US = 10000;
+        constexpr uint8_t BUFFER_CYCLES = 16; // Setpoints computed ahead of the cycle that sends them
+        constexpr uint8_t HOLD_CYCLES = 8;    // Final setpoints repeated after a move, then SYNC only
+        constexpr uint8_t PATH_QUEUE = 8;     // MAJ/MRJ queued as waypoints behind the segment streaming
+    }
+
+    // Emergency (EMCY) handling: what MoveControllerBase does when a drive reports a fault
+    namespace Emcy
+    {
+        constexpr uint8_t FRAME_MIN_LEN = 3;         // Error code + error register; vendor bytes may be missing
+        constexpr uint8_t VENDOR_BYTES = 5;
+        constexpr uint16_t ERROR_RESET = 0x0000;     // Error code of the "error reset / no error" EMCY
+        constexpr uint8_t REACTION_REPORT = 0x01;     // EMC line to the host
+        constexpr uint8_t REACTION_PAUSE = 0x02;      // Refuse MAJ/MRJ and drop streamed setpoints until EMCR
+        constexpr uint8_t REACTION_QUICK_STOP = 0x04; // Controlword quick stop to every axis, urgent class
+        constexpr uint8_t DEFAULT_REACTION = REACTION_REPORT | REACTION_PAUSE | REACTION_QUICK_STOP;
+    }
+
+    // Abort (MoveControllerBase::abort): quick stop to every axis, queued motion dropped, motion paused until EMCR
+    namespace Abort
+    {
+        constexpr uint8_t SOURCE_COMMAND = 0; // ABT line
+        constexpr uint8_t SOURCE_PIN = 1;     // Edge on the abort input (interrupt)
+        constexpr uint32_t STOP_CONFIRM_MS = 20; // An axis still reporting operation enabled this long after the quick stop gets it again
+        constexpr uint8_t MAX_STOP_ATTEMPTS = 5;
+    }
+
+    // CiA 402 drive state machine (MoveControllerBase::enableDrive)
+    namespace Cia402
+    {
+        constexpr uint16_t STATUSWORD_EVENT_TIMER_MS = 1000; // TPDO1 is sent on every change and at least this often
+        constexpr uint32_t STATUSWORD_SILENT_MS = 2 * STATUSWORD_EVENT_TIMER_MS + 500; // Operational without a statusword this long: configured again
+        constexpr uint32_t TRANSITION_TIMEOUT_MS = 50;       // Controlwords sent, state not reached: send again from the reported state
+        constexpr uint8_t MAX_ENABLE_ATTEMPTS = 3;
+        constexpr uint32_t MOVE_HOLD_TIMEOUT_MS = 500; // A move waiting for its drives to be enabled is dropped after this
+        constexpr uint16_t STATUSWORD_TARGET_REACHED = 0x0400; // Bit 10
+        constexpr uint16_t STATUSWORD_SET_POINT_ACK = 0x1000;  // Bit 12, profile position
+        constexpr uint32_t MOVE_DONE_MARGIN_MS = 2000;     // Planned duration plus this without target reached on every axis: MDN PF/FF
+        constexpr uint32_t FINAL_POSITION_TIMEOUT_MS = 50; // 0x6064 read after target reached unanswered: the target is reported
+    }
+
+    // CAN transmit queues, one per class (CanTxScheduler), in frames
+    namespace CanTx
+    {
+        constexpr uint8_t QUEUE_URGENT = 8; // A quick stop per axis
+        constexpr uint8_t QUEUE_SYNC = 4;
+        constexpr uint8_t QUEUE_PDO = 16; // A CSP cycle is one RPDO per axis
+        constexpr uint8_t QUEUE_SDO = 32; // sendMove: up to 4 SDOs per axis
+        constexpr uint8_t QUEUE_DIAG = 8;
+        constexpr uint8_t MAX_MAILBOXES = 3; // bxCAN
     }
 
     // Axis configuration
@@ -0,0 +1,209 @@
+#include "Stm32CanDriver.h"
+#include "Arduino.h"
+
+bool Stm32CanDriver::begin(uint32_t baudRate, bool loopback)
+{
+    Can.setAutoRetransmission(true);
+    Can.enableLoopBack(loopback);
+    Can.begin();
+    Can.setBaudRate(baudRate);
+    if (rxFilterCount > 0)
+    {
+        applyRxFilters(); // Can.begin() leaves the library's accept-all filter
+    }
+    return true;
+}
+
+bool Stm32CanDriver::setRxFilters(const CanRxFilter *filters, uint8_t count)
+{
+    if (count > RobotConstants::CANOpen::MAX_RX_FILTERS)
+    {
+        return false;
+    }
+    for (uint8_t i = 0; i < count; ++i)
+    {
+        rxFilters[i] = filters[i];
+    }
+    rxFilterCount = count;
+    return applyRxFilters();
+}
+
+bool Stm32CanDriver::applyRxFilters()
+{
+    // 16-bit banks: exact IDs go four to a bank in list mode, id/mask pairs two to a bank in mask mode
+    uint8_t exact = 0;
+    for (uint8_t i = 0; i < rxFilterCount; ++i)
+    {
+        exact += (rxFilters[i].mask & 0x7FF) == 0x7FF ? 1 : 0;
+    }
+    const uint8_t banks = (exact + 3) / 4 + (rxFilterCount - exact + 1) / 2;
+    if (banks > FILTER_BANKS)
+    {
+        return false;
+    }
+
+#if defined(ARDUINO_ARCH_STM32)
+    // 16-bit filter layout: STID[10:0] << 5 | RTR << 4 | IDE << 3; RTR and IDE always compared (standard data frames only)
+    const uint16_t typeBits = (1u << 4) | (1u << 3);
+    uint16_t list[4];
+    uint8_t listCount = 0;
+    uint16_t masks[2][2];
+    uint8_t maskCount = 0;
+    uint8_t bank = 0;
+    uint32_t listBanks = 0;
+
+    CAN1->FMR |= CAN_FMR_FINIT;
+    CAN1->FA1R = 0;
+    CAN1->FS1R = 0;  // 16-bit scale
+    CAN1->FFA1R = 0; // FIFO 0
+    if (rxFilterCount == 0)
+    {
+        CAN1->FS1R = 1; // Bank 0, 32-bit mask 0: everything
+        CAN1->sFilterRegister[0].FR1 = 0;
+        CAN1->sFilterRegister[0].FR2 = 0;
+        bank = 1;
+    }
+    for (uint8_t i = 0; i < rxFilterCount; ++i)
+    {
+        const uint16_t id = static_cast<uint16_t>((rxFilters[i].id & 0x7FF) << 5);
+        if ((rxFilters[i].mask & 0x7FF) == 0x7FF)
+        {
+            list[listCount++] = id;
+        }
+        else
+        {
+            masks[maskCount][0] = id;
+            masks[maskCount][1] = static_cast<uint16_t>(((rxFilters[i].mask & 0x7FF) << 5) | typeBits);
+            maskCount++;
+        }
+        const bool last = i + 1 == rxFilterCount;
+        if (listCount == 4 || (last && listCount > 0))
+        {
+            for (uint8_t j = listCount; j < 4; ++j)
+            {
+                list[j] = list[0]; // Unused list entries repeat an ID that is wanted anyway
+            }
+            CAN1->sFilterRegister[bank].FR1 = static_cast<uint32_t>(list[1]) << 16 | list[0];
+            CAN1->sFilterRegister[bank].FR2 = static_cast<uint32_t>(list[3]) << 16 | list[2];
+            listBanks |= 1u << bank;
+            bank++;
+            listCount = 0;
+        }
+        if (maskCount == 2 || (last && maskCount > 0))
+        {
+            if (maskCount == 1)
+            {
+                masks[1][0] = masks[0][0];
+                masks[1][1] = masks[0][1];
+            }
+            CAN1->sFilterRegister[bank].FR1 = static_cast<uint32_t>(masks[0][1]) << 16 | masks[0][0];
+            CAN1->sFilterRegister[bank].FR2 = static_cast<uint32_t>(masks[1][1]) << 16 | masks[1][0];
+            bank++;
+            maskCount = 0;
+        }
+    }
+    CAN1->FM1R = listBanks;
+    CAN1->FA1R = (1u << bank) - 1;
+    CAN1->FMR &= ~CAN_FMR_FINIT;
+    return true;
+#else
+    return Can.setRxFilters(rxFilters, rxFilterCount);
+#endif
+}
+
+void Stm32CanDriver::end()
+{
+    Can.end();
+}
+
+bool Stm32CanDriver::write(const CanFrame &frame)
+{
+    txMsg.id = frame.id;
+    txMsg.flags.extended = frame.extended;
+    txMsg.flags.remote = frame.remote;
+    txMsg.len = frame.len;
+    for (uint8_t i = 0; i < frame.len; ++i)
+    {
+        txMsg.buf[i] = frame.buf[i];
+    }
+#if defined(ARDUINO_ARCH_STM32)
+    // The library turns its TX mailbox empty interrupt on with every write. Its handler clears TXOK of
+    // a finished mailbox before txMailboxAborted() can read it, and the software FIFO it refills from
+    // stays empty (CanTxScheduler only writes into a free mailbox), so it is switched off again
+    noInterrupts();
+    const bool ok = Can.write(txMsg);
+    CAN1->IER &= ~CAN_IER_TMEIE;
+    interrupts();
+    return ok;
+#else
+    return Can.write(txMsg);
+#endif
+}
+
+bool Stm32CanDriver::read(CanFrame &frame)
+{
+    if (!Can.read(rxMsg))
+    {
+        return false;
+    }
+    frame.id = rxMsg.id;
+    frame.extended = rxMsg.flags.extended;
+    frame.remote = rxMsg.flags.remote;
+    frame.len = rxMsg.len;
+    for (uint8_t i = 0; i < rxMsg.len; ++i)
+    {
+        frame.buf[i] = rxMsg.buf[i];
+    }
+    frame.timestampUs = micros(); // The library's timestamp is in bit times of the CAN clock
+    return true;
+}
+
+int8_t Stm32CanDriver::freeTxMailbox()
+{
+#if defined(ARDUINO_ARCH_STM32)
+    const uint32_t tsr = CAN1->TSR;
+    if ((tsr & (CAN_TSR_TME0 | CAN_TSR_TME1 | CAN_TSR_TME2)) == 0)
+    {
+        return -1;
+    }
+    return static_cast<int8_t>((tsr & CAN_TSR_CODE) >> CAN_TSR_CODE_Pos); // The one HAL_CAN_AddTxMessage takes
+#else
+    return Can.freeTxMailbox();
+#endif
+}
+
+bool Stm32CanDriver::txMailboxBusy(uint8_t mailbox)
+{
+#if defined(ARDUINO_ARCH_STM32)
+    return (CAN1->TSR & (CAN_TSR_TME0 << mailbox)) == 0;
+#else
+    return Can.txMailboxBusy(mailbox);
+#endif
+}
+
+bool Stm32CanDriver::abortTxMailbox(uint8_t mailbox)
+{
+#if defined(ARDUINO_ARCH_STM32)
+    if ((CAN1->TSR & (CAN_TSR_TME0 << mailbox)) != 0)
+    {
+        return false; // Already gone
+    }
+    // A pending frame is dropped at once, the one on the wire finishes first; a request that comes
+    // after the mailbox emptied has no effect. The other TSR bits are write-1-to-clear, 0 leaves them
+    CAN1->TSR = CAN_TSR_ABRQ0 << (8 * mailbox);
+    return true;
+#else
+    return Can.abortTxMailbox(mailbox);
+#endif
+}
+
+bool Stm32CanDriver::txMailboxAborted(uint8_t mailbox)
+{
+#if defined(ARDUINO_ARCH_STM32)
+    // With automatic retransmission a mailbox empties only when its frame was sent (TXOK) or aborted.
+    // TXOK stays until the next write into the mailbox: nothing else clears RQCP (see write())
+    return (CAN1->TSR & (CAN_TSR_TXOK0 << (8 * mailbox))) == 0;
+#else
+    return Can.txMailboxAborted(mailbox);
+#endif
+}
@@ -0,0 +1,45 @@
+#pragma once
+#ifndef STM32_CAN_DRIVER_H
+#define STM32_CAN_DRIVER_H
+
+#include <Arduino.h>
+#include "CanDriver.h"
+#include "RobotConstants.h"
+#include "STM32_CAN.h"
+
+// bxCAN through the STM32_CAN library (CAN1 on PA11/PA12).
+// CanTxScheduler only writes when a mailbox is free, so the library's own TX FIFO stays empty
+// and is kept small; mailbox state, aborts and the acceptance filter banks go to the bxCAN
+// registers directly.
+class Stm32CanDriver : public CanDriver
+{
+public:
+    static constexpr uint8_t TX_MAILBOXES = 3;
+    static constexpr uint8_t FILTER_BANKS = 14; // CAN1 of the F103
+
+    Stm32CanDriver() : Can(PA11, PA12, RX_SIZE_128, TX_SIZE_16) {}
+
+    bool begin(uint32_t baudRate, bool loopback) override;
+    void end() override;
+    bool write(const CanFrame &frame) override;
+    bool read(CanFrame &frame) override;
+
+    bool setRxFilters(const CanRxFilter *filters, uint8_t count) override;
+
+    uint8_t txMailboxCount() const override { return TX_MAILBOXES; }
+    int8_t freeTxMailbox() override;
+    bool txMailboxBusy(uint8_t mailbox) override;
+    bool abortTxMailbox(uint8_t mailbox) override;
+    bool txMailboxAborted(uint8_t mailbox) override;
+
+private:
+    STM32_CAN Can;
+    CAN_message_t txMsg;
+    CAN_message_t rxMsg;
+    CanRxFilter rxFilters[RobotConstants::CANOpen::MAX_RX_FILTERS];
+    uint8_t rxFilterCount = 0;
+
+    bool applyRxFilters();
+};
+
+#endif // STM32_CAN_DRIVER_H
@@ -0,0 +1,249 @@
+// Micro-benchmarks of the firmware hot paths on the host build.
+//
+//   canopen_bench [filter] [--iterations N]
+//
+// Every benchmark prints wall time per operation and heap operations per operation
+// (HeapStats), so both speed and allocation regressions are visible. The hot paths the
+// steady-state move/feedback loop runs (encode, decode, bus, trace, plan) must not touch the
+// heap: one that does is reported and the bench exits with 1. Parsing, the serial queue and
+// command round trips work on String and may allocate.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "Arduino.h"
+#include "HostCanBus.h"
+#include "CanOpenController.h"
+#include "Stm32CanDriver.h"
+#include "HeapStats.h"
+#include "BusLoad.h"
+#include "CanTrace.h"
+#include "Params.h"
+
+// Sketch functions (CANCrusher.ino)
+MoveParams<RobotConstants::Robot::AXES_COUNT> stringToMoveParams(String command);
+MotorIndices stringToMotorIndices(String command);
+void addDataToOutQueue(String data);
+void sendData();
+void setup();
+void loop();
+
+namespace
+{
+    class BenchMoveController : public MoveController
+    {
+    public:
+        using MoveController::prepareMove;
+    };
+
+    // Stands in for the drives: counts the firmware's frames and injects replies
+    class BenchNode : public HostCanEndpoint
+    {
+    public:
+        uint32_t framesSeen = 0;
+
+        void onBusFrame(const CAN_message_t &) override { framesSeen++; }
+        void send(const CAN_message_t &msg) { HostCanBus::instance().transmit(this, msg); }
+    };
+
+    const char *filter = nullptr;
+    uint32_t iterationScale = 1;
+    uint32_t allocatingHotPaths = 0;
+
+    enum class Heap : uint8_t
+    {
+        NO_ALLOC,  // Steady-state hot path: any heap operation after the warm-up is a failure
+        MAY_ALLOC, // String based (command parsing, replies)
+    };
+
+    // settle() runs after every iteration, outside the timing and the heap count: what the loop does
+    // between two operations (replies included) without being part of the measured path
+    template <typename Fn, typename Settle>
+    void runBenchmark(const char *name, uint32_t iterations, Heap heap, Fn fn, Settle settle)
+    {
+        if (filter != nullptr && strstr(name, filter) == nullptr)
+        {
+            return;
+        }
+        iterations *= iterationScale;
+
+        for (uint32_t i = 0; i < iterations / 10 + 1; ++i) // Warm-up: caches, String buffers, queue capacity
+        {
+            fn(i);
+            settle();
+        }
+
+        HeapStats::NoAllocGuard guard;
+        uint32_t settleOperations = 0;
+        std::chrono::steady_clock::duration settleTime{};
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < iterations; ++i)
+        {
+            fn(i);
+            const uint32_t operationsBefore = guard.operations();
+            const auto settleStart = std::chrono::steady_clock::now();
+            settle();
+            settleTime += std::chrono::steady_clock::now() - settleStart;
+            settleOperations += guard.operations() - operationsBefore;
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start - settleTime;
+        uint32_t heapOperations = guard.operations() - settleOperations;
+
+        double nsPerOp = std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+        printf("%-30s %9u %12.1f ns/op %14.0f ops/s %9.2f heap ops/op\n",
+               name, iterations, nsPerOp, 1e9 / nsPerOp, static_cast<double>(heapOperations) / iterations);
+        if (heap == Heap::NO_ALLOC && heapOperations != 0)
+        {
+            printf("FAIL: %s allocates (%u heap operations after the warm-up)\n", name, heapOperations);
+            allocatingHotPaths++;
+        }
+    }
+
+    template <typename Fn>
+    void runBenchmark(const char *name, uint32_t iterations, Heap heap, Fn fn)
+    {
+        runBenchmark(name, iterations, heap, fn, []() {});
+    }
+
+    CAN_message_t positionResponse(uint8_t nodeId, int32_t position)
+    {
+        CAN_message_t msg;
+        msg.id = RobotConstants::CANOpen::COB_ID_SDO_CLIENT_BASE + nodeId;
+        msg.len = 8;
+        msg.buf[0] = 0x43; // Expedited upload response, 4 bytes
+        msg.buf[1] = RobotConstants::ODIndices::POSITION_ACTUAL_VALUE & 0xFF;
+        msg.buf[2] = RobotConstants::ODIndices::POSITION_ACTUAL_VALUE >> 8;
+        msg.buf[3] = RobotConstants::ODIndices::DEFAULT_SUBINDEX;
+        memcpy(&msg.buf[4], &position, sizeof(position));
+        return msg;
+    }
+
+    CAN_message_t heartbeat(uint8_t nodeId)
+    {
+        CAN_message_t msg;
+        msg.id = RobotConstants::CANOpen::COB_ID_HEARTBEAT_BASE + nodeId;
+        msg.len = 1;
+        msg.buf[0] = 0x05; // Operational
+        return msg;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+        {
+            iterationScale = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+            if (iterationScale == 0)
+            {
+                iterationScale = 1;
+            }
+        }
+        else
+        {
+            filter = argv[i];
+        }
+    }
+
+    uint32_t serialLines = 0;
+    Serial2.hostSetLineHandler([&serialLines](const char *)
+                               { serialLines++; });
+
+    setup(); // Sketch globals, used by the queue and round trip benchmarks
+
+    BenchNode node;
+    HostCanBus::instance().attach(&node);
+
+    Stm32CanDriver canDriver;
+    CanOpen canOpen(canDriver);
+    if (!canOpen.startCan(RobotConstants::Robot::CAN_BAUD_RATE))
+    {
+        fprintf(stderr, "CanOpen::startCan failed\n");
+        return 1;
+    }
+    BenchMoveController controller;
+    controller.start(&canOpen, RobotConstants::Robot::AXES_COUNT);
+
+    const uint8_t axesCount = RobotConstants::Robot::AXES_COUNT;
+
+    runBenchmark("encode/sdo_write_607A", 200000, Heap::NO_ALLOC, [&](uint32_t i)
+                 { canOpen.send_x607A_targetPosition(1 + i % axesCount, static_cast<int32_t>(i)); });
+
+    runBenchmark("encode/sdo_read_6064", 200000, Heap::NO_ALLOC, [&](uint32_t i)
+                 { canOpen.sendSDORead(1 + i % axesCount, RobotConstants::ODIndices::POSITION_ACTUAL_VALUE, RobotConstants::ODIndices::DEFAULT_SUBINDEX); });
+
+    runBenchmark("encode/rpdo4_target", 200000, Heap::NO_ALLOC, [&](uint32_t i)
+                 { canOpen.sendPDO4_x607A_SyncMovement(1 + i % axesCount, static_cast<int32_t>(i)); });
+
+    runBenchmark("decode/sdo_position", 200000, Heap::NO_ALLOC, [&](uint32_t i)
+                 {
+                     node.send(positionResponse(1 + i % axesCount, static_cast<int32_t>(i)));
+                     canOpen.read(); });
+
+    runBenchmark("decode/heartbeat", 200000, Heap::NO_ALLOC, [&](uint32_t i)
+                 {
+                     node.send(heartbeat(1 + i % axesCount));
+                     canOpen.read(); });
+
+    runBenchmark("decode/empty_poll", 1000000, Heap::NO_ALLOC, [&](uint32_t)
+                 { canOpen.read(); });
+
+    CanFrame busFrame;
+    busFrame.len = 8;
+    volatile uint16_t busBits = 0;
+    runBenchmark("bus/frame_bits", 1000000, Heap::NO_ALLOC, [&](uint32_t i)
+                 {
+                     busFrame.id = RobotConstants::CANOpen::COB_ID_SDO_CLIENT_BASE + 1 + i % axesCount;
+                     busFrame.buf[4] = static_cast<uint8_t>(i);
+                     busBits = BusLoad::frameBits(busFrame); });
+
+    runBenchmark("trace/record", 1000000, Heap::NO_ALLOC, [&](uint32_t i)
+                 { CanTrace::record(i, busFrame.id, false, false, busFrame.len, busFrame.buf, (i & 1) != 0); });
+
+    runBenchmark("plan/prepareMove", 100000, Heap::NO_ALLOC, [&](uint32_t i)
+                 {
+                     for (uint8_t nodeId = 1; nodeId <= axesCount; ++nodeId)
+                     {
+                         controller.getAxis(nodeId).setTargetPositionAbsoluteInUnits((i % 100) * 0.5 * nodeId - 20.0);
+                     }
+                     controller.setRegularSpeedUnits(10.0 + i % 50);
+                     controller.setAccelerationUnits(5.0 + i % 30);
+                     controller.prepareMove(); });
+
+    // The decode heartbeats left the drives present: they time out, no drive answers (nor holds) the moves
+    HostClock::advanceUs((RobotConstants::Robot::HEARTBEAT_TIMEOUT_MS + 1) * 1000ull);
+    runBenchmark("plan/move_prepare_and_send", 20000, Heap::NO_ALLOC, [&](uint32_t i)
+                 {
+                     for (uint8_t nodeId = 1; nodeId <= axesCount; ++nodeId)
+                     {
+                         controller.getAxis(nodeId).setTargetPositionRelativeInUnits((i % 2 == 0 ? 1.0 : -1.0) * nodeId);
+                     }
+                     controller.move(); },
+                 [&]()
+                 { controller.tick_fast(); }); // No drives answer: closes the move (MDN reply), the next one is sent at once
+
+    runBenchmark("parse/move_params", 100000, Heap::MAY_ALLOC, [&](uint32_t)
+                 { stringToMoveParams(String("MAJJA10.5JB-20JC0.25JD90JE-45SP50AC25")); });
+
+    runBenchmark("parse/motor_indices", 200000, Heap::MAY_ALLOC, [&](uint32_t)
+                 { stringToMotorIndices(String("RPPJAJCJE")); });
+
+    runBenchmark("queue/out_push_pop", 200000, Heap::MAY_ALLOC, [&](uint32_t)
+                 {
+                     addDataToOutQueue(String("RPP OK JA1.00 JB2.00"));
+                     sendData(); });
+
+    runBenchmark("command/rpp_round_trip", 20000, Heap::MAY_ALLOC, [&](uint32_t)
+                 {
+                     uint32_t before = serialLines;
+                     Serial2.hostFeed("RPP\n");
+                     while (serialLines == before)
+                     {
+                         loop();
+                     } });
+
+    printf("frames seen by bench node: %u\n", node.framesSeen);
+    return allocatingHotPaths == 0 ? 0 : 1;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#ifndef LOOPBACK_CAN_DRIVER_H
+#define LOOPBACK_CAN_DRIVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "CanDriver.h"
+
+// In-process CAN transport: two connected drivers form a point-to-point bus,
+// each one receives what the other writes. No kernel, no HostCanBus, no timing model.
+class LoopbackCanDriver : public CanDriver
+{
+public:
+    static constexpr size_t QUEUE_SIZE = 256;
+
+    static void connect(LoopbackCanDriver &a, LoopbackCanDriver &b);
+
+    bool begin(uint32_t baudRate, bool loopback) override;
+    void end() override;
+    bool write(const CanFrame &frame) override;
+    bool read(CanFrame &frame) override;
+
+    uint32_t overruns() const { return overrunCount; }
+
+private:
+    LoopbackCanDriver *peer = nullptr;
+    bool started = false;
+    bool selfLoop = false;
+
+    CanFrame queue[QUEUE_SIZE];
+    size_t head = 0;
+    size_t count = 0;
+    uint32_t overrunCount = 0;
+
+    bool push(const CanFrame &frame);
+};
+
+#endif // LOOPBACK_CAN_DRIVER_H
@@ -0,0 +1,270 @@
+#include <errno.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/can/raw.h>
+#include "SocketCanDriver.h"
+
+#ifndef SO_RXQ_OVFL
+#define SO_RXQ_OVFL 40
+#endif
+
+char SocketCanDriver::defaultInterface[IFNAMSIZ] = "can0";
+
+SocketCanDriver::SocketCanDriver(const char *interfaceName)
+    : useDefaultInterface(interfaceName == nullptr)
+{
+    snprintf(this->interfaceName, IFNAMSIZ, "%s", interfaceName != nullptr ? interfaceName : defaultInterface);
+
+    for (size_t i = 0; i < BATCH_SIZE; ++i)
+    {
+        rxIov[i].iov_base = &rxFrames[i];
+        rxIov[i].iov_len = sizeof(rxFrames[i]);
+        txIov[i].iov_base = &txFrames[i];
+        txIov[i].iov_len = sizeof(txFrames[i]);
+    }
+}
+
+SocketCanDriver::~SocketCanDriver()
+{
+    end();
+}
+
+void SocketCanDriver::setDefaultInterface(const char *interfaceName)
+{
+    snprintf(defaultInterface, IFNAMSIZ, "%s", interfaceName);
+}
+
+bool SocketCanDriver::begin(uint32_t baudRate, bool loopback)
+{
+    (void)baudRate;
+    end();
+    if (useDefaultInterface)
+    {
+        memcpy(interfaceName, defaultInterface, IFNAMSIZ);
+    }
+
+    sock = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    if (sock < 0)
+    {
+        return false;
+    }
+
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    memcpy(ifr.ifr_name, interfaceName, IFNAMSIZ);
+    if (ioctl(sock, SIOCGIFINDEX, &ifr) < 0)
+    {
+        end();
+        return false;
+    }
+
+    struct sockaddr_can addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = ifr.ifr_ifindex;
+    if (bind(sock, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0)
+    {
+        end();
+        return false;
+    }
+
+    const int enable = 1;
+    setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable));
+    setsockopt(sock, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(enable));
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+    applyRxFilters();
+
+    loopbackMode = loopback;
+    return true;
+}
+
+bool SocketCanDriver::setRxFilters(const CanRxFilter *filters, uint8_t count)
+{
+    if (count > MAX_RX_FILTERS)
+    {
+        return false;
+    }
+    for (uint8_t i = 0; i < count; ++i)
+    {
+        // Standard data frames only, as on bxCAN: EFF and RTR are compared too
+        rxFilters[i].can_id = filters[i].id & CAN_SFF_MASK;
+        rxFilters[i].can_mask = (filters[i].mask & CAN_SFF_MASK) | CAN_EFF_FLAG | CAN_RTR_FLAG;
+    }
+    rxFilterCount = count;
+    return sock < 0 || applyRxFilters();
+}
+
+bool SocketCanDriver::applyRxFilters()
+{
+    if (rxFilterCount == 0)
+    {
+        // The socket default: one filter that lets everything in
+        struct can_filter all;
+        all.can_id = 0;
+        all.can_mask = 0;
+        return setsockopt(sock, SOL_CAN_RAW, CAN_RAW_FILTER, &all, sizeof(all)) == 0;
+    }
+    return setsockopt(sock, SOL_CAN_RAW, CAN_RAW_FILTER, rxFilters, rxFilterCount * sizeof(rxFilters[0])) == 0;
+}
+
+void SocketCanDriver::end()
+{
+    if (sock >= 0)
+    {
+        close(sock);
+        sock = -1;
+    }
+    rxCount = 0;
+    rxIndex = 0;
+    txCount = 0;
+    loopbackHead = 0;
+    loopbackCount = 0;
+}
+
+bool SocketCanDriver::write(const CanFrame &frame)
+{
+    if (sock < 0 || frame.len > 8)
+    {
+        return false;
+    }
+
+    if (loopbackMode)
+    {
+        if (loopbackCount == BATCH_SIZE)
+        {
+            return false;
+        }
+        loopbackQueue[(loopbackHead + loopbackCount) % BATCH_SIZE] = frame;
+        loopbackCount++;
+        return true;
+    }
+
+    if (txCount == BATCH_SIZE)
+    {
+        flush();
+        if (txCount == BATCH_SIZE)
+        {
+            statistics.txRejected++;
+            return false;
+        }
+    }
+
+    struct can_frame &out = txFrames[txCount];
+    memset(&out, 0, sizeof(out));
+    out.can_id = frame.extended ? ((frame.id & CAN_EFF_MASK) | CAN_EFF_FLAG) : (frame.id & CAN_SFF_MASK);
+    if (frame.remote)
+    {
+        out.can_id |= CAN_RTR_FLAG;
+    }
+    out.can_dlc = frame.len;
+    memcpy(out.data, frame.buf, frame.len);
+    txCount++;
+    return true;
+}
+
+void SocketCanDriver::flush()
+{
+    if (sock < 0 || txCount == 0)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < txCount; ++i)
+    {
+        memset(&txMsgs[i], 0, sizeof(txMsgs[i]));
+        txMsgs[i].msg_hdr.msg_iov = &txIov[i];
+        txMsgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    int sent = sendmmsg(sock, txMsgs, static_cast<unsigned int>(txCount), MSG_DONTWAIT);
+    if (sent <= 0)
+    {
+        return; // EAGAIN/ENOBUFS: the kernel queue is full, retry on the next flush
+    }
+
+    statistics.txFrames += static_cast<uint32_t>(sent);
+    statistics.txBatches++;
+    txCount -= static_cast<size_t>(sent);
+    memmove(txFrames, txFrames + sent, txCount * sizeof(txFrames[0]));
+}
+
+bool SocketCanDriver::read(CanFrame &frame)
+{
+    if (loopbackMode)
+    {
+        if (loopbackCount == 0)
+        {
+            return false;
+        }
+        frame = loopbackQueue[loopbackHead];
+        loopbackHead = (loopbackHead + 1) % BATCH_SIZE;
+        loopbackCount--;
+        return true;
+    }
+
+    if (rxIndex == rxCount && !fetchBatch())
+    {
+        return false;
+    }
+
+    const struct can_frame &in = rxFrames[rxIndex];
+    struct msghdr &header = rxMsgs[rxIndex].msg_hdr;
+    rxIndex++;
+
+    frame.extended = (in.can_id & CAN_EFF_FLAG) != 0;
+    frame.remote = (in.can_id & CAN_RTR_FLAG) != 0;
+    frame.id = in.can_id & (frame.extended ? CAN_EFF_MASK : CAN_SFF_MASK);
+    frame.len = in.can_dlc <= 8 ? in.can_dlc : 8;
+    memcpy(frame.buf, in.data, frame.len);
+    frame.timestampUs = 0;
+
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&header); cmsg != nullptr; cmsg = CMSG_NXTHDR(&header, cmsg))
+    {
+        if (cmsg->cmsg_level != SOL_SOCKET)
+        {
+            continue;
+        }
+        if (cmsg->cmsg_type == SO_TIMESTAMPNS)
+        {
+            struct timespec ts;
+            memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+            frame.timestampUs = static_cast<uint32_t>(ts.tv_sec * 1000000ull + ts.tv_nsec / 1000);
+        }
+        else if (cmsg->cmsg_type == SO_RXQ_OVFL)
+        {
+            uint32_t drops;
+            memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+            statistics.rxKernelDrops += drops - lastKernelDropCount;
+            lastKernelDropCount = drops;
+        }
+    }
+    statistics.rxFrames++;
+    return true;
+}
+
+bool SocketCanDriver::fetchBatch()
+{
+    if (sock < 0)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < BATCH_SIZE; ++i)
+    {
+        memset(&rxMsgs[i], 0, sizeof(rxMsgs[i]));
+        rxMsgs[i].msg_hdr.msg_iov = &rxIov[i];
+        rxMsgs[i].msg_hdr.msg_iovlen = 1;
+        rxMsgs[i].msg_hdr.msg_control = rxControl[i];
+        rxMsgs[i].msg_hdr.msg_controllen = sizeof(rxControl[i]);
+    }
+    int received = recvmmsg(sock, rxMsgs, BATCH_SIZE, MSG_DONTWAIT, nullptr);
+    rxIndex = 0;
+    rxCount = received > 0 ? static_cast<size_t>(received) : 0;
+    if (rxCount > 0)
+    {
+        statistics.rxBatches++;
+    }
+    return rxCount > 0;
+}
@@ -0,0 +1,92 @@
+#pragma once
+#ifndef SOCKET_CAN_DRIVER_H
+#define SOCKET_CAN_DRIVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <linux/can.h>
+#include "CanDriver.h"
+
+// Linux SocketCAN transport (raw CAN_RAW socket) for running CanOpen on a gateway.
+//
+// - reception is batched with recvmmsg(): one syscall fills up to BATCH_SIZE frames,
+//   read() hands them out one by one
+// - transmission is batched with sendmmsg(): write() queues, flush() (called by
+//   CanOpen::read() every pass, or when the batch is full) sends the whole batch
+// - every received frame carries the kernel reception timestamp (SO_TIMESTAMPNS)
+// - the bit rate is configured on the interface (ip link set can0 type can bitrate 1000000);
+//   begin() ignores baudRate
+// - setRxFilters() becomes a CAN_RAW_FILTER on the socket, so the kernel drops frames for
+//   other nodes before they are copied out
+// - SocketCAN has no silent mode, so begin(.., true) opens the interface but loops written
+//   frames back in the driver; the self-test then checks framing without touching the bus
+class SocketCanDriver : public CanDriver
+{
+public:
+    static constexpr size_t BATCH_SIZE = 32;
+    static constexpr size_t MAX_RX_FILTERS = 32;
+
+    struct Stats
+    {
+        uint32_t rxFrames = 0;
+        uint32_t rxBatches = 0;     // recvmmsg() calls that returned frames
+        uint32_t rxKernelDrops = 0; // Socket queue overflows reported by the kernel (SO_RXQ_OVFL)
+        uint32_t txFrames = 0;
+        uint32_t txBatches = 0;     // sendmmsg() calls that sent frames
+        uint32_t txRejected = 0;    // write() refused: batch full and the kernel queue busy
+    };
+
+    // nullptr = use the interface set with setDefaultInterface() at begin() time
+    explicit SocketCanDriver(const char *interfaceName = nullptr);
+    ~SocketCanDriver() override;
+
+    static void setDefaultInterface(const char *interfaceName);
+
+    bool begin(uint32_t baudRate, bool loopback) override;
+    void end() override;
+    bool write(const CanFrame &frame) override;
+    bool read(CanFrame &frame) override;
+    void flush() override;
+    bool setRxFilters(const CanRxFilter *filters, uint8_t count) override;
+
+    int fd() const { return sock; }                               // For poll()
+    bool rxPending() const { return rxIndex < rxCount || loopbackCount > 0; } // Frames already fetched
+    const Stats &stats() const { return statistics; }
+
+private:
+    static char defaultInterface[IFNAMSIZ];
+
+    char interfaceName[IFNAMSIZ];
+    bool useDefaultInterface;
+    int sock = -1;
+    bool loopbackMode = false;
+    Stats statistics;
+
+    struct can_filter rxFilters[MAX_RX_FILTERS];
+    size_t rxFilterCount = 0;
+    bool applyRxFilters();
+
+    struct can_frame rxFrames[BATCH_SIZE];
+    struct iovec rxIov[BATCH_SIZE];
+    struct mmsghdr rxMsgs[BATCH_SIZE];
+    char rxControl[BATCH_SIZE][CMSG_SPACE(sizeof(struct timespec)) + CMSG_SPACE(sizeof(uint32_t))];
+    size_t rxCount = 0;
+    size_t rxIndex = 0;
+    uint32_t lastKernelDropCount = 0;
+
+    struct can_frame txFrames[BATCH_SIZE];
+    struct iovec txIov[BATCH_SIZE];
+    struct mmsghdr txMsgs[BATCH_SIZE];
+    size_t txCount = 0;
+
+    CanFrame loopbackQueue[BATCH_SIZE];
+    size_t loopbackHead = 0;
+    size_t loopbackCount = 0;
+
+    bool fetchBatch();
+};
+
+#endif // SOCKET_CAN_DRIVER_H
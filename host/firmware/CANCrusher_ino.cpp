@@ -0,0 +1,3 @@
+// Compiles the Arduino sketch as an ordinary C++ translation unit for host builds.
+// The sketch already declares its functions before use, so no prototype generation is needed.
+#include "../../CANCrusher.ino"
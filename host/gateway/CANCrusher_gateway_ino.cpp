@@ -0,0 +1,4 @@
+// The sketch on a Linux gateway: same command interface, CANopen master and motion
+// controller, with SocketCAN instead of bxCAN (CAN_DRIVER_CLASS is set in host/CMakeLists.txt).
+#include "SocketCanDriver.h"
+#include "../../CANCrusher.ino"
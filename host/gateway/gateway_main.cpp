@@ -0,0 +1,84 @@
+// CANCrusher on a Linux single-board computer.
+//
+//   can_gateway [--iface can0]
+//
+// Commands are read from stdin and replies written to stdout, one per line, exactly as over
+// the Blue Pill's serial port. The CAN interface must be up with its bit rate configured:
+//   ip link set can0 up type can bitrate 1000000
+//   (or: ip link add vcan0 type vcan && ip link set vcan0 up)
+
+#include <poll.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "Arduino.h"
+#include "RobotConstants.h"
+#include "SocketCanDriver.h"
+
+// Sketch functions and state (CANCrusher.ino, built with CAN_DRIVER_CLASS=SocketCanDriver)
+void setup();
+void loop();
+extern SocketCanDriver canDriver;
+extern std::vector<String> outData;
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--iface") == 0 && i + 1 < argc)
+        {
+            SocketCanDriver::setDefaultInterface(argv[++i]);
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--iface can0]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    SocketCanDriver probe;
+    if (!probe.begin(RobotConstants::Robot::CAN_BAUD_RATE, false))
+    {
+        fprintf(stderr, "cannot open the CAN interface (is it up?)\n");
+        return 1; // setup() would halt in its error loop instead
+    }
+    probe.end();
+
+    HostClock::setRealTime(true);
+    Serial2.hostSetLineHandler([](const char *line)
+                               {
+                                   fputs(line, stdout);
+                                   fputc('\n', stdout);
+                                   fflush(stdout); });
+
+    setup();
+
+    bool inputOpen = true;
+    for (;;)
+    {
+        const bool idle = Serial2.available() == 0 && outData.empty() && !canDriver.rxPending();
+        struct pollfd fds[2] = {
+            {inputOpen ? STDIN_FILENO : -1, POLLIN, 0},
+            {canDriver.fd(), POLLIN, 0},
+        };
+        poll(fds, 2, idle ? 1 : 0); // Sleep at most 1 ms so the 500 ms ticks stay on time
+
+        if (fds[0].revents & (POLLIN | POLLHUP))
+        {
+            char input[256];
+            ssize_t count = read(STDIN_FILENO, input, sizeof(input) - 1);
+            if (count <= 0)
+            {
+                inputOpen = false; // Keep serving the bus after stdin closes
+            }
+            else
+            {
+                input[count] = '\0';
+                Serial2.hostFeed(input);
+            }
+        }
+        HostClock::advanceToUs(HostClock::nowUs()); // Due timer interrupts (CSP cycle)
+        loop();
+    }
+}
@@ -0,0 +1,89 @@
+#pragma once
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+// Minimal Arduino core for host (Linux) builds of the firmware sources.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "WString.h"
+#include "HardwareSerial.h"
+#include "HostClock.h"
+#include "HardwareTimer.h"
+
+#define HEX 16
+#define DEC 10
+
+// Blue Pill pins used by the sketch; the values only need to be distinct
+enum HostPin : uint32_t
+{
+    PA2 = 2,
+    PA3 = 3,
+    PA11 = 11,
+    PA12 = 12,
+    PB0 = 16,
+};
+
+#define INPUT 0x0
+#define INPUT_PULLUP 0x2
+#define RISING 0x1
+#define FALLING 0x2
+#define CHANGE 0x3
+
+inline uint32_t millis() { return static_cast<uint32_t>(HostClock::nowUs() / 1000u); }
+inline uint32_t micros() { return static_cast<uint32_t>(HostClock::nowUs()); }
+
+// Called by delay() while it waits, as the STM32 core does; weak empty default in HostClock.cpp
+void yield();
+
+// The clock moves in steps, so an interrupt raised by an event source during the delay is
+// serviced from yield() about when it would be on the target
+inline void delay(uint32_t ms)
+{
+    constexpr uint64_t YIELD_STEP_US = 100;
+    const uint64_t endUs = HostClock::nowUs() + static_cast<uint64_t>(ms) * 1000u;
+    while (HostClock::nowUs() < endUs)
+    {
+        const uint64_t stepUs = endUs - HostClock::nowUs();
+        HostClock::advanceUs(stepUs < YIELD_STEP_US ? stepUs : YIELD_STEP_US);
+        yield();
+    }
+}
+inline void delayMicroseconds(uint32_t us) { HostClock::advanceUs(us); }
+
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+// External interrupts: hostPinInterrupt() (host only) runs what the sketch attached to the pin
+constexpr uint32_t HOST_PIN_COUNT = 32;
+typedef void (*HostPinHandler)();
+inline HostPinHandler *hostPinHandlers()
+{
+    static HostPinHandler handlers[HOST_PIN_COUNT] = {nullptr};
+    return handlers;
+}
+inline void pinMode(uint32_t, uint32_t) {}
+inline uint32_t digitalPinToInterrupt(uint32_t pin) { return pin; }
+inline void attachInterrupt(uint32_t pin, void (*handler)(), uint32_t)
+{
+    if (pin < HOST_PIN_COUNT)
+    {
+        hostPinHandlers()[pin] = handler;
+    }
+}
+inline void detachInterrupt(uint32_t pin) { attachInterrupt(pin, nullptr, 0); }
+inline bool hostPinInterrupt(uint32_t pin)
+{
+    if (pin >= HOST_PIN_COUNT || hostPinHandlers()[pin] == nullptr)
+    {
+        return false;
+    }
+    hostPinHandlers()[pin]();
+    return true;
+}
+
+inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+#endif // HOST_ARDUINO_H
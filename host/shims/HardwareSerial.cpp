@@ -0,0 +1,79 @@
+#include "HardwareSerial.h"
+
+#include <string.h>
+
+HardwareSerial::HardwareSerial(uint32_t rxPin, uint32_t txPin) : rxPin(rxPin), txPin(txPin)
+{
+}
+
+int HardwareSerial::read()
+{
+    if (inputCount == 0)
+    {
+        return -1;
+    }
+    char c = input[inputHead];
+    inputHead = (inputHead + 1) % INPUT_SIZE;
+    inputCount--;
+    return static_cast<unsigned char>(c);
+}
+
+size_t HardwareSerial::print(const String &text)
+{
+    return print(text.c_str());
+}
+
+size_t HardwareSerial::print(const char *text)
+{
+    append(text);
+    return strlen(text);
+}
+
+size_t HardwareSerial::println(const String &text)
+{
+    return println(text.c_str());
+}
+
+size_t HardwareSerial::println(const char *text)
+{
+    append(text);
+    flushLine();
+    return strlen(text) + 2;
+}
+
+bool HardwareSerial::hostFeed(const char *text)
+{
+    for (const char *c = text; *c != '\0'; ++c)
+    {
+        if (inputCount == INPUT_SIZE)
+        {
+            return false;
+        }
+        input[(inputHead + inputCount) % INPUT_SIZE] = *c;
+        inputCount++;
+    }
+    return true;
+}
+
+void HardwareSerial::append(const char *text)
+{
+    size_t length = strlen(text);
+    if (length > LINE_SIZE - 1 - pendingLength)
+    {
+        length = LINE_SIZE - 1 - pendingLength; // Truncate overlong lines
+    }
+    memcpy(pendingLine + pendingLength, text, length);
+    pendingLength += length;
+    pendingLine[pendingLength] = '\0';
+}
+
+void HardwareSerial::flushLine()
+{
+    pendingLine[pendingLength] = '\0';
+    if (lineHandler)
+    {
+        lineHandler(pendingLine);
+    }
+    pendingLength = 0;
+    pendingLine[0] = '\0';
+}
@@ -0,0 +1,57 @@
+#pragma once
+#ifndef HOST_HARDWARE_SERIAL_H
+#define HOST_HARDWARE_SERIAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+#include "WString.h"
+
+// Host replacement for the STM32 HardwareSerial.
+// Input is fed by the harness (hostFeed), every println() line is handed to the line handler.
+// Uses fixed buffers only, so the shim itself never shows up in heap accounting.
+class HardwareSerial
+{
+public:
+    using LineHandler = std::function<void(const char *line)>;
+
+    HardwareSerial(uint32_t rxPin, uint32_t txPin);
+
+    void setRx(uint32_t pin) { rxPin = pin; }
+    void setTx(uint32_t pin) { txPin = pin; }
+    void begin(unsigned long baudRate) { baud = baudRate; }
+    explicit operator bool() const { return true; }
+
+    int available() const { return static_cast<int>(inputCount); }
+    int read();
+
+    size_t print(const String &text);
+    size_t print(const char *text);
+    size_t println(const String &text);
+    size_t println(const char *text);
+
+    // ======== Host side ========
+    static constexpr size_t INPUT_SIZE = 1024;
+    static constexpr size_t LINE_SIZE = 1024;
+
+    bool hostFeed(const char *text); // false if the input buffer overflowed
+    void hostSetLineHandler(LineHandler handler) { lineHandler = handler; }
+
+private:
+    uint32_t rxPin;
+    uint32_t txPin;
+    unsigned long baud = 0;
+    char input[INPUT_SIZE];
+    size_t inputHead = 0;
+    size_t inputCount = 0;
+    char pendingLine[LINE_SIZE]; // print() output waiting for the end of the line
+    size_t pendingLength = 0;
+    LineHandler lineHandler;
+
+    void append(const char *text);
+    void flushLine();
+};
+
+extern HardwareSerial Serial2; // Defined by the sketch
+
+#endif // HOST_HARDWARE_SERIAL_H
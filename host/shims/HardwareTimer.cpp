@@ -0,0 +1,76 @@
+#include "HardwareTimer.h"
+
+TIM_TypeDef HostTim2 = {2};
+
+HardwareTimer::HardwareTimer(TIM_TypeDef *instance)
+{
+    (void)instance;
+}
+
+HardwareTimer::~HardwareTimer()
+{
+    pause();
+}
+
+void HardwareTimer::setOverflow(uint32_t value, TimerFormat_t format)
+{
+    if (format == HERTZ_FORMAT)
+    {
+        periodUs = value > 0 ? 1000000u / value : 0;
+    }
+    else
+    {
+        periodUs = value;
+    }
+    if (periodUs == 0)
+    {
+        periodUs = 1;
+    }
+}
+
+void HardwareTimer::attachInterrupt(callback_function_t callback)
+{
+    this->callback = callback;
+}
+
+void HardwareTimer::detachInterrupt()
+{
+    callback = nullptr;
+}
+
+void HardwareTimer::resume()
+{
+    if (running)
+    {
+        return;
+    }
+    running = true;
+    nextTickUs = HostClock::nowUs() + periodUs;
+    HostClock::addEventSource(this);
+}
+
+void HardwareTimer::pause()
+{
+    if (running)
+    {
+        running = false;
+        HostClock::removeEventSource(this);
+    }
+}
+
+uint64_t HardwareTimer::nextEventUs() const
+{
+    return running ? nextTickUs : HostClock::NO_EVENT;
+}
+
+void HardwareTimer::onTime(uint64_t nowUs)
+{
+    while (running && nextTickUs <= nowUs)
+    {
+        nextTickUs += periodUs;
+        if (callback)
+        {
+            callback();
+        }
+    }
+}
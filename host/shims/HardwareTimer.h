@@ -0,0 +1,51 @@
+#pragma once
+#ifndef HOST_HARDWARE_TIMER_H
+#define HOST_HARDWARE_TIMER_H
+
+// Host replacement for the STM32duino HardwareTimer (update interrupt only).
+// The "interrupt" is a HostClock event: it fires in time order while the clock advances,
+// also in the middle of a firmware delay(), like the timer IRQ on the target.
+
+#include <stdint.h>
+#include <functional>
+#include "HostClock.h"
+
+struct TIM_TypeDef
+{
+    uint8_t index;
+};
+extern TIM_TypeDef HostTim2;
+#define TIM2 (&HostTim2)
+
+enum TimerFormat_t : uint8_t
+{
+    TICK_FORMAT,
+    MICROSEC_FORMAT,
+    HERTZ_FORMAT,
+};
+
+using callback_function_t = std::function<void(void)>;
+
+class HardwareTimer : public HostClock::EventSource
+{
+public:
+    explicit HardwareTimer(TIM_TypeDef *instance);
+    ~HardwareTimer() override;
+
+    void setOverflow(uint32_t value, TimerFormat_t format = TICK_FORMAT); // TICK_FORMAT: 1 us ticks
+    void attachInterrupt(callback_function_t callback);
+    void detachInterrupt();
+    void resume();
+    void pause();
+
+    uint64_t nextEventUs() const override;
+    void onTime(uint64_t nowUs) override;
+
+private:
+    uint32_t periodUs = 1000;
+    callback_function_t callback;
+    bool running = false;
+    uint64_t nextTickUs = 0;
+};
+
+#endif // HOST_HARDWARE_TIMER_H
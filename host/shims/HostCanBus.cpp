@@ -0,0 +1,51 @@
+#include "HostCanBus.h"
+#include "STM32_CAN.h"
+
+HostCanBus &HostCanBus::instance()
+{
+    static HostCanBus bus;
+    return bus;
+}
+
+bool HostCanBus::attach(HostCanEndpoint *endpoint)
+{
+    for (size_t i = 0; i < endpointCount; ++i)
+    {
+        if (endpoints[i] == endpoint)
+        {
+            return true;
+        }
+    }
+    if (endpointCount == MAX_ENDPOINTS)
+    {
+        return false;
+    }
+    endpoints[endpointCount++] = endpoint;
+    return true;
+}
+
+void HostCanBus::detach(HostCanEndpoint *endpoint)
+{
+    for (size_t i = 0; i < endpointCount; ++i)
+    {
+        if (endpoints[i] == endpoint)
+        {
+            endpoints[i] = endpoints[--endpointCount];
+            endpoints[endpointCount] = nullptr;
+            return;
+        }
+    }
+}
+
+void HostCanBus::transmit(const HostCanEndpoint *sender, const CAN_message_t &msg)
+{
+    frameCount++;
+    // Endpoints may transmit from inside onBusFrame(); index-based iteration keeps that safe
+    for (size_t i = 0; i < endpointCount; ++i)
+    {
+        if (endpoints[i] != sender)
+        {
+            endpoints[i]->onBusFrame(msg);
+        }
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+#ifndef HOST_CAN_BUS_H
+#define HOST_CAN_BUS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct CAN_message_t; // STM32_CAN.h
+
+// In-memory CAN bus for host builds. Every attached endpoint (the firmware's STM32_CAN,
+// simulated drives, trace recorders, ...) sees every frame transmitted by the others.
+class HostCanEndpoint
+{
+public:
+    virtual ~HostCanEndpoint() = default;
+    virtual void onBusFrame(const CAN_message_t &msg) = 0;
+};
+
+class HostCanBus
+{
+public:
+    static constexpr size_t MAX_ENDPOINTS = 32;
+
+    static HostCanBus &instance();
+
+    bool attach(HostCanEndpoint *endpoint);
+    void detach(HostCanEndpoint *endpoint);
+
+    // Delivers `msg` to every attached endpoint except `sender` (nullptr = deliver to all)
+    void transmit(const HostCanEndpoint *sender, const CAN_message_t &msg);
+
+    uint32_t framesTransmitted() const { return frameCount; }
+
+private:
+    HostCanEndpoint *endpoints[MAX_ENDPOINTS] = {nullptr};
+    size_t endpointCount = 0;
+    uint32_t frameCount = 0;
+};
+
+#endif // HOST_CAN_BUS_H
@@ -0,0 +1,135 @@
+#include <stddef.h>
+#include <chrono>
+#include <thread>
+#include "HostClock.h"
+
+namespace HostClock
+{
+    namespace
+    {
+        constexpr size_t MAX_EVENT_SOURCES = 32;
+
+        uint64_t currentUs = 0;
+        EventSource *sources[MAX_EVENT_SOURCES] = {nullptr};
+        size_t sourceCount = 0;
+        bool firing = false;
+
+        bool realTime = false;
+        std::chrono::steady_clock::time_point realTimeStart;
+
+        void waitUntil(uint64_t us)
+        {
+            if (realTime)
+            {
+                std::this_thread::sleep_until(realTimeStart + std::chrono::microseconds(us));
+                currentUs = nowUs();
+            }
+            else if (us > currentUs)
+            {
+                currentUs = us;
+            }
+        }
+    }
+
+    void setRealTime(bool enabled)
+    {
+        realTime = enabled;
+        realTimeStart = std::chrono::steady_clock::now() - std::chrono::microseconds(currentUs);
+    }
+
+    uint64_t nowUs()
+    {
+        if (realTime)
+        {
+            currentUs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                                                  std::chrono::steady_clock::now() - realTimeStart)
+                                                  .count());
+        }
+        return currentUs;
+    }
+
+    void setNowUs(uint64_t us)
+    {
+        if (!realTime)
+        {
+            currentUs = us;
+        }
+    }
+
+    void advanceUs(uint64_t us)
+    {
+        advanceToUs(nowUs() + us);
+    }
+
+    void advanceToUs(uint64_t us)
+    {
+        // An event source that calls delay() from onTime() only moves the clock
+        if (!firing)
+        {
+            firing = true;
+            uint64_t eventUs;
+            while ((eventUs = nextEventUs()) <= us)
+            {
+                waitUntil(eventUs);
+                for (size_t i = 0; i < sourceCount; ++i)
+                {
+                    if (sources[i]->nextEventUs() <= currentUs)
+                    {
+                        sources[i]->onTime(currentUs);
+                    }
+                }
+            }
+            firing = false;
+        }
+        waitUntil(us);
+    }
+
+    bool addEventSource(EventSource *source)
+    {
+        for (size_t i = 0; i < sourceCount; ++i)
+        {
+            if (sources[i] == source)
+            {
+                return true;
+            }
+        }
+        if (sourceCount == MAX_EVENT_SOURCES)
+        {
+            return false;
+        }
+        sources[sourceCount++] = source;
+        return true;
+    }
+
+    void removeEventSource(EventSource *source)
+    {
+        for (size_t i = 0; i < sourceCount; ++i)
+        {
+            if (sources[i] == source)
+            {
+                sources[i] = sources[--sourceCount];
+                sources[sourceCount] = nullptr;
+                return;
+            }
+        }
+    }
+
+    uint64_t nextEventUs()
+    {
+        uint64_t earliest = NO_EVENT;
+        for (size_t i = 0; i < sourceCount; ++i)
+        {
+            uint64_t eventUs = sources[i]->nextEventUs();
+            if (eventUs < earliest)
+            {
+                earliest = eventUs;
+            }
+        }
+        return earliest;
+    }
+}
+
+// Arduino yield(), called by the delay() shim: the sketch defines its own, anything linked without it gets this one
+__attribute__((weak)) void yield()
+{
+}
@@ -0,0 +1,39 @@
+#pragma once
+#ifndef HOST_CLOCK_H
+#define HOST_CLOCK_H
+
+#include <stdint.h>
+
+// Controllable time base behind millis()/micros()/delay() on host builds.
+// Time only moves when the harness advances it or when the firmware calls delay(),
+// so a delay(200) in the firmware costs no wall time.
+//
+// Event sources (simulated drives, ...) are fired in time order while the clock advances,
+// so frames due in the middle of a firmware delay() arrive in the middle of it, as they
+// would through the CAN RX interrupt on the target.
+namespace HostClock
+{
+    constexpr uint64_t NO_EVENT = UINT64_MAX;
+
+    class EventSource
+    {
+    public:
+        virtual ~EventSource() = default;
+        virtual uint64_t nextEventUs() const = 0; // NO_EVENT if idle
+        virtual void onTime(uint64_t nowUs) = 0;  // Handle everything due at nowUs
+    };
+
+    // Real time (Linux gateway): nowUs() follows the monotonic clock and delay() sleeps
+    void setRealTime(bool enabled);
+
+    uint64_t nowUs();
+    void setNowUs(uint64_t us); // Jumps without firing events (ignored in real time)
+    void advanceUs(uint64_t us);
+    void advanceToUs(uint64_t us); // Fires due events in order, ends at `us`
+
+    bool addEventSource(EventSource *source);
+    void removeEventSource(EventSource *source);
+    uint64_t nextEventUs(); // Earliest event over all sources, NO_EVENT if none
+}
+
+#endif // HOST_CLOCK_H
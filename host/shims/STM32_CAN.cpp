@@ -0,0 +1,284 @@
+#include "STM32_CAN.h"
+#include "BusLoad.h"
+
+size_t STM32_CAN::rxPendingTotal = 0;
+bool STM32_CAN::txTiming = false;
+bool STM32_CAN::rxFiltering = true;
+uint32_t STM32_CAN::rxAcceptedTotal = 0;
+uint32_t STM32_CAN::rxFilteredTotal = 0;
+uint32_t STM32_CAN::txReorderedTotal = 0;
+
+namespace
+{
+    uint64_t transmitUs(const CAN_message_t &msg, uint32_t baudRate)
+    {
+        CanFrame frame;
+        frame.id = msg.id;
+        frame.extended = msg.flags.extended;
+        frame.remote = msg.flags.remote;
+        frame.len = msg.len;
+        for (uint8_t i = 0; i < msg.len && i < 8; ++i)
+        {
+            frame.buf[i] = msg.buf[i];
+        }
+        const uint32_t baud = baudRate > 0 ? baudRate : 1000000;
+        return (static_cast<uint64_t>(BusLoad::frameBits(frame)) * 1000000u + baud - 1) / baud;
+    }
+}
+
+STM32_CAN::STM32_CAN(uint32_t rxPin, uint32_t txPin, RXQUEUE_TABLE rxSize, TXQUEUE_TABLE txSize)
+    : rxSize(rxSize < RX_CAPACITY ? rxSize : RX_CAPACITY), txSize(txSize)
+{
+    (void)rxPin;
+    (void)txPin;
+}
+
+STM32_CAN::~STM32_CAN()
+{
+    end();
+}
+
+void STM32_CAN::begin(bool retransmission)
+{
+    (void)retransmission;
+    if (!started)
+    {
+        HostCanBus::instance().attach(this);
+        if (txTiming)
+        {
+            HostClock::addEventSource(this);
+        }
+        started = true;
+    }
+}
+
+void STM32_CAN::end()
+{
+    if (started)
+    {
+        HostCanBus::instance().detach(this);
+        HostClock::removeEventSource(this);
+        started = false;
+    }
+    txHead = 0;
+    txCount = 0;
+    for (uint8_t i = 0; i < TX_MAILBOXES; ++i)
+    {
+        mailboxPending[i] = false;
+    }
+    transmitting = -1;
+    rxPendingTotal -= rxCount;
+    rxHead = 0;
+    rxCount = 0;
+}
+
+bool STM32_CAN::write(CAN_message_t &msg)
+{
+    if (!started)
+    {
+        return false;
+    }
+    if (loopback)
+    {
+        pushRx(msg); // Silent loopback: the frame does not reach the bus
+        return true;
+    }
+    if (!txTiming)
+    {
+        HostCanBus::instance().transmit(this, msg);
+        return true;
+    }
+
+    const int8_t free = freeTxMailbox();
+    if (free < 0 || txCount > 0)
+    {
+        if (txCount == txSize)
+        {
+            return false;
+        }
+        txQueue[(txHead + txCount) % txSize] = msg;
+        txCount++;
+        return true;
+    }
+    loadMailbox(free, msg);
+    if (transmitting < 0)
+    {
+        startNextTransmission(HostClock::nowUs());
+    }
+    return true;
+}
+
+int8_t STM32_CAN::freeTxMailbox() const
+{
+    if (!txTiming)
+    {
+        return 0;
+    }
+    for (uint8_t i = 0; i < TX_MAILBOXES; ++i)
+    {
+        if (!mailboxPending[i])
+        {
+            return static_cast<int8_t>(i);
+        }
+    }
+    return -1;
+}
+
+bool STM32_CAN::txMailboxBusy(uint8_t index) const
+{
+    return txTiming && index < TX_MAILBOXES && mailboxPending[index];
+}
+
+bool STM32_CAN::abortTxMailbox(uint8_t index)
+{
+    // A frame on the wire finishes and counts as sent, as on bxCAN; one still in arbitration is dropped
+    if (!txTiming || index >= TX_MAILBOXES || !mailboxPending[index])
+    {
+        return false;
+    }
+    if (transmitting != index)
+    {
+        mailboxPending[index] = false;
+        mailboxAborted[index] = true;
+    }
+    return true;
+}
+
+uint64_t STM32_CAN::nextEventUs() const
+{
+    return transmitting >= 0 ? transmitEndUs : HostClock::NO_EVENT;
+}
+
+void STM32_CAN::onTime(uint64_t nowUs)
+{
+    if (transmitting < 0 || nowUs < transmitEndUs)
+    {
+        return;
+    }
+    const CAN_message_t msg = mailbox[transmitting];
+    mailboxPending[transmitting] = false;
+    transmitting = -1;
+
+    // TX mailbox empty interrupt: the library refills from its FIFO
+    while (txCount > 0)
+    {
+        const int8_t free = freeTxMailbox();
+        if (free < 0)
+        {
+            break;
+        }
+        loadMailbox(free, txQueue[txHead]);
+        txHead = (txHead + 1) % txSize;
+        txCount--;
+    }
+    startNextTransmission(transmitEndUs);
+    HostCanBus::instance().transmit(this, msg); // Receivers see the frame once its last bit is out
+}
+
+void STM32_CAN::loadMailbox(uint8_t index, const CAN_message_t &msg)
+{
+    mailbox[index] = msg;
+    mailboxPending[index] = true;
+    mailboxAborted[index] = false;
+    mailboxLoadOrder[index] = nextLoadOrder++;
+}
+
+void STM32_CAN::startNextTransmission(uint64_t nowUs)
+{
+    int8_t next = -1;
+    for (uint8_t i = 0; i < TX_MAILBOXES; ++i)
+    {
+        if (mailboxPending[i] && (next < 0 || mailbox[i].id < mailbox[next].id))
+        {
+            next = static_cast<int8_t>(i);
+        }
+    }
+    if (next >= 0)
+    {
+        for (uint8_t i = 0; i < TX_MAILBOXES; ++i)
+        {
+            if (mailboxPending[i] && mailbox[i].id == mailbox[next].id && mailbox[i].flags.extended == mailbox[next].flags.extended &&
+                static_cast<int32_t>(mailboxLoadOrder[i] - mailboxLoadOrder[next]) < 0)
+            {
+                txReorderedTotal++; // The same object would see its frames out of order
+                break;
+            }
+        }
+        transmitting = next;
+        transmitEndUs = nowUs + transmitUs(mailbox[next], baudRate);
+    }
+}
+
+bool STM32_CAN::read(CAN_message_t &msg)
+{
+    if (rxCount == 0)
+    {
+        return false;
+    }
+    msg = rxQueue[rxHead];
+    rxHead = (rxHead + 1) % rxSize;
+    rxCount--;
+    rxPendingTotal--;
+    return true;
+}
+
+void STM32_CAN::onBusFrame(const CAN_message_t &msg)
+{
+    if (loopback)
+    {
+        return;
+    }
+    if (!rxAccepted(msg))
+    {
+        rxFilteredTotal++;
+        return;
+    }
+    rxAcceptedTotal++;
+    pushRx(msg);
+}
+
+bool STM32_CAN::setRxFilters(const CanRxFilter *filters, uint8_t count)
+{
+    if (count > MAX_RX_FILTERS)
+    {
+        return false;
+    }
+    for (uint8_t i = 0; i < count; ++i)
+    {
+        rxFilters[i] = filters[i];
+    }
+    rxFilterCount = count;
+    return true;
+}
+
+bool STM32_CAN::rxAccepted(const CAN_message_t &msg) const
+{
+    if (!rxFiltering || rxFilterCount == 0)
+    {
+        return true;
+    }
+    if (msg.flags.extended || msg.flags.remote)
+    {
+        return false; // The 16-bit banks compare IDE and RTR
+    }
+    for (uint8_t i = 0; i < rxFilterCount; ++i)
+    {
+        if ((msg.id & rxFilters[i].mask) == (rxFilters[i].id & rxFilters[i].mask))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void STM32_CAN::pushRx(const CAN_message_t &msg)
+{
+    if (rxCount == rxSize)
+    {
+        rxOverrunCount++;
+        return;
+    }
+    rxQueue[(rxHead + rxCount) % rxSize] = msg;
+    rxCount++;
+    rxPendingTotal++;
+}
@@ -0,0 +1,151 @@
+#pragma once
+#ifndef HOST_STM32_CAN_H
+#define HOST_STM32_CAN_H
+
+// Host replacement for the STM32_CAN library: same message type and API subset,
+// frames go to the in-memory HostCanBus instead of the bxCAN peripheral.
+//
+// By default a written frame is on the bus at once. With setTxTiming(true) the bxCAN transmit
+// path is modelled: three mailboxes, the pending one with the lowest ID goes out next (TXFP = 0)
+// and occupies the bus for its on-wire length at the set baud rate; frames written while all
+// mailboxes are busy wait in the library's software FIFO. Only the master's own frames take
+// bus time, the drives' answers do not delay it.
+//
+// Frames with equal IDs go out in mailbox order, as on bxCAN; one sent ahead of an earlier loaded
+// frame with its ID is counted (txReorderedAllInstances()).
+//
+// setRxFilters() stands in for the bxCAN filter banks: frames that match none of the filters
+// never reach the RX queue, and the static counters tell how much receive work that saved.
+
+#include <stddef.h>
+#include <stdint.h>
+#include "CanDriver.h"
+#include "HostCanBus.h"
+#include "HostClock.h"
+
+struct CAN_message_t
+{
+    uint32_t id = 0;
+    uint16_t timestamp = 0;
+    uint8_t idhit = 0;
+    struct
+    {
+        bool extended = 0;
+        bool remote = 0;
+        bool overrun = 0;
+        bool reserved = 0;
+    } flags;
+    uint8_t len = 8;
+    uint8_t buf[8] = {0};
+    int8_t mb = 0;
+    uint8_t bus = 1;
+    bool seq = 0;
+};
+
+enum RXQUEUE_TABLE
+{
+    RX_SIZE_2 = 2,
+    RX_SIZE_4 = 4,
+    RX_SIZE_8 = 8,
+    RX_SIZE_16 = 16,
+    RX_SIZE_32 = 32,
+    RX_SIZE_64 = 64,
+    RX_SIZE_128 = 128,
+    RX_SIZE_256 = 256,
+};
+
+enum TXQUEUE_TABLE
+{
+    TX_SIZE_2 = 2,
+    TX_SIZE_4 = 4,
+    TX_SIZE_8 = 8,
+    TX_SIZE_16 = 16,
+    TX_SIZE_32 = 32,
+    TX_SIZE_64 = 64,
+    TX_SIZE_128 = 128,
+    TX_SIZE_256 = 256,
+};
+
+class STM32_CAN : public HostCanEndpoint, public HostClock::EventSource
+{
+public:
+    STM32_CAN(uint32_t rxPin, uint32_t txPin, RXQUEUE_TABLE rxSize = RX_SIZE_16, TXQUEUE_TABLE txSize = TX_SIZE_16);
+    ~STM32_CAN() override;
+
+    void begin(bool retransmission = false);
+    void end();
+    void setBaudRate(uint32_t baud) { baudRate = baud; }
+    void enableLoopBack(bool yes = true) { loopback = yes; }
+    void setAutoRetransmission(bool enabled) { autoRetransmission = enabled; }
+
+    bool write(CAN_message_t &msg);
+    bool read(CAN_message_t &msg);
+
+    // ======== Host side ========
+    static constexpr uint8_t TX_MAILBOXES = 3;
+
+    static void setTxTiming(bool enabled) { txTiming = enabled; } // Before begin()
+    static void setRxFiltering(bool enabled) { rxFiltering = enabled; } // False: filters are stored but let everything in
+
+    bool setRxFilters(const CanRxFilter *filters, uint8_t count); // Acceptance filters (Stm32CanDriver on the host)
+    static uint32_t rxAcceptedAllInstances() { return rxAcceptedTotal; } // Frames that passed the filters
+    static uint32_t rxFilteredAllInstances() { return rxFilteredTotal; } // Frames dropped by the filters
+
+    // Mailbox state as the bxCAN TSR register shows it (Stm32CanDriver reads this on the host)
+    int8_t freeTxMailbox() const;
+    bool txMailboxBusy(uint8_t index) const;
+    bool abortTxMailbox(uint8_t index);
+    bool txMailboxAborted(uint8_t index) const { return index < TX_MAILBOXES && mailboxAborted[index]; }
+    static uint32_t txReorderedAllInstances() { return txReorderedTotal; } // Sent before an older frame with the same ID
+
+    void onBusFrame(const CAN_message_t &msg) override;
+    uint64_t nextEventUs() const override;
+    void onTime(uint64_t nowUs) override;
+    size_t rxPending() const { return rxCount; }
+    uint32_t rxOverruns() const { return rxOverrunCount; }
+    static size_t rxPendingAllInstances() { return rxPendingTotal; } // Lets a harness tell when the firmware is idle
+
+private:
+    static constexpr size_t RX_CAPACITY = RX_SIZE_256;
+
+    uint32_t baudRate = 0;
+    bool loopback = false;
+    bool autoRetransmission = false;
+    bool started = false;
+
+    size_t rxSize;
+    CAN_message_t rxQueue[RX_CAPACITY];
+    size_t rxHead = 0;
+    size_t rxCount = 0;
+    uint32_t rxOverrunCount = 0;
+    static size_t rxPendingTotal;
+
+    static constexpr uint8_t MAX_RX_FILTERS = 56; // 14 banks in 16-bit list mode
+    static bool rxFiltering;
+    CanRxFilter rxFilters[MAX_RX_FILTERS];
+    uint8_t rxFilterCount = 0;
+    static uint32_t rxAcceptedTotal;
+    static uint32_t rxFilteredTotal;
+
+    bool rxAccepted(const CAN_message_t &msg) const;
+
+    static bool txTiming;
+    size_t txSize;
+    CAN_message_t txQueue[TX_SIZE_256]; // Library software FIFO in front of the mailboxes
+    size_t txHead = 0;
+    size_t txCount = 0;
+    CAN_message_t mailbox[TX_MAILBOXES];
+    bool mailboxPending[TX_MAILBOXES] = {false};
+    bool mailboxAborted[TX_MAILBOXES] = {false}; // TXOK clear: the last frame was taken back
+    uint32_t mailboxLoadOrder[TX_MAILBOXES] = {0};
+    uint32_t nextLoadOrder = 0;
+    static uint32_t txReorderedTotal;
+    int8_t transmitting = -1; // Mailbox on the wire
+    uint64_t transmitEndUs = 0;
+
+    void pushRx(const CAN_message_t &msg);
+    void loadMailbox(uint8_t index, const CAN_message_t &msg);
+    void startNextTransmission(uint64_t nowUs);
+};
+
+#endif // HOST_STM32_CAN_H
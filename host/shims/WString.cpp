@@ -0,0 +1,369 @@
+#include "WString.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace
+{
+    // Same digit layout as Arduino's ultoa()
+    void formatUnsigned(unsigned long value, unsigned char base, char *out)
+    {
+        if (base < 2 || base > 36)
+        {
+            base = 10;
+        }
+        char digits[8 * sizeof(unsigned long) + 1];
+        unsigned int count = 0;
+        do
+        {
+            unsigned long digit = value % base;
+            digits[count++] = static_cast<char>(digit < 10 ? '0' + digit : 'A' + digit - 10);
+            value /= base;
+        } while (value != 0);
+
+        unsigned int pos = 0;
+        while (count > 0)
+        {
+            out[pos++] = digits[--count];
+        }
+        out[pos] = '\0';
+    }
+
+    void formatSigned(long value, unsigned char base, char *out)
+    {
+        if (base == 10 && value < 0)
+        {
+            out[0] = '-';
+            formatUnsigned(static_cast<unsigned long>(-(value + 1)) + 1, base, out + 1);
+            return;
+        }
+        formatUnsigned(static_cast<unsigned long>(value), base, out);
+    }
+}
+
+String::String(const char *cstr)
+{
+    if (cstr != nullptr)
+    {
+        copy(cstr, static_cast<unsigned int>(strlen(cstr)));
+    }
+}
+
+String::String(const String &other)
+{
+    copy(other.c_str(), other.len);
+}
+
+String::String(String &&other) noexcept : buffer(other.buffer), capacity(other.capacity), len(other.len)
+{
+    other.buffer = nullptr;
+    other.capacity = 0;
+    other.len = 0;
+}
+
+String::String(char c)
+{
+    char text[2] = {c, '\0'};
+    copy(text, 1);
+}
+
+String::String(unsigned char value, unsigned char base) : String(static_cast<unsigned long>(value), base)
+{
+}
+
+String::String(int value, unsigned char base) : String(static_cast<long>(value), base)
+{
+}
+
+String::String(unsigned int value, unsigned char base) : String(static_cast<unsigned long>(value), base)
+{
+}
+
+String::String(long value, unsigned char base)
+{
+    char text[8 * sizeof(long) + 2];
+    formatSigned(value, base, text);
+    copy(text, static_cast<unsigned int>(strlen(text)));
+}
+
+String::String(unsigned long value, unsigned char base)
+{
+    char text[8 * sizeof(unsigned long) + 1];
+    formatUnsigned(value, base, text);
+    copy(text, static_cast<unsigned int>(strlen(text)));
+}
+
+String::String(float value, unsigned char decimalPlaces) : String(static_cast<double>(value), decimalPlaces)
+{
+}
+
+String::String(double value, unsigned char decimalPlaces)
+{
+    char text[64];
+    snprintf(text, sizeof(text), "%.*f", decimalPlaces, value);
+    copy(text, static_cast<unsigned int>(strlen(text)));
+}
+
+String::~String()
+{
+    delete[] buffer;
+}
+
+String &String::operator=(const String &other)
+{
+    if (this != &other)
+    {
+        copy(other.c_str(), other.len);
+    }
+    return *this;
+}
+
+String &String::operator=(String &&other) noexcept
+{
+    if (this != &other)
+    {
+        delete[] buffer;
+        buffer = other.buffer;
+        capacity = other.capacity;
+        len = other.len;
+        other.buffer = nullptr;
+        other.capacity = 0;
+        other.len = 0;
+    }
+    return *this;
+}
+
+String &String::operator=(const char *cstr)
+{
+    if (cstr == nullptr)
+    {
+        invalidate();
+        return *this;
+    }
+    copy(cstr, static_cast<unsigned int>(strlen(cstr)));
+    return *this;
+}
+
+bool String::reserve(unsigned int size)
+{
+    if (buffer != nullptr && capacity >= size)
+    {
+        return true;
+    }
+    char *grown = new char[size + 1];
+    if (buffer != nullptr)
+    {
+        memcpy(grown, buffer, len + 1);
+        delete[] buffer;
+    }
+    else
+    {
+        grown[0] = '\0';
+    }
+    buffer = grown;
+    capacity = size;
+    return true;
+}
+
+bool String::concat(const String &other)
+{
+    if (other.len == 0)
+    {
+        return true;
+    }
+    // `other` may be *this: copy its length before growing
+    unsigned int otherLen = other.len;
+    reserve(len + otherLen);
+    memmove(buffer + len, other.buffer, otherLen);
+    len += otherLen;
+    buffer[len] = '\0';
+    return true;
+}
+
+bool String::concat(const char *cstr)
+{
+    if (cstr == nullptr)
+    {
+        return false;
+    }
+    unsigned int cstrLen = static_cast<unsigned int>(strlen(cstr));
+    if (cstrLen == 0)
+    {
+        return true;
+    }
+    reserve(len + cstrLen);
+    memcpy(buffer + len, cstr, cstrLen + 1);
+    len += cstrLen;
+    return true;
+}
+
+bool String::concat(char c)
+{
+    char text[2] = {c, '\0'};
+    return concat(text);
+}
+
+bool String::equals(const String &other) const
+{
+    return len == other.len && strcmp(c_str(), other.c_str()) == 0;
+}
+
+bool String::equals(const char *cstr) const
+{
+    if (cstr == nullptr)
+    {
+        return len == 0;
+    }
+    return strcmp(c_str(), cstr) == 0;
+}
+
+char String::charAt(unsigned int index) const
+{
+    return index < len ? buffer[index] : '\0';
+}
+
+int String::indexOf(char c, unsigned int fromIndex) const
+{
+    if (fromIndex >= len)
+    {
+        return -1;
+    }
+    const char *found = strchr(buffer + fromIndex, c);
+    return found != nullptr ? static_cast<int>(found - buffer) : -1;
+}
+
+int String::indexOf(const String &str, unsigned int fromIndex) const
+{
+    if (fromIndex >= len)
+    {
+        return -1;
+    }
+    const char *found = strstr(buffer + fromIndex, str.c_str());
+    return found != nullptr ? static_cast<int>(found - buffer) : -1;
+}
+
+String String::substring(unsigned int beginIndex, unsigned int endIndex) const
+{
+    if (beginIndex > endIndex)
+    {
+        unsigned int swap = beginIndex;
+        beginIndex = endIndex;
+        endIndex = swap;
+    }
+    String out;
+    if (beginIndex >= len)
+    {
+        return out;
+    }
+    if (endIndex > len)
+    {
+        endIndex = len;
+    }
+    out.copy(buffer + beginIndex, endIndex - beginIndex);
+    return out;
+}
+
+void String::replace(const String &find, const String &replacement)
+{
+    if (len == 0 || find.len == 0)
+    {
+        return;
+    }
+    String out;
+    out.reserve(len);
+    unsigned int pos = 0;
+    while (pos < len)
+    {
+        const char *found = strstr(buffer + pos, find.c_str());
+        if (found == nullptr)
+        {
+            out.concat(buffer + pos);
+            break;
+        }
+        unsigned int foundPos = static_cast<unsigned int>(found - buffer);
+        char saved = buffer[foundPos];
+        buffer[foundPos] = '\0';
+        out.concat(buffer + pos);
+        buffer[foundPos] = saved;
+        out.concat(replacement);
+        pos = foundPos + find.len;
+    }
+    *this = static_cast<String &&>(out);
+}
+
+long String::toInt() const
+{
+    return buffer != nullptr ? atol(buffer) : 0;
+}
+
+float String::toFloat() const
+{
+    return static_cast<float>(toDouble());
+}
+
+double String::toDouble() const
+{
+    return buffer != nullptr ? atof(buffer) : 0.0;
+}
+
+void String::copy(const char *cstr, unsigned int length)
+{
+    if (length == 0)
+    {
+        if (buffer != nullptr)
+        {
+            buffer[0] = '\0';
+        }
+        len = 0;
+        return;
+    }
+    // reserve() keeps the old content; a fresh copy does not need it
+    if (buffer == nullptr || capacity < length)
+    {
+        delete[] buffer;
+        buffer = new char[length + 1];
+        capacity = length;
+    }
+    memmove(buffer, cstr, length);
+    buffer[length] = '\0';
+    len = length;
+}
+
+void String::invalidate()
+{
+    delete[] buffer;
+    buffer = nullptr;
+    capacity = 0;
+    len = 0;
+}
+
+String operator+(const String &lhs, const String &rhs)
+{
+    String out;
+    out.reserve(lhs.length() + rhs.length());
+    out.concat(lhs);
+    out.concat(rhs);
+    return out;
+}
+
+String operator+(const String &lhs, const char *rhs)
+{
+    String out(lhs);
+    out.concat(rhs);
+    return out;
+}
+
+String operator+(const char *lhs, const String &rhs)
+{
+    String out(lhs);
+    out.concat(rhs);
+    return out;
+}
+
+String operator+(const String &lhs, char rhs)
+{
+    String out(lhs);
+    out.concat(rhs);
+    return out;
+}
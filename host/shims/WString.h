@@ -0,0 +1,91 @@
+#pragma once
+#ifndef HOST_WSTRING_H
+#define HOST_WSTRING_H
+
+// Host replacement for the Arduino String class (WString.h).
+// Only the subset the firmware uses. Like the original it keeps its text in a heap buffer
+// for every non-empty value, so heap accounting on the host matches the target.
+
+#include <stddef.h>
+
+class String
+{
+public:
+    String(const char *cstr = "");
+    String(const String &other);
+    String(String &&other) noexcept;
+    explicit String(char c);
+    explicit String(unsigned char value, unsigned char base = 10);
+    explicit String(int value, unsigned char base = 10);
+    explicit String(unsigned int value, unsigned char base = 10);
+    explicit String(long value, unsigned char base = 10);
+    explicit String(unsigned long value, unsigned char base = 10);
+    explicit String(float value, unsigned char decimalPlaces = 2);
+    explicit String(double value, unsigned char decimalPlaces = 2);
+    ~String();
+
+    String &operator=(const String &other);
+    String &operator=(String &&other) noexcept;
+    String &operator=(const char *cstr);
+
+    bool reserve(unsigned int size);
+    unsigned int length() const { return len; }
+    const char *c_str() const { return buffer != nullptr ? buffer : ""; }
+
+    bool concat(const String &other);
+    bool concat(const char *cstr);
+    bool concat(char c);
+
+    String &operator+=(const String &other)
+    {
+        concat(other);
+        return *this;
+    }
+    String &operator+=(const char *cstr)
+    {
+        concat(cstr);
+        return *this;
+    }
+    String &operator+=(char c)
+    {
+        concat(c);
+        return *this;
+    }
+
+    bool equals(const String &other) const;
+    bool equals(const char *cstr) const;
+    bool operator==(const String &other) const { return equals(other); }
+    bool operator==(const char *cstr) const { return equals(cstr); }
+    bool operator!=(const String &other) const { return !equals(other); }
+    bool operator!=(const char *cstr) const { return !equals(cstr); }
+
+    char charAt(unsigned int index) const;
+    char operator[](unsigned int index) const { return charAt(index); }
+
+    int indexOf(char c, unsigned int fromIndex = 0) const;
+    int indexOf(const String &str, unsigned int fromIndex = 0) const;
+
+    String substring(unsigned int beginIndex) const { return substring(beginIndex, len); }
+    String substring(unsigned int beginIndex, unsigned int endIndex) const;
+
+    void replace(const String &find, const String &replacement);
+
+    long toInt() const;
+    float toFloat() const;
+    double toDouble() const;
+
+private:
+    char *buffer = nullptr;
+    unsigned int capacity = 0;
+    unsigned int len = 0;
+
+    void copy(const char *cstr, unsigned int length);
+    void invalidate();
+};
+
+String operator+(const String &lhs, const String &rhs);
+String operator+(const String &lhs, const char *rhs);
+String operator+(const char *lhs, const String &rhs);
+String operator+(const String &lhs, char rhs);
+
+#endif // HOST_WSTRING_H
@@ -0,0 +1,1039 @@
+#include <cmath>
+#include <cstring>
+#include "SimDrive.h"
+#include "HostClock.h"
+
+namespace
+{
+    constexpr uint32_t SDO_ABORT_COMMAND_SPECIFIER = 0x05040001;
+    constexpr uint32_t SDO_ABORT_READ_ONLY = 0x06010002;
+    constexpr uint32_t SDO_ABORT_NO_OBJECT = 0x06020000;
+    constexpr uint32_t SDO_ABORT_NO_SUBINDEX = 0x06090011;
+
+    constexpr uint16_t RPDO3_COMMUNICATION = RobotConstants::ODIndices::RPDO_PARAM_BASE + 2;
+    constexpr uint16_t RPDO3_MAPPING = RobotConstants::ODIndices::RPDO_MAPPING_BASE + 2;
+    constexpr uint16_t RPDO4_COMMUNICATION = RobotConstants::ODIndices::RPDO_PARAM_BASE + 3;
+    constexpr uint16_t RPDO4_MAPPING = RobotConstants::ODIndices::RPDO_MAPPING_BASE + 3;
+    constexpr uint16_t TPDO1_COMMUNICATION = RobotConstants::ODIndices::TPDO_PARAM_BASE;
+    constexpr uint16_t TPDO1_MAPPING = RobotConstants::ODIndices::TPDO_MAPPING_BASE;
+
+    constexpr uint16_t CW_NEW_SET_POINT = 0x0010;
+    constexpr uint16_t CW_FAULT_RESET = 0x0080;
+    constexpr uint16_t CW_HALT = RobotConstants::Control::CONTROLWORD_HALT;
+
+    // Statusword of each CiA 402 state (bits 0-3, 5, 6)
+    constexpr uint16_t STATE_SWITCH_ON_DISABLED = SimDrive::SW_SWITCH_ON_DISABLED;
+    constexpr uint16_t STATE_READY_TO_SWITCH_ON = SimDrive::SW_READY_TO_SWITCH_ON | SimDrive::SW_QUICK_STOP;
+    constexpr uint16_t STATE_SWITCHED_ON = STATE_READY_TO_SWITCH_ON | SimDrive::SW_SWITCHED_ON;
+    constexpr uint16_t STATE_OPERATION_ENABLED = STATE_SWITCHED_ON | SimDrive::SW_OPERATION_ENABLED;
+    constexpr uint16_t STATE_QUICK_STOP_ACTIVE = SimDrive::SW_READY_TO_SWITCH_ON | SimDrive::SW_SWITCHED_ON | SimDrive::SW_OPERATION_ENABLED;
+    constexpr uint16_t STATE_FAULT = SimDrive::SW_FAULT;
+
+    // Writing these two values to 0x260A in a row zeroes the actual position (ZEI sequence)
+    constexpr uint16_t ZEI_GEAR_FIRST = 0xEA66;
+    constexpr uint16_t ZEI_GEAR_SECOND = 0xEA70;
+}
+
+SimDrive::SimDrive(const Config &config)
+    : config(config), rngState(config.seed != 0 ? config.seed : 1)
+{
+    resetApplication();
+    resetCommunication();
+}
+
+SimDrive::~SimDrive()
+{
+    detach();
+}
+
+void SimDrive::attach()
+{
+    if (attached)
+    {
+        return;
+    }
+    HostCanBus::instance().attach(this);
+    HostClock::addEventSource(this);
+    attached = true;
+
+    const uint64_t nowUs = HostClock::nowUs();
+    motionTimeUs = nowUs;
+    resetApplication();
+    resetCommunication();
+    boot(nowUs);
+}
+
+void SimDrive::detach()
+{
+    if (attached)
+    {
+        HostCanBus::instance().detach(this);
+        HostClock::removeEventSource(this);
+        attached = false;
+    }
+    txCount = 0;
+}
+
+uint64_t SimDrive::nextEventUs() const
+{
+    if (!attached)
+    {
+        return HostClock::NO_EVENT;
+    }
+    uint64_t eventUs = (config.heartbeatIntervalMs > 0) ? nextHeartbeatUs : HostClock::NO_EVENT;
+    if (txCount > 0 && txQueue[0].dueUs < eventUs)
+    {
+        eventUs = txQueue[0].dueUs;
+    }
+    if (nmt == RobotConstants::CANOpen::NMT_STATE_OPERATIONAL && !(tpdo1.cobId & RobotConstants::CANOpen::COB_ID_PDO_INVALID) &&
+        tpdo1.eventTimerMs > 0 && tpdo1EventUs < eventUs)
+    {
+        eventUs = tpdo1EventUs;
+    }
+    const bool profileVelocity = mode == RobotConstants::Control::DEFAULT_MODE_VELOCITY;
+    if (moving && (profileVelocity || profileVelocityRpm > 0) && profileAccelerationRpmPerS > 0 && motionTimeUs + MOTION_STEP_US < eventUs)
+    {
+        eventUs = motionTimeUs + MOTION_STEP_US;
+    }
+    return eventUs;
+}
+
+void SimDrive::onTime(uint64_t nowUs)
+{
+    if (!attached)
+    {
+        return;
+    }
+    integrateMotion(nowUs);
+    serviceTpdo1(nowUs);
+
+    // The queue is kept in due-time order (queueResponse never lets a frame overtake an earlier one)
+    size_t released = 0;
+    while (released < txCount && txQueue[released].dueUs <= nowUs)
+    {
+        transmit(txQueue[released].msg);
+        released++;
+    }
+    if (released > 0)
+    {
+        memmove(txQueue, txQueue + released, (txCount - released) * sizeof(PendingFrame));
+        txCount -= released;
+    }
+
+    const uint64_t heartbeatIntervalUs = static_cast<uint64_t>(config.heartbeatIntervalMs) * 1000u;
+    while (heartbeatIntervalUs > 0 && nextHeartbeatUs <= nowUs)
+    {
+        if (heartbeatEnabled)
+        {
+            CAN_message_t heartbeat;
+            heartbeat.id = RobotConstants::CANOpen::COB_ID_HEARTBEAT_BASE + config.nodeId;
+            heartbeat.len = 1;
+            heartbeat.buf[0] = nmt;
+            transmit(heartbeat);
+        }
+        nextHeartbeatUs += heartbeatIntervalUs;
+    }
+}
+
+void SimDrive::onBusFrame(const CAN_message_t &msg)
+{
+    if (!online || frameLost())
+    {
+        return;
+    }
+    statistics.framesReceived++;
+
+    const uint64_t nowUs = HostClock::nowUs();
+    integrateMotion(nowUs); // Answers must reflect the position at reception time
+
+    const bool operational = nmt == RobotConstants::CANOpen::NMT_STATE_OPERATIONAL;
+    if (msg.id == RobotConstants::CANOpen::COB_ID_NMT)
+    {
+        if (msg.len >= 2 && (msg.buf[1] == RobotConstants::CANOpen::NMT_ALL_NODES || msg.buf[1] == config.nodeId))
+        {
+            handleNmt(msg.buf[0], nowUs);
+        }
+    }
+    else if (msg.id == RobotConstants::CANOpen::COB_ID_SYNC && operational)
+    {
+        if (syncRpdoPending)
+        {
+            syncRpdoPending = false;
+            applyRpdo(rpdo4, pendingSyncRpdo, nowUs);
+        }
+    }
+    else if (msg.id == RobotConstants::CANOpen::COB_ID_SDO_SERVER_BASE + config.nodeId && nmt != RobotConstants::CANOpen::NMT_STATE_STOPPED)
+    {
+        handleSdo(msg, nowUs);
+    }
+    else if (msg.id == rpdo4.cobId && operational) // Never matches while bit 31 (PDO invalid) is set
+    {
+        if (rpdo4.transmission <= 0xF0) // Synchronous: the last RPDO before the SYNC wins
+        {
+            pendingSyncRpdo = msg;
+            syncRpdoPending = true;
+        }
+        else
+        {
+            applyRpdo(rpdo4, msg, nowUs);
+        }
+    }
+    else if (msg.id == rpdo3.cobId && operational)
+    {
+        applyRpdo(rpdo3, msg, nowUs); // Synchronous transmission types are not modelled for RPDO3
+    }
+    serviceTpdo1(nowUs); // Statusword changed by the frame
+}
+
+void SimDrive::handleNmt(uint8_t command, uint64_t nowUs)
+{
+    switch (command)
+    {
+    case RobotConstants::CANOpen::NMT_START:
+        if (nmt != RobotConstants::CANOpen::NMT_STATE_OPERATIONAL)
+        {
+            statistics.lastOperationalUs = nowUs;
+            tpdo1Due = true;
+        }
+        nmt = RobotConstants::CANOpen::NMT_STATE_OPERATIONAL;
+        break;
+    case RobotConstants::CANOpen::NMT_STOP:
+        nmt = RobotConstants::CANOpen::NMT_STATE_STOPPED;
+        syncRpdoPending = false;
+        break;
+    case RobotConstants::CANOpen::NMT_PRE_OPERATIONAL:
+        nmt = RobotConstants::CANOpen::NMT_STATE_PRE_OPERATIONAL;
+        syncRpdoPending = false;
+        break;
+    case RobotConstants::CANOpen::NMT_RESET_NODE:
+        halt();
+        resetApplication();
+        resetCommunication();
+        boot(nowUs);
+        break;
+    case RobotConstants::CANOpen::NMT_RESET_COMMUNICATION:
+        resetCommunication();
+        boot(nowUs);
+        break;
+    default:
+        break;
+    }
+}
+
+void SimDrive::boot(uint64_t nowUs)
+{
+    txCount = 0; // Answers still pending are lost with the reset
+    nmt = RobotConstants::CANOpen::NMT_STATE_PRE_OPERATIONAL;
+    nextHeartbeatUs = nowUs + static_cast<uint64_t>(config.heartbeatIntervalMs) * 1000u;
+    statistics.bootUps++;
+    statistics.lastBootUpUs = nowUs;
+
+    CAN_message_t bootUp;
+    bootUp.id = RobotConstants::CANOpen::COB_ID_HEARTBEAT_BASE + config.nodeId;
+    bootUp.len = 1;
+    bootUp.buf[0] = RobotConstants::CANOpen::NMT_STATE_BOOT_UP;
+    transmit(bootUp);
+}
+
+// Power-on values of the device profile objects; the position stays where the axis is
+void SimDrive::resetApplication()
+{
+    controlword = 0;
+    status = SW_SWITCH_ON_DISABLED | SW_TARGET_REACHED;
+    mode = 0;
+    target = static_cast<int32_t>(position);
+    targetVelocityRpm = 0;
+    profileVelocityRpm = 0;
+    profileAccelerationRpmPerS = 0;
+    gearMolecules = 0;
+    velocity = 0;
+    moving = false;
+}
+
+void SimDrive::resetCommunication()
+{
+    rpdo4.cobId = RobotConstants::CANOpen::COB_ID_RPDO4_BASE + config.nodeId;
+    rpdo4.transmission = config.targetApply == TargetApply::ON_SYNC ? RobotConstants::CANOpen::PDO_TRANSMISSION_SYNC
+                                                                   : RobotConstants::CANOpen::PDO_TRANSMISSION_EVENT;
+    rpdo4.mappingCount = 1;
+    for (uint8_t i = 0; i < RobotConstants::CANOpen::PDO_MAPPING_MAX_ENTRIES; ++i)
+    {
+        rpdo4.mapping[i] = 0;
+    }
+    rpdo4.mapping[0] = 0x607A0020;
+    syncRpdoPending = false;
+
+    rpdo3 = Pdo();
+    rpdo3.cobId = RobotConstants::CANOpen::COB_ID_RPDO3_BASE + config.nodeId;
+    rpdo3.transmission = RobotConstants::CANOpen::PDO_TRANSMISSION_EVENT;
+    rpdo3.mappingCount = 3;
+    rpdo3.mapping[0] = 0x60400010;
+    rpdo3.mapping[1] = 0x60600008;
+    rpdo3.mapping[2] = 0x60FF0020;
+
+    tpdo1 = Pdo();
+    tpdo1.cobId = (RobotConstants::CANOpen::COB_ID_TPDO1_BASE + config.nodeId) | RobotConstants::CANOpen::COB_ID_PDO_INVALID;
+    tpdo1.transmission = RobotConstants::CANOpen::PDO_TRANSMISSION_EVENT;
+    tpdo1.mappingCount = 1;
+    tpdo1.mapping[0] = 0x60410010;
+    tpdo1Due = false;
+}
+
+uint32_t SimDrive::nextRandom()
+{
+    // xorshift32: cheap and reproducible for a given seed
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return rngState;
+}
+
+bool SimDrive::frameLost()
+{
+    if (config.frameLossPerMille == 0 || nextRandom() % 1000 >= config.frameLossPerMille)
+    {
+        return false;
+    }
+    statistics.framesLost++;
+    return true;
+}
+
+void SimDrive::handleSdo(const CAN_message_t &msg, uint64_t nowUs)
+{
+    if (msg.len < 4)
+    {
+        return;
+    }
+    const uint8_t cs = msg.buf[0];
+    const uint16_t index = static_cast<uint16_t>(msg.buf[1] | (msg.buf[2] << 8));
+    const uint8_t subindex = msg.buf[3];
+
+    uint32_t value = 0;
+    uint8_t size = 0;
+    if (!readObject(index, subindex, value, size))
+    {
+        queueSdoAbort(index, subindex, readObject(index, 0, value, size) ? SDO_ABORT_NO_SUBINDEX : SDO_ABORT_NO_OBJECT, nowUs);
+        return;
+    }
+
+    CAN_message_t response;
+    response.id = RobotConstants::CANOpen::COB_ID_SDO_CLIENT_BASE + config.nodeId;
+    response.len = 8;
+    response.buf[1] = msg.buf[1];
+    response.buf[2] = msg.buf[2];
+    response.buf[3] = subindex;
+
+    if (cs == 0x40) // Upload request
+    {
+        response.buf[0] = (size == 1) ? 0x4F : (size == 2) ? 0x4B
+                                                           : 0x43;
+        memcpy(&response.buf[4], &value, size);
+        queueResponse(response, nowUs);
+        return;
+    }
+
+    uint8_t writeSize;
+    switch (cs)
+    {
+    case 0x2F:
+        writeSize = 1;
+        break;
+    case 0x2B:
+        writeSize = 2;
+        break;
+    case 0x23:
+        writeSize = 4;
+        break;
+    default:
+        queueSdoAbort(index, subindex, SDO_ABORT_COMMAND_SPECIFIER, nowUs);
+        return;
+    }
+
+    uint32_t written = 0;
+    memcpy(&written, &msg.buf[4], writeSize);
+    if (!writeObject(index, subindex, written, nowUs))
+    {
+        queueSdoAbort(index, subindex, SDO_ABORT_READ_ONLY, nowUs);
+        return;
+    }
+    response.buf[0] = 0x60; // Download response
+    queueResponse(response, nowUs);
+}
+
+bool SimDrive::readObject(uint16_t index, uint8_t subindex, uint32_t &value, uint8_t &size) const
+{
+    if (index == RPDO3_COMMUNICATION || index == RPDO4_COMMUNICATION)
+    {
+        const Pdo &pdo = (index == RPDO3_COMMUNICATION) ? rpdo3 : rpdo4;
+        if (subindex > 2)
+        {
+            return false;
+        }
+        value = (subindex == 0) ? 2 : (subindex == 1) ? pdo.cobId
+                                                      : pdo.transmission;
+        size = (subindex == 1) ? 4 : 1;
+        return true;
+    }
+    if (index == TPDO1_COMMUNICATION)
+    {
+        switch (subindex)
+        {
+        case 0:
+            value = 5;
+            size = 1;
+            return true;
+        case 1:
+            value = tpdo1.cobId;
+            size = 4;
+            return true;
+        case 2:
+            value = tpdo1.transmission;
+            size = 1;
+            return true;
+        case 5:
+            value = tpdo1.eventTimerMs;
+            size = 2;
+            return true;
+        default:
+            return false; // No inhibit time
+        }
+    }
+    if (index == RPDO3_MAPPING || index == RPDO4_MAPPING || index == TPDO1_MAPPING)
+    {
+        const Pdo &pdo = (index == RPDO3_MAPPING) ? rpdo3 : (index == RPDO4_MAPPING) ? rpdo4
+                                                                                     : tpdo1;
+        if (subindex > RobotConstants::CANOpen::PDO_MAPPING_MAX_ENTRIES)
+        {
+            return false;
+        }
+        value = (subindex == 0) ? pdo.mappingCount : pdo.mapping[subindex - 1];
+        size = (subindex == 0) ? 1 : 4;
+        return true;
+    }
+    if (subindex != 0)
+    {
+        return false;
+    }
+    switch (index)
+    {
+    case RobotConstants::ODIndices::CONTROLWORD:
+        value = controlword;
+        size = 2;
+        return true;
+    case RobotConstants::ODIndices::STATUSWORD:
+        value = status;
+        size = 2;
+        return true;
+    case RobotConstants::ODIndices::MODES_OF_OPERATION:
+        value = static_cast<uint8_t>(mode);
+        size = 1;
+        return true;
+    case RobotConstants::ODIndices::TARGET_VELOCITY:
+        value = static_cast<uint32_t>(targetVelocityRpm);
+        size = 4;
+        return true;
+    case RobotConstants::ODIndices::POSITION_ACTUAL_VALUE:
+        value = static_cast<uint32_t>(positionActual());
+        size = 4;
+        return true;
+    case RobotConstants::ODIndices::TARGET_POSITION:
+        value = static_cast<uint32_t>(target);
+        size = 4;
+        return true;
+    case RobotConstants::ODIndices::PROFILE_VELOCITY:
+        value = profileVelocityRpm;
+        size = 4;
+        return true;
+    case RobotConstants::ODIndices::PROFILE_ACCELERATION:
+        value = profileAccelerationRpmPerS;
+        size = 4;
+        return true;
+    case RobotConstants::ODIndices::ELECTRONIC_GEAR_MOLECULES:
+        value = gearMolecules;
+        size = 2;
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool SimDrive::writeObject(uint16_t index, uint8_t subindex, uint32_t value, uint64_t nowUs)
+{
+    if (index == RPDO4_COMMUNICATION)
+    {
+        if (subindex == 1)
+        {
+            rpdo4.cobId = value;
+            syncRpdoPending = false;
+            return true;
+        }
+        if (subindex == 2)
+        {
+            rpdo4.transmission = static_cast<uint8_t>(value);
+            return true;
+        }
+        return false;
+    }
+    if (index == RPDO3_COMMUNICATION)
+    {
+        if (subindex == 1)
+        {
+            rpdo3.cobId = value;
+            return true;
+        }
+        if (subindex == 2)
+        {
+            rpdo3.transmission = static_cast<uint8_t>(value);
+            return true;
+        }
+        return false;
+    }
+    if (index == TPDO1_COMMUNICATION)
+    {
+        switch (subindex)
+        {
+        case 1:
+            tpdo1.cobId = value;
+            tpdo1Due = true;
+            return true;
+        case 2:
+            tpdo1.transmission = static_cast<uint8_t>(value);
+            return true;
+        case 5:
+            tpdo1.eventTimerMs = static_cast<uint16_t>(value);
+            tpdo1EventUs = nowUs + static_cast<uint64_t>(tpdo1.eventTimerMs) * 1000u;
+            return true;
+        default:
+            return false;
+        }
+    }
+    if (index == RPDO3_MAPPING)
+    {
+        return writeMapping(rpdo3, subindex, value);
+    }
+    if (index == RPDO4_MAPPING)
+    {
+        return writeMapping(rpdo4, subindex, value);
+    }
+    if (index == TPDO1_MAPPING)
+    {
+        return writeMapping(tpdo1, subindex, value);
+    }
+    switch (index)
+    {
+    case RobotConstants::ODIndices::CONTROLWORD:
+    {
+        const bool newSetPoint = (value & CW_NEW_SET_POINT) && !(controlword & CW_NEW_SET_POINT);
+        const bool released = !(value & CW_HALT) && (controlword & CW_HALT);
+        applyControlword(static_cast<uint16_t>(value));
+        if (newSetPoint && mode != RobotConstants::Control::DEFAULT_MODE_VELOCITY)
+        {
+            setTarget(target, nowUs);
+        }
+        else if (released && mode == RobotConstants::Control::DEFAULT_MODE_POSITION && !moving &&
+                 std::fabs(target - position) >= 0.5 && (status & SW_OPERATION_ENABLED) && (status & SW_QUICK_STOP))
+        {
+            moving = true; // On to the set point the halt interrupted
+            motionTimeUs = nowUs;
+            status &= ~SW_TARGET_REACHED;
+        }
+        updateVelocityMotion(nowUs);
+        return true;
+    }
+    case RobotConstants::ODIndices::MODES_OF_OPERATION:
+        if (mode == RobotConstants::Control::DEFAULT_MODE_VELOCITY && static_cast<int8_t>(value) != mode)
+        {
+            halt(); // Out of profile velocity: the axis stops where it is and holds that position
+            target = positionActual();
+            status |= SW_TARGET_REACHED;
+        }
+        mode = static_cast<int8_t>(value);
+        updateVelocityMotion(nowUs);
+        return true;
+    case RobotConstants::ODIndices::TARGET_VELOCITY:
+        targetVelocityRpm = static_cast<int32_t>(value);
+        statistics.velocityUpdates++;
+        statistics.lastVelocityUpdateUs = nowUs;
+        updateVelocityMotion(nowUs);
+        return true;
+    case RobotConstants::ODIndices::TARGET_POSITION:
+        target = static_cast<int32_t>(value); // Taken over by the next new-set-point edge
+        return true;
+    case RobotConstants::ODIndices::PROFILE_VELOCITY:
+        profileVelocityRpm = value;
+        statistics.profileWrites++;
+        statistics.lastProfileWriteUs = nowUs;
+        return true;
+    case RobotConstants::ODIndices::PROFILE_ACCELERATION:
+        profileAccelerationRpmPerS = value;
+        statistics.profileWrites++;
+        statistics.lastProfileWriteUs = nowUs;
+        return true;
+    case RobotConstants::ODIndices::ELECTRONIC_GEAR_MOLECULES:
+        if (gearMolecules == ZEI_GEAR_FIRST && value == ZEI_GEAR_SECOND)
+        {
+            position = 0;
+            velocity = 0;
+            target = 0;
+            moving = false;
+        }
+        gearMolecules = static_cast<uint16_t>(value);
+        return true;
+    default:
+        return false; // 0x6041, 0x6064 are read-only
+    }
+}
+
+// CiA 301: entries are writable only while the mapping is cleared (sub 0 = 0)
+bool SimDrive::writeMapping(Pdo &pdo, uint8_t subindex, uint32_t value) const
+{
+    if (subindex == 0)
+    {
+        if (value > RobotConstants::CANOpen::PDO_MAPPING_MAX_ENTRIES)
+        {
+            return false;
+        }
+        uint32_t bits = 0;
+        for (uint8_t i = 0; i < value; ++i)
+        {
+            bits += pdo.mapping[i] & 0xFF;
+        }
+        if (bits > 64)
+        {
+            return false;
+        }
+        pdo.mappingCount = static_cast<uint8_t>(value);
+        return true;
+    }
+    if (subindex > RobotConstants::CANOpen::PDO_MAPPING_MAX_ENTRIES || pdo.mappingCount != 0)
+    {
+        return false;
+    }
+    uint32_t ignored;
+    uint8_t objectSize = 0;
+    const uint8_t bits = static_cast<uint8_t>(value & 0xFF);
+    if (!readObject(static_cast<uint16_t>(value >> 16), 0, ignored, objectSize) || bits != objectSize * 8u)
+    {
+        return false; // Not mappable
+    }
+    pdo.mapping[subindex - 1] = value;
+    return true;
+}
+
+// Event-driven TPDO1 (transmission types 0xFE/0xFF; synchronous types are not modelled)
+void SimDrive::serviceTpdo1(uint64_t nowUs)
+{
+    if (nmt != RobotConstants::CANOpen::NMT_STATE_OPERATIONAL || (tpdo1.cobId & RobotConstants::CANOpen::COB_ID_PDO_INVALID))
+    {
+        return;
+    }
+    CAN_message_t tpdo;
+    tpdo.id = tpdo1.cobId & 0x7FF;
+    tpdo.len = 0;
+    for (uint8_t i = 0; i < tpdo1.mappingCount; ++i)
+    {
+        uint32_t value = 0;
+        uint8_t size = 0;
+        readObject(static_cast<uint16_t>(tpdo1.mapping[i] >> 16), 0, value, size);
+        memcpy(&tpdo.buf[tpdo.len], &value, size);
+        tpdo.len += size;
+    }
+    const bool changed = memcmp(tpdo.buf, tpdo1Data, tpdo.len) != 0;
+    const bool timerExpired = tpdo1.eventTimerMs > 0 && nowUs >= tpdo1EventUs;
+    if (!changed && !timerExpired && !tpdo1Due)
+    {
+        return;
+    }
+    memcpy(tpdo1Data, tpdo.buf, tpdo.len);
+    tpdo1Due = false;
+    tpdo1EventUs = nowUs + static_cast<uint64_t>(tpdo1.eventTimerMs) * 1000u;
+    statistics.tpdos++;
+    queueResponse(tpdo, nowUs); // Behind the SDO answer to the frame that changed the data
+}
+
+// CiA 402 state machine (transitions 2-12, 15, 16). From ready to switch on, enable operation
+// takes transitions 3 and 4 at once, as the standard allows
+void SimDrive::applyControlword(uint16_t value)
+{
+    const bool faultReset = (value & CW_FAULT_RESET) && !(controlword & CW_FAULT_RESET);
+    controlword = value;
+
+    const uint16_t motionBits = status & (SW_TARGET_REACHED | SW_SET_POINT_ACK);
+    const uint16_t current = status & 0x006F;
+    const bool faulted = (status & SW_FAULT) != 0;
+    const bool disableVoltage = (value & 0x0002) == 0;
+    const bool quickStop = (value & 0x0006) == 0x0002;
+    const bool shutdown = (value & 0x0007) == 0x0006;
+    const bool switchOn = (value & 0x000F) == 0x0007;
+    const bool enableOperation = (value & 0x000F) == 0x000F;
+
+    uint16_t state = current;
+    if (faulted)
+    {
+        if (!faultReset)
+        {
+            return;
+        }
+        state = STATE_SWITCH_ON_DISABLED; // Transition 15
+    }
+    else if (current & SW_SWITCH_ON_DISABLED)
+    {
+        state = shutdown ? STATE_READY_TO_SWITCH_ON : STATE_SWITCH_ON_DISABLED;
+    }
+    else if (current == STATE_QUICK_STOP_ACTIVE)
+    {
+        state = disableVoltage ? STATE_SWITCH_ON_DISABLED : enableOperation ? STATE_OPERATION_ENABLED
+                                                                             : STATE_QUICK_STOP_ACTIVE;
+    }
+    else if (disableVoltage)
+    {
+        state = STATE_SWITCH_ON_DISABLED;
+    }
+    else if (quickStop)
+    {
+        state = (current == STATE_OPERATION_ENABLED) ? STATE_QUICK_STOP_ACTIVE : STATE_SWITCH_ON_DISABLED;
+    }
+    else if (shutdown)
+    {
+        state = STATE_READY_TO_SWITCH_ON;
+    }
+    else if (switchOn)
+    {
+        state = STATE_SWITCHED_ON; // From ready (3) or, disable operation, from enabled (5)
+    }
+    else if (enableOperation)
+    {
+        state = STATE_OPERATION_ENABLED;
+    }
+
+    if (state == STATE_QUICK_STOP_ACTIVE && current != STATE_QUICK_STOP_ACTIVE)
+    {
+        statistics.lastQuickStopUs = HostClock::nowUs();
+    }
+    if (state == STATE_OPERATION_ENABLED && current != STATE_OPERATION_ENABLED)
+    {
+        statistics.lastEnabledUs = HostClock::nowUs();
+    }
+    if (state != STATE_OPERATION_ENABLED)
+    {
+        halt(); // Power stage off or quick stop: the model halts at once
+    }
+
+    status = state | motionBits;
+    if (faulted)
+    {
+        sendEmcy(0x0000, 0x00); // Error reset
+    }
+    if (!(value & CW_NEW_SET_POINT))
+    {
+        status &= ~SW_SET_POINT_ACK;
+    }
+}
+
+void SimDrive::injectFault(uint16_t errorCode, uint8_t errorRegister)
+{
+    integrateMotion(HostClock::nowUs());
+    halt();
+    status = SW_FAULT | (status & (SW_TARGET_REACHED | SW_SET_POINT_ACK));
+    statistics.lastFaultUs = HostClock::nowUs();
+    sendEmcy(errorCode, errorRegister);
+    serviceTpdo1(HostClock::nowUs());
+}
+
+void SimDrive::halt()
+{
+    if (moving)
+    {
+        statistics.lastHaltUs = HostClock::nowUs();
+    }
+    velocity = 0;
+    moving = false;
+}
+
+void SimDrive::sendEmcy(uint16_t errorCode, uint8_t errorRegister)
+{
+    CAN_message_t emcy;
+    emcy.id = RobotConstants::CANOpen::COB_ID_EMCY_BASE + config.nodeId;
+    emcy.len = 8;
+    emcy.buf[0] = static_cast<uint8_t>(errorCode & 0xFF);
+    emcy.buf[1] = static_cast<uint8_t>(errorCode >> 8);
+    emcy.buf[2] = errorRegister;
+    transmit(emcy); // EMCY is not a response: on the bus at once
+}
+
+void SimDrive::setTarget(int32_t value, uint64_t nowUs)
+{
+    target = value;
+    status |= SW_SET_POINT_ACK;
+    if (!moving && std::fabs(target - position) < 0.5)
+    {
+        status |= SW_TARGET_REACHED; // Set point equal to the actual position: nothing to do
+        return;
+    }
+    if ((status & SW_OPERATION_ENABLED) && (status & SW_QUICK_STOP))
+    {
+        if (!moving)
+        {
+            statistics.lastMotionStartUs = nowUs;
+        }
+        moving = true;
+        status &= ~SW_TARGET_REACHED;
+    }
+}
+
+void SimDrive::applyRpdo(const Pdo &rpdo, const CAN_message_t &msg, uint64_t nowUs)
+{
+    uint8_t length = 0;
+    bool controlwordMapped = false;
+    for (uint8_t i = 0; i < rpdo.mappingCount; ++i)
+    {
+        length += static_cast<uint8_t>((rpdo.mapping[i] & 0xFF) / 8);
+        controlwordMapped = controlwordMapped || (rpdo.mapping[i] >> 16) == RobotConstants::ODIndices::CONTROLWORD;
+    }
+    if (msg.len < length)
+    {
+        return; // Shorter than the mapping: ignored
+    }
+
+    uint8_t offset = 0;
+    for (uint8_t i = 0; i < rpdo.mappingCount; ++i)
+    {
+        const uint16_t index = static_cast<uint16_t>(rpdo.mapping[i] >> 16);
+        const uint8_t size = static_cast<uint8_t>((rpdo.mapping[i] & 0xFF) / 8);
+        uint32_t value = 0;
+        memcpy(&value, &msg.buf[offset], size);
+        offset += size;
+        if (index == RobotConstants::ODIndices::TARGET_POSITION && mode == RobotConstants::Control::MODE_CYCLIC_SYNC_POSITION)
+        {
+            followSetpoint(static_cast<int32_t>(value), nowUs);
+        }
+        else if (index == RobotConstants::ODIndices::TARGET_POSITION && !controlwordMapped)
+        {
+            setTarget(static_cast<int32_t>(value), nowUs); // Target alone starts the move (what the firmware relies on by default)
+        }
+        else
+        {
+            writeObject(index, 0, value, nowUs); // Objects apply in mapping order: 0x607A before the 0x6040 edge
+        }
+    }
+}
+
+void SimDrive::updateVelocityMotion(uint64_t nowUs)
+{
+    if (mode != RobotConstants::Control::DEFAULT_MODE_VELOCITY)
+    {
+        return;
+    }
+    if (!(status & SW_OPERATION_ENABLED) || !(status & SW_QUICK_STOP))
+    {
+        return; // applyControlword() halted it already
+    }
+    const double targetSpeed = targetVelocityRpm * static_cast<double>(config.stepsPerRevolution) / 60.0;
+    if (targetSpeed == velocity)
+    {
+        status |= SW_TARGET_REACHED;
+        return;
+    }
+    if (!moving)
+    {
+        statistics.lastMotionStartUs = nowUs;
+        motionTimeUs = nowUs;
+    }
+    moving = true;
+    status &= ~SW_TARGET_REACHED;
+}
+
+void SimDrive::followSetpoint(int32_t value, uint64_t nowUs)
+{
+    target = value;
+    if (!(status & SW_OPERATION_ENABLED) || !(status & SW_QUICK_STOP))
+    {
+        return;
+    }
+    statistics.cspSetpoints++;
+    if (value != positionActual())
+    {
+        // Slow axes repeat setpoints while accelerating; only a change after a standstill is a start
+        if (cspLastChangeUs == 0 || nowUs - cspLastChangeUs > CSP_STANDSTILL_US)
+        {
+            statistics.lastMotionStartUs = nowUs;
+        }
+        cspLastChangeUs = nowUs;
+    }
+    position = value;
+    velocity = 0;
+    moving = false;
+    status |= SW_TARGET_REACHED;
+}
+
+void SimDrive::queueResponse(const CAN_message_t &msg, uint64_t receivedUs)
+{
+    if (txCount == TX_QUEUE_SIZE)
+    {
+        return; // Drive overloaded: the request is silently not answered
+    }
+    uint64_t dueUs = receivedUs + config.responseLatencyUs;
+    if (config.responseJitterUs > 0)
+    {
+        dueUs += nextRandom() % (config.responseJitterUs + 1);
+    }
+    if (txCount > 0 && dueUs < txQueue[txCount - 1].dueUs)
+    {
+        dueUs = txQueue[txCount - 1].dueUs; // A drive answers in order
+    }
+    txQueue[txCount].dueUs = dueUs;
+    txQueue[txCount].msg = msg;
+    txCount++;
+}
+
+void SimDrive::queueSdoAbort(uint16_t index, uint8_t subindex, uint32_t abortCode, uint64_t receivedUs)
+{
+    statistics.sdoAborts++;
+    CAN_message_t response;
+    response.id = RobotConstants::CANOpen::COB_ID_SDO_CLIENT_BASE + config.nodeId;
+    response.len = 8;
+    response.buf[0] = 0x80;
+    response.buf[1] = static_cast<uint8_t>(index & 0xFF);
+    response.buf[2] = static_cast<uint8_t>(index >> 8);
+    response.buf[3] = subindex;
+    memcpy(&response.buf[4], &abortCode, sizeof(abortCode));
+    queueResponse(response, receivedUs);
+}
+
+void SimDrive::transmit(const CAN_message_t &msg)
+{
+    if (!online || frameLost())
+    {
+        return;
+    }
+    statistics.framesSent++;
+    if (msg.buf[0] == 0x43 && msg.id == RobotConstants::CANOpen::COB_ID_SDO_CLIENT_BASE + config.nodeId &&
+        (msg.buf[1] | (msg.buf[2] << 8)) == RobotConstants::ODIndices::POSITION_ACTUAL_VALUE)
+    {
+        statistics.positionReads++;
+        statistics.lastPositionReadUs = HostClock::nowUs();
+    }
+    HostCanBus::instance().transmit(this, msg);
+}
+
+void SimDrive::integrateMotion(uint64_t untilUs)
+{
+    if (!moving)
+    {
+        motionTimeUs = untilUs;
+        return;
+    }
+    if (mode == RobotConstants::Control::DEFAULT_MODE_VELOCITY)
+    {
+        integrateVelocity(untilUs);
+        return;
+    }
+
+    const double maxSpeed = profileVelocityRpm * static_cast<double>(config.stepsPerRevolution) / 60.0;        // steps/s
+    const double acceleration = profileAccelerationRpmPerS * static_cast<double>(config.stepsPerRevolution) / 60.0; // steps/s^2
+    if (maxSpeed <= 0 || acceleration <= 0)
+    {
+        motionTimeUs = untilUs; // No profile: the drive accepts the target but cannot move
+        return;
+    }
+
+    const double dt = MOTION_STEP_US / 1e6;
+    const bool halted = controlword & CW_HALT;
+    while (moving && motionTimeUs + MOTION_STEP_US <= untilUs)
+    {
+        motionTimeUs += MOTION_STEP_US;
+
+        if (halted)
+        {
+            // Ramp down and hold; the set point stays for the release
+            if (std::fabs(velocity) <= acceleration * dt)
+            {
+                velocity = 0;
+                moving = false;
+                status |= SW_TARGET_REACHED;
+                statistics.lastHaltedUs = motionTimeUs;
+                break;
+            }
+            velocity -= (velocity > 0 ? 1.0 : -1.0) * acceleration * dt;
+            position += velocity * dt;
+            continue;
+        }
+
+        const double remaining = target - position;
+        const double direction = (remaining >= 0) ? 1.0 : -1.0;
+        double speed = velocity * direction; // Negative while still moving away from the target
+
+        if (speed < 0)
+        {
+            speed = std::fmin(speed + acceleration * dt, 0.0);
+        }
+        else if (speed * speed / (2 * acceleration) >= std::fabs(remaining))
+        {
+            speed = std::fmax(speed - acceleration * dt, 0.0);
+        }
+        else if (speed > maxSpeed)
+        {
+            speed = std::fmax(speed - acceleration * dt, maxSpeed); // 0x6081 lowered during the move
+        }
+        else
+        {
+            speed = std::fmin(speed + acceleration * dt, maxSpeed);
+        }
+
+        if (speed >= 0 && std::fabs(remaining) <= std::fmax(speed * dt, 0.5))
+        {
+            position = target;
+            velocity = 0;
+            moving = false;
+            status |= SW_TARGET_REACHED;
+            statistics.lastTargetReachedUs = motionTimeUs;
+            break;
+        }
+        velocity = speed * direction;
+        position += velocity * dt;
+    }
+    if (!moving)
+    {
+        motionTimeUs = untilUs;
+    }
+}
+
+// Profile velocity: the speed ramps to 0x60FF at 0x6083 and holds it; the axis stands again only
+// when the target is zero
+void SimDrive::integrateVelocity(uint64_t untilUs)
+{
+    const double targetSpeed = targetVelocityRpm * static_cast<double>(config.stepsPerRevolution) / 60.0;             // steps/s
+    const double acceleration = profileAccelerationRpmPerS * static_cast<double>(config.stepsPerRevolution) / 60.0; // steps/s^2
+    if (acceleration <= 0)
+    {
+        motionTimeUs = untilUs;
+        return;
+    }
+
+    const double dt = MOTION_STEP_US / 1e6;
+    while (moving && motionTimeUs + MOTION_STEP_US <= untilUs)
+    {
+        motionTimeUs += MOTION_STEP_US;
+        const double difference = targetSpeed - velocity;
+        if (std::fabs(difference) <= acceleration * dt)
+        {
+            velocity = targetSpeed;
+            status |= SW_TARGET_REACHED;
+        }
+        else
+        {
+            velocity += (difference > 0 ? 1.0 : -1.0) * acceleration * dt;
+            status &= ~SW_TARGET_REACHED;
+        }
+        position += velocity * dt;
+        if (velocity == 0)
+        {
+            moving = false;
+            statistics.lastStandstillUs = motionTimeUs;
+        }
+    }
+    if (!moving)
+    {
+        motionTimeUs = untilUs;
+    }
+}
@@ -0,0 +1,216 @@
+#pragma once
+#ifndef SIM_DRIVE_H
+#define SIM_DRIVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "HostClock.h"
+#include "STM32_CAN.h"
+#include "RobotConstants.h"
+
+// Software model of one CiA 402 servo drive on the host CAN bus.
+//
+// - expedited SDO upload/download for the objects CanOpen uses
+//   (0x6040, 0x6041, 0x6060, 0x6064, 0x607A, 0x6081, 0x6083, 0x60FF, 0x260A, RPDO3 0x1402/0x1602,
+//   RPDO4 0x1403/0x1603, TPDO1 0x1800/0x1A00), abort for anything else
+// - NMT: boots into pre-operational with a boot-up message; start/stop/pre-operational and the
+//   two resets on 0x000 (addressed or broadcast). SDOs are served unless stopped, SYNC and RPDOs
+//   only while operational; reset node returns the object dictionary to its power-on values,
+//   reset communication only the PDO parameters
+// - heartbeat on 0x700+id every heartbeatIntervalMs, carrying the NMT state
+// - RPDO4 0x500+id decoded through its mapping (default 0x607A only, which sets the target and
+//   starts the move); applied on reception or, with transmission type 0x01, on the next SYNC
+// - RPDO3 0x400+id decoded through its mapping (default 0x6040, 0x6060, 0x60FF, as the drive
+//   ships), applied on reception
+// - TPDO1 0x180+id, invalid until configured (mapping 0x6041 by default): sent while operational
+//   when the mapped data changes, on entering operational and every event timer period (0x1800 sub 5)
+// - CiA 402 state machine on 0x6040 as the standard has it: enable operation is accepted from
+//   ready to switch on, switched on and quick stop active only, fault reset on the bit 7 edge
+// - trapezoidal motion toward the target with 0x6081 [rpm] and 0x6083 [rpm/s], both taken over
+//   at once when written during a move; the halt bit (0x6040 bit 8) ramps the axis down and holds
+//   it with target reached set, clearing it continues to the same target; in cyclic
+//   synchronous position (0x6060 = 8) the position follows each 0x607A setpoint at once; in
+//   profile velocity (0x6060 = 3) the speed ramps to 0x60FF [rpm] with 0x6083, target reached
+//   once it is there; leaving the mode stops the axis where it is
+// - configurable response latency and frame loss (deterministic PRNG, reproducible runs)
+// - injectFault(): the drive halts, enters fault and sends an EMCY on 0x080+id; a fault reset
+//   (0x6040 bit 7) clears it and sends the error reset EMCY (error code 0)
+//
+// Frames arrive through onBusFrame(); everything time-based (delayed responses, motion,
+// heartbeats) is a HostClock event, fired in time order as the virtual clock advances.
+class SimDrive : public HostCanEndpoint, public HostClock::EventSource
+{
+public:
+    enum class TargetApply : uint8_t
+    {
+        ON_RPDO, // Target takes effect when the RPDO arrives (what the firmware relies on today)
+        ON_SYNC, // CiA 301 synchronous RPDO (transmission type 0x01): buffered until SYNC
+    };
+
+    struct Config
+    {
+        uint8_t nodeId = 1;
+        uint32_t responseLatencyUs = 200;   // Frame reception to response on the bus
+        uint32_t responseJitterUs = 0;      // Uniform extra latency in [0, jitter]
+        uint16_t frameLossPerMille = 0;     // Probability (1/1000) that a frame in either direction is lost
+        uint32_t heartbeatIntervalMs = RobotConstants::Robot::HEARTBEAT_INTERVAL_MS;
+        uint32_t stepsPerRevolution = RobotConstants::Axis::DEFAULT_STEPS_PER_REVOLUTION;
+        TargetApply targetApply = TargetApply::ON_RPDO; // Initial RPDO4 transmission type (0xFF / 0x01)
+        uint32_t seed = 1;
+    };
+
+    struct Stats
+    {
+        uint32_t framesReceived = 0;
+        uint32_t framesSent = 0;
+        uint32_t framesLost = 0;          // Dropped by the loss model (both directions)
+        uint32_t sdoAborts = 0;
+        uint32_t positionReads = 0;       // Answered 0x6064 uploads
+        uint64_t lastPositionReadUs = 0;  // When the last 0x6064 answer went on the bus
+        uint64_t lastMotionStartUs = 0;
+        uint64_t lastTargetReachedUs = 0;
+        uint32_t cspSetpoints = 0;        // 0x607A setpoints taken over in cyclic synchronous position
+        uint64_t lastFaultUs = 0;         // injectFault(): EMCY on the bus
+        uint64_t lastQuickStopUs = 0;     // Quick stop controlword received
+        uint64_t lastHaltUs = 0;          // Motion stopped by quick stop, disable or fault
+        uint32_t bootUps = 0;             // Boot-up messages sent (attach() and NMT resets)
+        uint64_t lastBootUpUs = 0;
+        uint64_t lastOperationalUs = 0;   // NMT start taken over
+        uint32_t tpdos = 0;               // TPDO1 frames queued
+        uint64_t lastEnabledUs = 0;       // Operation enabled entered
+        uint32_t velocityUpdates = 0;     // 0x60FF writes (SDO or RPDO)
+        uint64_t lastVelocityUpdateUs = 0;
+        uint64_t lastStandstillUs = 0;    // Profile velocity: ramped down to a zero target
+        uint32_t profileWrites = 0;       // 0x6081/0x6083 writes
+        uint64_t lastProfileWriteUs = 0;
+        uint64_t lastHaltedUs = 0;        // Halt bit: ramped down to standstill
+    };
+
+    explicit SimDrive(const Config &config);
+    ~SimDrive() override;
+
+    // attach() is a power-up: object dictionary at its defaults (the position is kept, as with an
+    // absolute encoder), pre-operational, boot-up message. detach() is the power going off
+    void attach();
+    void detach();
+
+    // Releases due responses, integrates motion and sends heartbeats up to `nowUs`
+    void onTime(uint64_t nowUs) override;
+    uint64_t nextEventUs() const override;
+
+    void onBusFrame(const CAN_message_t &msg) override;
+
+    // Heartbeat loss/restore scenarios. Offline = cable pulled: no frames in or out,
+    // but the drive keeps its state and timing (unlike detach()/attach(), a power cycle).
+    void setHeartbeatEnabled(bool enabled) { heartbeatEnabled = enabled; }
+    void setOnline(bool enabled) { online = enabled; }
+    // Drive fault: motion halts at once, EMCY <errorCode> <errorRegister> goes on the bus
+    void injectFault(uint16_t errorCode, uint8_t errorRegister);
+
+    uint8_t nodeId() const { return config.nodeId; }
+    int32_t positionActual() const { return static_cast<int32_t>(position); }
+    int32_t targetPosition() const { return target; }
+    uint16_t statusword() const { return status; }
+    int8_t modeOfOperation() const { return mode; }
+    int32_t targetVelocity() const { return targetVelocityRpm; }
+    bool isMoving() const { return moving; }
+    uint8_t nmtState() const { return nmt; }
+    const Stats &stats() const { return statistics; }
+
+    // Statusword bits used by the model (CiA 402)
+    static constexpr uint16_t SW_READY_TO_SWITCH_ON = 0x0001;
+    static constexpr uint16_t SW_SWITCHED_ON = 0x0002;
+    static constexpr uint16_t SW_OPERATION_ENABLED = 0x0004;
+    static constexpr uint16_t SW_FAULT = 0x0008;
+    static constexpr uint16_t SW_QUICK_STOP = 0x0020;
+    static constexpr uint16_t SW_SWITCH_ON_DISABLED = 0x0040;
+    static constexpr uint16_t SW_TARGET_REACHED = 0x0400;
+    static constexpr uint16_t SW_SET_POINT_ACK = 0x1000;
+
+private:
+    static constexpr size_t TX_QUEUE_SIZE = 32;
+    static constexpr uint32_t MOTION_STEP_US = 1000; // Motion integration step
+    static constexpr uint32_t CSP_STANDSTILL_US = 50000; // CSP: unchanged setpoints this long = standing still
+
+    struct PendingFrame
+    {
+        uint64_t dueUs;
+        CAN_message_t msg;
+    };
+
+    Config config;
+    Stats statistics;
+    bool attached = false;
+    bool heartbeatEnabled = true;
+    bool online = true;
+    uint32_t rngState;
+
+    PendingFrame txQueue[TX_QUEUE_SIZE];
+    size_t txCount = 0;
+
+    uint8_t nmt = RobotConstants::CANOpen::NMT_STATE_PRE_OPERATIONAL;
+
+    // Object dictionary
+    uint16_t controlword = 0;
+    uint16_t status = SW_SWITCH_ON_DISABLED;
+    int8_t mode = 0; // 0x6060
+    int32_t target = 0;
+    int32_t targetVelocityRpm = 0;
+    uint32_t profileVelocityRpm = 0;
+    uint32_t profileAccelerationRpmPerS = 0;
+    uint16_t gearMolecules = 0;
+
+    // PDO communication (0x14xx/0x18xx) and mapping (0x16xx/0x1Axx) parameters
+    struct Pdo
+    {
+        uint32_t cobId = 0;
+        uint8_t transmission = 0;
+        uint16_t eventTimerMs = 0; // TPDO only
+        uint8_t mappingCount = 0;
+        uint32_t mapping[RobotConstants::CANOpen::PDO_MAPPING_MAX_ENTRIES] = {0};
+    };
+    Pdo rpdo3;
+    Pdo rpdo4;
+    Pdo tpdo1;
+    uint8_t tpdo1Data[8] = {0}; // Last payload sent
+    bool tpdo1Due = false;      // Send on the next check whatever the payload (entering operational)
+    uint64_t tpdo1EventUs = 0;  // Event timer expiry
+    CAN_message_t pendingSyncRpdo;
+    bool syncRpdoPending = false;
+
+    // Motion state (steps, steps/s)
+    double position = 0;
+    double velocity = 0;
+    bool moving = false;
+    uint64_t cspLastChangeUs = 0; // CSP: last setpoint that moved the axis
+    uint64_t motionTimeUs = 0;
+    uint64_t nextHeartbeatUs = 0;
+
+    uint32_t nextRandom();
+    bool frameLost();
+
+    void handleNmt(uint8_t command, uint64_t nowUs);
+    void boot(uint64_t nowUs);
+    void resetApplication();
+    void resetCommunication();
+    void handleSdo(const CAN_message_t &msg, uint64_t nowUs);
+    bool readObject(uint16_t index, uint8_t subindex, uint32_t &value, uint8_t &size) const;
+    bool writeObject(uint16_t index, uint8_t subindex, uint32_t value, uint64_t nowUs);
+    bool writeMapping(Pdo &pdo, uint8_t subindex, uint32_t value) const;
+    void serviceTpdo1(uint64_t nowUs);
+    void applyControlword(uint16_t value);
+    void setTarget(int32_t value, uint64_t nowUs);
+    void applyRpdo(const Pdo &rpdo, const CAN_message_t &msg, uint64_t nowUs);
+    void updateVelocityMotion(uint64_t nowUs); // Profile velocity: start or stop after 0x60FF, 0x6060 or a state change
+    void followSetpoint(int32_t value, uint64_t nowUs);
+
+    void queueResponse(const CAN_message_t &msg, uint64_t receivedUs);
+    void queueSdoAbort(uint16_t index, uint8_t subindex, uint32_t abortCode, uint64_t receivedUs);
+    void transmit(const CAN_message_t &msg);
+    void integrateMotion(uint64_t untilUs);
+    void integrateVelocity(uint64_t untilUs);
+    void halt();
+    void sendEmcy(uint16_t errorCode, uint8_t errorRegister);
+};
+
+#endif // SIM_DRIVE_H
@@ -0,0 +1,144 @@
+#include <cstdio>
+#include <cstring>
+#include "SimHarness.h"
+#include "Arduino.h"
+
+// Sketch functions and state (CANCrusher.ino)
+void setup();
+void loop();
+extern std::vector<String> outData;
+extern uint32_t lastTickTime_500;
+
+SimHarness::SimHarness(const SimDrive::Config &driveTemplate, uint8_t driveCount, uint32_t stepUs)
+    : stepUs(stepUs)
+{
+    for (uint8_t nodeId = 1; nodeId <= driveCount; ++nodeId)
+    {
+        SimDrive::Config config = driveTemplate;
+        config.nodeId = nodeId;
+        config.seed = driveTemplate.seed * 7919u + nodeId; // Independent loss patterns per drive
+        drives.emplace_back(new SimDrive(config));
+    }
+}
+
+void SimHarness::begin()
+{
+    Serial2.hostSetLineHandler([this](const char *line)
+                               { onSerialLine(line); });
+    setup();
+    for (auto &drive : drives)
+    {
+        drive->attach();
+    }
+}
+
+void SimHarness::step()
+{
+    loop();
+    passCount++;
+    if (!timeWarp)
+    {
+        HostClock::advanceUs(stepUs);
+        return;
+    }
+
+    const uint64_t nowUs = HostClock::nowUs();
+    if (!firmwareIdle())
+    {
+        HostClock::advanceUs(loopCostUs);
+        return;
+    }
+    uint64_t nextUs = HostClock::nextEventUs();
+    const uint64_t timerUs = nextFirmwareTimerUs();
+    if (timerUs < nextUs)
+    {
+        nextUs = timerUs;
+    }
+    HostClock::advanceToUs(nextUs > nowUs ? nextUs : nowUs + loopCostUs);
+}
+
+bool SimHarness::firmwareIdle() const
+{
+    return Serial2.available() == 0 && STM32_CAN::rxPendingAllInstances() == 0 && outData.empty();
+}
+
+uint64_t SimHarness::nextFirmwareTimerUs() const
+{
+    // loop() runs the ticks once millis() - lastTickTime_500 >= 500
+    return (static_cast<uint64_t>(lastTickTime_500) + 500u) * 1000u;
+}
+
+void SimHarness::runFor(uint64_t durationUs)
+{
+    const uint64_t endUs = HostClock::nowUs() + durationUs;
+    while (HostClock::nowUs() < endUs)
+    {
+        step();
+    }
+}
+
+bool SimHarness::runUntil(const std::function<bool()> &done, uint64_t timeoutUs)
+{
+    const uint64_t endUs = HostClock::nowUs() + timeoutUs;
+    while (!done())
+    {
+        if (HostClock::nowUs() >= endUs)
+        {
+            return false;
+        }
+        step();
+    }
+    return true;
+}
+
+void SimHarness::feed(const char *line)
+{
+    std::string input = std::string(line) + "\n";
+    Serial2.hostFeed(input.c_str());
+}
+
+bool SimHarness::command(const char *line, const char *replyPrefix, uint64_t timeoutUs, uint64_t &elapsedUs)
+{
+    expectedText = replyPrefix;
+    matchPrefix = true;
+    feed(line);
+    return waitForReply(timeoutUs, elapsedUs);
+}
+
+bool SimHarness::waitForLine(const char *text, uint64_t timeoutUs, uint64_t &elapsedUs)
+{
+    expectedText = text;
+    matchPrefix = false;
+    return waitForReply(timeoutUs, elapsedUs);
+}
+
+bool SimHarness::waitForReply(uint64_t timeoutUs, uint64_t &elapsedUs)
+{
+    replyReceived = false;
+    const uint64_t startUs = HostClock::nowUs();
+    bool ok = runUntil([this]()
+                       { return replyReceived; }, timeoutUs);
+    elapsedUs = HostClock::nowUs() - startUs;
+    expectedText.clear();
+    return ok;
+}
+
+void SimHarness::onSerialLine(const char *line)
+{
+    lineCount++;
+    if (echo)
+    {
+        printf("  < %s\n", line);
+    }
+    if (expectedText.empty())
+    {
+        return;
+    }
+    const bool matched = matchPrefix ? strncmp(line, expectedText.c_str(), expectedText.size()) == 0
+                                     : strstr(line, expectedText.c_str()) != nullptr;
+    if (matched)
+    {
+        reply = line;
+        replyReceived = true;
+    }
+}
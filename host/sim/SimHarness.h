@@ -0,0 +1,75 @@
+#pragma once
+#ifndef SIM_HARNESS_H
+#define SIM_HARNESS_H
+
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "SimDrive.h"
+
+// Runs the sketch (setup()/loop()) against simulated drives on the host CAN bus.
+//
+// Fixed step (default): the virtual clock advances by stepUs after every loop() pass; drive
+// events due in that interval fire on the way, so their responses land in the firmware's RX
+// queue between passes.
+// Time warp: while the firmware has work (serial input, received frames, queued output) every
+// pass costs loopCostUs; once it is idle the clock jumps straight to the next event, which is
+// either a drive event or the sketch's 500 ms tick. Hours of operation run in well under a second.
+class SimHarness
+{
+public:
+    SimHarness(const SimDrive::Config &driveTemplate, uint8_t driveCount, uint32_t stepUs = 50);
+
+    void setTimeWarp(bool enabled, uint32_t loopCostUs = 10)
+    {
+        timeWarp = enabled;
+        this->loopCostUs = loopCostUs;
+    }
+
+    // Calls the sketch's setup() and attaches the drives (they send their boot-up frames)
+    void begin();
+
+    void step();
+    void runFor(uint64_t durationUs);
+    // Steps until done() is true; false on timeout
+    bool runUntil(const std::function<bool()> &done, uint64_t timeoutUs);
+
+    void feed(const char *line); // Queues "line\n" on the firmware's serial input
+
+    // Feeds a command line and runs until a serial line starting with replyPrefix arrives.
+    // elapsedUs is the virtual time from feeding to the reply; false on timeout.
+    bool command(const char *line, const char *replyPrefix, uint64_t timeoutUs, uint64_t &elapsedUs);
+    // Runs until a serial line containing `text` arrives
+    bool waitForLine(const char *text, uint64_t timeoutUs, uint64_t &elapsedUs);
+
+    SimDrive &drive(uint8_t nodeId) { return *drives.at(nodeId - 1); }
+    uint8_t driveCount() const { return static_cast<uint8_t>(drives.size()); }
+    const std::string &lastReply() const { return reply; }
+    uint32_t linesSeen() const { return lineCount; }
+    uint64_t loopPasses() const { return passCount; }
+
+    void setEcho(bool enabled) { echo = enabled; } // Copy every firmware serial line to stdout
+
+private:
+    std::vector<std::unique_ptr<SimDrive>> drives;
+    uint32_t stepUs;
+    bool timeWarp = false;
+    uint32_t loopCostUs = 10;
+    bool echo = false;
+    uint64_t passCount = 0;
+
+    std::string expectedText;
+    bool matchPrefix = true;
+    std::string reply;
+    bool replyReceived = false;
+    uint32_t lineCount = 0;
+
+    bool firmwareIdle() const;
+    uint64_t nextFirmwareTimerUs() const;
+    bool waitForReply(uint64_t timeoutUs, uint64_t &elapsedUs);
+    void onSerialLine(const char *line);
+};
+
+#endif // SIM_HARNESS_H
@@ -0,0 +1,1166 @@
+// Closed-loop run of the firmware against simulated CiA 402 drives.
+//
+//   drive_sim [--moves N] [--latency-us N] [--jitter-us N] [--loss-permille N] [--seed N] [--echo]
+//             [--plan-axes N] [--plan-poll-hz N] [--sync-start] [--csp-period-us N] [--bus-timing] [--tx-fifo]
+//             [--foreign-hz N] [--no-rx-filter] [--fault-move N] [--fault-node N] [--fault-delay-ms N] [--jog N]
+//             [--feed-rate P] [--abort N] [--path N]
+//
+// Boots the sketch with one SimDrive per axis, runs ZEI, then a series of MAJ moves, and reports
+// (all in virtual time):
+//   zei        ZEI command to ZEI reply
+//   start      MAJ line fed to the first drive starting to move
+//   skew       first to last drive starting to move (drive model), and as the firmware measured it
+//              from timestamped 0x6064 answers (SYN); --sync-start sends SYN1 after ZEI, so every
+//              move is preloaded on synchronous RPDOs and released by one SYNC
+//   csp        with --csp-period-us the moves are streamed in cyclic synchronous position (CSP<N>):
+//              cycle count, missed cycles, overruns, underruns, tick-to-SYNC latency and bus load
+//   path       with --csp-period-us and --path N, N cycles of a pick-and-place path (four waypoints
+//              between two poses, all MAJ lines queued at once), first stopping at every waypoint
+//              (PTH0), then blended (PTH1): cycle time and gain, the closest pass by each waypoint,
+//              and the peak acceleration of any axis from the drives' positions (cycles without lost frames);
+//              fails unless PTH1 blends junctions (blended=) and the planner's acceleration between cycles
+//              (acc=) stays within the limit; then a junction that reverses an axis at its full deceleration
+//              has to be stopped at, and one that fits the limit with a gentler next ramp has to blend
+//   complete   MAJ line fed to the last drive standing at the commanded target (lost RPDOs fail the move)
+//   move done  profile position moves: the firmware's MDN reply (statusword target reached, final
+//              0x6064 read back) after the last drive reached its target, and the duration MDN reports
+//   feedback   age of the newest 0x6064 answer while moving, and the firmware's position error; at
+//              the end, after two idle rate windows, the FBK reply (poll ceiling and budget, per-axis rate and interval)
+//              and the PLN reply (move plans prepared, dispatched, replaced while staged)
+//   bus        frames and bus time per traffic class and per command (BusLoad), and the background
+//              load (heartbeat + position polls) projected to --plan-axes drives polled at --plan-poll-hz
+//   tx         per transmit class (CanTxScheduler): frames, preemptions, queue depth and the time from
+//              queueing to a TX mailbox. Only meaningful with --bus-timing, which models the three
+//              bxCAN mailboxes and the time each frame takes on the bus; --tx-fifo sends TXQ0 (one
+//              FIFO, no preemption) to compare against. A frame sent ahead of an older one with its
+//              COB-ID (equal IDs go in mailbox order) fails the run
+//   fault      with --fault-move N, drive --fault-node (default 1) faults --fault-delay-ms (default 20)
+//              after move N has started and sends an EMCY: time from the EMCY to the quick stop
+//              reaching the last of the other drives, and the firmware's own reaction time (EMC);
+//              then EMCR clears the fault and the remaining moves run; fault reset is the time from the
+//              EMCR line to the last drive back in operation enabled (CiA 402 state machine, DRV)
+//   rx         frames on the bus, frames the acceptance filters (CanOpen::applyRxFilters) kept out of
+//              the RX queue, and what reached CanOpen::read(). --foreign-hz N adds traffic from other
+//              devices (PDOs, heartbeats and SDO answers of nodes the master does not drive);
+//              --no-rx-filter lets everything in, as without filters
+//   jog        with --jog N, N jogs after the moves, axis by axis, each a JOG line and keep-alives every
+//              JOG_KEEP_ALIVE_US: response is the JOG line to the drive taking the new 0x60FF; every
+//              other jog is released with speed 0, the others by the deadman (no keep-alive): deadman is
+//              the last keep-alive to the zero velocity reaching the drive, stop the zero velocity to
+//              the drive back in profile position, where the firmware's position has to match the drive's
+//   feed rate  with --feed-rate P, OVR<P> FEED_RATE_DELAY_US into every move, OVR100 after it: override
+//              is the OVR line to the last moving drive taking its new 0x6081/0x6083, finish skew the
+//              first to last moving drive reaching its target. P = 0 holds the move instead: hold is the
+//              OVR0 line to the last drive standing; FEED_HOLD_US later OVR100 releases it, and a drive
+//              that crept meanwhile fails the move
+//   abort      with --abort N, the first N moves are aborted: even ones by an ABT line ABORT_DELAY_US after
+//              the first drive started, odd ones by an edge on the abort pin ABORT_PIN_DELAY_US after the MAJ
+//              line, while the firmware is still sending the move (serviced from yield() in its delays).
+//              abort to stop is the request to the quick stop reaching the last drive, abort (fw) the
+//              latency the firmware reports (ABT OK / ABT PIN); a drive that moves afterwards or a
+//              missing MDN FF fails the abort, then EMCR resumes and the next move runs
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include "Arduino.h"
+#include "BusLoad.h"
+#include "CanOpenController.h"
+#include "CspStreamer.h"
+#include "SimHarness.h"
+#include "STM32_CAN.h"
+
+extern CanOpen canOpen;
+extern MoveController moveController;
+extern StepDirController::CspStreamer cspStreamer;
+
+namespace
+{
+    constexpr uint64_t MOVE_TIMEOUT_US = 30000000;
+    constexpr uint64_t ZEI_TIMEOUT_US = 5000000;
+    constexpr uint64_t FEEDBACK_SAMPLE_US = 1000;
+    constexpr uint16_t FAULT_ERROR_CODE = 0x2310; // Continuous over-current
+    constexpr uint8_t FAULT_ERROR_REGISTER = 0x03; // Generic + current
+    constexpr uint64_t JOG_KEEP_ALIVE_US = 100000;
+    constexpr uint32_t JOG_KEEP_ALIVES = 5;
+    constexpr uint64_t FEED_RATE_DELAY_US = 100000;
+    constexpr uint64_t FEED_HOLD_US = 300000;
+    constexpr uint64_t ABORT_DELAY_US = 50000;
+    constexpr uint64_t ABORT_PIN_DELAY_US = 8000;
+    constexpr uint64_t ABORT_STANDSTILL_US = 200000; // Watched after the stop: nothing may move
+    constexpr uint64_t PATH_SAMPLE_US = 20000;       // Acceleration from positions this far apart (1 step = 2.5e3 steps/s^2)
+    constexpr double PATH_ACCELERATION_MARGIN = 3.0; // units/s^2: sampling of whole steps
+    constexpr double PATH_PLANNED_TOLERANCE = 1.001;  // PTH acc= (unrounded rows): float rounding of the reply only
+
+    // Pick-and-place path [units per axis]: cycles run it forward (pose 0 to 5) and back; the poses
+    // in between are waypoints, axes B and C rise and fall on the way
+    constexpr uint8_t PATH_POSES = 6;
+    constexpr double PATH[PATH_POSES][RobotConstants::Robot::MAX_AXES_COUNT] = {
+        {0, 0, 0, 0, 0, 0},
+        {2, 8, 4, 1, 0, 3},
+        {8, 12, 6, 3, 2, 6},
+        {16, 14, 7, 6, 4, 8},
+        {22, 12, 5, 8, 6, 9},
+        {24, 6, 2, 9, 7, 9},
+    };
+    constexpr double PATH_SPEED_UNITS = 50;
+    constexpr double PATH_ACCELERATION_UNITS = 50;
+
+    // Other devices on the bus: their PDOs, heartbeats and SDO answers
+    class ForeignTraffic : public HostCanEndpoint, public HostClock::EventSource
+    {
+    public:
+        explicit ForeignTraffic(uint32_t frequencyHz) : periodUs(1000000 / frequencyHz), nextUs(HostClock::nowUs() + periodUs) {}
+
+        void onBusFrame(const CAN_message_t &) override {}
+
+        uint64_t nextEventUs() const override { return nextUs; }
+
+        void onTime(uint64_t nowUs) override
+        {
+            while (nextUs <= nowUs)
+            {
+                static const uint32_t ids[] = {0x1A0, 0x720, 0x2A0, 0x590, 0x1B0, 0x730, 0x0A0, 0x3A0};
+                CAN_message_t msg;
+                msg.id = ids[sent % (sizeof(ids) / sizeof(ids[0]))];
+                msg.len = 8;
+                msg.buf[0] = static_cast<uint8_t>(sent);
+                HostCanBus::instance().transmit(this, msg);
+                sent++;
+                nextUs += periodUs;
+            }
+        }
+
+        uint32_t framesSent() const { return sent; }
+
+    private:
+        uint64_t periodUs;
+        uint64_t nextUs;
+        uint32_t sent = 0;
+    };
+
+    // Falling edge on the sketch's abort input (ABORT_PIN, PB0 by default) at a set virtual time; the
+    // interrupt handler runs from the clock, in the middle of whatever the firmware is doing
+    class AbortPinEdge : public HostClock::EventSource
+    {
+    public:
+        void schedule(uint64_t atUs) { edgeUs = atUs; }
+        uint64_t nextEventUs() const override { return edgeUs; }
+
+        void onTime(uint64_t) override
+        {
+            edgeUs = HostClock::NO_EVENT;
+            hostPinInterrupt(PB0);
+        }
+
+    private:
+        uint64_t edgeUs = HostClock::NO_EVENT;
+    };
+
+    // Waits for every drive back in operation enabled; lastEnabledUs: when the last one got there
+    bool waitEnabled(SimHarness &sim, uint64_t fromUs, uint64_t &lastEnabledUs)
+    {
+        const bool enabled = sim.runUntil([&]()
+                                          {
+                                              for (uint8_t nodeId = 1; nodeId <= sim.driveCount(); ++nodeId)
+                                              {
+                                                  if (RobotConstants::driveStateFromStatusword(sim.drive(nodeId).statusword()) != RobotConstants::DriveState::DRIVE_OPERATION_ENABLED)
+                                                  {
+                                                      return false;
+                                                  }
+                                              }
+                                              return true; },
+                                          1000000);
+        lastEnabledUs = fromUs;
+        for (uint8_t nodeId = 1; enabled && nodeId <= sim.driveCount(); ++nodeId)
+        {
+            const uint64_t enabledUs = sim.drive(nodeId).stats().lastEnabledUs;
+            lastEnabledUs = enabledUs > lastEnabledUs ? enabledUs : lastEnabledUs;
+        }
+        return enabled;
+    }
+
+    struct Summary
+    {
+        const char *name;
+        const char *unit;
+        double scale; // Divisor applied to the raw values when printing
+        uint32_t count = 0;
+        double total = 0;
+        double minValue = 0;
+        double maxValue = 0;
+
+        Summary(const char *name, const char *unit, double scale) : name(name), unit(unit), scale(scale) {}
+
+        void add(double value)
+        {
+            minValue = (count == 0 || value < minValue) ? value : minValue;
+            maxValue = (count == 0 || value > maxValue) ? value : maxValue;
+            total += value;
+            count++;
+        }
+
+        void print() const
+        {
+            if (count == 0)
+            {
+                printf("%-18s n=0\n", name);
+                return;
+            }
+            printf("%-18s n=%-6u min=%10.3f avg=%10.3f max=%10.3f %s\n",
+                   name, count, minValue / scale, total / count / scale, maxValue / scale, unit);
+        }
+    };
+
+    std::string moveCommand(uint32_t moveIndex)
+    {
+        // Alternate between two poses so every move has a non-zero distance on every axis
+        std::string line = "MAJ";
+        const double sign = (moveIndex % 2 == 0) ? 1.0 : -1.0;
+        char axis[32];
+        for (uint8_t nodeId = 1; nodeId <= RobotConstants::Robot::AXES_COUNT; ++nodeId)
+        {
+            snprintf(axis, sizeof(axis), "J%c%.2f", 'A' + nodeId - 1, sign * (5.0 + 3.0 * nodeId + moveIndex % 4));
+            line += axis;
+        }
+        line += "SP50AC50";
+        return line;
+    }
+
+    std::string pathCommand(const double *units, double accelerationUnits)
+    {
+        std::string line = "MAJ";
+        char axis[32];
+        for (uint8_t nodeId = 1; nodeId <= RobotConstants::Robot::AXES_COUNT; ++nodeId)
+        {
+            snprintf(axis, sizeof(axis), "J%c%.2f", 'A' + nodeId - 1, units[nodeId - 1]);
+            line += axis;
+        }
+        snprintf(axis, sizeof(axis), "SP%.0fAC%.0f", PATH_SPEED_UNITS, accelerationUnits);
+        return line + axis;
+    }
+
+    std::string pathCommand(uint8_t pose)
+    {
+        return pathCommand(PATH[pose], PATH_ACCELERATION_UNITS);
+    }
+
+    // PTH reply field, -1 if missing
+    double pathField(const std::string &reply, const char *key)
+    {
+        const size_t at = reply.find(key);
+        return at != std::string::npos ? atof(reply.c_str() + at + strlen(key)) : -1;
+    }
+
+    void printBusBudget(uint8_t driveCount, uint8_t planAxes, double planPollHz)
+    {
+        const double seconds = HostClock::nowUs() / 1e6;
+        for (uint8_t traffic = 0; traffic < BUS_TRAFFIC_COUNT; ++traffic)
+        {
+            const BusLoad::TrafficStats &stats = BusLoad::trafficStats(static_cast<BusTraffic>(traffic));
+            printf("bus %-6s frames=%-7u us=%-9llu worst us=%-9llu",
+                   BusLoad::trafficName(static_cast<BusTraffic>(traffic)), stats.frames,
+                   static_cast<unsigned long long>(BusLoad::bitsToMicros(stats.bits)),
+                   static_cast<unsigned long long>(BusLoad::bitsToMicros(stats.worstBits)));
+            if (stats.commands > 0)
+            {
+                printf(" per command: n=%u frames=%.1f us=%.1f worst us=%.1f",
+                       stats.commands, static_cast<double>(stats.frames) / stats.commands,
+                       static_cast<double>(BusLoad::bitsToMicros(stats.bits)) / stats.commands,
+                       static_cast<double>(BusLoad::bitsToMicros(stats.worstBits)) / stats.commands);
+            }
+            printf("\n");
+        }
+        printf("bus load: last window %.1f%%, peak %.1f%%, average %.1f%%\n",
+               BusLoad::utilizationPermille() / 10.0, BusLoad::peakPermille() / 10.0, BusLoad::averagePermille() / 10.0);
+
+        // Background cost per drive and second, measured at the firmware's poll rate, scaled to the plan
+        const BusLoad::TrafficStats &heartbeat = BusLoad::trafficStats(BUS_TRAFFIC_HEARTBEAT);
+        const BusLoad::TrafficStats &poll = BusLoad::trafficStats(BUS_TRAFFIC_POLL);
+        if (seconds <= 0 || driveCount == 0 || poll.frames == 0)
+        {
+            return;
+        }
+        const double heartbeatUsPerDrive = BusLoad::bitsToMicros(heartbeat.worstBits) / seconds / driveCount;
+        const double pollUsPerExchange = static_cast<double>(BusLoad::bitsToMicros(poll.worstBits)) / (poll.frames / 2.0); // Request + answer
+        const double backgroundUs = planAxes * (heartbeatUsPerDrive + planPollHz * pollUsPerExchange);
+        printf("plan: %u drives, position poll %.1f Hz -> background %.1f%% of the bus (worst-case stuffing)\n",
+               planAxes, planPollHz, backgroundUs / 1e4);
+    }
+
+    void printTxClasses()
+    {
+        CanTxScheduler &scheduler = canOpen.getTxScheduler();
+        printf("tx scheduling: %s, %u preemptions, %u frames sent ahead of an older one with their COB-ID\n",
+               scheduler.isPrioritized() ? "by class" : "fifo", scheduler.preemptions(), STM32_CAN::txReorderedAllInstances());
+        for (uint8_t txClass = 0; txClass < CAN_TX_CLASS_COUNT; ++txClass)
+        {
+            const CanTxScheduler::ClassStats &stats = scheduler.classStats(static_cast<CanTxClass>(txClass));
+            printf("tx %-6s frames=%-7u dropped=%-4u preempted=%-5u max depth=%-3u latency avg=%7.1f max=%6u us\n",
+                   CanTxScheduler::className(static_cast<CanTxClass>(txClass)), stats.frames, stats.dropped, stats.preempted, stats.maxDepth,
+                   stats.frames > 0 ? static_cast<double>(stats.totalLatencyUs) / stats.frames : 0.0, stats.maxLatencyUs);
+        }
+    }
+
+    void printRxFiltering(uint32_t acceptedBefore, uint32_t filteredBefore, uint32_t foreignFrames)
+    {
+        CanRxFilter filters[RobotConstants::CANOpen::MAX_RX_FILTERS];
+        const uint8_t count = canOpen.rxFilters(filters, RobotConstants::CANOpen::MAX_RX_FILTERS);
+        printf("rx filters: %u, %s:", count, canOpen.rxFiltering() ? "programmed" : "off");
+        for (uint8_t i = 0; i < count; ++i)
+        {
+            printf(" %03X/%03X", static_cast<unsigned>(filters[i].id), static_cast<unsigned>(filters[i].mask));
+        }
+        printf("\n");
+
+        const uint32_t accepted = STM32_CAN::rxAcceptedAllInstances() - acceptedBefore;
+        const uint32_t filtered = STM32_CAN::rxFilteredAllInstances() - filteredBefore;
+        const uint32_t seen = accepted + filtered;
+        const CanOpen::DispatchStats &stats = canOpen.getDispatchStats();
+        printf("rx: bus frames=%u (foreign %u) filtered in hardware=%u (%.1f%%) read by CanOpen=%u rejected in software=%u\n",
+               seen, foreignFrames, filtered, seen > 0 ? 100.0 * filtered / seen : 0.0, stats.framesDecoded, stats.rejected);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    SimDrive::Config driveConfig;
+    uint32_t moves = 20;
+    bool echo = false;
+    uint8_t planAxes = RobotConstants::Robot::MAX_AXES_COUNT;
+    double planPollHz = 1000.0 / 500.0; // tick_500
+    bool syncStart = false;
+    uint32_t cspPeriodUs = 0;
+    bool txFifo = false;
+    uint32_t foreignHz = 0;
+    int64_t faultMove = -1;
+    uint8_t faultNode = 1;
+    uint32_t faultDelayMs = 20;
+    uint32_t jogs = 0;
+    int32_t feedRate = -1;
+    uint32_t aborts = 0;
+    uint32_t paths = 0;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--moves") == 0 && hasValue)
+        {
+            moves = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        }
+        else if (strcmp(argv[i], "--latency-us") == 0 && hasValue)
+        {
+            driveConfig.responseLatencyUs = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        }
+        else if (strcmp(argv[i], "--jitter-us") == 0 && hasValue)
+        {
+            driveConfig.responseJitterUs = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        }
+        else if (strcmp(argv[i], "--loss-permille") == 0 && hasValue)
+        {
+            driveConfig.frameLossPerMille = static_cast<uint16_t>(strtoul(argv[++i], nullptr, 10));
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && hasValue)
+        {
+            driveConfig.seed = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        }
+        else if (strcmp(argv[i], "--echo") == 0)
+        {
+            echo = true;
+        }
+        else if (strcmp(argv[i], "--plan-axes") == 0 && hasValue)
+        {
+            planAxes = static_cast<uint8_t>(strtoul(argv[++i], nullptr, 10));
+        }
+        else if (strcmp(argv[i], "--plan-poll-hz") == 0 && hasValue)
+        {
+            planPollHz = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--sync-start") == 0)
+        {
+            syncStart = true;
+        }
+        else if (strcmp(argv[i], "--csp-period-us") == 0 && hasValue)
+        {
+            cspPeriodUs = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        }
+        else if (strcmp(argv[i], "--bus-timing") == 0)
+        {
+            STM32_CAN::setTxTiming(true);
+        }
+        else if (strcmp(argv[i], "--tx-fifo") == 0)
+        {
+            txFifo = true;
+        }
+        else if (strcmp(argv[i], "--foreign-hz") == 0 && hasValue)
+        {
+            foreignHz = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        }
+        else if (strcmp(argv[i], "--no-rx-filter") == 0)
+        {
+            STM32_CAN::setRxFiltering(false);
+        }
+        else if (strcmp(argv[i], "--fault-move") == 0 && hasValue)
+        {
+            faultMove = static_cast<int64_t>(strtoul(argv[++i], nullptr, 10));
+        }
+        else if (strcmp(argv[i], "--fault-node") == 0 && hasValue)
+        {
+            faultNode = static_cast<uint8_t>(strtoul(argv[++i], nullptr, 10));
+        }
+        else if (strcmp(argv[i], "--fault-delay-ms") == 0 && hasValue)
+        {
+            faultDelayMs = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        }
+        else if (strcmp(argv[i], "--jog") == 0 && hasValue)
+        {
+            jogs = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        }
+        else if (strcmp(argv[i], "--feed-rate") == 0 && hasValue)
+        {
+            feedRate = static_cast<int32_t>(strtoul(argv[++i], nullptr, 10));
+        }
+        else if (strcmp(argv[i], "--abort") == 0 && hasValue)
+        {
+            aborts = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        }
+        else if (strcmp(argv[i], "--path") == 0 && hasValue)
+        {
+            paths = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--moves N] [--latency-us N] [--jitter-us N] [--loss-permille N] [--seed N] [--echo] [--plan-axes N] [--plan-poll-hz N] [--sync-start] [--csp-period-us N] [--bus-timing] [--tx-fifo] [--foreign-hz N] [--no-rx-filter] [--fault-move N] [--fault-node N] [--fault-delay-ms N] [--jog N] [--feed-rate P] [--abort N] [--path N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (faultNode == 0 || RobotConstants::Robot::AXES_COUNT < faultNode)
+    {
+        fprintf(stderr, "--fault-node must be 1..%u\n", RobotConstants::Robot::AXES_COUNT);
+        return 2;
+    }
+
+    SimHarness sim(driveConfig, RobotConstants::Robot::AXES_COUNT);
+    sim.setEcho(echo);
+    sim.begin();
+    sim.runFor(2500000); // Heartbeats mark every axis alive
+
+    Summary zeiTime("zei", "ms", 1000.0);
+    Summary startLatency("start", "ms", 1000.0);
+    Summary completeTime("complete", "ms", 1000.0);
+    Summary moveDoneDelay("move done delay", "ms", 1000.0);
+    Summary moveDoneTime("move done (fw)", "ms", 1000.0);
+    Summary startSkew("start skew", "ms", 1000.0);
+    Summary measuredSkew("start skew (fw)", "ms", 1000.0);
+    Summary measuredResolution("skew resolution", "ms", 1000.0);
+    Summary feedbackAge("feedback age", "ms", 1000.0);
+    Summary feedbackError("feedback error", "steps", 1.0);
+    Summary faultToStop("fault to stop", "ms", 1000.0);
+    Summary faultReset("fault reset", "ms", 1000.0);
+    Summary jogResponse("jog response", "ms", 1000.0);
+    Summary jogDeadman("jog deadman", "ms", 1000.0);
+    Summary jogStop("jog stop", "ms", 1000.0);
+    Summary feedRateChange("override", "ms", 1000.0);
+    Summary feedHold("hold", "ms", 1000.0);
+    Summary finishSkew("finish skew", "ms", 1000.0);
+    Summary abortToStop("abort to stop", "ms", 1000.0);
+    Summary abortLatency("abort (fw)", "ms", 1000.0);
+    Summary pathStopTime("path stop-and-go", "ms", 1000.0);
+    Summary pathBlendTime("path blended", "ms", 1000.0);
+    Summary pathStopDeviation("via stop-and-go", "units", 1.0);
+    Summary pathBlendDeviation("via blended", "units", 1.0);
+    Summary pathStopAcceleration("acc stop-and-go", "units/s2", 1.0);
+    Summary pathBlendAcceleration("acc blended", "units/s2", 1.0);
+    uint32_t failedMoves = 0;
+    uint32_t failedJogs = 0;
+    uint32_t failedAborts = 0;
+    uint32_t failedPaths = 0;
+    AbortPinEdge abortPin;
+    HostClock::addEventSource(&abortPin);
+    bool faultHandled = faultMove < 0;
+
+    uint64_t elapsedUs = 0;
+    if (txFifo)
+    {
+        sim.command("TXQ0", "TXQ ", ZEI_TIMEOUT_US, elapsedUs);
+    }
+    canOpen.getTxScheduler().resetStats(); // Boot traffic is not part of the run
+    canOpen.resetDispatchStats();
+    const uint32_t rxAcceptedBefore = STM32_CAN::rxAcceptedAllInstances();
+    const uint32_t rxFilteredBefore = STM32_CAN::rxFilteredAllInstances();
+    ForeignTraffic foreign(foreignHz > 0 ? foreignHz : 1);
+    if (foreignHz > 0)
+    {
+        HostCanBus::instance().attach(&foreign);
+        HostClock::addEventSource(&foreign);
+    }
+    if (sim.command("ZEI", "ZEI ", ZEI_TIMEOUT_US, elapsedUs))
+    {
+        zeiTime.add(static_cast<double>(elapsedUs));
+        printf("ZEI reply: %s\n", sim.lastReply().c_str());
+    }
+    else
+    {
+        printf("ZEI: no reply within %llu ms\n", static_cast<unsigned long long>(ZEI_TIMEOUT_US / 1000));
+    }
+    if (syncStart)
+    {
+        const bool configured = sim.command("SYN1", "SYN ", ZEI_TIMEOUT_US, elapsedUs);
+        printf("SYN1 reply: %s\n", configured ? sim.lastReply().c_str() : "none");
+    }
+    if (cspPeriodUs > 0)
+    {
+        const std::string line = "CSP" + std::to_string(cspPeriodUs);
+        const bool started = sim.command(line.c_str(), "CSP ", ZEI_TIMEOUT_US, elapsedUs);
+        printf("%s reply: %s\n", line.c_str(), started ? sim.lastReply().c_str() : "none");
+        if (!started || sim.lastReply().find("active=1") == std::string::npos)
+        {
+            return 1;
+        }
+    }
+
+    for (uint32_t moveIndex = 0; moveIndex < moves; ++moveIndex)
+    {
+        const uint64_t startUs = HostClock::nowUs();
+        if (moveIndex < aborts)
+        {
+            // Abort in mid-move: every drive has to get the quick stop and stay where it stopped
+            const bool byPin = moveIndex % 2 == 1;
+            uint64_t requestUs = startUs + ABORT_PIN_DELAY_US;
+            bool acknowledged = false;
+            if (byPin)
+            {
+                abortPin.schedule(requestUs);
+                sim.feed(moveCommand(moveIndex).c_str());
+                acknowledged = sim.waitForLine("ABT PIN", MOVE_TIMEOUT_US, elapsedUs);
+            }
+            else
+            {
+                sim.feed(moveCommand(moveIndex).c_str());
+                sim.runUntil([&]()
+                             {
+                                 for (uint8_t nodeId = 1; nodeId <= sim.driveCount(); ++nodeId)
+                                 {
+                                     if (sim.drive(nodeId).stats().lastMotionStartUs >= startUs)
+                                     {
+                                         return true;
+                                     }
+                                 }
+                                 return false; },
+                             MOVE_TIMEOUT_US);
+                sim.runFor(ABORT_DELAY_US);
+                requestUs = HostClock::nowUs();
+                acknowledged = sim.command("ABT", "ABT ", 1000000, elapsedUs) && sim.lastReply().find("ABT OK") == 0;
+            }
+            const std::string abortReply = sim.lastReply();
+            const bool reported = acknowledged && sim.waitForLine("MDN FF", 1000000, elapsedUs);
+            uint64_t lastStopUs = requestUs;
+            const bool stopped = sim.runUntil([&]()
+                                              {
+                                                  for (uint8_t nodeId = 1; nodeId <= sim.driveCount(); ++nodeId)
+                                                  {
+                                                      const uint64_t quickStopUs = sim.drive(nodeId).stats().lastQuickStopUs;
+                                                      if (quickStopUs < requestUs)
+                                                      {
+                                                          return false;
+                                                      }
+                                                      lastStopUs = quickStopUs > lastStopUs ? quickStopUs : lastStopUs;
+                                                  }
+                                                  return true; },
+                                              1000000);
+            int32_t stoppedAt[RobotConstants::Robot::AXES_COUNT + 1] = {0};
+            for (uint8_t nodeId = 1; nodeId <= sim.driveCount(); ++nodeId)
+            {
+                stoppedAt[nodeId] = sim.drive(nodeId).positionActual();
+            }
+            sim.runFor(ABORT_STANDSTILL_US);
+            bool moved = false;
+            for (uint8_t nodeId = 1; nodeId <= sim.driveCount(); ++nodeId)
+            {
+                const SimDrive &drive = sim.drive(nodeId);
+                moved = moved || drive.isMoving() || drive.positionActual() != stoppedAt[nodeId] || drive.stats().lastMotionStartUs > lastStopUs;
+            }
+            if (stopped)
+            {
+                abortToStop.add(static_cast<double>(lastStopUs - requestUs));
+            }
+            const size_t latencyAt = abortReply.find("latency=");
+            if (acknowledged && latencyAt != std::string::npos)
+            {
+                abortLatency.add(atof(abortReply.c_str() + latencyAt + strlen("latency=")));
+            }
+            printf("abort: move %u by %s, reply \"%s\", %s, %s\n", moveIndex, byPin ? "pin" : "ABT",
+                   acknowledged ? abortReply.c_str() : "none", reported ? "MDN FF" : "no MDN FF",
+                   !stopped ? "not every drive stopped" : (moved ? "a drive moved after the stop" : "all drives standing"));
+
+            const uint64_t resetUs = HostClock::nowUs();
+            const bool resumed = sim.command("EMCR", "EMC OK", ZEI_TIMEOUT_US, elapsedUs) && sim.lastReply().find("paused=0") != std::string::npos;
+            uint64_t lastEnabledUs = resetUs;
+            const bool enabled = waitEnabled(sim, resetUs, lastEnabledUs);
+            sim.runFor(100000);
+            if (!acknowledged || !reported || !stopped || moved || !resumed || !enabled)
+            {
+                failedAborts++;
+            }
+            continue;
+        }
+        sim.feed(moveCommand(moveIndex).c_str());
+
+        bool started = sim.runUntil([&]()
+                                    {
+                                        for (uint8_t nodeId = 1; nodeId <= sim.driveCount(); ++nodeId)
+                                        {
+                                            if (sim.drive(nodeId).stats().lastMotionStartUs >= startUs && sim.drive(nodeId).stats().lastMotionStartUs > 0)
+                                            {
+                                                return true;
+                                            }
+                                        }
+                                        return false; },
+                                    MOVE_TIMEOUT_US);
+        if (!started)
+        {
+            failedMoves++;
+            continue;
+        }
+        startLatency.add(static_cast<double>(HostClock::nowUs() - startUs));
+
+        const bool overridden = feedRate >= 0 && cspPeriodUs == 0 && static_cast<int64_t>(moveIndex) != faultMove;
+        if (overridden)
+        {
+            sim.runFor(FEED_RATE_DELAY_US);
+            bool moving[RobotConstants::Robot::AXES_COUNT + 1] = {false};
+            for (uint8_t nodeId = 1; nodeId <= sim.driveCount(); ++nodeId)
+            {
+                moving[nodeId] = sim.drive(nodeId).isMoving();
+            }
+            char line[16];
+            snprintf(line, sizeof(line), "OVR%d", static_cast<int>(feedRate));
+            const uint64_t overrideUs = HostClock::nowUs();
+            uint64_t lastUs = overrideUs;
+            const bool taken = sim.command(line, "OVR ", 1000000, elapsedUs) && sim.lastReply() == "OVR OK" &&
+                               sim.runUntil([&]()
+                                            {
+                                                for (uint8_t nodeId = 1; nodeId <= sim.driveCount(); ++nodeId)
+                                                {
+                                                    const SimDrive::Stats &stats = sim.drive(nodeId).stats();
+                                                    const uint64_t takenUs = feedRate == 0 ? stats.lastHaltedUs : stats.lastProfileWriteUs;
+                                                    if (moving[nodeId] && takenUs < overrideUs)
+                                                    {
+                                                        return false;
+                                                    }
+                                                    lastUs = (moving[nodeId] && takenUs > lastUs) ? takenUs : lastUs;
+                                                }
+                                                return true; },
+                                            1000000);
+            if (taken)
+            {
+                (feedRate == 0 ? feedHold : feedRateChange).add(static_cast<double>(lastUs - overrideUs));
+            }
+            if (feedRate == 0)
+            {
+                int32_t heldAt[RobotConstants::Robot::AXES_COUNT + 1] = {0};
+                for (uint8_t nodeId = 1; nodeId <= sim.driveCount(); ++nodeId)
+                {
+                    heldAt[nodeId] = sim.drive(nodeId).positionActual();
+                }
+                sim.runFor(FEED_HOLD_US);
+                bool crept = false;
+                for (uint8_t nodeId = 1; nodeId <= sim.driveCount(); ++nodeId)
+                {
+                    crept = crept || sim.drive(nodeId).positionActual() != heldAt[nodeId];
+                }
+                if (!taken || crept)
+                {
+                    printf("move %u: feed hold %s\n", moveIndex, taken ? "did not hold every drive" : "not taken");
+                    failedMoves++;
+                }
+                sim.command("OVR100", "OVR ", 1000000, elapsedUs);
+            }
+        }
+
+        if (static_cast<int64_t>(moveIndex) == faultMove)
+        {
+            // Fault in mid-move: every other drive has to get the quick stop (the model halts on it)
+            sim.runFor(static_cast<uint64_t>(faultDelayMs) * 1000u);
+            SimDrive &faulty = sim.drive(faultNode);
+            faulty.injectFault(FAULT_ERROR_CODE, FAULT_ERROR_REGISTER);
+            const uint64_t faultUs = faulty.stats().lastFaultUs;
+            uint8_t stopped = 0;
+            uint64_t lastStopUs = faultUs;
+            const bool halted = sim.runUntil([&]()
+                                             {
+                                                 stopped = 0;
+                                                 for (uint8_t nodeId = 1; nodeId <= sim.driveCount(); ++nodeId)
+                                                 {
+                                                     const uint64_t quickStopUs = sim.drive(nodeId).stats().lastQuickStopUs;
+                                                     if (nodeId != faultNode && quickStopUs >= faultUs)
+                                                     {
+                                                         stopped++;
+                                                         lastStopUs = quickStopUs > lastStopUs ? quickStopUs : lastStopUs;
+                                                     }
+                                                 }
+                                                 return stopped == sim.driveCount() - 1; },
+                                             1000000);
+            if (halted)
+            {
+                faultToStop.add(static_cast<double>(lastStopUs - faultUs));
+            }
+            printf("fault: node %u error %04X during move %u, %u/%u other drives quick-stopped\n",
+                   faultNode, FAULT_ERROR_CODE, moveIndex, stopped, sim.driveCount() - 1);
+            sim.runFor(10000);
+            if (sim.command("EMC", "EMC OK", 1000000, elapsedUs))
+            {
+                printf("EMC reply: %s\n", sim.lastReply().c_str());
+            }
+            const uint64_t resetUs = HostClock::nowUs();
+            faultHandled = sim.command("EMCR", "EMC OK", ZEI_TIMEOUT_US, elapsedUs) && sim.lastReply().find("paused=0") != std::string::npos;
+            uint64_t lastEnabledUs = resetUs;
+            const bool enabled = waitEnabled(sim, resetUs, lastEnabledUs);
+            if (enabled)
+            {
+                faultReset.add(static_cast<double>(lastEnabledUs - resetUs));
+            }
+            faultHandled = faultHandled && enabled;
+            sim.runFor(100000);
+            if (sim.command("DRV", "DRV OK", 1000000, elapsedUs))
+            {
+                printf("DRV reply: %s\n", sim.lastReply().c_str());
+            }
+            continue;
+        }
+
+        uint64_t nextSampleUs = HostClock::nowUs();
+        bool completed = sim.runUntil([&]()
+                                      {
+                                          const uint64_t nowUs = HostClock::nowUs();
+                                          bool allReached = true;
+                                          for (uint8_t nodeId = 1; nodeId <= sim.driveCount(); ++nodeId)
+                                          {
+                                              const SimDrive &drive = sim.drive(nodeId);
+                                              if (drive.isMoving() || drive.positionActual() != moveController.getAxis(nodeId).getTargetPositionAbsolute())
+                                              {
+                                                  allReached = false;
+                                              }
+                                              if (nowUs >= nextSampleUs && drive.isMoving())
+                                              {
+                                                  const uint64_t lastReadUs = drive.stats().lastPositionReadUs;
+                                                  feedbackAge.add(static_cast<double>(nowUs - lastReadUs));
+                                                  feedbackError.add(std::fabs(static_cast<double>(moveController.axisPosition(nodeId)) - drive.positionActual()));
+                                              }
+                                          }
+                                          if (nowUs >= nextSampleUs)
+                                          {
+                                              nextSampleUs = nowUs + FEEDBACK_SAMPLE_US;
+                                          }
+                                          return allReached; },
+                                      MOVE_TIMEOUT_US);
+        if (!completed)
+        {
+            failedMoves++;
+            continue;
+        }
+        completeTime.add(static_cast<double>(HostClock::nowUs() - startUs));
+
+        uint64_t reachedUs = 0;
+        for (uint8_t nodeId = 1; nodeId <= sim.driveCount(); ++nodeId)
+        {
+            const uint64_t targetReachedUs = sim.drive(nodeId).stats().lastTargetReachedUs;
+            reachedUs = targetReachedUs > reachedUs ? targetReachedUs : reachedUs;
+        }
+        unsigned moveDoneUs = 0;
+        if (cspPeriodUs == 0)
+        {
+            if (sim.waitForLine("MDN ", 1000000, elapsedUs) && sim.lastReply().compare(0, 6, "MDN OK") == 0 &&
+                sscanf(sim.lastReply().c_str(), "MDN OK time=%uus", &moveDoneUs) == 1)
+            {
+                moveDoneDelay.add(static_cast<double>(HostClock::nowUs() - reachedUs));
+                moveDoneTime.add(moveDoneUs);
+            }
+            else
+            {
+                printf("move %u: no MDN OK (%s)\n", moveIndex, sim.lastReply().c_str());
+                failedMoves++;
+            }
+        }
+
+        uint64_t firstStartUs = 0;
+        uint64_t lastStartUs = 0;
+        for (uint8_t nodeId = 1; nodeId <= sim.driveCount(); ++nodeId)
+        {
+            const uint64_t motionStartUs = sim.drive(nodeId).stats().lastMotionStartUs;
+            firstStartUs = (nodeId == 1 || motionStartUs < firstStartUs) ? motionStartUs : firstStartUs;
+            lastStartUs = motionStartUs > lastStartUs ? motionStartUs : lastStartUs;
+        }
+        startSkew.add(static_cast<double>(lastStartUs - firstStartUs));
+
+        if (overridden)
+        {
+            uint64_t firstReachedUs = 0;
+            uint64_t lastReachedUs = 0;
+            bool first = true;
+            for (uint8_t nodeId = 1; nodeId <= sim.driveCount(); ++nodeId)
+            {
+                const SimDrive::Stats &stats = sim.drive(nodeId).stats();
+                if (stats.lastMotionStartUs < startUs)
+                {
+                    continue; // Did not move
+                }
+                firstReachedUs = (first || stats.lastTargetReachedUs < firstReachedUs) ? stats.lastTargetReachedUs : firstReachedUs;
+                lastReachedUs = stats.lastTargetReachedUs > lastReachedUs ? stats.lastTargetReachedUs : lastReachedUs;
+                first = false;
+            }
+            finishSkew.add(static_cast<double>(lastReachedUs - firstReachedUs));
+            sim.command("OVR100", "OVR ", 1000000, elapsedUs); // The next move starts at full speed
+        }
+
+        sim.runFor(100000); // Settle between moves
+        unsigned skewUs = 0;
+        unsigned resolutionUs = 0;
+        if (cspPeriodUs == 0 && sim.command("SYN", "SYN ", 1000000, elapsedUs) &&
+            sscanf(sim.lastReply().c_str(), "SYN OK mode=%*u skew=%u res=%u", &skewUs, &resolutionUs) == 2)
+        {
+            measuredSkew.add(skewUs);
+            measuredResolution.add(resolutionUs);
+        }
+    }
+
+    for (uint32_t jogIndex = 0; jogIndex < jogs && cspPeriodUs == 0; ++jogIndex)
+    {
+        const uint8_t nodeId = static_cast<uint8_t>(jogIndex % sim.driveCount() + 1);
+        SimDrive &drive = sim.drive(nodeId);
+        const bool byDeadman = jogIndex % 2 == 1;
+        char line[32];
+        snprintf(line, sizeof(line), "JOGJ%c%d", 'A' + nodeId - 1, (jogIndex % 4 < 2) ? 20 : -20);
+
+        // The first line switches the mode, the keep-alives are one RPDO3 each
+        bool ok = true;
+        uint64_t lastUpdateUs = 0;
+        for (uint32_t update = 0; update <= JOG_KEEP_ALIVES && ok; ++update)
+        {
+            const uint32_t updatesBefore = drive.stats().velocityUpdates;
+            lastUpdateUs = HostClock::nowUs();
+            ok = sim.command(line, "JOG ", 1000000, elapsedUs) && sim.lastReply() == "JOG OK";
+            // A lost RPDO3 is not repeated: the next keep-alive makes up for it
+            if (ok && sim.runUntil([&]()
+                                   { return drive.stats().velocityUpdates != updatesBefore; },
+                                   JOG_KEEP_ALIVE_US))
+            {
+                jogResponse.add(static_cast<double>(drive.stats().lastVelocityUpdateUs - lastUpdateUs));
+            }
+            const uint64_t sinceUpdateUs = HostClock::nowUs() - lastUpdateUs;
+            sim.runFor(sinceUpdateUs < JOG_KEEP_ALIVE_US ? JOG_KEEP_ALIVE_US - sinceUpdateUs : 0);
+        }
+        ok = ok && drive.modeOfOperation() == RobotConstants::Control::DEFAULT_MODE_VELOCITY && drive.isMoving();
+
+        if (ok && !byDeadman)
+        {
+            snprintf(line, sizeof(line), "JOGJ%c0", 'A' + nodeId - 1);
+            lastUpdateUs = HostClock::nowUs();
+            ok = sim.command(line, "JOG ", 1000000, elapsedUs) && sim.lastReply() == "JOG OK";
+        }
+        ok = ok && sim.runUntil([&]()
+                                { return drive.targetVelocity() == 0; },
+                                1000000);
+        const uint64_t zeroUs = drive.stats().lastVelocityUpdateUs;
+        if (ok && byDeadman)
+        {
+            jogDeadman.add(static_cast<double>(zeroUs - lastUpdateUs));
+        }
+        ok = ok && sim.runUntil([&]()
+                                { return drive.modeOfOperation() == RobotConstants::Control::DEFAULT_MODE_POSITION; },
+                                static_cast<uint64_t>(RobotConstants::Jog::STOP_TIMEOUT_MS) * 2000u);
+        if (ok)
+        {
+            jogStop.add(static_cast<double>(HostClock::nowUs() - zeroUs));
+        }
+        sim.runFor(100000);
+        if (!ok || drive.isMoving() || moveController.axisPosition(nodeId) != drive.positionActual())
+        {
+            printf("jog %u (axis %u): failed, firmware position %d, drive %d\n", jogIndex, nodeId,
+                   static_cast<int>(moveController.axisPosition(nodeId)), static_cast<int>(drive.positionActual()));
+            failedJogs++;
+        }
+    }
+
+    // Waypoint paths in CSP: every cycle queues all its MAJ lines at once, stopping at every waypoint
+    // (PTH0) and then blended (PTH1)
+    std::string pathReplies[2];
+    for (uint8_t blend = 0; blend < 2 && paths > 0 && cspPeriodUs > 0; ++blend)
+    {
+        sim.command(blend == 1 ? "PTH1" : "PTH0", "PTH ", 1000000, elapsedUs);
+        sim.command("PTHR", "PTH ", 1000000, elapsedUs);
+        sim.feed(pathCommand(0).c_str()); // From pose 0
+        sim.runUntil([&]()
+                     {
+                         for (uint8_t nodeId = 1; nodeId <= sim.driveCount(); ++nodeId)
+                         {
+                             if (sim.drive(nodeId).positionActual() != moveController.getAxis(nodeId).unitsToSteps(PATH[0][nodeId - 1]))
+                             {
+                                 return false;
+                             }
+                         }
+                         return true; },
+                     MOVE_TIMEOUT_US);
+        sim.runFor(100000);
+        sim.command("PTHR", "PTH ", 1000000, elapsedUs);
+
+        for (uint32_t pathIndex = 0; pathIndex < paths; ++pathIndex)
+        {
+            const bool forward = pathIndex % 2 == 0;
+            const uint8_t last = forward ? PATH_POSES - 1 : 0;
+            for (uint8_t step = 1; step < PATH_POSES; ++step)
+            {
+                sim.feed(pathCommand(forward ? step : PATH_POSES - 1 - step).c_str());
+            }
+
+            // Closest pass by every waypoint (largest axis distance) and the peak acceleration of any axis
+            double deviation[PATH_POSES];
+            for (uint8_t pose = 0; pose < PATH_POSES; ++pose)
+            {
+                deviation[pose] = 1e9;
+            }
+            double samples[3][RobotConstants::Robot::AXES_COUNT + 1] = {{0}};
+            uint32_t sampleCount = 0;
+            double peakAcceleration = 0;
+            uint64_t nextSampleUs = HostClock::nowUs();
+            const uint64_t startUs = HostClock::nowUs();
+            uint32_t lostBefore = 0;
+            for (uint8_t nodeId = 1; nodeId <= sim.driveCount(); ++nodeId)
+            {
+                lostBefore += sim.drive(nodeId).stats().framesLost;
+            }
+            const bool completed = sim.runUntil([&]()
+                                                {
+                                                    const uint64_t nowUs = HostClock::nowUs();
+                                                    bool reached = true;
+                                                    for (uint8_t pose = 0; pose < PATH_POSES; ++pose)
+                                                    {
+                                                        double distance = 0;
+                                                        for (uint8_t nodeId = 1; nodeId <= sim.driveCount(); ++nodeId)
+                                                        {
+                                                            const Axis &axis = moveController.getAxis(nodeId);
+                                                            const double d = std::fabs(axis.stepsToUnits(sim.drive(nodeId).positionActual() - axis.unitsToSteps(PATH[pose][nodeId - 1])));
+                                                            distance = d > distance ? d : distance;
+                                                        }
+                                                        deviation[pose] = distance < deviation[pose] ? distance : deviation[pose];
+                                                        reached = reached && (pose != last || distance == 0);
+                                                    }
+                                                    if (nowUs >= nextSampleUs)
+                                                    {
+                                                        for (uint8_t nodeId = 1; nodeId <= sim.driveCount(); ++nodeId)
+                                                        {
+                                                            samples[0][nodeId] = samples[1][nodeId];
+                                                            samples[1][nodeId] = samples[2][nodeId];
+                                                            samples[2][nodeId] = moveController.getAxis(nodeId).stepsToUnits(sim.drive(nodeId).positionActual());
+                                                            const double dt = PATH_SAMPLE_US / 1e6;
+                                                            const double acceleration = std::fabs(samples[2][nodeId] - 2 * samples[1][nodeId] + samples[0][nodeId]) / (dt * dt);
+                                                            peakAcceleration = (sampleCount >= 2 && acceleration > peakAcceleration) ? acceleration : peakAcceleration;
+                                                        }
+                                                        sampleCount++;
+                                                        nextSampleUs += PATH_SAMPLE_US;
+                                                    }
+                                                    return reached && cspStreamer.queuedWaypoints() == 0 && !cspStreamer.isMoving(); },
+                                                MOVE_TIMEOUT_US);
+            const uint64_t cycleUs = HostClock::nowUs() - startUs;
+            double worstDeviation = 0;
+            for (uint8_t pose = 1; pose + 1 < PATH_POSES; ++pose)
+            {
+                worstDeviation = deviation[pose] > worstDeviation ? deviation[pose] : worstDeviation;
+            }
+            // A lost setpoint RPDO holds the drive for a cycle: the step it makes up is no planning error
+            uint32_t lost = 0;
+            for (uint8_t nodeId = 1; nodeId <= sim.driveCount(); ++nodeId)
+            {
+                lost += sim.drive(nodeId).stats().framesLost;
+            }
+            const bool clean = lost == lostBefore;
+            if (!completed || (clean && peakAcceleration > PATH_ACCELERATION_UNITS + PATH_ACCELERATION_MARGIN))
+            {
+                printf("path %u (%s): %s, peak acceleration %.1f units/s2\n", pathIndex, blend == 1 ? "blended" : "stop-and-go",
+                       completed ? "over the acceleration limit" : "end pose not reached", peakAcceleration);
+                failedPaths++;
+            }
+            if (completed)
+            {
+                (blend == 1 ? pathBlendTime : pathStopTime).add(static_cast<double>(cycleUs));
+                (blend == 1 ? pathBlendDeviation : pathStopDeviation).add(worstDeviation);
+                if (clean)
+                {
+                    (blend == 1 ? pathBlendAcceleration : pathStopAcceleration).add(peakAcceleration);
+                }
+            }
+            sim.runFor(100000); // Place
+        }
+        // The planner's own view, every cycle before rounding: the sampled positions above cannot
+        // resolve single cycles, and blending has to have happened at all
+        const bool replied = sim.command("PTH", "PTH ", 1000000, elapsedUs);
+        pathReplies[blend] = replied ? sim.lastReply() : std::string();
+        const double blended = pathField(pathReplies[blend], "blended=");
+        const double plannedAcceleration = pathField(pathReplies[blend], "acc=");
+        if (plannedAcceleration < 0 || plannedAcceleration > PATH_ACCELERATION_UNITS * PATH_PLANNED_TOLERANCE || (blend == 1 && blended <= 0))
+        {
+            printf("paths (%s): %.0f junctions blended, planned peak acceleration %.2f units/s2 (limit %.0f)\n", blend == 1 ? "blended" : "stop-and-go",
+                   blended, plannedAcceleration, PATH_ACCELERATION_UNITS);
+            failedPaths++;
+        }
+    }
+
+    // Two junctions over an axis' own limit, fed one after the other from the end of the path.
+    // Stopped: A leads the first segment at half the acceleration and turns back a little while B
+    // leads the second one; overlapped, A would accelerate by 25 + 5 units/s2, over the 25 of both
+    // segments A moves in, and no gentler ramp takes that back. Softened: B leads the first segment,
+    // A (at 25) turns back and leads the second; at the full ramp A would need 25 + 50, at half of it 50
+    if (paths > 0 && cspPeriodUs > 0)
+    {
+        struct Junction
+        {
+            const char *name;
+            double poses[2][RobotConstants::Robot::MAX_AXES_COUNT];
+            double accelerationUnits[2];
+            bool blends;
+        };
+        const Junction junctions[2] = {
+            {"stopped", {{10, 0, 0, 0, 0, 0}, {8, 20, 0, 0, 0, 0}}, {PATH_ACCELERATION_UNITS / 2, PATH_ACCELERATION_UNITS}, false},
+            {"softened", {{18, 40, 0, 0, 0, 0}, {-2, 40, 10, 0, 0, 0}}, {PATH_ACCELERATION_UNITS, PATH_ACCELERATION_UNITS}, true},
+        };
+        auto atPose = [&](const double *units)
+        {
+            for (uint8_t nodeId = 1; nodeId <= sim.driveCount(); ++nodeId)
+            {
+                if (sim.drive(nodeId).positionActual() != moveController.getAxis(nodeId).unitsToSteps(units[nodeId - 1]))
+                {
+                    return false;
+                }
+            }
+            return cspStreamer.queuedWaypoints() == 0 && !cspStreamer.isMoving();
+        };
+        sim.command("PTH1", "PTH ", 1000000, elapsedUs);
+        sim.feed(pathCommand(0).c_str());
+        sim.runUntil([&]()
+                     { return atPose(PATH[0]); },
+                     MOVE_TIMEOUT_US);
+        sim.runFor(100000);
+        for (const Junction &junction : junctions)
+        {
+            sim.command("PTHR", "PTH ", 1000000, elapsedUs);
+            sim.feed(pathCommand(junction.poses[0], junction.accelerationUnits[0]).c_str());
+            sim.feed(pathCommand(junction.poses[1], junction.accelerationUnits[1]).c_str());
+            const bool completed = sim.runUntil([&]()
+                                                { return atPose(junction.poses[1]); },
+                                                MOVE_TIMEOUT_US);
+            const bool replied = completed && sim.command("PTH", "PTH ", 1000000, elapsedUs);
+            const std::string reply = replied ? sim.lastReply() : std::string();
+            const double plannedAcceleration = pathField(reply, "acc=");
+            const bool blended = pathField(reply, "blended=") == 1 && pathField(reply, "stopped=") == 0;
+            const bool stopped = pathField(reply, "stopped=") == 1 && pathField(reply, "blended=") == 0;
+            printf("path junction over an axis' own limit (%s): %s, planned peak acceleration %.2f units/s2\n", junction.name,
+                   blended ? "blended" : (stopped ? "stopped" : "no reply"), plannedAcceleration);
+            if (!(junction.blends ? blended : stopped) || plannedAcceleration < 0 || plannedAcceleration > PATH_ACCELERATION_UNITS * PATH_PLANNED_TOLERANCE)
+            {
+                failedPaths++;
+            }
+        }
+    }
+
+    printf("drives=%u moves=%u failed=%u latency=%uus jitter=%uus loss=%u/1000 start=%s\n",
+           sim.driveCount(), moves, failedMoves, driveConfig.responseLatencyUs, driveConfig.responseJitterUs, driveConfig.frameLossPerMille,
+           syncStart ? "sync" : "immediate");
+    zeiTime.print();
+    startLatency.print();
+    completeTime.print();
+    moveDoneDelay.print();
+    moveDoneTime.print();
+    startSkew.print();
+    measuredSkew.print();
+    measuredResolution.print();
+    feedbackAge.print();
+    feedbackError.print();
+    if (faultMove >= 0)
+    {
+        faultToStop.print();
+        faultReset.print();
+    }
+    if (feedRate >= 0)
+    {
+        feedRateChange.print();
+        feedHold.print();
+        finishSkew.print();
+    }
+    if (aborts > 0)
+    {
+        printf("aborts=%u failed=%u\n", aborts < moves ? aborts : moves, failedAborts);
+        abortToStop.print();
+        abortLatency.print();
+    }
+    if (paths > 0)
+    {
+        printf("paths=%u x2 waypoints=%u failed=%u cycle gain=%.1f%%\n", paths, PATH_POSES - 2, failedPaths,
+               pathStopTime.count > 0 && pathBlendTime.count > 0 ? 100.0 * (1.0 - (pathBlendTime.total / pathBlendTime.count) / (pathStopTime.total / pathStopTime.count)) : 0.0);
+        pathStopTime.print();
+        pathBlendTime.print();
+        pathStopDeviation.print();
+        pathBlendDeviation.print();
+        pathStopAcceleration.print();
+        pathBlendAcceleration.print();
+    }
+    if (jogs > 0)
+    {
+        printf("jogs=%u failed=%u\n", jogs, failedJogs);
+        jogResponse.print();
+        jogDeadman.print();
+        jogStop.print();
+    }
+
+    for (uint8_t nodeId = 1; nodeId <= sim.driveCount(); ++nodeId)
+    {
+        const SimDrive::Stats &stats = sim.drive(nodeId).stats();
+        printf("drive %u: rx=%u tx=%u lost=%u aborts=%u position reads=%u\n",
+               nodeId, stats.framesReceived, stats.framesSent, stats.framesLost, stats.sdoAborts, stats.positionReads);
+    }
+    printBusBudget(sim.driveCount(), planAxes, planPollHz);
+    printTxClasses();
+    if (foreignHz > 0)
+    {
+        HostClock::removeEventSource(&foreign);
+        HostCanBus::instance().detach(&foreign);
+    }
+    printRxFiltering(rxAcceptedBefore, rxFilteredBefore, foreignHz > 0 ? foreign.framesSent() : 0);
+    sim.runFor(2 * RobotConstants::Feedback::RATE_WINDOW_MS * 1000ull); // Idle: the rates decay to the keep-alive
+    if (sim.command("FBK", "FBK ", 1000000, elapsedUs))
+    {
+        printf("feedback: %s\n", sim.lastReply().c_str());
+    }
+    if (sim.command("PLN", "PLN ", 1000000, elapsedUs))
+    {
+        printf("plans: %s\n", sim.lastReply().c_str());
+    }
+    if (feedRate >= 0 && sim.command("OVR", "OVR ", 1000000, elapsedUs))
+    {
+        printf("feed rate: %s\n", sim.lastReply().c_str());
+    }
+    if (jogs > 0 && sim.command("JOG", "JOG ", 1000000, elapsedUs))
+    {
+        printf("jog: %s\n", sim.lastReply().c_str());
+    }
+    if (cspPeriodUs > 0 && sim.command("CSP", "CSP ", 1000000, elapsedUs))
+    {
+        printf("csp: %s\n", sim.lastReply().c_str());
+    }
+    if (aborts > 0 && sim.command("ABTS", "ABT ", 1000000, elapsedUs))
+    {
+        printf("abort: %s\n", sim.lastReply().c_str());
+    }
+    for (uint8_t blend = 0; blend < 2; ++blend)
+    {
+        if (!pathReplies[blend].empty())
+        {
+            printf("path: %s\n", pathReplies[blend].c_str());
+        }
+    }
+    HostClock::removeEventSource(&abortPin);
+    printf("virtual time %.3f s, serial lines %u\n", HostClock::nowUs() / 1e6, sim.linesSeen());
+    return failedMoves == 0 && failedJogs == 0 && failedAborts == 0 && failedPaths == 0 && faultHandled && STM32_CAN::txReorderedAllInstances() == 0 ? 0 : 1;
+}
@@ -0,0 +1,343 @@
+// Time-warp soak run of the whole firmware loop against simulated drives.
+//
+//   timewarp_sim [--hours H] [--seed N] [--loss-permille N] [--echo]
+//
+// The virtual clock jumps from event to event (SimHarness time warp), so hours of operation
+// take a fraction of a second of wall time. Scenarios, in order:
+//   heartbeat   take one drive off the bus; the firmware must report the timeout and, after the
+//               drive is back, the restore (detection latency in virtual time). Silencing only the
+//               heartbeat is not enough: answered 0x6064 polls also count as a sign of life.
+//   power-blip  power-cycle one drive, then reset all of them with NMTR: the drives come back
+//               pre-operational at their defaults, and the firmware has to configure and start
+//               them (boot-up to operational in virtual time) before a move reaches them
+//   pick-place  MAJ between a pick and a place pose for H hours: the next move goes out as soon as
+//               the firmware reports the last one done (MDN), which has to find every drive standing
+//               at its target; each move is followed by an RPP query
+//   steady      after a warm-up, the move/feedback loop must not touch the heap: no heap operation
+//               from the first drive moving to the last one at its target, nor while idle after MDN
+//               (HeapStats::NoAllocGuard); command parsing and replies are outside the guards
+//   queued      MRJ sent while a MAJ is under way: planned from the MAJ target, sent only after its
+//               MDN OK (no drive starts again before it), and done with a second MDN OK there
+// Exits with 1 if any check failed, so it can run on every change.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include "Arduino.h"
+#include "CanOpenController.h"
+#include "HeapStats.h"
+#include "SimHarness.h"
+
+extern MoveController moveController;
+
+namespace
+{
+    constexpr uint64_t US_PER_HOUR = 3600ull * 1000000ull;
+    constexpr uint64_t MOVE_TIMEOUT_US = 30000000;
+    constexpr uint64_t REPLY_TIMEOUT_US = 2000000;
+    constexpr uint64_t DWELL_US = 300000; // Gripper time at each pose
+    constexpr uint8_t SILENT_NODE = 3;
+    constexpr uint8_t BLIP_NODE = 2;
+    constexpr uint64_t BLIP_OFF_US = 50000;
+    constexpr uint64_t RECOVERY_TIMEOUT_US = 5000000;
+    constexpr uint32_t STEADY_WARM_UP_MOVES = 2;
+    constexpr uint32_t STEADY_MOVES = 20;
+    constexpr uint64_t STEADY_REPLY_US = 20000;
+
+    uint32_t failures = 0;
+
+    void check(bool ok, const char *what)
+    {
+        if (!ok)
+        {
+            failures++;
+            printf("FAIL: %s (t=%.3f s)\n", what, HostClock::nowUs() / 1e6);
+        }
+    }
+
+    bool allAtTarget(SimHarness &sim)
+    {
+        for (uint8_t nodeId = 1; nodeId <= sim.driveCount(); ++nodeId)
+        {
+            if (sim.drive(nodeId).isMoving() ||
+                sim.drive(nodeId).positionActual() != moveController.getAxis(nodeId).getTargetPositionAbsolute())
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void heartbeatScenario(SimHarness &sim)
+    {
+        char text[64];
+        uint64_t elapsedUs = 0;
+
+        sim.drive(SILENT_NODE).setOnline(false);
+        snprintf(text, sizeof(text), "Heartbeat timeout for Axis %u", SILENT_NODE);
+        bool detected = sim.waitForLine(text, 10000000, elapsedUs);
+        check(detected, "heartbeat timeout not reported");
+        printf("heartbeat   timeout reported after %.1f ms (limit %u ms)\n", elapsedUs / 1000.0, RobotConstants::Robot::HEARTBEAT_TIMEOUT_MS);
+
+        sim.drive(SILENT_NODE).setOnline(true);
+        snprintf(text, sizeof(text), "Heartbeat restored for Axis %u", SILENT_NODE);
+        bool restored = sim.waitForLine(text, 10000000, elapsedUs);
+        check(restored, "heartbeat restore not reported");
+        printf("heartbeat   restore reported after %.1f ms\n", elapsedUs / 1000.0);
+    }
+
+    bool allOperational(SimHarness &sim)
+    {
+        for (uint8_t nodeId = 1; nodeId <= sim.driveCount(); ++nodeId)
+        {
+            if (sim.drive(nodeId).nmtState() != RobotConstants::CANOpen::NMT_STATE_OPERATIONAL)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Done when the firmware reports it (MDN), and by then every drive has to stand at its target
+    bool moveAndCheck(SimHarness &sim, const char *line, uint64_t &elapsedUs)
+    {
+        return sim.command(line, "MDN ", MOVE_TIMEOUT_US, elapsedUs) && sim.lastReply().compare(0, 6, "MDN OK") == 0 && allAtTarget(sim);
+    }
+
+    void powerBlipScenario(SimHarness &sim)
+    {
+        SimDrive &drive = sim.drive(BLIP_NODE);
+        drive.detach();
+        sim.runFor(BLIP_OFF_US);
+        drive.attach();
+        const uint64_t bootUs = drive.stats().lastBootUpUs;
+        bool started = sim.runUntil([&]()
+                                    { return drive.nmtState() == RobotConstants::CANOpen::NMT_STATE_OPERATIONAL; },
+                                    RECOVERY_TIMEOUT_US);
+        check(started, "power-cycled drive not started again");
+        printf("power-blip  drive %u operational %.1f ms after its boot-up\n", BLIP_NODE, (drive.stats().lastOperationalUs - bootUs) / 1000.0);
+        uint64_t elapsedUs = 0;
+        check(moveAndCheck(sim, "MAJJA5JB5JC5JD5JE5SP80AC60", elapsedUs), "move after the power cycle did not reach the target");
+
+        const uint64_t resetUs = HostClock::nowUs();
+        bool replied = sim.command("NMTR", "NMT ", REPLY_TIMEOUT_US, elapsedUs);
+        check(replied && sim.lastReply().compare(0, 6, "NMT OK") == 0, "NMTR failed");
+        started = sim.runUntil([&]()
+                               { return HostClock::nowUs() > resetUs && allOperational(sim); },
+                               RECOVERY_TIMEOUT_US);
+        check(started, "drives not started again after NMT reset");
+        uint64_t lastUs = 0;
+        for (uint8_t nodeId = 1; nodeId <= sim.driveCount(); ++nodeId)
+        {
+            const SimDrive::Stats &stats = sim.drive(nodeId).stats();
+            lastUs = stats.lastOperationalUs > lastUs ? stats.lastOperationalUs : lastUs;
+        }
+        sim.runFor(RobotConstants::Robot::HEARTBEAT_INTERVAL_MS * 1000ull); // States are taken from the heartbeats
+        replied = sim.command("NMT", "NMT ", REPLY_TIMEOUT_US, elapsedUs);
+        printf("power-blip  NMTR: all %u drives operational %.1f ms after the reset; %s\n", sim.driveCount(),
+               (lastUs - resetUs) / 1000.0, replied ? sim.lastReply().c_str() : "no NMT reply");
+        check(moveAndCheck(sim, "MAJJA-5JB-5JC-5JD-5JE-5SP80AC60", elapsedUs), "move after the NMT reset did not reach the target");
+    }
+
+    // The move/feedback loop must not touch the heap once it runs: guarded from the first drive
+    // moving to the last one at its target (CAN traffic, move tracking, position polls), and over
+    // the dwell after MDN (idle polls, heartbeats). Command parsing and the replies are String
+    // based and stay outside the guards.
+    void steadyStateScenario(SimHarness &sim)
+    {
+        const char *poses[] = {
+            "MAJJA10JB-20JC15JD30JE-5SP80AC60",
+            "MAJJA-25JB10JC-5JD-40JE20SP80AC60",
+        };
+        uint32_t motionOps = 0;
+        uint32_t idleOps = 0;
+        uint64_t elapsedUs = 0;
+        check(moveAndCheck(sim, "MAJJA0JB0JC0JD0JE0SP80AC60", elapsedUs), "move to the steady-state start pose failed"); // Every pose below then moves
+        for (uint32_t move = 0; move < STEADY_WARM_UP_MOVES + STEADY_MOVES; ++move)
+        {
+            const bool guarded = move >= STEADY_WARM_UP_MOVES; // Warm-up: queues and Strings reach their capacity
+            const uint64_t startUs = HostClock::nowUs();
+            sim.feed(poses[move % 2]);
+            bool ok = sim.runUntil([&]()
+                                   {
+                                       for (uint8_t nodeId = 1; nodeId <= sim.driveCount(); ++nodeId)
+                                       {
+                                           if (sim.drive(nodeId).stats().lastMotionStartUs >= startUs)
+                                           {
+                                               return true;
+                                           }
+                                       }
+                                       return false; },
+                                   MOVE_TIMEOUT_US);
+            HeapStats::NoAllocGuard motion;
+            ok = ok && sim.runUntil([&]()
+                                    { return allAtTarget(sim); },
+                                    MOVE_TIMEOUT_US);
+            motionOps += guarded ? motion.operations() : 0;
+            ok = ok && sim.waitForLine("MDN OK", MOVE_TIMEOUT_US, elapsedUs);
+            check(ok, "steady-state move not done");
+            sim.runFor(STEADY_REPLY_US); // MDN goes out over the serial line
+
+            HeapStats::NoAllocGuard idle;
+            sim.runFor(DWELL_US);
+            idleOps += guarded ? idle.operations() : 0;
+        }
+        check(motionOps == 0, "heap used while moving (steady state)");
+        check(idleOps == 0, "heap used while idle (steady state)");
+        printf("steady      %u moves after %u warm-up: %u heap ops while moving, %u while idle\n",
+               STEADY_MOVES, STEADY_WARM_UP_MOVES, motionOps, idleOps);
+    }
+
+    bool motionStartedSince(SimHarness &sim, uint64_t sinceUs)
+    {
+        for (uint8_t nodeId = 1; nodeId <= sim.driveCount(); ++nodeId)
+        {
+            if (sim.drive(nodeId).stats().lastMotionStartUs >= sinceUs)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // A move commanded during another one waits for it: the drives finish the first target,
+    // MDN reports it, and only then does the second one go out, relative to where the first ended
+    void queuedMoveScenario(SimHarness &sim)
+    {
+        uint64_t elapsedUs = 0;
+        const uint32_t queuedBefore = moveController.getPlanStats().queued;
+        const uint64_t firstUs = HostClock::nowUs();
+        sim.feed("MAJJA20JB-10JC25JD-30JE10SP80AC60");
+        bool ok = sim.runUntil([&]()
+                               { return motionStartedSince(sim, firstUs); },
+                               MOVE_TIMEOUT_US);
+        check(ok, "first move of the queued pair did not start");
+        int32_t firstTargets[RobotConstants::Robot::AXES_COUNT + 1] = {};
+        for (uint8_t nodeId = 1; nodeId <= sim.driveCount(); ++nodeId)
+        {
+            firstTargets[nodeId] = moveController.getAxis(nodeId).getTargetPositionAbsolute();
+        }
+
+        sim.feed("MRJJA5JB5JC5JD5JE5SP80AC60");
+        const uint64_t secondUs = HostClock::nowUs();
+        uint64_t firstDoneUs = 0;
+        ok = sim.runUntil([&]()
+                          {
+                              bool atFirst = true;
+                              for (uint8_t nodeId = 1; nodeId <= sim.driveCount(); ++nodeId)
+                              {
+                                  atFirst = atFirst && !sim.drive(nodeId).isMoving() && sim.drive(nodeId).positionActual() == firstTargets[nodeId];
+                              }
+                              firstDoneUs = atFirst ? HostClock::nowUs() : 0;
+                              return atFirst || motionStartedSince(sim, secondUs); },
+                          MOVE_TIMEOUT_US);
+        check(ok && firstDoneUs != 0, "queued move went out before every drive reached the target under way");
+        ok = sim.waitForLine("MDN ", MOVE_TIMEOUT_US, elapsedUs) && sim.lastReply().compare(0, 6, "MDN OK") == 0;
+        check(ok, "move under way not done (MDN OK) after a second move was commanded");
+
+        ok = sim.waitForLine("MDN ", MOVE_TIMEOUT_US, elapsedUs) && sim.lastReply().compare(0, 6, "MDN OK") == 0 && allAtTarget(sim);
+        check(ok, "queued move not done (MDN OK) with every drive at its target");
+        bool relative = true;
+        for (uint8_t nodeId = 1; nodeId <= sim.driveCount(); ++nodeId)
+        {
+            const Axis &axis = moveController.getAxis(nodeId);
+            relative = relative && axis.getTargetPositionAbsolute() == firstTargets[nodeId] + axis.unitsToSteps(5.0);
+        }
+        check(relative, "queued MRJ not relative to the target of the move before it");
+        check(moveController.getPlanStats().queued == queuedBefore + 1, "queued move not counted (PLN queued=)");
+        printf("queued      second move started after the first one was done, at its relative target %.1f ms later\n",
+               (HostClock::nowUs() - firstDoneUs) / 1000.0);
+    }
+
+    void pickPlaceScenario(SimHarness &sim, double hours)
+    {
+        const char *poses[] = {
+            "MAJJA10JB-20JC15JD30JE-5SP80AC60",  // Pick
+            "MAJJA-25JB10JC-5JD-40JE20SP80AC60", // Place
+        };
+        const uint64_t endUs = HostClock::nowUs() + static_cast<uint64_t>(hours * US_PER_HOUR);
+        const uint32_t heapOpsBefore = HeapStats::snapshot().operations;
+
+        uint32_t moves = 0;
+        uint32_t positionReplies = 0;
+        uint64_t totalMoveUs = 0;
+        while (HostClock::nowUs() < endUs && failures == 0)
+        {
+            uint64_t elapsedUs = 0;
+            check(moveAndCheck(sim, poses[moves % 2], elapsedUs), "move not reported done (MDN OK) with every drive at its target");
+            totalMoveUs += elapsedUs;
+            moves++;
+
+            bool replied = sim.command("RPP", "RPP ", REPLY_TIMEOUT_US, elapsedUs);
+            check(replied && sim.lastReply().compare(0, 6, "RPP OK") == 0, "RPP failed");
+            positionReplies += replied ? 1 : 0;
+
+            sim.runFor(DWELL_US);
+        }
+
+        const uint32_t heapOps = HeapStats::snapshot().operations - heapOpsBefore;
+        printf("pick-place  %u moves in %.2f h, avg move %.1f ms, %u RPP replies, %.1f heap ops/move\n",
+               moves, hours, moves ? totalMoveUs / 1000.0 / moves : 0.0, positionReplies,
+               moves ? static_cast<double>(heapOps) / moves : 0.0);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    SimDrive::Config driveConfig;
+    double hours = 1.0;
+    bool echo = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--hours") == 0 && hasValue)
+        {
+            hours = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && hasValue)
+        {
+            driveConfig.seed = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        }
+        else if (strcmp(argv[i], "--loss-permille") == 0 && hasValue)
+        {
+            driveConfig.frameLossPerMille = static_cast<uint16_t>(strtoul(argv[++i], nullptr, 10));
+        }
+        else if (strcmp(argv[i], "--echo") == 0)
+        {
+            echo = true;
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--hours H] [--seed N] [--loss-permille N] [--echo]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    auto wallStart = std::chrono::steady_clock::now();
+
+    SimHarness sim(driveConfig, RobotConstants::Robot::AXES_COUNT);
+    sim.setTimeWarp(true);
+    sim.setEcho(echo);
+    sim.begin();
+    sim.runFor(2500000); // Heartbeats mark every axis alive
+
+    uint64_t elapsedUs = 0;
+    bool zeroed = sim.command("ZEI", "ZEI ", 5000000, elapsedUs);
+    check(zeroed && sim.lastReply().compare(0, 6, "ZEI OK") == 0, "ZEI failed");
+
+    heartbeatScenario(sim);
+    powerBlipScenario(sim);
+    pickPlaceScenario(sim, hours);
+    steadyStateScenario(sim);
+    queuedMoveScenario(sim);
+
+    const double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    const double virtualSeconds = HostClock::nowUs() / 1e6;
+    printf("virtual %.1f s in %.3f s wall (x%.0f), %llu loop passes, %u failures\n",
+           virtualSeconds, wallSeconds, virtualSeconds / wallSeconds,
+           static_cast<unsigned long long>(sim.loopPasses()), failures);
+    return failures == 0 ? 0 : 1;
+}
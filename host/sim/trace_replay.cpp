@@ -0,0 +1,297 @@
+// Replays a recorded CAN trace through the firmware's decode path.
+//
+//   trace_replay [--original-timing] [--repeat N] [--no-timeline] [--include-master] [trace]
+//
+// The trace is a CTR dump (serial capture, see CANCrusher.ino) or a candump log, read from the
+// file or stdin. Frames the master sent itself are skipped (CTR: TX flag; candump: NMT, SYNC,
+// RPDO and SDO request COB-IDs) unless --include-master is given.
+//
+//   default            frames go onto the host CAN bus back to back and CanOpen::read() decodes
+//                      each one right away; the clock jumps to the frame's timestamp, nothing else
+//                      runs. Throughput of the decode path, repeatable with --repeat N
+//   --original-timing  the whole sketch runs (loop(), 500 ms ticks, position polls, heartbeat
+//                      timeouts) in virtual time, and every frame arrives at its recorded offset
+//
+// Reports frames/s decoded, callback dispatch counts (CanOpen::DispatchStats) and the axis state
+// timeline: every change of an axis' position, liveness or ZEI status.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "Arduino.h"
+#include "CanOpenController.h"
+#include "SimHarness.h"
+#include "../tools/CanTraceLog.h"
+
+extern CanOpen canOpen;
+extern MoveController moveController;
+extern std::vector<String> outData;
+void sendData();
+
+namespace
+{
+    constexpr uint64_t START_OFFSET_US = 100000; // First frame this long after the replay starts
+
+    struct AxisState
+    {
+        int32_t position = 0;
+        bool alive = false;
+        RobotConstants::InitStatus initStatus = RobotConstants::InitStatus::ZEI_NONE;
+    };
+
+    // Puts the trace onto the host bus, either on demand or as a clock event source
+    class ReplaySource : public HostCanEndpoint, public HostClock::EventSource
+    {
+    public:
+        ReplaySource(const std::vector<CanLogFrame> &frames, uint64_t baseUs) : frames(frames), baseUs(baseUs) {}
+
+        void onBusFrame(const CAN_message_t &) override {} // Polls from the firmware go unanswered
+
+        uint64_t nextEventUs() const override
+        {
+            return next < frames.size() ? baseUs + frames[next].timestampUs : HostClock::NO_EVENT;
+        }
+
+        void onTime(uint64_t nowUs) override
+        {
+            while (next < frames.size() && baseUs + frames[next].timestampUs <= nowUs)
+            {
+                send(frames[next++]);
+            }
+        }
+
+        void send(const CanLogFrame &frame)
+        {
+            CAN_message_t msg;
+            msg.id = frame.id;
+            msg.flags.extended = (frame.flags & CAN_TRACE_FLAG_EXTENDED) != 0;
+            msg.flags.remote = (frame.flags & CAN_TRACE_FLAG_REMOTE) != 0;
+            msg.len = frame.len;
+            memcpy(msg.buf, frame.data, sizeof(msg.buf));
+            HostCanBus::instance().transmit(this, msg);
+        }
+
+        bool done() const { return next >= frames.size(); }
+
+    private:
+        const std::vector<CanLogFrame> &frames;
+        uint64_t baseUs;
+        size_t next = 0;
+    };
+
+    class Timeline
+    {
+    public:
+        explicit Timeline(bool print) : print(print) {}
+
+        void check(uint64_t traceUs)
+        {
+            for (uint8_t nodeId = 1; nodeId <= moveController.getAxesCount(); ++nodeId)
+            {
+                Axis &axis = moveController.getAxis(nodeId);
+                AxisState now;
+                now.position = moveController.axisPosition(nodeId);
+                now.alive = axis.getIsAlive();
+                now.initStatus = axis.getInitStatus();
+
+                AxisState &last = states[nodeId];
+                if (initialized && now.position == last.position && now.alive == last.alive && now.initStatus == last.initStatus)
+                {
+                    continue;
+                }
+                last = now;
+                changes++;
+                if (print)
+                {
+                    printf("%12.6f  axis %u  pos=%ld alive=%d init=%s\n", traceUs / 1e6, nodeId,
+                           static_cast<long>(now.position), now.alive ? 1 : 0, RobotConstants::initStatusToString(now.initStatus));
+                }
+            }
+            initialized = true;
+        }
+
+        uint32_t changeCount() const { return changes; }
+
+    private:
+        bool print;
+        bool initialized = false;
+        uint32_t changes = 0;
+        AxisState states[RobotConstants::Robot::AXES_COUNT + 1];
+    };
+
+    bool sentByMaster(const CanLogFrame &frame)
+    {
+        if (frame.directionKnown)
+        {
+            return (frame.flags & CAN_TRACE_FLAG_TX) != 0;
+        }
+        const uint32_t functionCode = frame.id & 0x780;
+        return frame.id == RobotConstants::CANOpen::COB_ID_NMT ||
+               frame.id == RobotConstants::CANOpen::COB_ID_SYNC ||
+               functionCode == 0x200 || functionCode == 0x300 || functionCode == 0x400 || functionCode == 0x500 || // RPDO 1..4
+               functionCode == RobotConstants::CANOpen::COB_ID_SDO_SERVER_BASE;
+    }
+
+    void drainSerial()
+    {
+        while (!outData.empty())
+        {
+            sendData();
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    bool originalTiming = false;
+    bool printTimeline = true;
+    bool includeMaster = false;
+    uint32_t repeat = 1;
+    const char *path = nullptr;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--original-timing") == 0)
+        {
+            originalTiming = true;
+        }
+        else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+        {
+            repeat = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        }
+        else if (strcmp(argv[i], "--no-timeline") == 0)
+        {
+            printTimeline = false;
+        }
+        else if (strcmp(argv[i], "--include-master") == 0)
+        {
+            includeMaster = true;
+        }
+        else if (argv[i][0] != '-' && path == nullptr)
+        {
+            path = argv[i];
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--original-timing] [--repeat N] [--no-timeline] [--include-master] [trace]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (repeat == 0 || (originalTiming && repeat != 1))
+    {
+        fprintf(stderr, "--repeat needs N >= 1 and is only supported without --original-timing\n");
+        return 2;
+    }
+
+    FILE *input = path ? fopen(path, "r") : stdin;
+    if (input == nullptr)
+    {
+        fprintf(stderr, "cannot open %s\n", path);
+        return 1;
+    }
+
+    // Load the trace, timestamps relative to the first frame
+    std::vector<CanLogFrame> frames;
+    CanLogClock clock;
+    uint32_t parsed = 0;
+    uint32_t skipped = 0;
+    char line[512];
+    while (fgets(line, sizeof(line), input) != nullptr)
+    {
+        CanLogFrame frame;
+        if (!CanTraceLog::parseLine(line, frame))
+        {
+            continue;
+        }
+        if (frame.directionKnown)
+        {
+            frame.timestampUs = clock.unwrap(static_cast<uint32_t>(frame.timestampUs));
+        }
+        parsed++;
+        if (!includeMaster && sentByMaster(frame))
+        {
+            skipped++;
+            continue;
+        }
+        frames.push_back(frame);
+    }
+    if (input != stdin)
+    {
+        fclose(input);
+    }
+    if (frames.empty())
+    {
+        fprintf(stderr, "no frames to replay (%u parsed, %u sent by the master)\n", parsed, skipped);
+        return 1;
+    }
+    const uint64_t firstUs = frames.front().timestampUs;
+    for (CanLogFrame &frame : frames)
+    {
+        frame.timestampUs -= firstUs;
+    }
+    const uint64_t traceUs = frames.back().timestampUs;
+
+    SimDrive::Config unused;
+    SimHarness sim(unused, 0);
+    sim.setTimeWarp(true);
+    sim.begin();
+    canOpen.resetDispatchStats();
+
+    Timeline timeline(printTimeline);
+    const uint64_t baseUs = HostClock::nowUs() + START_OFFSET_US;
+    ReplaySource source(frames, baseUs);
+    HostCanBus::instance().attach(&source);
+    const auto wallStart = std::chrono::steady_clock::now();
+
+    if (originalTiming)
+    {
+        HostClock::addEventSource(&source);
+        timeline.check(0);
+        sim.runUntil([&]()
+                     {
+                         const uint64_t nowUs = HostClock::nowUs();
+                         timeline.check(nowUs > baseUs ? nowUs - baseUs : 0);
+                         return source.done() && nowUs >= baseUs + traceUs + 1000000; },
+                     traceUs + START_OFFSET_US + 10000000);
+        HostClock::removeEventSource(&source);
+    }
+    else
+    {
+        for (uint32_t pass = 0; pass < repeat; ++pass)
+        {
+            const uint64_t passBaseUs = baseUs + pass * (traceUs + 1000000);
+            for (const CanLogFrame &frame : frames)
+            {
+                HostClock::setNowUs(passBaseUs + frame.timestampUs);
+                source.send(frame);
+                canOpen.read();
+                drainSerial(); // Error messages for rejected frames
+                if (pass == 0)
+                {
+                    timeline.check(frame.timestampUs);
+                }
+            }
+        }
+    }
+    HostCanBus::instance().detach(&source);
+
+    const double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    const CanOpen::DispatchStats &stats = canOpen.getDispatchStats();
+    const uint32_t dispatched = stats.heartbeat + stats.emcy + stats.x260A_electronicGearMolecules + stats.x6040_controlword +
+                                stats.x6060_modesOfOperation + stats.x607A_targetPosition + stats.x6064_positionActualValue +
+                                stats.x6041_statusword;
+
+    printf("trace: %u frames parsed, %zu replayed, %u sent by the master skipped, %.3f s long\n",
+           parsed, frames.size(), skipped, traceUs / 1e6);
+    printf("mode: %s, %u pass(es), %.3f s wall, %.0f frames/s, %.1f ns/frame\n",
+           originalTiming ? "original timing (virtual clock, full loop)" : "as fast as possible (CanOpen::read only)",
+           repeat, wallSeconds, stats.framesDecoded / wallSeconds, wallSeconds * 1e9 / (stats.framesDecoded ? stats.framesDecoded : 1));
+    printf("dispatch: decoded=%u rejected=%u no-callback=%u heartbeat=%u emcy=%u 6064=%u 6041=%u 6040=%u 260A=%u 6060=%u 607A=%u\n",
+           stats.framesDecoded, stats.rejected, stats.framesDecoded - stats.rejected - dispatched,
+           stats.heartbeat, stats.emcy, stats.x6064_positionActualValue, stats.x6041_statusword, stats.x6040_controlword,
+           stats.x260A_electronicGearMolecules, stats.x6060_modesOfOperation, stats.x607A_targetPosition);
+    printf("timeline: %u axis state changes\n", timeline.changeCount());
+    return 0;
+}
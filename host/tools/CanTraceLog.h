@@ -0,0 +1,163 @@
+#pragma once
+#ifndef CAN_TRACE_LOG_H
+#define CAN_TRACE_LOG_H
+
+// Line parsers for CAN frame logs: the firmware's CTR dump and candump log files.
+// Header only, shared by cantrace_convert and trace_replay.
+
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include "../../CanTrace.h"
+
+struct CanLogFrame
+{
+    uint64_t timestampUs = 0; // CTR: micros() of the MCU (32 bit, see CanLogClock); candump: absolute
+    uint32_t id = 0;
+    uint8_t flags = 0; // CAN_TRACE_FLAG_*
+    uint8_t len = 0;
+    uint8_t data[8] = {0};
+    bool directionKnown = false; // candump logs do not say who sent the frame
+};
+
+namespace CanTraceLog
+{
+    inline bool parseHexBytes(const char *cursor, uint8_t len, uint8_t *out)
+    {
+        for (uint8_t i = 0; i < len; ++i)
+        {
+            char byte[3] = {cursor[2 * i], cursor[2 * i] ? cursor[2 * i + 1] : '\0', '\0'};
+            char *end = nullptr;
+            out[i] = static_cast<uint8_t>(strtoul(byte, &end, 16));
+            if (end != byte + 2)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // "CTR <timestampUs> <flags> <id> <len> <data>", all hex except len
+    inline bool parseCtrLine(const char *line, CanLogFrame &frame)
+    {
+        if (strncmp(line, "CTR ", 4) != 0)
+        {
+            return false;
+        }
+
+        uint32_t fields[4];
+        const char *cursor = line + 4;
+        for (uint8_t i = 0; i < 4; ++i)
+        {
+            char *end = nullptr;
+            unsigned long value = strtoul(cursor, &end, i == 3 ? 10 : 16);
+            if (end == cursor)
+            {
+                return false; // Summary line ("CTR OK ...") or a truncated record
+            }
+            fields[i] = static_cast<uint32_t>(value);
+            cursor = end;
+        }
+        if (fields[3] > 8)
+        {
+            return false;
+        }
+
+        frame.timestampUs = fields[0];
+        frame.flags = static_cast<uint8_t>(fields[1]);
+        frame.id = fields[2];
+        frame.len = static_cast<uint8_t>(fields[3]);
+        frame.directionKnown = true;
+        while (*cursor == ' ')
+        {
+            cursor++;
+        }
+        return (frame.flags & CAN_TRACE_FLAG_REMOTE) != 0 || parseHexBytes(cursor, frame.len, frame.data);
+    }
+
+    // "(<sec>.<usec>) <iface> <id>#<data>" or "<id>#R[len]"; 8 hex digit IDs are extended
+    inline bool parseCandumpLine(const char *line, CanLogFrame &frame)
+    {
+        if (line[0] != '(')
+        {
+            return false;
+        }
+        char *end = nullptr;
+        const unsigned long long seconds = strtoull(line + 1, &end, 10);
+        if (*end != '.')
+        {
+            return false;
+        }
+        const char *fraction = end + 1;
+        const unsigned long micros = strtoul(fraction, &end, 10);
+        if (*end != ')' || end - fraction != 6)
+        {
+            return false;
+        }
+        const char *cursor = strchr(end, ' ');
+        cursor = cursor ? strchr(cursor + 1, ' ') : nullptr; // Skip the interface name
+        if (cursor == nullptr)
+        {
+            return false;
+        }
+        cursor++;
+
+        const char *hash = strchr(cursor, '#');
+        if (hash == nullptr || hash[1] == '#') // CAN FD frames are not replayed
+        {
+            return false;
+        }
+        frame.timestampUs = seconds * 1000000ull + micros;
+        frame.id = static_cast<uint32_t>(strtoul(cursor, nullptr, 16));
+        frame.flags = (hash - cursor == 8) ? CAN_TRACE_FLAG_EXTENDED : 0;
+        frame.directionKnown = false;
+
+        const char *payload = hash + 1;
+        if (*payload == 'R')
+        {
+            frame.flags |= CAN_TRACE_FLAG_REMOTE;
+            frame.len = (payload[1] >= '0' && payload[1] <= '8') ? static_cast<uint8_t>(payload[1] - '0') : 0;
+            return true;
+        }
+        size_t digits = 0;
+        while (isxdigit(static_cast<unsigned char>(payload[digits])))
+        {
+            digits++;
+        }
+        if (digits % 2 != 0 || digits > 16)
+        {
+            return false;
+        }
+        frame.len = static_cast<uint8_t>(digits / 2);
+        return parseHexBytes(payload, frame.len, frame.data);
+    }
+
+    inline bool parseLine(const char *line, CanLogFrame &frame)
+    {
+        return parseCtrLine(line, frame) || parseCandumpLine(line, frame);
+    }
+}
+
+// Extends the MCU's 32-bit micros() timestamps of a CTR dump (wrap every ~71.6 minutes)
+class CanLogClock
+{
+public:
+    uint64_t unwrap(uint32_t timestampUs)
+    {
+        if (started && timestampUs < last && last - timestampUs > 0x80000000u)
+        {
+            offsetUs += 0x100000000ull;
+        }
+        started = true;
+        last = timestampUs;
+        return offsetUs + timestampUs;
+    }
+
+private:
+    bool started = false;
+    uint32_t last = 0;
+    uint64_t offsetUs = 0;
+};
+
+#endif // CAN_TRACE_LOG_H
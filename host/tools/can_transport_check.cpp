@@ -0,0 +1,143 @@
+// Runs CanOpen over a CanDriver other than bxCAN and checks SDO round trips end to end.
+//
+//   can_transport_check [--iface vcan0] [--round-trips N]
+//
+// Without --iface the two ends are an in-process LoopbackCanDriver pair; with --iface they
+// are two SocketCAN sockets on the same interface (a vcan works). One end is a CanOpen
+// master, the other a minimal node answering 0x6064 uploads with a counter.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "Arduino.h"
+#include "CanOpen.h"
+#include "LoopbackCanDriver.h"
+#include "SocketCanDriver.h"
+
+void addDataToOutQueue(String data)
+{
+    printf("%s\n", data.c_str());
+}
+
+namespace
+{
+    constexpr uint8_t NODE_ID = 1;
+
+    // Answers SDO uploads of 0x6064 with an incrementing position
+    bool serveNode(CanDriver &node, int32_t &position)
+    {
+        CanFrame request;
+        bool served = false;
+        while (node.read(request))
+        {
+            if (request.id != RobotConstants::CANOpen::COB_ID_SDO_SERVER_BASE + NODE_ID || request.buf[0] != 0x40)
+            {
+                continue;
+            }
+            CanFrame response;
+            response.id = RobotConstants::CANOpen::COB_ID_SDO_CLIENT_BASE + NODE_ID;
+            response.len = 8;
+            response.buf[0] = 0x43;
+            response.buf[1] = request.buf[1];
+            response.buf[2] = request.buf[2];
+            response.buf[3] = request.buf[3];
+            ++position;
+            memcpy(&response.buf[4], &position, sizeof(position));
+            node.write(response);
+            served = true;
+        }
+        node.flush();
+        return served;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *interfaceName = nullptr;
+    uint32_t roundTrips = 10000;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--iface") == 0 && i + 1 < argc)
+        {
+            interfaceName = argv[++i];
+        }
+        else if (strcmp(argv[i], "--round-trips") == 0 && i + 1 < argc)
+        {
+            roundTrips = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--iface vcan0] [--round-trips N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    LoopbackCanDriver loopbackMaster;
+    LoopbackCanDriver loopbackNode;
+    LoopbackCanDriver::connect(loopbackMaster, loopbackNode);
+    SocketCanDriver socketMaster(interfaceName != nullptr ? interfaceName : "");
+    SocketCanDriver socketNode(interfaceName != nullptr ? interfaceName : "");
+
+    CanDriver &masterDriver = interfaceName ? static_cast<CanDriver &>(socketMaster) : loopbackMaster;
+    CanDriver &nodeDriver = interfaceName ? static_cast<CanDriver &>(socketNode) : loopbackNode;
+
+    CanOpen canOpen(masterDriver);
+    if (!canOpen.startCan(RobotConstants::Robot::CAN_BAUD_RATE))
+    {
+        fprintf(stderr, "CanOpen::startCan failed on %s\n", interfaceName ? interfaceName : "loopback");
+        return 1;
+    }
+    if (!nodeDriver.begin(RobotConstants::Robot::CAN_BAUD_RATE, false))
+    {
+        fprintf(stderr, "node driver failed to start\n");
+        return 1;
+    }
+
+    int32_t nodePosition = 0;
+    int32_t lastPosition = 0;
+    uint32_t answers = 0;
+    canOpen.set_callback_x6064_positionActualValue([&](uint8_t, bool success, int32_t position)
+                                                   {
+                                                       if (success)
+                                                       {
+                                                           lastPosition = position;
+                                                           answers++;
+                                                       } },
+                                                   NODE_ID);
+
+    uint32_t mismatches = 0;
+    uint32_t timeouts = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < roundTrips; ++i)
+    {
+        const uint32_t before = answers;
+        canOpen.sendSDORead(NODE_ID, RobotConstants::ODIndices::POSITION_ACTUAL_VALUE, RobotConstants::ODIndices::DEFAULT_SUBINDEX);
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+        while (answers == before && std::chrono::steady_clock::now() < deadline)
+        {
+            canOpen.read(); // Also flushes the master's batched request
+            serveNode(nodeDriver, nodePosition);
+        }
+        if (answers == before)
+        {
+            timeouts++;
+        }
+        else if (lastPosition != nodePosition)
+        {
+            mismatches++;
+        }
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%s: %u round trips in %.3f s (%.0f/s, %.1f us each), %u timeouts, %u mismatches\n",
+           interfaceName ? interfaceName : "loopback", roundTrips, seconds, roundTrips / seconds,
+           seconds * 1e6 / roundTrips, timeouts, mismatches);
+    if (interfaceName)
+    {
+        const SocketCanDriver::Stats &stats = socketMaster.stats();
+        printf("master socket: rx %u frames in %u batches, tx %u frames in %u batches, kernel drops %u, rejected %u\n",
+               stats.rxFrames, stats.rxBatches, stats.txFrames, stats.txBatches, stats.rxKernelDrops, stats.txRejected);
+    }
+    return (timeouts == 0 && mismatches == 0) ? 0 : 1;
+}
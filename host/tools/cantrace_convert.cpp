@@ -0,0 +1,133 @@
+// Converts a CAN trace streamed out of the firmware with the CTR command into a bus log.
+//
+// Reads the serial log on stdin, picks the "CTR <ts> <flags> <id> <len> <data>" lines and writes
+// candump log format (default, replays with canplayer) or Vector ASC (--asc) to stdout. candump
+// lines on the input are accepted too (candump -> ASC). All other lines are ignored; the trigger
+// frame and the dump summary are reported on stderr.
+//
+//   cantrace_convert [--asc] [--iface can0] < serial_capture.txt > trace.log
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include "CanTraceLog.h"
+
+namespace
+{
+    void printAscHeader()
+    {
+        char date[64];
+        const time_t now = time(nullptr);
+        strftime(date, sizeof(date), "%a %b %d %H:%M:%S.000 %Y", localtime(&now));
+        printf("date %s\n", date);
+        printf("base hex  timestamps absolute\n");
+        printf("internal events logged\n");
+        printf("Begin Triggerblock %s\n", date);
+        printf("   0.000000 Start of measurement\n");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    bool asc = false;
+    const char *iface = "can0";
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--asc") == 0)
+        {
+            asc = true;
+        }
+        else if (strcmp(argv[i], "--iface") == 0 && i + 1 < argc)
+        {
+            iface = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--asc] [--iface can0] < serial_capture.txt\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (asc)
+    {
+        printAscHeader();
+    }
+
+    char line[512];
+    CanLogClock clock;
+    uint64_t firstUs = 0;
+    uint32_t records = 0;
+    while (fgets(line, sizeof(line), stdin) != nullptr)
+    {
+        CanLogFrame record;
+        if (!CanTraceLog::parseLine(line, record))
+        {
+            if (strncmp(line, "CTR OK", 6) == 0)
+            {
+                fprintf(stderr, "%s", line);
+            }
+            continue;
+        }
+
+        const uint64_t timestampUs = record.directionKnown ? clock.unwrap(static_cast<uint32_t>(record.timestampUs)) : record.timestampUs;
+        if (records == 0)
+        {
+            firstUs = timestampUs;
+        }
+        records++;
+
+        const bool extended = (record.flags & CAN_TRACE_FLAG_EXTENDED) != 0;
+        const bool remote = (record.flags & CAN_TRACE_FLAG_REMOTE) != 0;
+        const bool tx = (record.flags & CAN_TRACE_FLAG_TX) != 0;
+        if ((record.flags & CAN_TRACE_FLAG_TRIGGER) != 0)
+        {
+            fprintf(stderr, "trigger at %llu.%06llu s, %s id 0x%X\n",
+                    static_cast<unsigned long long>(timestampUs / 1000000u), static_cast<unsigned long long>(timestampUs % 1000000u),
+                    tx ? "TX" : "RX", record.id);
+        }
+
+        if (asc)
+        {
+            const uint64_t relativeUs = timestampUs - firstUs;
+            char id[16];
+            snprintf(id, sizeof(id), extended ? "%Xx" : "%X", record.id);
+            printf("%4llu.%06llu 1  %-15s %s   %s %u",
+                   static_cast<unsigned long long>(relativeUs / 1000000u), static_cast<unsigned long long>(relativeUs % 1000000u),
+                   id, tx ? "Tx" : "Rx", remote ? "r" : "d", record.len);
+            if (!remote)
+            {
+                for (uint8_t i = 0; i < record.len; ++i)
+                {
+                    printf(" %02X", record.data[i]);
+                }
+            }
+            printf("\n");
+        }
+        else
+        {
+            printf("(%llu.%06llu) %s ",
+                   static_cast<unsigned long long>(timestampUs / 1000000u), static_cast<unsigned long long>(timestampUs % 1000000u), iface);
+            printf(extended ? "%08X#" : "%03X#", record.id);
+            if (remote)
+            {
+                printf("R");
+            }
+            else
+            {
+                for (uint8_t i = 0; i < record.len; ++i)
+                {
+                    printf("%02X", record.data[i]);
+                }
+            }
+            printf("\n");
+        }
+    }
+
+    if (asc)
+    {
+        printf("End TriggerBlock\n");
+    }
+    fprintf(stderr, "%u frames\n", records);
+    return 0;
+}
@@ -0,0 +1,64 @@
+// Decodes deferred debug records drained from the firmware with the DLG command.
+//
+// Reads the serial log on stdin, formats every "DLG <ts> <id> <level> <argc> <a0> <a1> <a2> <a3>"
+// line with the message catalog from DebugMessages.h and passes all other lines through unchanged.
+//
+//   dbglog_decode < serial_capture.txt
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "../../DebugRecord.h"
+
+namespace
+{
+    bool parseRecordLine(const char *line, DbgRecord &record)
+    {
+        if (strncmp(line, "DLG ", 4) != 0)
+        {
+            return false;
+        }
+
+        uint32_t fields[4 + DBG_RECORD_MAX_ARGS];
+        const char *cursor = line + 4;
+        for (uint32_t &field : fields)
+        {
+            char *end = nullptr;
+            unsigned long value = strtoul(cursor, &end, 16);
+            if (end == cursor)
+            {
+                return false; // Summary line ("DLG OK ...") or a truncated record
+            }
+            field = static_cast<uint32_t>(value);
+            cursor = end;
+        }
+
+        record.timestampUs = fields[0];
+        record.messageId = static_cast<uint16_t>(fields[1]);
+        record.level = static_cast<uint8_t>(fields[2]);
+        record.argCount = static_cast<uint8_t>(fields[3]);
+        memcpy(record.args, &fields[4], sizeof(record.args));
+        return true;
+    }
+}
+
+int main()
+{
+    char line[512];
+    char text[256];
+    while (fgets(line, sizeof(line), stdin) != nullptr)
+    {
+        DbgRecord record;
+        if (!parseRecordLine(line, record))
+        {
+            fputs(line, stdout);
+            continue;
+        }
+        dbgFormatRecord(record, text, sizeof(text));
+        printf("%10lu.%06lu [%s] %s\n",
+               static_cast<unsigned long>(record.timestampUs / 1000000u),
+               static_cast<unsigned long>(record.timestampUs % 1000000u),
+               dbgLevelTag(record.level), text);
+    }
+    return 0;
+}